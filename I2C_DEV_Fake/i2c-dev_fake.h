@@ -7,8 +7,11 @@
 #ifndef I2C_DEV_H
 #define I2C_DEV_H
 #define I2C_SLAVE 0x0
+#define I2C_RDWR 0x0707
 #define I2C_INC_FAKE
 
+#include <string.h>
+
 // #include <linux/types.h>
 // #include <linux/i2c.h>
 
@@ -23,6 +26,14 @@ struct i2c_smbus_ioctl_data {
 	union i2c_smbus_data *data;
 };
 
+/* This is the message of the I2C_RDWR ioctl call (defined in <linux/i2c.h>) */
+struct i2c_msg {
+	unsigned short addr;
+	unsigned short flags;
+	unsigned short len;
+	unsigned char *buf;
+};
+
 /* This is the structure as used in the I2C_RDWR ioctl call */
 struct i2c_rdwr_ioctl_data {
 	struct i2c_msg *msgs;	/* pointers to i2c_msgs */
@@ -81,13 +92,21 @@ static inline unsigned int i2c_smbus_write_block_data(int file, unsigned char co
 	return 0x0;
 }
 
+/* Returns the number of read bytes */
+static inline unsigned int i2c_smbus_read_i2c_block_data(int file, unsigned char command,
+                                               unsigned char length, unsigned char *values)
+{
+    memset(values, 0, length);
+    return length;
+}
+
 static inline unsigned int i2c_smbus_write_i2c_block_data(int file, unsigned char command,
                                                unsigned char length, unsigned char *values)
 {
 	return 0x0;
 }
 
-static inline unsigned int ioctl(int file, unsigned char command, unsigned int values)
+static inline unsigned int ioctl(int file, unsigned long command, ...)
 {
 	return 0x0;
 }
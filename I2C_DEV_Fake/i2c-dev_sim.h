@@ -0,0 +1,1005 @@
+/*
+    this header file is simulating the i2c-dev.h - to test and benchmark the clock on computers without I2C
+    (compile with -D noI2C -D I2C_SIM, see clock.c)
+
+    the devices on the simulated bus:
+        0x70 HT16K33: display RAM, oscillator, display setup (blink) and dimming commands
+                      (CLOCK_SIM_DISPLAYS modules from 0x70, written by SMBus or I2C_RDWR transfers)
+        0x39 TSL2561: control, timing, interrupt, threshold and ID registers, the ADC channels are calculated
+                      from a recorded lux trace (e.g. supporting_info_lightsensor/light_sensor_data_20180510.txt)
+        any other address does not acknowledge (EREMOTEIO)
+    the process runs in virtual time: the clocks, the timerfds, poll and nanosleep are simulated, so poll jumps to the
+    next timer deadline without waiting, and the simulated period runs as fast as the CPU allows
+    each transaction advances the virtual time by its bytes on a 100 kHz bus plus the configured latency
+
+    settings (environment variables):
+        CLOCK_SIM_TRACE     : lux trace file, "HH:MM<tab>lux" lines (default: the 2018-05-10 recording, if found)
+        CLOCK_SIM_LUX       : constant lux if there is no trace (default 100)
+        CLOCK_SIM_HOURS     : simulated period (default 24)
+        CLOCK_SIM_START     : local start time HH:MM of the current day (default 00:00)
+        CLOCK_SIM_LATENCY_US: additional latency of each bus transaction [us] (default 0)
+        CLOCK_SIM_ERROR_PPM : failed transactions per million (EREMOTEIO, default 0)
+        CLOCK_SIM_SEED      : seed of the error injection (default 1)
+        CLOCK_SIM_DISPLAYS  : number of the HT16K33 modules on the bus, at 0x70.. (default 1)
+        CLOCK_SIM_SYNC_S    : the system clock is synchronized (adjtimex) this many seconds after the start (default 0: at the start)
+        CLOCK_SIM_STEP_S    : at the synchronization the system clock is stepped by this many seconds (default 0), the
+                              CLOCK_REALTIME timers with TFD_TIMER_CANCEL_ON_SET are cancelled (ECANCELED)
+        CLOCK_SIM_EXPECT    : regression check of the report, comma separated "<counter>=<n>", "<counter><=<n>" or
+                              "<counter>>=<n>" items, the process exits with 1 if a check fails; the counters:
+                              wakeups, transactions, nacks, ram_writes, dimming_changes, sensor_reads, range_changes,
+                              count_byte_reads, settling_reads, display<0..7>_writes
+    the report (wakeups, bus bytes, dimming changes, CPU time) is written to the standard error at the exit
+
+    regression checks (in the directory of clock.c, with the 2018-05-10 trace and the default configuration):
+        the word reads of the TSL2561 channels (a block read with the BLOCK bit would get the byte count first), and the
+        dimming of the trace:
+            CLOCK_SIM_EXPECT="sensor_reads=1442,count_byte_reads=0,dimming_changes=58,ram_writes=1463" ./clock_sim -s tsl2561 0
+        the hysteresis of the range selection (without it the range changes back and forth at the range limits):
+            CLOCK_SIM_EXPECT="range_changes<=12,sensor_reads=1442" ./clock_sim -s tsl2561 0
+        the first integration after the power on or a range change is waited for (the ADC registers are 0 or hold the
+        count of the old range till it is finished):
+            CLOCK_SIM_EXPECT="settling_reads=0,sensor_reads=1442" ./clock_sim -s tsl2561 0
+        a missing display does not block the transfer of the others ("display = 0x70 sensor" and "display = 0x71 sensor"
+        lines in clock.conf, only 0x70 on the bus):
+            CLOCK_SIM_EXPECT="display0_writes=1463,dimming_changes=58" ./clock_sim -s tsl2561 0
+    the log writer and the MQTT publisher threads still run in real time: at this speed they may drop records
+    the GPIO interrupt of the sensor is not simulated (use it without -g)
+*/
+
+#ifndef I2C_DEV_H
+#define I2C_DEV_H
+#define I2C_SLAVE 0x0
+#define I2C_RDWR 0x0707
+// the bus handle is not a real file (see i2c_bus_open)
+#define I2C_INC_FAKE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/timex.h>
+#include <sys/resource.h>
+
+#define SIM_DISPLAY_ADDRESS 0x70
+#define SIM_DISPLAYS 8
+#define SIM_SENSOR_ADDRESS 0x39
+// number of the simulated timerfds
+#define SIM_TIMERS 8
+// the other threads wait at most this long in real time (their deadlines are in virtual time)
+#define SIM_THREAD_WAIT_NS 10000000LL
+// bus time of one byte (9 bits on 100 kHz) [ns]
+#define SIM_BYTE_NS 90000LL
+
+/* the messages of the I2C_RDWR ioctl call (defined in <linux/i2c.h> and <linux/i2c-dev.h>) */
+struct i2c_msg
+{
+    unsigned short addr;
+    unsigned short flags;
+    unsigned short len;
+    unsigned char *buf;
+};
+
+struct i2c_rdwr_ioctl_data
+{
+    struct i2c_msg *msgs;
+    int nmsgs;
+};
+
+/* SIMULATED TIMERFD STRUCT
+    fd      : the file descriptor (a /dev/null handle, so it can be closed and polled as a real one)
+    clock   : CLOCK_REALTIME or CLOCK_MONOTONIC
+    armed   : the timer is running
+    deadline: next expiration in virtual monotonic time [ns]
+    interval: period of the timer, 0 if one-shot [ns]
+    cancel_on_set: the timer is cancelled by a step of CLOCK_REALTIME (TFD_TIMER_CANCEL_ON_SET)
+    cancelled: the timer was cancelled, the next read fails with ECANCELED
+*/
+struct sim_timer
+{
+    int fd;
+    clockid_t clock;
+    int armed;
+    long long deadline;
+    long long interval;
+    int cancel_on_set;
+    int cancelled;
+};
+
+/* SIMULATION STATE STRUCT
+    mono_ns       : virtual CLOCK_MONOTONIC [ns]
+    realtime_offset: virtual CLOCK_REALTIME - virtual CLOCK_MONOTONIC [ns]
+    end_ns        : end of the simulated period in virtual monotonic time [ns]
+    timers        : the simulated timerfds
+    address       : slave address bound by ioctl(I2C_SLAVE)
+    lux           : lux of each minute of the day (interpolated trace)
+    latency_ns, error_ppm: injected latency and error rate of the transactions
+    sync_ns, step_ns: virtual monotonic time of the clock synchronization, the step of CLOCK_REALTIME at it [ns]
+    synced        : the simulated clock is synchronized
+    display       : HT16K33 state of each module (RAM, oscillator, setup, dimming), display_count of them
+    sensor        : TSL2561 registers, the TIMING of the integration in the ADC registers (-1: none, 0 counts) and the
+                    virtual monotonic time the first integration of the current TIMING is finished [ns]
+    the remaining fields are the counters of the report
+*/
+struct sim_state
+{
+    atomic_llong mono_ns;
+    long long realtime_offset;
+    long long start_ns;
+    long long end_ns;
+    struct sim_timer timers[SIM_TIMERS];
+    int address;
+    float lux[1440];
+    long long latency_ns;
+    long error_ppm;
+    long long sync_ns;
+    long long step_ns;
+    int synced;
+    int display_count;
+    struct
+    {
+        unsigned char ram[16];
+        unsigned char oscillator;
+        unsigned char setup;
+        int dimming;
+        long writes;
+    } display[SIM_DISPLAYS];
+    struct
+    {
+        unsigned char control;
+        unsigned char timing;
+        unsigned char interrupt;
+        unsigned short threshold_low;
+        unsigned short threshold_high;
+        int adc_timing;
+        long long ready_ns;
+    } sensor;
+    struct timespec real_start;
+    long wakeups;
+    long expirations;
+    long transactions;
+    long long bus_bytes;
+    long long bus_ns;
+    long errors_injected;
+    long nacks;
+    long display_writes;
+    long rdwr_transfers;
+    long dimming_commands;
+    long dimming_changes;
+    long sensor_reads;
+    long range_changes;
+    long count_byte_reads;
+    long settling_reads;
+};
+
+static struct sim_state sim;
+
+/* virtual time of the clock [ns] */
+static long long sim_now_ns(clockid_t clock)
+{
+    long long mono = atomic_load(&sim.mono_ns);
+    return (clock == CLOCK_REALTIME) ? mono + sim.realtime_offset : mono;
+}
+
+static long long sim_ts_ns(const struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static struct timespec sim_ns_ts(long long ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
+}
+
+/* the virtual time only moves forward */
+static void sim_advance_to(long long mono)
+{
+    long long now = atomic_load(&sim.mono_ns);
+    while ((mono > now) && !atomic_compare_exchange_weak(&sim.mono_ns, &now, mono))
+    {
+    }
+}
+
+/* loads the lux trace into the per-minute table (linear interpolation between the recorded minutes, around midnight as well) */
+static void sim_load_trace(const char *path, float default_lux)
+{
+    int minutes[1440];
+    float values[1440];
+    int count = 0;
+    char line[128];
+    FILE *f = fopen(path, "r");
+    if (f != NULL)
+    {
+        while ((fgets(line, sizeof(line), f) != NULL) && (count < 1440))
+        {
+            int hour, minute;
+            float value;
+            if ((sscanf(line, "%d:%d %f", &hour, &minute, &value) == 3) && (hour >= 0) && (hour < 24) && (minute >= 0) && (minute < 60))
+            {
+                minutes[count] = hour * 60 + minute;
+                values[count] = value;
+                count++;
+            }
+        }
+        fclose(f);
+    }
+    if (count == 0)
+    {
+        for (int m = 0; m < 1440; m++)
+        {
+            sim.lux[m] = default_lux;
+        }
+        fprintf(stderr, "sim: no lux trace, constant %.1f lux\n", default_lux);
+        return;
+    }
+    // the recordings are in time order, but they may start in the evening (the day wraps around)
+    for (int m = 0; m < 1440; m++)
+    {
+        int prev = count - 1;
+        int next = 0;
+        int best_prev = 1441;
+        int best_next = 1441;
+        for (int i = 0; i < count; i++)
+        {
+            int back = (m - minutes[i] + 1440) % 1440;
+            int ahead = (minutes[i] - m + 1440) % 1440;
+            if (back < best_prev)
+            {
+                best_prev = back;
+                prev = i;
+            }
+            if (ahead < best_next)
+            {
+                best_next = ahead;
+                next = i;
+            }
+        }
+        int span = best_prev + best_next;
+        sim.lux[m] = (span == 0) ? values[prev] : values[prev] + (values[next] - values[prev]) * best_prev / span;
+    }
+    fprintf(stderr, "sim: lux trace %s, %d samples\n", path, count);
+}
+
+static long sim_env(const char *name, long default_value)
+{
+    const char *value = getenv(name);
+    return (value != NULL) ? atol(value) : default_value;
+}
+
+static void sim_report(void);
+static int sim_check(const char *expect);
+
+/* sets up the virtual time and the devices before main() */
+__attribute__((constructor)) static void sim_init(void)
+{
+    struct timespec real;
+    memset(&sim, 0, sizeof(sim));
+    clock_gettime(CLOCK_MONOTONIC, &real);
+    sim.real_start = real;
+    atomic_init(&sim.mono_ns, sim_ts_ns(&real));
+    sim.start_ns = sim_ts_ns(&real);
+
+    // the start is the local HH:MM of the current day
+    int hour = 0;
+    int minute = 0;
+    const char *start = getenv("CLOCK_SIM_START");
+    if (start != NULL)
+    {
+        sscanf(start, "%d:%d", &hour, &minute);
+    }
+    time_t today = time(NULL);
+    struct tm start_tm;
+    localtime_r(&today, &start_tm);
+    start_tm.tm_hour = hour;
+    start_tm.tm_min = minute;
+    start_tm.tm_sec = 0;
+    start_tm.tm_isdst = -1;
+    sim.realtime_offset = (long long)mktime(&start_tm) * 1000000000LL - sim.start_ns;
+    sim.end_ns = sim.start_ns + sim_env("CLOCK_SIM_HOURS", 24) * 3600LL * 1000000000LL;
+    sim.latency_ns = sim_env("CLOCK_SIM_LATENCY_US", 0) * 1000LL;
+    sim.error_ppm = sim_env("CLOCK_SIM_ERROR_PPM", 0);
+    sim.sync_ns = sim.start_ns + sim_env("CLOCK_SIM_SYNC_S", 0) * 1000000000LL;
+    sim.step_ns = sim_env("CLOCK_SIM_STEP_S", 0) * 1000000000LL;
+    sim.synced = (sim.sync_ns <= sim.start_ns) && (sim.step_ns == 0);
+    // before the synchronization the clock is behind by the step
+    sim.realtime_offset -= sim.synced ? 0 : sim.step_ns;
+    srand((unsigned int)sim_env("CLOCK_SIM_SEED", 1));
+    sim.address = -1;
+    sim.display_count = (int)sim_env("CLOCK_SIM_DISPLAYS", 1);
+    if ((sim.display_count < 1) || (sim.display_count > SIM_DISPLAYS))
+    {
+        sim.display_count = 1;
+    }
+    for (int i = 0; i < SIM_DISPLAYS; i++)
+    {
+        sim.display[i].dimming = -1;
+    }
+    // TIMING register default at power on: gain 1x, 402 ms
+    sim.sensor.timing = 0x02;
+    sim.sensor.adc_timing = -1;
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        sim.timers[i].fd = -1;
+    }
+    const char *trace = getenv("CLOCK_SIM_TRACE");
+    sim_load_trace((trace != NULL) ? trace : "supporting_info_lightsensor/light_sensor_data_20180510.txt",
+                   (float)sim_env("CLOCK_SIM_LUX", 100));
+    atexit(sim_report);
+}
+
+/* the report of the simulated period */
+static void sim_report(void)
+{
+    struct rusage usage;
+    struct timespec real;
+    getrusage(RUSAGE_SELF, &usage);
+    clock_gettime(CLOCK_MONOTONIC, &real);
+    double hours = (atomic_load(&sim.mono_ns) - sim.start_ns) / 3600e9;
+    fprintf(stderr, "sim: simulated %.2f h in %.3f s real time\n", hours, (sim_ts_ns(&real) - sim_ts_ns(&sim.real_start)) / 1e9);
+    fprintf(stderr, "sim: wakeups: %ld (%.1f / h), timer expirations: %ld\n", sim.wakeups, (hours > 0) ? sim.wakeups / hours : 0.0, sim.expirations);
+    fprintf(stderr, "sim: bus: %ld transactions (%ld I2C_RDWR), %lld bytes, %.3f s bus time, %ld injected errors, %ld NACKs\n",
+            sim.transactions, sim.rdwr_transfers, sim.bus_bytes, sim.bus_ns / 1e9, sim.errors_injected, sim.nacks);
+    fprintf(stderr, "sim: display: %ld RAM writes, %ld dimming commands, %ld dimming changes, sensor reads: %ld\n",
+            sim.display_writes, sim.dimming_commands, sim.dimming_changes, sim.sensor_reads);
+    fprintf(stderr, "sim: sensor: %ld range changes, %ld block reads with the byte count, %ld reads before the first integration\n",
+            sim.range_changes, sim.count_byte_reads, sim.settling_reads);
+    for (int i = 0; i < sim.display_count; i++)
+    {
+        fprintf(stderr, "sim: display %#.2x RAM: %02x %02x : %02x %02x (colon %02x), dimming %d\n", SIM_DISPLAY_ADDRESS + i,
+                sim.display[i].ram[0], sim.display[i].ram[2], sim.display[i].ram[6], sim.display[i].ram[8], sim.display[i].ram[4],
+                sim.display[i].dimming);
+    }
+    fprintf(stderr, "sim: CPU time: user %.3f s, system %.3f s\n", usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+    const char *expect = getenv("CLOCK_SIM_EXPECT");
+    if ((expect != NULL) && (sim_check(expect) < 0))
+    {
+        // exit() shall not be called again in an atexit handler, the streams are flushed and the process leaves at once
+        fflush(NULL);
+        _exit(1);
+    }
+}
+
+/* the value of a report counter by name, -1 if the name is unknown */
+static long sim_counter(const char *name)
+{
+    int index;
+    if (strcmp(name, "wakeups") == 0) return sim.wakeups;
+    if (strcmp(name, "transactions") == 0) return sim.transactions;
+    if (strcmp(name, "nacks") == 0) return sim.nacks;
+    if (strcmp(name, "ram_writes") == 0) return sim.display_writes;
+    if (strcmp(name, "dimming_changes") == 0) return sim.dimming_changes;
+    if (strcmp(name, "sensor_reads") == 0) return sim.sensor_reads;
+    if (strcmp(name, "range_changes") == 0) return sim.range_changes;
+    if (strcmp(name, "count_byte_reads") == 0) return sim.count_byte_reads;
+    if (strcmp(name, "settling_reads") == 0) return sim.settling_reads;
+    if ((sscanf(name, "display%d_writes", &index) == 1) && (index >= 0) && (index < SIM_DISPLAYS)) return sim.display[index].writes;
+    return -1;
+}
+
+/* checks the report counters against the CLOCK_SIM_EXPECT items, 0 if all of them pass, -1 otherwise */
+static int sim_check(const char *expect)
+{
+    char items[512];
+    char *save = NULL;
+    int result = 0;
+    snprintf(items, sizeof(items), "%s", expect);
+    for (char *item = strtok_r(items, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        char name[32];
+        char op[3];
+        long limit;
+        // the operator is "<=", ">=" or "="
+        if (sscanf(item, " %31[a-z0-9_] %2[<>=] %ld", name, op, &limit) != 3)
+        {
+            fprintf(stderr, "sim: check \"%s\" is invalid\n", item);
+            result = -1;
+            continue;
+        }
+        long value = sim_counter(name);
+        int pass = (value >= 0) && (((strcmp(op, "=") == 0) && (value == limit)) || ((strcmp(op, "<=") == 0) && (value <= limit)) ||
+                                    ((strcmp(op, ">=") == 0) && (value >= limit)));
+        fprintf(stderr, "sim: check %s %s %ld: %ld, %s\n", name, op, limit, value, pass ? "passed" : "FAILED");
+        result = pass ? result : -1;
+    }
+    return result;
+}
+
+//----------------------------------- virtual time -----------------------------------
+
+static int sim_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+    if ((clock != CLOCK_REALTIME) && (clock != CLOCK_MONOTONIC))
+    {
+        return clock_gettime(clock, ts);
+    }
+    *ts = sim_ns_ts(sim_now_ns(clock));
+    return 0;
+}
+
+static time_t sim_time(time_t *t)
+{
+    time_t now = (time_t)(sim_now_ns(CLOCK_REALTIME) / 1000000000LL);
+    if (t != NULL)
+    {
+        *t = now;
+    }
+    return now;
+}
+
+static int sim_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+    sim_advance_to(sim_now_ns(CLOCK_MONOTONIC) + sim_ts_ns(req));
+    return 0;
+}
+
+static struct sim_timer *sim_find_timer(int fd)
+{
+    for (int i = 0; (i < SIM_TIMERS) && (fd >= 0); i++)
+    {
+        if (sim.timers[i].fd == fd)
+        {
+            return &sim.timers[i];
+        }
+    }
+    return NULL;
+}
+
+static int sim_timerfd_create(clockid_t clock, int flags)
+{
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    // a reused descriptor number replaces the slot of the closed timer
+    struct sim_timer *timer = sim_find_timer(fd);
+    for (int i = 0; (i < SIM_TIMERS) && (timer == NULL); i++)
+    {
+        if (sim.timers[i].fd < 0)
+        {
+            timer = &sim.timers[i];
+        }
+    }
+    if (timer == NULL)
+    {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    memset(timer, 0, sizeof(struct sim_timer));
+    timer->fd = fd;
+    timer->clock = clock;
+    return fd;
+}
+
+static int sim_timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old)
+{
+    struct sim_timer *timer = sim_find_timer(fd);
+    if (timer == NULL)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    long long expiry = sim_ts_ns(&value->it_value);
+    timer->interval = sim_ts_ns(&value->it_interval);
+    timer->armed = (expiry != 0);
+    timer->cancelled = 0;
+    timer->cancel_on_set = (timer->clock == CLOCK_REALTIME) && (flags & TFD_TIMER_ABSTIME) && (flags & TFD_TIMER_CANCEL_ON_SET);
+    if (flags & TFD_TIMER_ABSTIME)
+    {
+        // the deadline is kept in virtual monotonic time
+        timer->deadline = expiry - sim_now_ns(timer->clock) + sim_now_ns(CLOCK_MONOTONIC);
+    }
+    else
+    {
+        timer->deadline = sim_now_ns(CLOCK_MONOTONIC) + expiry;
+    }
+    return 0;
+}
+
+/* the expirations of a timerfd, the other descriptors are read by read() */
+static ssize_t sim_read(int fd, void *buf, size_t count)
+{
+    struct sim_timer *timer = sim_find_timer(fd);
+    if (timer == NULL)
+    {
+        return read(fd, buf, count);
+    }
+    if (timer->cancelled)
+    {
+        timer->cancelled = 0;
+        errno = ECANCELED;
+        return -1;
+    }
+    long long now = sim_now_ns(CLOCK_MONOTONIC);
+    if (!timer->armed || (timer->deadline > now) || (count < sizeof(uint64_t)))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    uint64_t expirations = 1;
+    if (timer->interval > 0)
+    {
+        expirations += (now - timer->deadline) / timer->interval;
+        timer->deadline += expirations * timer->interval;
+    }
+    else
+    {
+        timer->armed = 0;
+    }
+    sim.expirations += expirations;
+    memcpy(buf, &expirations, sizeof(expirations));
+    return sizeof(expirations);
+}
+
+/* the synchronization of the simulated clock: CLOCK_REALTIME is stepped, the absolute CLOCK_REALTIME deadlines
+are moved with it, and the timers with TFD_TIMER_CANCEL_ON_SET are cancelled */
+static void sim_sync(void)
+{
+    sim.synced = 1;
+    if (sim.step_ns == 0)
+    {
+        return;
+    }
+    sim.realtime_offset += sim.step_ns;
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        struct sim_timer *timer = &sim.timers[i];
+        if ((timer->fd >= 0) && timer->armed && timer->cancel_on_set)
+        {
+            timer->deadline -= sim.step_ns;
+            timer->cancelled = 1;
+        }
+    }
+}
+
+static int sim_adjtimex(struct timex *tx)
+{
+    memset(tx, 0, sizeof(struct timex));
+    tx->status = sim.synced ? STA_PLL : STA_UNSYNC;
+    tx->esterror = sim.synced ? 1000 : 16000000;
+    tx->maxerror = sim.synced ? 2000 : 16000000;
+    return sim.synced ? TIME_OK : TIME_ERROR;
+}
+
+/* the other descriptors are checked without waiting, than the virtual time jumps to the first timer deadline
+at the end of the simulated period SIGTERM is raised, so the clock shuts down as on a KILL request */
+static int sim_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    struct pollfd others[8];
+    nfds_t other_count = 0;
+    long long first = -1;
+    sim.wakeups++;
+    for (nfds_t i = 0; i < nfds; i++)
+    {
+        fds[i].revents = 0;
+        struct sim_timer *timer = sim_find_timer(fds[i].fd);
+        if ((timer != NULL) && timer->armed && ((first < 0) || (timer->deadline < first)))
+        {
+            first = timer->deadline;
+        }
+        if ((timer == NULL) && (fds[i].fd >= 0) && (other_count < 8))
+        {
+            others[other_count++] = fds[i];
+        }
+    }
+    if ((other_count > 0) && (poll(others, other_count, 0) > 0))
+    {
+        int ready = 0;
+        for (nfds_t i = 0, j = 0; i < nfds; i++)
+        {
+            if ((sim_find_timer(fds[i].fd) == NULL) && (fds[i].fd >= 0) && (j < other_count))
+            {
+                fds[i].revents = others[j++].revents;
+                ready += (fds[i].revents != 0);
+            }
+        }
+        return ready;
+    }
+    long long now = sim_now_ns(CLOCK_MONOTONIC);
+    if ((timeout >= 0) && ((first < 0) || (first > now + timeout * 1000000LL)))
+    {
+        first = now + timeout * 1000000LL;
+    }
+    if ((first < 0) || (first >= sim.end_ns))
+    {
+        sim_advance_to(sim.end_ns);
+        raise(SIGTERM);
+        errno = EINTR;
+        return -1;
+    }
+    // the clock synchronization is before the deadline: the cancelled timers wake up the process at it
+    if (!sim.synced && (sim.sync_ns <= first))
+    {
+        sim_advance_to(sim.sync_ns);
+        sim_sync();
+        first = (sim.step_ns != 0) ? sim_now_ns(CLOCK_MONOTONIC) : first;
+    }
+    sim_advance_to(first);
+    now = sim_now_ns(CLOCK_MONOTONIC);
+    int ready = 0;
+    for (nfds_t i = 0; i < nfds; i++)
+    {
+        struct sim_timer *timer = sim_find_timer(fds[i].fd);
+        if ((timer != NULL) && (timer->cancelled || (timer->armed && (timer->deadline <= now))))
+        {
+            fds[i].revents = POLLIN;
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/* the deadline of the other threads is in virtual time: they wait at most SIM_THREAD_WAIT_NS in real time */
+static int sim_sem_clockwait(sem_t *sem, clockid_t clock, const struct timespec *abstime)
+{
+    long long remaining = sim_ts_ns(abstime) - sim_now_ns(clock);
+    if (remaining > SIM_THREAD_WAIT_NS)
+    {
+        remaining = SIM_THREAD_WAIT_NS;
+    }
+    if (remaining < 0)
+    {
+        remaining = 0;
+    }
+    struct timespec real;
+    clock_gettime(CLOCK_MONOTONIC, &real);
+    real = sim_ns_ts(sim_ts_ns(&real) + remaining);
+    return sem_clockwait(sem, CLOCK_MONOTONIC, &real);
+}
+
+//----------------------------------- simulated bus -----------------------------------
+
+/* index of the simulated HT16K33 at the address, -1 if there is none */
+static int sim_display_index(int address)
+{
+    int index = address - SIM_DISPLAY_ADDRESS;
+    return ((index >= 0) && (index < sim.display_count)) ? index : -1;
+}
+
+/* accounts the bus time of a transfer of bytes (with the address bytes), and decides if an error is injected */
+static int sim_bus_transfer(int bytes)
+{
+    long long duration = bytes * SIM_BYTE_NS + sim.latency_ns;
+    sim.transactions++;
+    sim.bus_bytes += bytes;
+    sim.bus_ns += duration;
+    sim_advance_to(sim_now_ns(CLOCK_MONOTONIC) + duration);
+    if ((sim.error_ppm > 0) && ((rand() % 1000000) < sim.error_ppm))
+    {
+        sim.errors_injected++;
+        errno = EREMOTEIO;
+        return -1;
+    }
+    return 0;
+}
+
+/* 0 if the device answers at the address, -1 with errno EREMOTEIO if it does not */
+static int sim_device_ack(int address)
+{
+    if ((sim_display_index(address) < 0) && (address != SIM_SENSOR_ADDRESS))
+    {
+        sim.nacks++;
+        errno = EREMOTEIO;
+        return -1;
+    }
+    return 0;
+}
+
+/* accounts a transaction of bytes with the device bound by ioctl(I2C_SLAVE), and decides its result:
+0 if the addressed device answers, -1 with errno EREMOTEIO if it does not (or an error is injected) */
+static int sim_transaction(int bytes)
+{
+    if (sim_bus_transfer(bytes) < 0)
+    {
+        return -1;
+    }
+    return sim_device_ack(sim.address);
+}
+
+/* HT16K33 commands: 0x2x oscillator, 0x8x display setup (on, blink), 0xEx dimming */
+static void sim_display_command(int index, unsigned char command)
+{
+    if ((command & 0xF0) == 0x20)
+    {
+        sim.display[index].oscillator = command & 0x01;
+    }
+    else if ((command & 0xF0) == 0x80)
+    {
+        sim.display[index].setup = command & 0x07;
+    }
+    else if ((command & 0xF0) == 0xE0)
+    {
+        sim.dimming_commands++;
+        if ((command & 0x0F) != sim.display[index].dimming)
+        {
+            sim.dimming_changes++;
+            sim.display[index].dimming = command & 0x0F;
+        }
+    }
+}
+
+/* HT16K33 display RAM write from the address command */
+static void sim_display_write(int index, unsigned char command, int length, const unsigned char *values)
+{
+    for (int i = 0; (i < length) && ((command & 0x0F) + i < 16); i++)
+    {
+        sim.display[index].ram[(command & 0x0F) + i] = values[i];
+    }
+    sim.display_writes++;
+    sim.display[index].writes++;
+}
+
+// TSL2561 integration time of the INTEG bits of TIMING [ms] (3: manual, simulated as 402 ms)
+static const float sim_atime_ms[4] = {13.7f, 101.0f, 402.0f, 402.0f};
+
+/* TSL2561 power on or TIMING change: the ADC registers keep the last integration (0 after the power on) till the
+first integration of the current TIMING is finished */
+static void sim_sensor_restart(int power_on)
+{
+    long long now = sim_now_ns(CLOCK_MONOTONIC);
+    if (power_on)
+    {
+        sim.sensor.adc_timing = -1;
+    }
+    else if (now >= sim.sensor.ready_ns)
+    {
+        sim.sensor.adc_timing = sim.sensor.timing;
+    }
+    sim.sensor.ready_ns = now + (long long)(sim_atime_ms[sim.sensor.timing & 0x03] * 1e6);
+}
+
+/* TSL2561 ADC channels of the lux of the current virtual minute (daylight: CH1/CH0 = 0.3)
+the lux formula of the datasheet is inverted at gain 16x, 402 ms, than scaled to the gain and integration time of the
+integration in the ADC registers (before the first integration of the current TIMING: the previous one)
+returns 1 if the channels are of the current TIMING, 0 if not yet */
+static int sim_sensor_channels(int *broadband, int *ir)
+{
+    static const int saturation[4] = {5047, 37177, 65535, 65535};
+    time_t now = sim_time(NULL);
+    struct tm now_tm;
+    localtime_r(&now, &now_tm);
+    float lux = sim.lux[now_tm.tm_hour * 60 + now_tm.tm_min];
+    int settled = (sim_now_ns(CLOCK_MONOTONIC) >= sim.sensor.ready_ns);
+    int timing = settled ? sim.sensor.timing : sim.sensor.adc_timing;
+    int integration = timing & 0x03;
+    float gain = (timing & 0x10) ? 16.0f : 1.0f;
+    float ch0 = lux / (0.0304f - 0.062f * 0.1853f) / ((16.0f / gain) * (402.0f / sim_atime_ms[integration]));
+    if (((sim.sensor.control & 0x03) != 0x03) || (timing < 0))
+    {
+        ch0 = 0.0f;
+    }
+    *broadband = (ch0 > saturation[integration]) ? saturation[integration] : (int)ch0;
+    *ir = (int)(*broadband * 0.3f);
+    return settled;
+}
+
+/* I2C_SLAVE binds the handle to the address, I2C_RDWR is a combined transfer (the messages are separated by repeated starts) */
+static inline int ioctl(int file, unsigned long command, ...)
+{
+    va_list args;
+    va_start(args, command);
+    if (command == I2C_SLAVE)
+    {
+        sim.address = va_arg(args, int);
+        va_end(args);
+        return 0;
+    }
+    if (command != I2C_RDWR)
+    {
+        va_end(args);
+        return 0;
+    }
+    struct i2c_rdwr_ioctl_data *transfer = va_arg(args, struct i2c_rdwr_ioctl_data *);
+    va_end(args);
+    int bytes = 0;
+    for (int i = 0; i < transfer->nmsgs; i++)
+    {
+        bytes += 1 + transfer->msgs[i].len;
+    }
+    sim.rdwr_transfers++;
+    if (sim_bus_transfer(bytes) < 0)
+    {
+        return -1;
+    }
+    // the transfer stops at the first message which is not acknowledged
+    for (int i = 0; i < transfer->nmsgs; i++)
+    {
+        const struct i2c_msg *msg = &transfer->msgs[i];
+        int index = sim_display_index(msg->addr);
+        if (sim_device_ack(msg->addr) < 0)
+        {
+            return -1;
+        }
+        if ((index >= 0) && (msg->len == 1))
+        {
+            sim_display_command(index, msg->buf[0]);
+        }
+        else if ((index >= 0) && (msg->len > 1))
+        {
+            sim_display_write(index, msg->buf[0], msg->len - 1, &msg->buf[1]);
+        }
+    }
+    return transfer->nmsgs;
+}
+
+static inline int i2c_smbus_read_byte(int file)
+{
+    return sim_transaction(2);
+}
+
+static inline int i2c_smbus_write_byte(int file, unsigned char value)
+{
+    // TSL2561: the command with the CLEAR bit clears the interrupt (nothing to be simulated)
+    return sim_transaction(2);
+}
+
+static inline int i2c_smbus_read_byte_data(int file, unsigned char command)
+{
+    if (sim_transaction(4) < 0)
+    {
+        return -1;
+    }
+    if (sim_display_index(sim.address) >= 0)
+    {
+        // the clock sends the HT16K33 commands as the command byte of a read
+        sim_display_command(sim_display_index(sim.address), command);
+        return 0;
+    }
+    switch (command & 0x0F)
+    {
+        case 0x0: return sim.sensor.control;
+        case 0x1: return sim.sensor.timing;
+        case 0x6: return sim.sensor.interrupt;
+        // ID register: TSL2561T/FN/CL, revision 0
+        case 0xA: return 0x50;
+        default: return 0;
+    }
+}
+
+static inline int i2c_smbus_write_byte_data(int file, unsigned char command, unsigned char value)
+{
+    if (sim_transaction(3) < 0)
+    {
+        return -1;
+    }
+    if (sim.address == SIM_SENSOR_ADDRESS)
+    {
+        switch (command & 0x0F)
+        {
+            case 0x0:
+                if (((value & 0x03) == 0x03) && (sim.sensor.control != 0x03))
+                {
+                    sim_sensor_restart(1);
+                }
+                sim.sensor.control = value & 0x03;
+                break;
+            case 0x1:
+                sim.range_changes += ((value & 0x1B) != sim.sensor.timing);
+                sim.sensor.timing = value & 0x1B;
+                sim_sensor_restart(0);
+                break;
+            case 0x6: sim.sensor.interrupt = value & 0x3F; break;
+            default: break;
+        }
+    }
+    return 0;
+}
+
+static inline int i2c_smbus_read_word_data(int file, unsigned char command)
+{
+    if (sim_transaction(5) < 0)
+    {
+        return -1;
+    }
+    int broadband, ir;
+    int settled = sim_sensor_channels(&broadband, &ir);
+    switch (command & 0x0F)
+    {
+        case 0xC:
+            sim.sensor_reads++;
+            sim.settling_reads += !settled;
+            return broadband;
+        case 0xE: return ir;
+        default: return 0;
+    }
+}
+
+static inline int i2c_smbus_write_word_data(int file, unsigned char command, unsigned short value)
+{
+    if (sim_transaction(4) < 0)
+    {
+        return -1;
+    }
+    if ((sim.address == SIM_SENSOR_ADDRESS) && ((command & 0x0F) == 0x2))
+    {
+        sim.sensor.threshold_low = value;
+    }
+    if ((sim.address == SIM_SENSOR_ADDRESS) && ((command & 0x0F) == 0x4))
+    {
+        sim.sensor.threshold_high = value;
+    }
+    return 0;
+}
+
+static inline int i2c_smbus_process_call(int file, unsigned char command, unsigned short value)
+{
+    return sim_transaction(6);
+}
+
+/* Returns the number of read bytes */
+static inline int i2c_smbus_read_block_data(int file, unsigned char command, unsigned char *values)
+{
+    return sim_transaction(4);
+}
+
+static inline int i2c_smbus_write_block_data(int file, unsigned char command, unsigned char length, unsigned char *values)
+{
+    return sim_transaction(3 + length);
+}
+
+/* Returns the number of read bytes: the TSL2561 ADC channels (Ch0 low, Ch0 high, Ch1 low, Ch1 high)
+   with the BLOCK bit (0x10) of the command the TSL2561 uses the SMBus block protocol: the byte count is sent first,
+   so a plain I2C block read returns the channels shifted by one byte (as the real chip) */
+static inline int i2c_smbus_read_i2c_block_data(int file, unsigned char command, unsigned char length, unsigned char *values)
+{
+    if (sim_transaction(3 + length) < 0)
+    {
+        return -1;
+    }
+    memset(values, 0, length);
+    if ((sim.address == SIM_SENSOR_ADDRESS) && ((command & 0x0F) == 0xC) && (length >= 4))
+    {
+        int broadband, ir;
+        unsigned char data[5];
+        int block = (command & 0x10) != 0;
+        sim.settling_reads += !sim_sensor_channels(&broadband, &ir);
+        data[0] = 4;
+        data[1] = broadband & 0xFF;
+        data[2] = broadband >> 8;
+        data[3] = ir & 0xFF;
+        data[4] = ir >> 8;
+        memcpy(values, &data[!block], 4);
+        sim.sensor_reads++;
+        sim.count_byte_reads += block;
+    }
+    return length;
+}
+
+/* HT16K33 display RAM write from the address command */
+static inline int i2c_smbus_write_i2c_block_data(int file, unsigned char command, unsigned char length, unsigned char *values)
+{
+    if (sim_transaction(2 + length) < 0)
+    {
+        return -1;
+    }
+    if (sim_display_index(sim.address) >= 0)
+    {
+        sim_display_write(sim_display_index(sim.address), command, length, values);
+    }
+    return 0;
+}
+
+// from here the clock uses the virtual time
+#define clock_gettime sim_clock_gettime
+#define time sim_time
+#define nanosleep sim_nanosleep
+#define timerfd_create sim_timerfd_create
+#define timerfd_settime sim_timerfd_settime
+#define read sim_read
+#define poll sim_poll
+#define sem_clockwait sim_sem_clockwait
+#define adjtimex sim_adjtimex
+
+#endif
@@ -1,7 +1,7 @@
 //---------------------- CLOCK.C --------------------------------------
 /*
 This clock.c is driving a 4x7 segment display (ht16K33v110) to display the time.
-The dimming is set based on a light sensor value from TSL2561 (CS package!).
+The dimming is set based on a light sensor value from TSL2561 (T package, the CS package is selected by tsl2561_package).
 Light sensor also supports TSL2591 - not tested as received board is unfunctional.
 Addes support for VEML7700
 The display and the light sensor are connected to a raspberry pi 2 I2C outputs.
@@ -12,40 +12,145 @@ Inputs to call:
             1: only important output for standard log
             2: reduced output (only communication to the display) - exit via keypress
             3: most verbose output - exit via keypress
-
-to compile with TSL2561:
-     gcc -Wall -Ofast clock.c -D TSL2561 -lpaho-mqtt3c -lm -li2c -o clock
-to compile with TSL2591:
-     gcc -Wall -Ofast clock.c -D TSL2591 -lpaho-mqtt3c -lm -li2c -o clock
-to compile with VEML7700:
-     gcc -Wall -Ofast clock.c -D VEML7700 -lpaho-mqtt3c -lm -li2c -o clock
+Options (before or after input 1):
+ - -e json|bin|cbor: MQTT payload encoding (default json)
+            json: text payload on clock/light (unchanged)
+            bin : fixed layout little-endian payload on clock/light/bin2
+            cbor: CBOR map payload on clock/light/cbor2
+ - -s auto|none|tsl2561|tsl2591|veml7700: light sensor (default auto)
+            auto: the sensor is probed on the I2C bus (0x39, 0x29, 0x10), the result is cached in sensor_probe.txt
+            none: no light sensor, the dimming is based on the sun-set and sun-rise
+ - -g <line>: GPIO line (on gpiochip0) connected to the INT pin of the light sensor (TSL2561, TSL2591)
+            the sensor thresholds are set around the current dimming band, and the sensor is read only
+            if the light crosses into another band (plus a check in every 15 minutes)
+ - -l <lat>,<lon>: coordinates of the location for the sun-set and sun-rise, north and east positive (default 47.5,19.0 Budapest)
+            the sun-rise / sun-set table of the year is generated into sun_table.bin at the first start on the location
+            in the polar night the dimming stays at the minimum, in the polar day at the maximum
+ - -r <ms>: duration of the dimming transitions (default 2000), 0: the dimming is changed at once
+            the brightness is stepped one level at a time, only the brightness command is sent to the display
+ - -d hhmm|blink|mmss|hwblink|lux: display mode (default hhmm)
+            hhmm   : HH:MM with steady colon, the display is updated at the minute change
+            blink  : HH:MM, the colon is toggled at every second
+            mmss   : MM:SS, the digits are updated at every second
+            hwblink: HH:MM, the whole display is blinked at 1 Hz by the HT16K33 (the CPU is not woken up for it)
+            lux    : the measured (filtered) lux instead of the time, "Err" if the light sensor has no valid reading
+            while the system clock is not synchronized (adjtimex, e.g. no RTC and no NTP yet) the time and date show ----,
+            the clock step of NTP is shown at once; after clock_sync_wait (default 600 s) the time is shown anyway if the year is valid
+Configuration file (clock.conf next to the executable, see the example):
+            the lux-dimming table, MQTT settings, location, sensor and display mode, the command line options override it
+            the file is parsed again if it is changed (inotify), an invalid file is rejected and the settings are unchanged
+            the lux table, dimming learning, location, ramp, display mode, pages and telemetry policy are changed at once, the other settings at the next start
+            if the file has no lux table, lux_dimming.txt is used
+Pages:
+            the display can rotate through pages, one "page = time|date|temp|text <seconds>" line in clock.conf for each
+            (time: the display mode, date: DD.MM, temp: the outdoor temperature received on temp_topic of MQTT, text: the text command)
+            only the visible page is drawn, and only if its content changed; the per-second refresh and the blinking
+            are stopped while a page without the time is shown
+Commands:
+            the clock subscribes to <parent of mqtt_topic>/<mqtt_client_id>/cmd (e.g. clock/ExampleClientPub/cmd), one command per message:
+            brightness <0..15>|auto (override of the dimming of all displays), mode <display mode> (till the next change of clock.conf),
+            page <name> (the page is shown at once), text <text> (the text page shows it at once), reload (clock.conf is read again),
+            calibrate <reference lux>|reset (a point of the lux calibration, see below),
+            history raw|5min|hour|override [<count> [<skip>]] (the newest records of the lux history, see below)
+            the commands wake up the main loop at once (eventfd), nothing is polled
+Lux calibration:
+            the TSL2561 lux coefficients of the package are selected by tsl2561_package (t: T, FN and CL packages, cs: CS package),
+            the lux of any sensor is calibrated per board: lux = lux_scale * sensor lux + lux_offset (clock.conf), so one lux table
+            can be used on all boards; "calibrate <lux>" with the reading of a reference lux meter next to the clock reads the sensor
+            and fits the calibration to the points (one point: scale, points at different light: scale and offset), the result is
+            logged and used at once, it is kept after a restart only if it is written into clock.conf
+Several displays:
+            one process can drive up to 8 HT16K33 modules (0x70..0x77), one "display = <address> sensor|sun" line in clock.conf
+            for each, with its own lux table (the lux lines after it) and dimming source (the light sensor or the sun-set / sun-rise)
+            the displays show the same time, the frame of all displays is written in one I2C_RDWR transfer
+Logging:
+            the messages are kept in an in-memory ring of the last records, and written by a background thread
+            the verbose input is the level of all subsystems (clock, display, sensor, mqtt, sched), log_<subsystem>
+            in clock.conf overrides it at run-time; kill -USR1 writes the whole ring (all levels, with time stamps)
+Statistics:
+            in every 5 minutes a JSON message is published on clock/stats (sibling of the telemetry topic): latency histograms
+            (log2 us buckets) of the loop, display update, light measurement, MQTT publish and the minute flip delay,
+            and the I2C operation / error / reopen and MQTT connect / failure counters of the period
+            once per start a retained JSON message on clock/<mqtt_client_id>/startup (per board, as the commands): the time of
+            the first frame (since the process start and since the boot), of the first lux reading and of the first MQTT
+            connection; the first frame is written before the sensor and the MQTT are brought up, the sensor warm-up
+            measurement runs while the MQTT connects
+History:
+            the reading of each minute is archived in lux_history.bin next to the executable (memory mapped, fixed size, 308 kB):
+            the raw lux, ir and broadband of 24 hours, the min / max / avg lux of 5 minutes for 30 days and of an hour for 365 days,
+            and the last 256 brightness commands with the lux of the moment (override);
+            each tier is an append-only ring on its own pages (a record dirties only its page, the header is written once),
+            only the time of the synchronized clock is archived; the result of the history command (at most 288 records,
+            the oldest first, skip: the newer records left out) is published on <parent of mqtt_topic>/<mqtt_client_id>/history
+Dimming learning:
+            with dimming_learn = 1 the lux table of each display following the sensor is fitted to the brightness commands
+            (the level chosen at the lux of the moment; the commands within a minute are one choice): a monotone regression of the level
+            over the lux, the configured table decides only where there is no command; the weight of a command is halved in every 30 days;
+            the table is fitted again only when a command arrives (and at the start-up), the learned table is logged in the lux line format;
+            the brightness command still holds till "brightness auto", then the learned table is followed
+Telemetry:
+            published on change: a record is sent if the lux moved out of the deadband (telemetry_deadband, default 10 %),
+            the dimming, the sensor range or the display error state changed, or the heartbeat (telemetry_heartbeat, default 900 s) is over
+            (telemetry_heartbeat = 60 gives the old one record per minute); the suppressed records are counted in clock/stats
+
+to compile (all light sensors are supported, the sensor is selected at start-up):
+     gcc -Wall -Ofast clock.c -lpaho-mqtt3c -lm -li2c -lpthread -o clock
 
 
 for cygwin:
     gcc -c  clock.c -g -O3 -D noI2C -DNDEBUG  -o .//clock.c.o -I. -I.
+
+simulation and benchmark (no I2C hardware, simulated HT16K33 and TSL2561, lux trace replay in virtual time):
+    gcc -Wall -O2 clock.c -D noI2C -D I2C_SIM -lpaho-mqtt3c -lm -lpthread -o clock_sim
+    CLOCK_SIM_HOURS=24 CLOCK_SIM_LATENCY_US=50 CLOCK_SIM_ERROR_PPM=100 ./clock_sim -s tsl2561 1
+    the simulated day runs as fast as possible, the report (wakeups, bus bytes, dimming changes, CPU time) is written
+    to the standard error at the end, see I2C_DEV_Fake/i2c-dev_sim.h for the settings
+    with CLOCK_SIM_EXPECT the counters of the report are checked (exit status 1 on a mismatch), the regression checks
+    of the sensor read, the range selection and the missing display are listed in I2C_DEV_Fake/i2c-dev_sim.h
 */
 //--------------------------------------------------------------------
 
 //---------------------- INCLUDES AND DEFINES --------------------------------------
 
+// needed for sem_clockwait()
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/timex.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include "MQTTClient.h"
 
 #ifndef noI2C
     #include <sys/ioctl.h>
+    #include <linux/i2c.h>
     #include <linux/i2c-dev.h>
     #include <i2c/smbus.h>
+    #include <linux/gpio.h>
 #endif
 #ifdef noI2C
-    #include <I2C_DEV_Fake\i2c-dev_fake.h>
+    // I2C_SIM: simulated devices and virtual time for the tests and benchmarks (see I2C_DEV_Fake/i2c-dev_sim.h)
+    #ifdef I2C_SIM
+        #include "I2C_DEV_Fake/i2c-dev_sim.h"
+    #else
+        #include "I2C_DEV_Fake/i2c-dev_fake.h"
+    #endif
 #endif
 
 
@@ -56,25 +161,244 @@ for cygwin:
 #ifdef noI2C
     #define ADDRESS     "tcp://xx.xx.xx.xx:xxxx"
 #endif
+// default MQTT settings, they can be changed in the configuration file
 #define CLIENTID    "ExampleClientPub"
 #define TOPIC       "clock/light"
 #define QOS         0
 #define TIMEOUT     5000L
+// size of the telemetry queue between the main loop and the MQTT publisher thread (power of 2)
+#define TELEMETRY_QUEUE_SIZE 16
+// size of the command queue between the MQTT client thread and the main loop (power of 2)
+#define COMMAND_QUEUE_SIZE 8
+// number of the log-lux buckets of the compiled dimming curve (LuxBucketsPerOctave per octave above LuxBucketMin)
+#define LUX_BUCKETS 512
+// the largest median window of the lux filter
+#define LUX_MEDIAN_MAX 9
+// number of the segments of the CH1/CH0 ^ 1.4 table of the TSL2561 lux calculation
+#define RATIO_POW_STEPS 64
+// number of the records in the in-memory log ring (power of 2), and the limits of a log record
+#define LOG_RING_SIZE 512
+#define LOG_MAX_ARGS 8
+#define LOG_STRING_SIZE 96
+// number of the log-scale buckets of the latency histograms
+#define STATS_BUCKETS 20
+// the most displays driven by one process (HT16K33 addresses 0x70..0x77)
+#define DISPLAY_MAX 8
+// the most messages of one I2C_RDWR transfer (I2C_RDWR_IOCTL_MAX_MSGS of i2c-dev)
+#define DISPLAY_BATCH_MSGS 42
+// the most pages of the display rotation
+#define PAGE_MAX 8
+// number of the tiers of the lux history (raw, 5 minutes, 1 hour, overrides), and the most records of one history query
+#define LUX_HISTORY_TIERS 4
+#define LUX_HISTORY_QUERY_MAX 288
+// number of the brightness overrides kept in the lux history (one page), the points of the dimming learning
+#define LUX_HISTORY_OVERRIDES 256
+// light sensor capability flags
+#define SENSOR_CAP_IR_CHANNEL    0x01
+#define SENSOR_CAP_THRESHOLD_INT 0x02
+#define SENSOR_CAP_GAIN          0x04
 
 //---------------------- END OF INCLUDES AND DEFINES -------------------------------
 
 //----------------------------STRUCTURE DEFINITIONS--------------------
 
+/* LOG SUBSYSTEM ENUM
+the parts of the clock with their own log level
+*/
+enum log_subsystem
+{
+    LOG_CLOCK,
+    LOG_DISPLAY,
+    LOG_SENSOR,
+    LOG_MQTT,
+    LOG_SCHED,
+    LOG_SUBSYSTEMS
+};
+
+/* LOG LEVEL ENUM
+the level of a log record, the same steps as the former verbose input
+  LOG_LEVEL_ERROR : written always (unless the level of the subsystem is set to -1)
+  LOG_LEVEL_NOTICE: important output for the standard log (verbose 1)
+  LOG_LEVEL_INFO  : reduced output, e.g. the minutely display update (verbose 2)
+  LOG_LEVEL_DEBUG : most verbose output, e.g. the I2C transactions (verbose 3)
+*/
+enum log_level
+{
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_NOTICE = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3
+};
+
+/* STATS STAGE ENUM
+the measured stages of the hot path, each has its own latency histogram
+  STATS_LOOP       : one main loop iteration (from the wake-up to the next sleep)
+  STATS_DISPLAY    : display_update (framebuffer compose and I2C write)
+  STATS_MEASURE    : I2C part of the light measurement (start, ready check, read and range change)
+  STATS_MQTT       : publish of a live telemetry message, till MQTTClient_waitForCompletion returns
+  STATS_MINUTE_LATE: delay of the minute flip on the display after the real minute boundary
+*/
+enum stats_stage
+{
+    STATS_LOOP,
+    STATS_DISPLAY,
+    STATS_MEASURE,
+    STATS_MQTT,
+    STATS_MINUTE_LATE,
+    STATS_STAGES
+};
+
+/* LATENCY HISTOGRAM STRUCT
+fixed log-scale histogram in us: bucket 0 counts the values below 1 us, bucket k counts [2^(k-1), 2^k) us,
+the last bucket counts the longer values as well
+    buckets: number of the values in the bucket
+    count  : number of the values
+    sum_us : sum of the values (for the average)
+    max_us : the highest value
+*/
+struct latency_histogram
+{
+    atomic_uint buckets[STATS_BUCKETS];
+    atomic_uint count;
+    atomic_ulong sum_us;
+    atomic_ulong max_us;
+};
+
+/* CLOCK STATS STRUCT
+hot path instrumentation, updated by the main loop and the publisher thread without locking,
+published and reset by the publisher thread in every StatsPeriodSec
+    stages          : latency histogram of each stage
+    i2c_ops         : checked I2C operations (one or more transactions, see i2c_bus_check)
+    i2c_errors      : failed I2C operations with a bus fault (NACK, timeout, controller error)
+    i2c_reopens     : reopen of the I2C bus after a fault burst
+    sensor_restarts : restart attempts of the not responding light sensor
+    mqtt_connects   : successful connections to the broker
+    mqtt_connect_failures: failed connection attempts
+    mqtt_publish_failures: failed publishes of live telemetry (the record is kept for the replay)
+    telemetry_suppressed : telemetry records not published, nothing changed out of the deadband (see telemetry_policy_check)
+*/
+struct clock_stats
+{
+    struct latency_histogram stages[STATS_STAGES];
+    atomic_uint i2c_ops;
+    atomic_uint i2c_errors;
+    atomic_uint i2c_reopens;
+    atomic_uint sensor_restarts;
+    atomic_uint mqtt_connects;
+    atomic_uint mqtt_connect_failures;
+    atomic_uint mqtt_publish_failures;
+    atomic_uint telemetry_suppressed;
+};
+
+/* STARTUP TIMING STRUCT
+the timing of the start-up, published once on <parent of mqtt_topic>/<client id>/startup after the MQTT connection
+(the times of the stages are measured from the start of the process [us], -1 if the stage is not yet reached)
+    start          : the start of the process (CLOCK_MONOTONIC)
+    first_frame_us : the first frame is written to the displays
+    boot_ms        : time since the boot of the system at the first frame (CLOCK_BOOTTIME) [ms]
+    first_lux_us   : the first valid lux reading (the end of the sensor warm-up)
+    mqtt_connect_us: the first MQTT connection
+    complete       : 1 if the start-up is finished (the warm-up measurement is done or there is no sensor)
+*/
+struct startup_timing
+{
+    struct timespec start;
+    atomic_long first_frame_us;
+    atomic_long boot_ms;
+    atomic_long first_lux_us;
+    atomic_long mqtt_connect_us;
+    atomic_int complete;
+};
+
+/* LOG RECORD STRUCT
+one binary log record: the format string is not expanded at the logging, only the arguments are stored
+(the format shall be a string literal, the string arguments are copied)
+    time     : CLOCK_REALTIME of the record
+    format   : printf format of the message
+    subsystem: enum log_subsystem
+    level    : enum log_level
+    argc     : number of the stored arguments
+    args     : the arguments (integers are stored as long long, %s as offset in strings)
+    strings  : copy of the string arguments
+*/
+struct log_record
+{
+    struct timespec time;
+    const char *format;
+    unsigned char subsystem;
+    unsigned char level;
+    unsigned char argc;
+    union
+    {
+        long long i;
+        double d;
+        const void *p;
+    } args[LOG_MAX_ARGS];
+    char strings[LOG_STRING_SIZE];
+};
+
+/* LOG RING STRUCT
+lock-free in-memory ring of the last LOG_RING_SIZE log records (flight recorder), written by any thread
+the writer reserves a slot by incrementing head, the sequence of the slot is odd while the record is written,
+so the reader (writer thread, SIGUSR1 dump) can detect a record which is overwritten while it is copied
+    head    : number of the records reserved since the start
+    seq     : per slot sequence (2 * record number + 2 if the record is complete)
+    pending : per slot record number + 1 of the enabled record not yet written (0: none), taken by the writer thread, or by
+              the logging thread which reuses the slot (than the record is lost)
+    lost    : number of the enabled records overwritten before they are written (since the last report)
+    records : the records
+    levels  : per subsystem level of the records written to the standard output (-1: none, 0: errors only), set at run-time
+    ready   : posted if a record to be written is logged, or if the dump is requested
+    dump    : set by SIGUSR1, the whole ring is written by the writer thread
+    stop    : set to stop the writer thread
+    thread  : the writer thread
+*/
+struct log_ring
+{
+    atomic_ulong head;
+    atomic_ulong seq[LOG_RING_SIZE];
+    atomic_ulong pending[LOG_RING_SIZE];
+    atomic_ulong lost;
+    struct log_record records[LOG_RING_SIZE];
+    atomic_int levels[LOG_SUBSYSTEMS];
+    sem_t ready;
+    volatile sig_atomic_t dump;
+    atomic_int stop;
+    pthread_t thread;
+};
+
 /* LIGHT SENSOR MEASUREMENT STRUCT
 create a structure to contain the measured sensor values and the calculated lux
     s_ir : infrared value
     s_broadband  : broadband value
-    lux: calculated lux value
+    lux: calculated lux value (calibrated by the main loop)
+    raw_lux: lux calculated by the sensor driver (before the per-board calibration, proportional to the counts)
+    range: index of the gain / integration time setting of the measurement in the range table of the driver (-1: unknown)
+    error: errno of the failed transaction of the measurement (0: no failed transaction)
 */
 struct light_sensor_data
 {
     int s_ir, s_broadband;
     float lux;
+    float raw_lux;
+    int range;
+    int error;
+};
+
+/* SENSOR RANGE STRUCT
+one gain / integration time setting of a light sensor, the range tables are ordered by increasing sensitivity
+(the first range is the shortest integration time for very bright scenes)
+    gain     : analog gain [x]
+    atime_ms : integration time [ms]
+    max_count: the highest channel count in this range (saturation)
+    config   : driver specific register value of the setting
+*/
+struct sensor_range
+{
+    float gain;
+    float atime_ms;
+    int max_count;
+    unsigned short config;
 };
 
 /* DISPLAY MEMORY VALUES STRUCT
@@ -84,10 +408,195 @@ create a structure to contain all the display memory values which needs refresh
     disp_min1: minute first digit
     char disp_min2: minute second digit
     char disp_dim : dimming
+    disp_colon: colon (Colon_on or 0)
 */
 struct disp_refresh_values
 {
-    unsigned char disp_h1, disp_h2, disp_min1, disp_min2, disp_dim;
+    unsigned char disp_h1, disp_h2, disp_min1, disp_min2, disp_dim, disp_colon;
+};
+
+/* DISPLAY FRAMEBUFFER STRUCT
+shadow copy of the HT16K33 display RAM, only the bytes which differ from the last written frame are sent to the display
+    ram       : display RAM content to be shown (16 bytes, starting at display address 0x00)
+    dim       : dimming command to be shown (0xE0 + dimming value)
+    sent      : display RAM content last written to the display
+    sent_dim  : dimming command last written to the display
+    sent_valid: 1 if sent and sent_dim represent the display content (0 after start-up or I2C failure)
+*/
+struct display_framebuffer
+{
+    unsigned char ram[16];
+    unsigned char dim;
+    unsigned char sent[16];
+    unsigned char sent_dim;
+    int sent_valid;
+};
+
+/* I2C BUS STRUCT
+the I2C bus session shared by the display and the light sensor: one file handle, the slave address is only
+switched if the next transaction is for another device
+    adapter_nr: the I2C bus number (/dev/i2c-<adapter_nr>)
+    fd        : the bus handle, -1 if the bus is not open
+    address   : the slave address the handle is bound to, -1 if not known
+    errors    : number of consecutive failed transactions with bus fault error codes
+    recoveries: number of bus recoveries (reopen) since the start
+*/
+struct i2c_bus
+{
+    int adapter_nr;
+    int fd;
+    int address;
+    int errors;
+    int recoveries;
+};
+
+/* DIMMING CURVE STRUCT
+the lux-dimming table compiled for the lookup at every lux sample: the defined levels are stored densely in
+increasing lux order, and a log-lux bucket table gives the level of a lux value without scanning the table
+    count : number of the levels (the first one is dimming 0 below the lowest lux value)
+    level : dimming value of the levels
+    lux   : lux threshold of the levels (the level is selected above this lux)
+    up    : lux to be exceeded to step up into the level (threshold plus the up hysteresis)
+    down  : lux below which the level is left downwards (threshold minus the down hysteresis)
+    bucket: for each log-lux bucket the index of the highest level with a threshold below the bucket
+*/
+struct dimming_curve
+{
+    int count;
+    unsigned char level[16];
+    float lux[16];
+    float up[16];
+    float down[16];
+    unsigned char bucket[LUX_BUCKETS];
+};
+
+/* LUX FILTER STRUCT
+the filtering of the measured lux: a median of the last samples rejects the short spikes (e.g. car head lights),
+than an exponential smoother with a time constant in seconds follows (the smoothing factor is calculated from the
+time between the samples, so it is correct at any, also irregular, sample rate)
+    window     : ring buffer of the last samples
+    count      : number of samples in the window
+    next       : index of the next sample in the ring buffer
+    median_size: number of samples of the median (1: no spike rejection)
+    tau_s      : time constant of the smoother [s] (0: no smoothing)
+    value      : the filtered lux
+    last_time  : monotonic time of the last sample [s]
+*/
+struct lux_filter
+{
+    float window[LUX_MEDIAN_MAX];
+    int count;
+    int next;
+    int median_size;
+    float tau_s;
+    float value;
+    double last_time;
+};
+
+/* TSL2561 PACKAGE STRUCT
+the lux coefficients of a TSL2561 package (datasheet), the segment is selected by the ratio CH1/CH0:
+lux = ch0[0] * CH0 - ch1[0] * CH0 * ratio^1.4 in the first segment, lux = ch0[i] * CH0 - ch1[i] * CH1 in the others,
+above the last ratio limit there is no visible light
+    name    : name of the package in the configuration file (tsl2561_package)
+    ratio   : upper ratio limit of each segment
+    ch0, ch1: coefficients of the channels in each segment
+*/
+struct tsl2561_package
+{
+    const char *name;
+    float ratio[4];
+    float ch0[4];
+    float ch1[4];
+};
+
+/* LUX CALIBRATION STRUCT
+the least squares fit of the per-board lux calibration (lux = scale * sensor lux + offset) to the reference readings
+of the calibrate command (a reference lux meter next to the clock)
+    points: number of the reference points
+    sum_x, sum_y, sum_xx, sum_xy: sums of the sensor lux (x) and of the reference lux (y) of the points
+*/
+struct lux_calibration
+{
+    int points;
+    double sum_x, sum_y, sum_xx, sum_xy;
+};
+
+/* DIMMING RAMP STRUCT
+state of the smooth dimming transition: the brightness is stepped by one level per timed brightness command,
+the steps of a transition are spread over the ramp duration
+one ramp (one timer) drives all displays, the brightness commands of a step are sent together
+    timer_fd   : timerfd created on CLOCK_MONOTONIC, expires at the next brightness step
+    count      : number of the displays
+    level      : the brightness level on each display (0..15, -1: not yet set)
+    target     : the brightness level to be reached on each display
+    duration_ms: duration of a transition [ms], 0: the target is set at once
+    override   : brightness of all displays set by the brightness command, -1: the dimming of each display is the target
+*/
+struct dimming_ramp
+{
+    int timer_fd;
+    int count;
+    int level[DISPLAY_MAX];
+    int target[DISPLAY_MAX];
+    int duration_ms;
+    int override;
+};
+
+/* DISPLAY MODE ENUM
+what the display shows, selected by the -d option
+  DISPLAY_MODE_HHMM   : HH:MM with steady colon, the display is updated at the minute change (original behaviour)
+  DISPLAY_MODE_BLINK  : HH:MM, the colon is toggled at every second by the refresh scheduler
+  DISPLAY_MODE_MMSS   : MM:SS with steady colon, the digits are updated at every second by the refresh scheduler
+  DISPLAY_MODE_HWBLINK: HH:MM, the whole display is blinked at 1 Hz by the HT16K33 (no per-second wake-up)
+  DISPLAY_MODE_LUX    : the filtered lux instead of the time, updated at the minute change ("Err" without a valid reading)
+*/
+enum display_mode
+{
+    DISPLAY_MODE_HHMM,
+    DISPLAY_MODE_BLINK,
+    DISPLAY_MODE_MMSS,
+    DISPLAY_MODE_HWBLINK,
+    DISPLAY_MODE_LUX
+};
+
+/* CLOCK SYNC STRUCT
+the synchronization state of the system clock, the time is only shown if the clock is synchronized
+(the Pi has no RTC, so the clock is wrong at the boot till NTP sets it)
+    timer_fd: timerfd created on CLOCK_MONOTONIC, expires in every ClockSyncCheckSec while the clock is not synchronized
+              (CLOCK_EVENT_SYNC), -1 if the clock is synchronized
+    synced  : 1 if the time can be shown
+    wait_s  : the longest wait for the NTP synchronization [s], after it the time is shown if the year is valid
+              (e.g. an RTC without NTP), 0: the synchronization is not waited for
+    start   : the start of the wait (CLOCK_MONOTONIC)
+*/
+struct clock_sync
+{
+    int timer_fd;
+    int synced;
+    int wait_s;
+    struct timespec start;
+};
+
+/* REFRESH SCHEDULER STRUCT
+the per-second display refresh, the ticks are absolute CLOCK_MONOTONIC deadlines aligned to the second boundary
+of the system clock (re-aligned at every minute change, so the NTP slew of the system clock is followed)
+    timer_fd     : timerfd created on CLOCK_MONOTONIC, -1 if the display mode has no per-second refresh
+    period_ms    : period of the ticks [ms]
+    deadline     : the next deadline (CLOCK_MONOTONIC)
+    ticks        : number of ticks since the last statistics reset
+    missed       : number of deadlines which expired without being served (the process was late by a whole period)
+    jitter_sum_us: sum of the wake-up delays after the deadlines [us]
+    jitter_max_us: the largest wake-up delay after a deadline [us]
+*/
+struct refresh_scheduler
+{
+    int timer_fd;
+    int period_ms;
+    struct timespec deadline;
+    long ticks;
+    long missed;
+    double jitter_sum_us;
+    long jitter_max_us;
 };
 
 /* SUN-RISE CALCULATION STRUCT
@@ -96,10 +605,53 @@ this structure is defined to provide the output of the sun-set sun-rise calculat
     set_min : is the minute when the sun sets
     rise_hour: is the hour of the given day when the sun rises
     rise_min : is the minute when the sun rises
+    polar    : 0: the sun rises and sets, -1: polar night (the sun does not rise), 1: polar day (the sun does not set),
+               the set and rise times are not used in the polar days
 */
 struct sunup
 {
     int set_hour, set_min, rise_hour, rise_min;
+    int polar;
+};
+
+/* SUN TABLE HEADER STRUCT
+header at the beginning of the sun-rise / sun-set table file
+    magic    : SunTableMagic, to detect foreign or corrupted files
+    version  : layout version of the file
+    latitude : north coordinate of the location the table is calculated for [deg]
+    longitude: west coordinate of the location the table is calculated for [deg]
+*/
+struct sun_table_header
+{
+    uint32_t magic;
+    uint32_t version;
+    double latitude;
+    double longitude;
+};
+
+/* SUN TABLE ENTRY STRUCT
+sun-rise and sun-set of one day of the year
+    rise_utc_min: sun-rise in minutes after UTC midnight (0..1439), SunPolarNight or SunPolarDay in the polar days
+    set_utc_min : sun-set in minutes after UTC midnight (0..1439), SunPolarNight or SunPolarDay in the polar days
+*/
+struct sun_table_entry
+{
+    int16_t rise_utc_min;
+    int16_t set_utc_min;
+};
+
+/* SUN TABLE STRUCT
+the memory mapped sun-rise / sun-set table, one entry for each day of the leap year SunTableYear (looked up by the month
+and the day, so the 29th of February does not shift the days of the other years)
+    header: the mapped header
+    days  : the mapped entries
+    size  : size of the mapping
+*/
+struct sun_table
+{
+    struct sun_table_header *header;
+    struct sun_table_entry *days;
+    size_t size;
 };
 
 /* DIMMING VALUE STRUCT
@@ -117,1634 +669,8724 @@ struct display_dimming
     unsigned char dimming_min;
 };
 
-//---------------------END OF STRUCTURE DEFINITIONS--------------------
+/* CLOCK DISPLAY STRUCT
+one HT16K33 display module driven by the process, the displays share the bus, the minute tick and the light sensor
+    address   : I2C address of the display (0x70..0x77)
+    use_sensor: 1 if the dimming follows the light sensor, 0 if it follows the sun-set and sun-rise
+    curve     : the lux-dimming table of the display compiled for the lookup
+    dimming   : the dimming settings of the display
+    fb        : shadow of the display RAM
+    offline   : 1 if the display failed its init or a transfer: it is sent in its own transfer (a NACK of it does not stop
+                the transfer of the other displays) till it is initialized again (see display_flush)
+*/
+struct clock_display
+{
+    unsigned char address;
+    int use_sensor;
+    struct dimming_curve curve;
+    struct display_dimming dimming;
+    struct display_framebuffer fb;
+    int offline;
+};
 
-//------------------------FUNCTION DECLARATIONS------------------------
+/* CLOCK EVENT ENUM
+the events the main loop can be woken up by
+  CLOCK_EVENT_NONE  : nothing to do (e.g. interrupted by a signal)
+  CLOCK_EVENT_SAMPLE: lux sample slot before the minute change
+  CLOCK_EVENT_MINUTE: minute boundary, the display shall be updated
+  CLOCK_EVENT_JUMP  : the system clock was set (e.g. NTP step), the display shall be updated
+  CLOCK_EVENT_LIGHT : the light sensor interrupt was raised (the light crossed into another dimming band)
+  CLOCK_EVENT_SENSOR_READY: the started light measurement is expected to be ready
+  CLOCK_EVENT_RAMP  : the next brightness step of the dimming ramp is due
+  CLOCK_EVENT_TICK  : the per-second display refresh is due (seconds, blinking colon)
+  CLOCK_EVENT_CONFIG: the configuration file (or the lux-dimming file) was changed
+  CLOCK_EVENT_PAGE  : the display time of the visible page is over, the next page shall be shown
+  CLOCK_EVENT_PAGE_DATA: new data of the visible page was received (e.g. the temperature on MQTT)
+  CLOCK_EVENT_COMMAND: a command was received on the MQTT command topic
+  CLOCK_EVENT_SYNC  : the synchronization state of the system clock shall be checked (only while it is not synchronized)
+*/
+enum clock_event
+{
+    CLOCK_EVENT_NONE,
+    CLOCK_EVENT_SAMPLE,
+    CLOCK_EVENT_MINUTE,
+    CLOCK_EVENT_JUMP,
+    CLOCK_EVENT_LIGHT,
+    CLOCK_EVENT_SENSOR_READY,
+    CLOCK_EVENT_RAMP,
+    CLOCK_EVENT_TICK,
+    CLOCK_EVENT_CONFIG,
+    CLOCK_EVENT_PAGE,
+    CLOCK_EVENT_PAGE_DATA,
+    CLOCK_EVENT_COMMAND,
+    CLOCK_EVENT_SYNC
+};
 
-/* FUNCTION: GET_HEX_CODE
-sub-function is created to get hex code for a single digit =meaning this shall be called four times for HH:MM format
- input
-        anum: a number value between 0-900000000
-output
-        integer with the value representing the digit anum on the display memory
+/* PAGE UPDATE ENUM
+when the content of a display page can change
+  PAGE_UPDATE_CLOCK : with the time, at the minute change (or at every second in the blink and mmss display modes)
+  PAGE_UPDATE_MINUTE: checked at the minute change (e.g. the date)
+  PAGE_UPDATE_DATA  : when the data of the page is received (the main loop is only woken up if the page is visible)
 */
-unsigned char get_hex_code(int anum);
+enum page_update
+{
+    PAGE_UPDATE_CLOCK,
+    PAGE_UPDATE_MINUTE,
+    PAGE_UPDATE_DATA
+};
 
-/* FUNCTION: DISPLAY_INIT
-sub-function is created to turn on and turn off the display
- inputs
-        onoff: 1 to turn the display and the oscillator on; 0 to turn it off
-        verbose: 1, or greater integer if you want to have messages on the standard output
- output: ----
+/* PAGE FEED STRUCT
+the data of the pages received on the MQTT thread
+    event_fd       : eventfd written by the MQTT thread if the page of the data is visible (CLOCK_EVENT_PAGE_DATA), -1 if not used
+    listening      : 1 if a PAGE_UPDATE_DATA page is visible, the MQTT thread wakes up the main loop only then
+    temperature    : the last received outdoor temperature [0.1 C]
+    temperature_seq: number of the received temperature messages (0: none yet)
+    text           : content of the text page (set by the main loop from the text command)
+    text_seq       : number of the text commands
 */
-int display_init(unsigned char onoff,int file, int verbose);
+struct page_feed
+{
+    int event_fd;
+    atomic_int listening;
+    atomic_int temperature;
+    atomic_uint temperature_seq;
+    char text[16];
+    unsigned int text_seq;
+};
 
-/* FUNCTION: SENSOR_INIT
-sub-function is created to turn on and turn off the display
- inputs
-        onoff: 1 to turn the display and the oscillator on; 0 to turn it off
-        verbose: 1, or greater integer if you want to have messages on the standard output
- output: ----
+/* PAGE CONTEXT STRUCT
+the data the pages are drawn from
+    a_tm     : the current local time
+    mode     : the display mode (what the time page shows)
+    lux      : the filtered lux
+    lux_valid: 1 if the light sensor has a valid reading
+    clock_synced: 1 if the system clock is synchronized (the time and the date are shown, ---- before it)
+    feed     : the data received on the MQTT thread
 */
-int sensor_init(unsigned char onoff,int file, int verbose);
+struct page_context
+{
+    struct tm *a_tm;
+    enum display_mode mode;
+    float lux;
+    int lux_valid;
+    int clock_synced;
+    const struct page_feed *feed;
+};
 
-/* FUNCTION: READ_LUX_VALUES
-sub-function is created to read lux values for dimming from file
-    file name is stored in lux_file variable
-        the file shall contain lux dimming pairs in each row, both as integer values
-    input: pointer to the array to be filled
+/* PAGE DRIVER STRUCT
+a kind of display page, the page lines of the configuration file refer to the name
+    name  : name of the page in the configuration file
+    update: when the content of the page can change
+    stamp : returns a value which changes if the content of the page changes (the page is only drawn if it changed)
+    render: draws the page into the display refresh values
 */
-void read_lux_values(int * lux_array, char * filepath);
+struct page_driver
+{
+    const char *name;
+    enum page_update update;
+    long (*stamp)(const struct page_context *ctx);
+    void (*render)(const struct page_context *ctx, struct disp_refresh_values *values);
+};
 
-/* FUNCTION: GET_DISPL_VALUES
-sub-function create the hex values for the display settings
- inputs:
-    struct tm *a_tm                 : including the current time
-    currlight                       : the required dimming value
-    verbose                         : if 1 some information will be sent to the standard output
- output: struct
-    displ_h1 - memory content of the first character of the hour
-    displ_h2 - memory content of the second character of the hour
-    disp_min1 - memory content of the first character of the minute
-    disp_min2 - memory content of the second character of the minute
-    disp_dim : dimming
+/* PAGE CONFIGURATION STRUCT
+one page of the rotation ("page = <name> <seconds>" line of the configuration file)
+    driver    : the kind of the page
+    duration_s: display time of the page [s]
 */
-struct disp_refresh_values get_displ_values(struct tm *a_tm,unsigned char currlight, int verbose);
+struct page_config
+{
+    const struct page_driver *driver;
+    int duration_s;
+};
 
-/* FUNCTION: DISPLAY_UPDATE
-this function send the defined values to the display device via the I2C bus
- inputs:
-    adisp_refresh_values    :   contains the register values of the display segments
-    file                    :   bus handler
-    lightchange             :   if light settings needs to be updated (positive increase, negative decrease)
-    verbose                 :   if 1 some information will be sent to the standard output
+/* PAGE SCHEDULER STRUCT
+the rotation of the display pages, only the visible page is drawn, and only if its content changed
+    timer_fd   : timerfd created on CLOCK_MONOTONIC, expires at the end of the display time of the visible page (CLOCK_EVENT_PAGE),
+                 not armed if there is only one page
+    count      : number of the pages
+    pages      : the pages in the order of the rotation
+    visible    : index of the visible page
+    drawn_valid: 1 if the frame of the visible page is drawn (0: the page shall be drawn at the next page_draw)
+    drawn_stamp: the stamp of the drawn frame
+    feed       : the data of the pages received on the MQTT thread
 */
-int display_update(struct disp_refresh_values adisp_refresh_values, int file, int lightchange, int verbose);
+struct page_scheduler
+{
+    int timer_fd;
+    int count;
+    struct page_config pages[PAGE_MAX];
+    int visible;
+    int drawn_valid;
+    long drawn_stamp;
+    struct page_feed feed;
+};
 
-/* FUNCTION: UPDATE_DIMMING
-this function is responsible to modify the current dimming settings in function of the current time
-inputs:
- struct tm *a_tm                    : including the current time
- struct display_dimming adimming    : including the previous dimming settings
- struct sunup thissunup             : including the sun-set sun-rise times to know when the dimming needs to change
- verbose                            : gives some text to the standard output
-output                              : including the current dimming settings (with memory)
+/* TELEMETRY RECORD STRUCT
+one minute of telemetry, pushed by the main loop to the MQTT publisher thread
+    timestamp     : time of the display update
+    lux           : filtered lux value
+    dimming       : current dimming value
+    ir, broadband : last light sensor raw values
+    range         : gain / integration time range of the last light measurement (-1: no sensor)
+    disp_err      : result of the last display update
+    sensor_restart: 1 if the light sensor restart was tried in this minute
 */
-struct display_dimming update_dimming(struct tm *a_tm,struct display_dimming adimming,struct sunup thissunup, int verbose);
+struct telemetry_record
+{
+    time_t timestamp;
+    float lux;
+    int dimming;
+    int ir, broadband;
+    int range;
+    int disp_err;
+    int sensor_restart;
+};
 
-/* FUNCTION: UPDATE_DIMMING_BY_LUX
-this function is responsible to modify the current dimming settings in function of the measured lux
-inputs:
- int lux                            : measured lux value
- struct display_dimming adimming    : including the previous dimming settings
- int * lux_array                    : look-up table for dimming vs lux
-output                              : including the current dimming settings (with memory)
+/* TELEMETRY POLICY STRUCT
+publish-on-change of the telemetry: a record is published if a field changed since the last published record
+(the lux out of its deadband, the dimming, the display error state, the sensor range, a sensor restart),
+or if the heartbeat interval is over
+    lux_deadband_pct: deadband of the lux [%] of the last published lux (but at least of LuxDeadbandFloor)
+    heartbeat_s     : the longest time between two published records [s]
+    valid           : 1 if a record was published (the first record is always published)
+    last            : the last published record (the state of each field)
 */
-struct display_dimming update_dimming_by_lux(int lux, int * lux_array, struct display_dimming adimming, int verbose);
+struct telemetry_policy
+{
+    int lux_deadband_pct;
+    int heartbeat_s;
+    int valid;
+    struct telemetry_record last;
+};
 
+/* PAYLOAD ENCODING ENUM
+the selectable encodings of the MQTT telemetry payload, the topic suffix identifies the encoding and its schema version
+  PAYLOAD_JSON  : JSON text (original format, no topic suffix)
+  PAYLOAD_BINARY: fixed layout little-endian struct, topic suffix "/bin2"
+  PAYLOAD_CBOR  : CBOR (RFC 8949) map with the same keys as the JSON, topic suffix "/cbor2"
+*/
+enum payload_encoding
+{
+    PAYLOAD_JSON,
+    PAYLOAD_BINARY,
+    PAYLOAD_CBOR
+};
 
-/* FUNCTION: CALCULATE_SUN_UP
-To calculate the sun-set and sun-rise times for a given location, on the current day this function should be called
-Necessary inputs:
-Ln_deg: north longitudial coordinate, as double (for locations south to the equador it is a negative value)
-Lw_deg: west latituial coordinate, as double (for location east to Greenwich it is a negative value)
-verbose: if it is set to 1, some intermediate information will be printed to the standard output (printf)
-Output will be provided as struct sunup
+/* DISPLAY CONFIGURATION STRUCT
+the settings of one display ("display = <address> sensor|sun" line of the configuration file)
+    address   : I2C address of the display (0x70..0x77)
+    use_sensor: 1 if the dimming follows the light sensor (if there is one), 0 if it follows the sun-set and sun-rise
+    lux_values: lux-dimming table of the display (the lux lines after the display line, or the common table)
 */
-struct sunup calculate_sun_up(double Ln_deg,double Lw_deg, int verbose);
+struct display_config
+{
+    unsigned char address;
+    int use_sensor;
+    int lux_values[16];
+};
 
-/* FUNCTION: PROGRAM_SLEEP
-this subfunction calles the nanosleep() function for the defined seconds
-Input:
-    sec: the seconds till the program needs to sleep
-    verbose: writes slept time to the standard output
+/* CLOCK CONFIGURATION STRUCT
+the validated settings of the configuration file (clock.conf), the command line options override the file
+the lux table, the location, the ramp duration, the display mode, the pages and the telemetry policy are changed at run-time if the file is changed,
+the other settings are used at the start-up only
+    lux_values    : lux-dimming table, the minimum lux of each dimming level (0: not defined)
+    hysteresis_up, hysteresis_down: hysteresis of the dimming changes [%] (above / below the lux threshold of the level)
+    lux_median    : number of samples of the median spike rejection of the lux (1..LUX_MEDIAN_MAX)
+    lux_tau_s     : time constant of the lux smoothing [s] (in interrupt mode only the median is used)
+    mqtt_address  : MQTT broker address
+    mqtt_client_id: MQTT client identifier
+    mqtt_topic    : MQTT telemetry topic (the replay topic is <mqtt_topic>/replay)
+    encoding      : MQTT payload encoding
+    sensor        : light sensor selection (auto, none, or a driver name)
+    gpio_line     : GPIO line of the sensor interrupt, -1 if not used
+    latitude, longitude: location for the sun-set and sun-rise, north and east positive
+    ramp_ms       : duration of the dimming transitions [ms]
+    display_mode  : what the display shows
+    log_levels    : per subsystem level of the terminal messages (LogLevelDefault: the verbose input)
+    display_count : number of the displays
+    displays      : the settings of each display
+    page_count    : number of the pages of the display rotation
+    pages         : the pages of the display rotation
+    temp_topic    : MQTT topic of the outdoor temperature (empty: not subscribed)
+    tsl2561_package: the lux coefficients of the TSL2561
+    lux_scale, lux_offset: the per-board lux calibration (lux = lux_scale * sensor lux + lux_offset)
+    telemetry_deadband : lux deadband of the telemetry publishing [%]
+    telemetry_heartbeat: the longest time between two published telemetry records [s]
+    clock_sync_wait    : the longest wait for the NTP synchronization of the system clock at the start-up [s]
+    dimming_learn      : 1 if the lux tables are fitted to the brightness overrides (see dimming_learn_table), 0: the tables are used
 */
-void program_sleep(float sec, int verbose);
+struct clock_config
+{
+    int lux_values[16];
+    int hysteresis_up, hysteresis_down;
+    int lux_median;
+    int lux_tau_s;
+    char mqtt_address[128];
+    char mqtt_client_id[64];
+    char mqtt_topic[48];
+    enum payload_encoding encoding;
+    char sensor[16];
+    int gpio_line;
+    double latitude, longitude;
+    int ramp_ms;
+    enum display_mode display_mode;
+    int log_levels[LOG_SUBSYSTEMS];
+    int display_count;
+    struct display_config displays[DISPLAY_MAX];
+    int page_count;
+    struct page_config pages[PAGE_MAX];
+    char temp_topic[64];
+    const struct tsl2561_package *tsl2561_package;
+    float lux_scale, lux_offset;
+    int telemetry_deadband;
+    int telemetry_heartbeat;
+    int clock_sync_wait;
+    int dimming_learn;
+};
 
-/* FUNCTION OPENI2C_BUS
-This function opens the I2C bus
-Inputs:
-    adapter_nr: integer, describes which I2C bus to be opened
-    verbose: puts success information to the standard output
-    address: address of the device
-Output:
-    variable to store I2C bus handle
+/* PAYLOAD WRITER STRUCT
+output buffer of the payload encoders
+    buf : the buffer
+    size: size of the buffer
+    len : number of bytes written (if larger than size, the payload did not fit)
 */
-int openI2C_bus(int adapter_nr,unsigned char address, int verbose);
+struct payload_writer
+{
+    unsigned char *buf;
+    int size;
+    int len;
+};
 
-/* FUNCTION: GET_UTC_CORRECTION
-this function converts the time-zone and summer time information to a single hour difference between UTC and the system time
-Input:
-    struct tm *a_tm: including the current time
-Output:
-    hour difference between UTC and the system time
+/* TELEMETRY SAMPLE STRUCT
+compact, fixed layout telemetry sample stored in the offline telemetry ring file
+    timestamp     : time of the display update (seconds since epoch)
+    lux           : filtered lux value
+    ir, broadband : last light sensor raw values
+    dimming       : current dimming value
+    disp_err      : result of the last display update (0: OK, -1: failed)
+    range         : gain / integration time range of the light sensor (0xFF: no sensor)
 */
-int get_UTC_correction(struct tm *a_tm);
+struct telemetry_sample
+{
+    uint32_t timestamp;
+    float lux;
+    int32_t ir, broadband;
+    uint8_t dimming;
+    int8_t disp_err;
+    uint8_t range;
+    uint8_t reserved;
+};
 
-/* FUNCTION: MEASURE_LUX
-this functional reads the light sensor measured data, and calls the lux calculation, than returns the calculated lux
-Input:
-    int file: file descriptor of the light sensor
-    verbose: puts information to the standard output
-Output:
-    struct light_sensor_data: measured data and calculated lux
+/* TELEMETRY RING HEADER STRUCT
+header at the beginning of the offline telemetry ring file
+    magic   : TelemetryRingMagic, to detect foreign or corrupted files
+    version : layout version of the file
+    capacity: number of samples the file can store
+    head    : number of samples written (the next sample goes to head % capacity)
+    tail    : number of samples replayed (the oldest not replayed sample is at tail % capacity)
 */
-struct light_sensor_data measure_lux(int file, int verbose);
+struct telemetry_ring_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t tail;
+};
 
-/* FUNCTION: CALCULATE_LUX
-this function calculates the lux value from the measured light sensor data
-Input:
-    float broadband: bradband sensor measured value
-    float ir: infrared sensor measured value
-Output:
-    float lux   : the calculated lux value
+/* TELEMETRY RING STRUCT
+memory mapped, fixed size ring file of the telemetry samples which could not be published (survives restarts)
+    header : header of the mapped file
+    samples: sample storage of the mapped file
+    size   : size of the mapping
 */
-float calculate_lux(float broadband, float ir);
+struct telemetry_ring
+{
+    struct telemetry_ring_header *header;
+    struct telemetry_sample *samples;
+    size_t size;
+};
 
-// stuff to properly shutdown the process
-void term(int signo);
+/* LUX HISTORY TIER ENUM
+the tiers of the lux history file, the raw readings and their downsampled periods
+  LUX_HISTORY_RAW : the reading of each minute (lux, ir, broadband), 24 hours
+  LUX_HISTORY_5MIN: min / max / avg lux of 5 minutes, 30 days
+  LUX_HISTORY_HOUR: min / max / avg lux of an hour, 365 days
+  LUX_HISTORY_OVERRIDE: the brightness commands with the lux of the moment, the last LUX_HISTORY_OVERRIDES
+*/
+enum lux_history_tier
+{
+    LUX_HISTORY_RAW,
+    LUX_HISTORY_5MIN,
+    LUX_HISTORY_HOUR,
+    LUX_HISTORY_OVERRIDE
+};
 
-//------------------END OF FUNCTION DECLARATIONS------------------------
+/* LUX HISTORY SAMPLE STRUCT
+one record of the raw tier (16 bytes, a page holds a whole number of records)
+    timestamp: UNIX time of the minute [s], 0: empty slot
+    lux      : calibrated lux of the reading (not filtered)
+    ir, broadband: raw channel values of the reading
+*/
+struct lux_history_sample
+{
+    uint32_t timestamp;
+    float lux;
+    int32_t ir, broadband;
+};
 
-//-------------------------CONSTANTS------------------------------------
-// define adapter number of I2C bus
-const unsigned char adapter_nr = 1;
-// Define display I2C address
-const unsigned char disp_address = 0x70;
-// display internal address of first character
-const unsigned char Hour1_address = 0x00;
-// display internal address of second character
-const unsigned char Hour2_address = 0x02;
-// display internal address of third character
-const unsigned char Min1_address = 0x06;
-// display internal address of fourth character
-const unsigned char Min2_address = 0x08;
-// display internal address of colon character
-const unsigned char Colon_address = 0x04;
-// define constant for maximum dimming value
-const unsigned char MaxDimming = 15;
+/* LUX HISTORY AGGREGATE STRUCT
+one record of a downsampled tier (16 bytes, as the raw record)
+    timestamp: UNIX time of the start of the period [s], 0: empty slot
+    min, max, avg: lux of the readings of the period
+*/
+struct lux_history_aggregate
+{
+    uint32_t timestamp;
+    float min, max, avg;
+};
 
-#ifdef TSL2561
-  // create constant to define if light sensor shall be used
-  const int use_light_sensor = 1;
-  // Sensor I2C address
-  const unsigned char sensor_address = 0x39;
-  // Base Command value
-  const unsigned char Sensor_command = 0x80;
-  // Command extension to read word
-  const unsigned char Sensor_Read_Word = 0x20;
-  // Command value to change power on/off
-  const unsigned char Sensor_Power = 0x0;
-  // The TIMING register defaults to 02h at power on. - which should be good, anyway to change it the command value extension
-  const unsigned char Sensor_Timing = 0x1;
-  // Command value to change interrupt settings
-  const unsigned char Sensor_interrupt = 0x6;
-  // ADC Channel Data Registers (Ch - Fh)
-  const unsigned char Broadband_Low = 0xC;
-  const unsigned char Broadband_High = 0xD;
-  const unsigned char IR_Low = 0xE;
-  const unsigned char IR_High = 0xF;
-#endif
+/* LUX HISTORY OVERRIDE STRUCT
+one record of the override tier: the brightness the user has chosen at the light (a point of the dimming learning)
+    timestamp: UNIX time of the brightness command [s], 0: empty slot
+    lux      : filtered lux at the command (the lux the dimming follows)
+    level    : brightness of the command (0..15)
+    reserved : 0 (16 bytes, as the other records)
+*/
+struct lux_history_override
+{
+    uint32_t timestamp;
+    float lux;
+    int32_t level;
+    uint32_t reserved;
+};
 
-#ifdef TSL2591
-  // create constant to define if light sensor shall be used
-  const int use_light_sensor = 1;
-  // Sensor I2C address
-  const unsigned char sensor_address = 0x29;
-  const unsigned char command_bit    = 0xA0;
-  //Register (0x00)
-  const unsigned char enable_register = 0x00;
-  const unsigned char enable_poweron  = 0x01;
-  const unsigned char enable_poweroff = 0x00;
-  const unsigned char enable_aen      = 0x02;
+/* LUX HISTORY HEADER STRUCT
+first page of the lux history file, it is only written when the file is created (the tiers follow on their own pages)
+    magic   : LuxHistoryMagic, to detect foreign or corrupted files
+    version : layout version of the file
+    capacity: number of records of each tier
+*/
+struct lux_history_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity[LUX_HISTORY_TIERS];
+};
 
-  const unsigned char control_register = 0x01;
-  const unsigned char sreset           = 0x80;
-  //AGAIN
-  const unsigned char low_gain         = 0X00; //Low gain (1x)
-  const unsigned char medium_gain      = 0X10; //Medium gain (25x)
-  const unsigned char high_gain        = 0X20; //High gain (428x)
-  const unsigned char max_gain         = 0x30; //Max gain (9876x)
-  //ATIME
-  const unsigned char atime_100ms      = 0x00; //100 millis    MAX COUNT 36863 
-  const unsigned char atime_200ms      = 0x01; //200 millis    MAX COUNT 65535 
-  const unsigned char atime_300ms      = 0x02; //300 millis
-  const unsigned char atime_400ms      = 0x03; //400 millis
-  const unsigned char atime_500ms      = 0x04; //500 millis
-  const unsigned char atime_600ms      = 0x05; //600 millis
-  // Chip ID
-  const unsigned char id_register      = 0x12;
-  // ADC Channel Data Registers
-  const unsigned char Broadband_Low = 0x14;
-  const unsigned char Broadband_High = 0x15;
-  const unsigned char IR_Low = 0x16;
-  const unsigned char IR_High = 0x17;
-  
-  //lux calculation constant
-  const float lux_df = 762.0;
-#endif
+/* LUX HISTORY BUCKET STRUCT
+the readings of the current period of a downsampled tier, the record is written when the period is over
+    start: start of the period [s], 0: no reading yet
+    min, max, sum: lux of the readings
+    count: number of readings
+*/
+struct lux_history_bucket
+{
+    uint32_t start;
+    float min, max;
+    double sum;
+    int count;
+};
 
-#ifdef VEML7700
-  // create constant to define if light sensor shall be used
-  const int use_light_sensor = 1;
-  // Sensor I2C address
-  const unsigned char sensor_address = 0x10;
-  
-  // config
-  const unsigned char configuration_register    = 0x00;
-  const unsigned short als_poweroff             = 0x1;
-  const unsigned short als_poweron              = 0x0;
-  const unsigned short interrupt_disable        = 0x0;
-  const unsigned short als_pers_1               = 0x0;
-  const unsigned short als_pers_2               = 0x10;
-  const unsigned short als_pers_4               = 0x20;
-  const unsigned short als_pers_8               = 0x30;
-  const unsigned short als_integration_time_25  = 0x300;
-  const unsigned short als_integration_time_50  = 0x200;
-  const unsigned short als_integration_time_100 = 0x00;
-  const unsigned short als_integration_time_200 = 0x40;
-  const unsigned short als_integration_time_400 = 0x80;
-  const unsigned short als_integration_time_800 = 0xC0;
-  const unsigned short als_gain_1p4             = 0x1800;
-  const unsigned short als_gain_1p8             = 0x1000;
-  const unsigned short als_gain_2               = 0x800;
-  const unsigned short als_gain_1               = 0x0;
-  
-  //power save
-  const unsigned char power_saving_register = 0x03;
-  const unsigned char psm_1                 = 0x0;
-  const unsigned char psm_2                 = 0x02;
-  const unsigned char psm_3                 = 0x04;
-  const unsigned char psm_4                 = 0x06;
-  const unsigned char psm_en               = 0x01;
-  const unsigned char psm_dis              = 0x0;
-  
-  // measurements
-  const unsigned char als_register          = 0x04;
-  const unsigned char white_register        = 0x05;
-  
-#endif
+/* LUX HISTORY STRUCT
+memory mapped, fixed size archive of the lux readings (survives restarts), each tier is an append-only ring on its own pages
+the write position is not stored: it is found by the newest timestamp at the open, so a record dirties only its own page
+    header : header of the mapped file (NULL: no history)
+    size   : size of the mapping
+    records: first record of each tier (struct lux_history_sample or struct lux_history_aggregate)
+    head   : slot of the next record of each tier
+    filled : number of valid records of each tier
+    newest : timestamp of the newest record of each tier
+    buckets: the current period of the downsampled tiers (index: tier - 1, the 5 minute and the hour tier)
+*/
+struct lux_history
+{
+    struct lux_history_header *header;
+    size_t size;
+    void *records[LUX_HISTORY_TIERS];
+    uint32_t head[LUX_HISTORY_TIERS];
+    uint32_t filled[LUX_HISTORY_TIERS];
+    uint32_t newest[LUX_HISTORY_TIERS];
+    struct lux_history_bucket buckets[LUX_HISTORY_HOUR];
+};
 
+/* LUX HISTORY QUERY STRUCT
+single slot hand-over of the result of a history command from the main loop to the publisher thread
+    pending: 1 while the result waits for the publishing (set by the main loop, cleared by the publisher thread)
+    tier   : the tier of the records
+    count  : number of records, the oldest first
+    records: the records of the tier
+*/
+struct lux_history_query
+{
+    atomic_int pending;
+    enum lux_history_tier tier;
+    int count;
+    union
+    {
+        struct lux_history_sample samples[LUX_HISTORY_QUERY_MAX];
+        struct lux_history_aggregate aggregates[LUX_HISTORY_QUERY_MAX];
+        struct lux_history_override overrides[LUX_HISTORY_QUERY_MAX];
+    } records;
+};
 
-#ifndef TSL2561
-  #ifndef TSL2591
-    #ifndef VEML7700
-      const int use_light_sensor = 0;
-      const unsigned char sensor_address = 0x0;
-    #endif
-  #endif
-#endif
+/* DIMMING LEARN BLOCK STRUCT
+a point of the dimming learning (an override or a level of the configured table), or a block of pooled points
+of the monotone regression
+    lux_low, lux_high: the lowest and the highest lux of the points
+    weight: sum of the weights of the points
+    sum   : weighted sum of the levels of the points (the fitted level is sum / weight)
+*/
+struct dimming_learn_block
+{
+    float lux_low, lux_high;
+    double weight, sum;
+};
 
-// filename which conatains lux values for dimming
-const char lux_file[] = "lux_dimming.txt";
+/* TELEMETRY QUEUE STRUCT
+bounded lock-free single-producer (main loop) single-consumer (publisher thread) queue
+    records: ring buffer of the queued records
+    head   : index of the next record to be written (only modified by the producer)
+    tail   : index of the next record to be read (only modified by the consumer)
+    dropped: number of records dropped because the queue was full
+    ready  : posted by the producer after each push, to wake up the consumer
+*/
+struct telemetry_queue
+{
+    struct telemetry_record records[TELEMETRY_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+    sem_t ready;
+};
 
+/* COMMAND KIND ENUM
+the commands of the MQTT command topic (<parent of mqtt_topic>/<client id>/cmd), the payload is "<command> [<argument>]"
+  COMMAND_BRIGHTNESS: "brightness <0..15>|auto", the brightness of all displays, auto: the dimming follows the sensor / sun again
+  COMMAND_MODE      : "mode hhmm|blink|mmss|hwblink|lux", the display mode (till the next change of the configuration file)
+  COMMAND_PAGE      : "page <name>", the first page of the kind in the rotation is shown at once
+  COMMAND_TEXT      : "text <text>", the content of the text page, the text page is shown at once (if it is in the rotation)
+  COMMAND_RELOAD    : "reload", the configuration file is read again
+  COMMAND_CALIBRATE : "calibrate <reference lux>|reset", a point of the lux calibration (the sensor is read at once), reset: no calibration
+  COMMAND_HISTORY   : "history raw|5min|hour|override [<count> [<skip>]]", the newest records of the lux history tier (skip: newer records
+                      left out) are published on <parent of mqtt_topic>/<client id>/history
+*/
+enum command_kind
+{
+    COMMAND_BRIGHTNESS,
+    COMMAND_MODE,
+    COMMAND_PAGE,
+    COMMAND_TEXT,
+    COMMAND_RELOAD,
+    COMMAND_CALIBRATE,
+    COMMAND_HISTORY
+};
 
-//--------------------END OF CONSTANTS----------------------------------
+/* CLOCK COMMAND STRUCT
+one parsed command of the MQTT command topic
+    kind : the command
+    value: brightness (-1: auto), display mode or history tier
+    page : the page driver of the page command
+    text : the text of the text command
+    lux  : the reference lux of the calibrate command (-1: reset)
+    count, skip: the records of the history command
+*/
+struct clock_command
+{
+    enum command_kind kind;
+    int value;
+    const struct page_driver *page;
+    char text[16];
+    float lux;
+    int count, skip;
+};
 
-//-------------------------GLOBAL VARIABLES-----------------------------
-// variable created to handle external KILL signal
-volatile sig_atomic_t done = 0;
+/* COMMAND QUEUE STRUCT
+bounded lock-free single-producer (thread of the MQTT client) single-consumer (main loop) queue
+    commands: ring buffer of the queued commands
+    head    : index of the next command to be written (only modified by the producer)
+    tail    : index of the next command to be read (only modified by the consumer)
+    event_fd: eventfd written by the producer after each push, it wakes up the main loop (CLOCK_EVENT_COMMAND)
+*/
+struct command_queue
+{
+    struct clock_command commands[COMMAND_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    int event_fd;
+};
 
-//---------------------END OF GLOBAL VARIABLES--------------------------
+/* MQTT PUBLISHER STRUCT
+state of the MQTT publisher thread, all MQTT client calls are done on this thread
+    thread   : the publisher thread
+    started  : 1 if the client is created and the thread is running (the stop does nothing without it)
+    queue    : telemetry queue fed by the main loop
+    stop     : set to 1 to stop the thread
+    ring     : offline telemetry ring, replayed after reconnect
+    encoding : payload encoding
+    topic    : topic of the live telemetry
+    replay_topic: topic of the replayed telemetry
+    stats_topic: topic of the instrumentation statistics (<parent of mqtt_topic>/stats)
+    startup_topic: topic of the start-up timing (<parent of mqtt_topic>/<client id>/startup)
+    client_id: MQTT client identifier, sent in the statistics to identify the board
+    client   : MQTT client handle
+    conn_opts: MQTT connection options
+    temp_topic: topic of the outdoor temperature (empty: not subscribed)
+    cmd_topic: topic of the commands (<parent of mqtt_topic>/<client id>/cmd)
+    history_topic: topic of the history command results (<parent of mqtt_topic>/<client id>/history)
+    feed     : the received data of the display pages
+    commands : the received commands, consumed by the main loop
+    history  : the result of the last history command, filled by the main loop
+*/
+struct mqtt_publisher
+{
+    pthread_t thread;
+    int started;
+    struct telemetry_queue queue;
+    atomic_int stop;
+    struct telemetry_ring ring;
+    enum payload_encoding encoding;
+    char topic[64];
+    char replay_topic[72];
+    char stats_topic[64];
+    char startup_topic[128];
+    char client_id[64];
+    MQTTClient client;
+    MQTTClient_connectOptions conn_opts;
+    char temp_topic[64];
+    char cmd_topic[128];
+    char history_topic[128];
+    struct page_feed *feed;
+    struct command_queue commands;
+    struct lux_history_query history;
+};
 
+/* SENSOR DRIVER STRUCT
+a light sensor driver, the driver of the sensor found on the bus is bound at start-up
+    name    : name of the driver (stored in the probe cache file)
+    address : I2C address of the sensor
+    caps    : capability flags (SENSOR_CAP_...)
+    probe   : returns 1 if the sensor on the address is handled by this driver
+    init    : turns on (onoff = 1) or off (onoff = 0) the sensor
+    start   : starts a measurement, returns the time till the data is expected to be valid [ms] (negative on failure)
+    ready   : returns 1 if the data of the started measurement is valid, 0 if not yet (negative on failure)
+    read    : reads the measured data (both channels in one transaction if possible) and calculates the lux
+    shutdown: turns off the sensor
+    ranges       : gain / integration time range table, ordered by increasing sensitivity
+    range_count  : number of ranges
+    default_range: range set after the sensor init
+    set_range    : sets the gain and integration time of a range
+    set_thresholds : programs the low/high interrupt threshold (raw channel 0 counts) and enables the interrupt
+                     (only with SENSOR_CAP_THRESHOLD_INT, else NULL)
+    clear_interrupt: clears the pending interrupt (only with SENSOR_CAP_THRESHOLD_INT, else NULL)
+*/
+struct sensor_driver
+{
+    const char *name;
+    unsigned char address;
+    unsigned int caps;
+    int (*probe)(int file);
+    int (*init)(unsigned char onoff, int file);
+    int (*start)(int file, const struct sensor_range *range);
+    int (*ready)(int file);
+    struct light_sensor_data (*read)(int file, const struct sensor_range *range);
+    int (*shutdown)(int file);
+    const struct sensor_range *ranges;
+    int range_count;
+    int default_range;
+    int (*set_range)(int file, const struct sensor_range *range);
+    int (*set_thresholds)(int file, int low, int high);
+    int (*clear_interrupt)(int file);
+};
 
-int main (int argc, char *argv[])
+/* LIGHT MEASUREMENT STRUCT
+state of the non-blocking light measurement: the integration is started, and the main loop is woken up
+by the timer when the data is expected to be valid (the process does not sleep during the integration)
+    active  : 1 if a measurement is started and not yet read
+    failed  : 1 if the start of the measurement failed
+    polls   : number of ready checks of the measurement
+    timer_fd: timerfd created on CLOCK_MONOTONIC, expires at the expected ready time
+    range   : the current gain / integration time range of the sensor (-1: not yet set after the sensor init)
+*/
+struct light_measurement
 {
-    // prepare function to be killed properly
-    struct sigaction action;
-    memset(&action, 0, sizeof(struct sigaction));
-    action.sa_handler = term;
-    sigaction(SIGTERM, &action, NULL);
-    sigaction(SIGINT, &action, NULL);
-    sigaction(SIGTRAP, &action, NULL);
+    int active;
+    int failed;
+    int polls;
+    int timer_fd;
+    int range;
+};
 
-    //allocate lux_path to calling command
-    char lux_path[50];
-    char filepath[50];
-    snprintf(lux_path,50, "%s",argv[0]);
-    //Get executable location from argv[0] (see main function), and append with lux_file
-    char *s = strrchr(lux_path, '/');
-    if (s) {
-        *s = '\0';
-    }
-    strcpy(filepath, lux_path);
-    strcat(filepath, "/");
-    strcat(filepath, lux_file);
-    //snprintf(filepath,50,"%s/%s", lux_path, lux_file);
+//---------------------END OF STRUCTURE DEFINITIONS--------------------
 
-    // create variables to have terminal messages
-    int verbose = 0;
-    // if the program is started with a number argument above or equal to 1, than turn on terminal messages
-    if (argc > 1)
-    {
-        verbose = atol(argv[1]);
-    }
+//------------------------FUNCTION DECLARATIONS------------------------
 
-    // define variable to store I2C bus handle
-    int display_file_descriptor;
-    // define variable to store I2C bus handle
-    int sensor_file_descriptor;
+/* FUNCTION: GET_HEX_CODE
+sub-function is created to get hex code for a single digit =meaning this shall be called four times for HH:MM format
+ input
+        anum: a number value between 0-9
+output
+        integer with the value representing the digit anum on the display memory (the SegmentFont glyph of the digit)
+*/
+unsigned char get_hex_code(int anum);
 
-    // open th I2C bus for the communication with the display (but no actual communication yet)
-    display_file_descriptor = openI2C_bus(adapter_nr,disp_address, verbose);
+/* FUNCTION: RENDER_TEXT
+this function renders a text into the four digits and the colon of the display refresh values (the dimming is unchanged)
+the characters are looked up in SegmentFont, a '.' lights the decimal point of the previous digit, a ':' the colon
+a text longer than the four digits is shown as "----"
+ inputs:
+    values          : the display refresh values to be filled
+    text            : the text to be shown
+    justify_right   : 1 to justify the text to the right, 0 to the left
+*/
+void render_text(struct disp_refresh_values *values, const char *text, int justify_right);
 
-    // open th I2C bus for the communication with the sensor (but no actual communication yet)
-    int light_sensor_available = 0;
-    int light_sensor_dead = 0;
-    int light_sensor_dead_lim = 5;
-    if (use_light_sensor)
-    {
-        sensor_file_descriptor = openI2C_bus(adapter_nr,sensor_address, verbose);
-        light_sensor_available = 1;
-    }
+/* FUNCTION: RENDER_NUMBER
+this function renders a number right justified into the four digits of the display refresh values
+the number is shown with as many of the decimals as fit, a larger number in thousands with a "k" suffix, "----" if it does not fit
+ inputs:
+    values          : the display refresh values to be filled
+    value           : the number to be shown
+    decimals        : the most decimals to be shown
+*/
+void render_number(struct disp_refresh_values *values, float value, int decimals);
+
+/* FUNCTIONS: TIME_PAGE_..., DATE_PAGE_..., TEMP_PAGE_...
+the page drivers: stamp (changes with the content of the page), render (draws the page)
+    time: the time in the display mode (or the lux in the lux mode), ---- till the system clock is synchronized
+    date: DD.MM, ---- till the system clock is synchronized
+    temp: the outdoor temperature received on MQTT, e.g. 21.5* (* is the degree sign), --* before the first message
+    text: the text of the last text command (left justified, blank before the first command)
+*/
+long time_page_stamp(const struct page_context *ctx);
+void time_page_render(const struct page_context *ctx, struct disp_refresh_values *values);
+long date_page_stamp(const struct page_context *ctx);
+void date_page_render(const struct page_context *ctx, struct disp_refresh_values *values);
+long temp_page_stamp(const struct page_context *ctx);
+void temp_page_render(const struct page_context *ctx, struct disp_refresh_values *values);
+long text_page_stamp(const struct page_context *ctx);
+void text_page_render(const struct page_context *ctx, struct disp_refresh_values *values);
+
+/* FUNCTION: FIND_PAGE_DRIVER
+this function looks up a page driver by its name
+Input:
+    name: name of the page (time, date, temp, text)
+Output:
+    the page driver, or NULL if the name is unknown
+*/
+const struct page_driver *find_page_driver(const char *name);
 
-    //set up MQTT
-    char mqtt_payload[100];
-    int MQTT_Connected = 0;
-    MQTTClient client;
-    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-    MQTTClient_message pubmsg = MQTTClient_message_initializer;
-    MQTTClient_deliveryToken token;
+/* FUNCTION: PAGE_SCHEDULER_INIT
+this function creates the rotation timer and the data eventfd of the page scheduler (a failure is not fatal:
+without the timer the first page is shown, without the eventfd the received data is shown at the next minute change)
+Input:
+    pages: the page scheduler
+*/
+void page_scheduler_init(struct page_scheduler *pages);
 
-    MQTTClient_create(&client, ADDRESS, CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
-    conn_opts.keepAliveInterval = 70;
-    conn_opts.cleansession = 1;
+/* FUNCTION: PAGE_SCHEDULER_CONFIGURE
+this function sets the pages of the rotation, the first page is shown, and the rotation timer is armed if there are more pages
+Input:
+    pages: the page scheduler
+    config: the pages of the configuration
+*/
+void page_scheduler_configure(struct page_scheduler *pages, const struct clock_config *config);
 
-    // memory allocation for lux based dimming
-    int lux_values[16] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    // is the lux value set up?
-    int lux_read = 0;
+/* FUNCTION: PAGE_SCHEDULER_ROTATE
+this function is called when the rotation timer expires: the next page is made visible (it is drawn at the next page_draw),
+and the timer is armed for its display time
+Input:
+    pages: the page scheduler
+Output:
+    1 if the visible page is changed, 0 if not, negative on failure
+*/
+int page_scheduler_rotate(struct page_scheduler *pages);
 
-    // The location coordinates (Budapest) as double
-    double Ln_deg    = 47.5;
-    double Lw_deg    = -19;
+/* FUNCTION: PAGE_SCHEDULER_SHOW
+this function makes the first page of a kind visible at once (it is drawn at the next page_draw), the rotation goes on from it
+Input:
+    pages: the page scheduler
+    driver: the kind of the page
+Output:
+    1 if the visible page is changed, 0 if it is already visible, -1 if the rotation has no such page
+*/
+int page_scheduler_show(struct page_scheduler *pages, const struct page_driver *driver);
 
-    // create a sunup type struct, with invalid (not HH:MM) values, {-1,-1,-1,-1}
-    struct sunup thissunup={-1,-1,-1,-1};
+/* FUNCTION: PAGE_SHOWS_CLOCK
+Input:
+    pages: the page scheduler
+Output:
+    1 if the visible page changes with the time (the per-second refresh and the blinking are only needed then), 0 if not
+*/
+int page_shows_clock(const struct page_scheduler *pages);
 
-    // create dimming status structure, and fill it with initial values
-    //      adimming.lightchange=0;
-    //      adimming.currlight=0;
-    //      adimming.dimming_max=15;
-    //      adimming.dimming_min=0;
-    // currlight is set to -1 to ensure that the starting value is really set
-    struct display_dimming adimming={0, -1, MaxDimming, 0};
+/* FUNCTION: PAGE_DATA_READ
+this function reads the pending wake-ups of the data eventfd (CLOCK_EVENT_PAGE_DATA)
+Input:
+    pages: the page scheduler
+Output:
+    the number of the wake-ups, negative on failure
+*/
+int page_data_read(struct page_scheduler *pages);
 
-    // create structure variable for display refresh values
-    struct disp_refresh_values adisp_refresh_values;
+/* FUNCTION: PAGE_DRAW
+this function draws the visible page if it is not yet drawn or its content changed (the page stamp changed),
+the pages which are not visible are not drawn
+Input:
+    pages: the page scheduler
+    ctx: the data of the pages
+    values: the display refresh values, unchanged if the page is not drawn
+Output:
+    1 if the page is drawn (the display shall be updated), 0 if the frame is unchanged
+*/
+int page_draw(struct page_scheduler *pages, const struct page_context *ctx, struct disp_refresh_values *values);
 
-    // create time management structure to get the current time and the used timezone, summer time information
-    struct tm *a_tm;
+/* FUNCTION: PAGE_SCHEDULER_CLOSE
+this function closes the timer and the eventfd of the page scheduler
+Input:
+    pages: the page scheduler
+*/
+void page_scheduler_close(struct page_scheduler *pages);
 
-    // create a variable to show if this is the first entering to minute change "if", and to show that in this case there is no need for a 55sec wait afterwards
-    int dontwait=1;
-    int sleep_sec = 50;
+/* FUNCTION: DISPLAY_INIT
+sub-function is created to turn on and turn off the display
+ inputs
+        onoff: 1 to turn the display and the oscillator on; 0 to turn it off
+ output: ----
+*/
+int display_init(unsigned char onoff,int file);
 
-    // define variable for I2C bus read/wrtie event results
-    int res=0;
-    int disp_status;
+/* FUNCTION: SENSOR_INIT
+sub-function is created to turn on and turn off the light sensor, via the bound sensor driver
+ inputs
+        sensor: the sensor driver
+        onoff: 1 to turn the sensor on; 0 to turn it off
+ output: ----
+*/
+int sensor_init(const struct sensor_driver *sensor, unsigned char onoff, int file);
 
-    // create int to store previous time value, set it to a not a minute value (e.g. 66)
-    int amin=66;
+/* FUNCTION: FIND_SENSOR_DRIVER
+this function looks up a sensor driver by name
+Input:
+    name: name of the driver (e.g. tsl2561)
+Output:
+    the driver, or NULL if the name is unknown
+*/
+const struct sensor_driver *find_sensor_driver(const char *name);
 
-    // define variable to store lux value
-    float lux = 0.0;
-    struct light_sensor_data ls_data;
-    ls_data.lux = 0.0;
-    ls_data.s_ir = 0;
-    ls_data.s_broadband = 0;
+/* FUNCTION: SENSOR_PROBE
+this function finds the light sensor on the bus (cached driver first, than all known drivers), and caches the result
+Input:
+    bus: the I2C bus to be probed
+    cache_path: path of the probe cache file
+Output:
+    the bound driver, or NULL if no sensor is found
+*/
+const struct sensor_driver *sensor_probe(struct i2c_bus *bus, const char *cache_path);
 
-    // Turn on display
-    disp_status=display_init(1, display_file_descriptor, verbose);
-    if ((disp_status < 0) && verbose)
-    {
-        printf("DISPLAY INIT FAILED\n");
-    }
+/* FUNCTIONS: TSL2561_..., TSL2591_..., VEML7700_...
+the sensor drivers: probe, init (turn on/off), start, ready, read, shutdown, set_range, set_thresholds, clear_interrupt
+*/
+int tsl2561_probe(int file);
+int tsl2561_init(unsigned char onoff, int file);
+int tsl2561_start(int file, const struct sensor_range *range);
+int tsl2561_ready(int file);
+struct light_sensor_data tsl2561_read(int file, const struct sensor_range *range);
+int tsl2561_set_range(int file, const struct sensor_range *range);
+int tsl2561_shutdown(int file);
+int tsl2561_set_thresholds(int file, int low, int high);
+int tsl2561_clear_interrupt(int file);
+int tsl2591_probe(int file);
+int tsl2591_init(unsigned char onoff, int file);
+int tsl2591_start(int file, const struct sensor_range *range);
+int tsl2591_ready(int file);
+struct light_sensor_data tsl2591_read(int file, const struct sensor_range *range);
+int tsl2591_set_range(int file, const struct sensor_range *range);
+int tsl2591_shutdown(int file);
+int tsl2591_set_thresholds(int file, int low, int high);
+int tsl2591_clear_interrupt(int file);
+int veml7700_probe(int file);
+int veml7700_init(unsigned char onoff, int file);
+int veml7700_start(int file, const struct sensor_range *range);
+int veml7700_ready(int file);
+struct light_sensor_data veml7700_read(int file, const struct sensor_range *range);
+int veml7700_set_range(int file, const struct sensor_range *range);
+int veml7700_shutdown(int file);
+
+/* FUNCTION: SENSOR_ARM_THRESHOLDS
+this function programs the interrupt thresholds of the sensor around the lux band of the current dimming,
+so the sensor interrupt is raised only if the light crosses into another dimming band
+(with more displays following the sensor, the intersection of their bands is used)
+Input:
+    sensor: the sensor driver (with SENSOR_CAP_THRESHOLD_INT)
+    file: file descriptor of the light sensor
+    ls_data: the last measurement (the lux band is converted to raw counts with the counts/lux ratio of its driver lux)
+    displays: the displays (their lux-dimming curve and current dimming)
+    count: number of the displays
+    range: the current gain / integration time range of the sensor (the counts are compared in this range)
+    scale, offset: the lux calibration (the bands are in calibrated lux)
+Output:
+    negative value if an I2C transaction failed
+*/
+int sensor_arm_thresholds(const struct sensor_driver *sensor, int file, struct light_sensor_data ls_data, const struct clock_display *displays, int count, int range,
+                          float scale, float offset);
+
+/* FUNCTION: SENSOR_SELECT_RANGE
+this function selects the gain / integration time range for the next measurement from the counts of the last one:
+the range is kept while the counts stay between RangeKeepFillLow and RangeKeepFillHigh of its saturation, else
+the counts are scaled to each range, and the most sensitive range is selected where the expected counts
+stay below RangeTargetFill of the saturation (a saturated measurement selects the least sensitive range)
+Input:
+    sensor: the sensor driver
+    ls_data: the last measurement
+Output:
+    index of the selected range
+*/
+int sensor_select_range(const struct sensor_driver *sensor, struct light_sensor_data ls_data);
 
-    // Turn on sensor
-    if (light_sensor_available)
-    {
-      res=sensor_init(1, sensor_file_descriptor, verbose);
-      if ((res < 0) && verbose)
-      {
-          // light_sensor_available = 0;
-          printf("LIGHT SENSOR INIT FAILED\n");
-      }
-    }
+/* FUNCTION: GPIO_OPEN_EVENT
+this function requests the falling edge events of a GPIO line via the gpiochip character device
+(the INT output of the light sensors is active low)
+Input:
+    chip_path: path of the gpiochip device
+    line: line offset on the gpiochip
+Output:
+    file descriptor of the line events (readable if an edge is detected), or -1 on failure
+*/
+int gpio_open_event(const char *chip_path, int line);
 
-    // continous operation (while(1))
-    // done parameter can be changed by application kill signal for proper shutdown
-    while(!done)
-    {
-        // create variable where the time information will be stored [type: time_t]
-        time_t now=time(NULL);
-        // get the current time from the system
-        a_tm = localtime(&now);
+/* FUNCTION: READ_LUX_VALUES
+sub-function is created to read lux values for dimming from file
+    file name is stored in lux_file variable
+        the file shall contain lux dimming pairs in each row, both as integer values
+    input: pointer to the array to be filled
+*/
+void read_lux_values(int * lux_array, char * filepath);
 
-        // if it is 4 o'clock in the morning, or the sunset is not yet calculated, than let's calculate it
-        if (!((light_sensor_available == 1) && (use_light_sensor == 1)))
-        {
-            if (((a_tm->tm_hour == 4) && (a_tm->tm_min == 0))||(thissunup.set_hour == -1))
-            {
-                // calculate sun-set and sun-rise times
-                thissunup=calculate_sun_up(Ln_deg, Lw_deg,verbose);
-                // output at every loglevel
-                if (verbose)
-                {
-                    printf("sun set is expected at %02d:%02d\n", thissunup.set_hour, thissunup.set_min);
-                    printf("sun rise is expected at %02d:%02d\n", thissunup.rise_hour, thissunup.rise_min);
-                }
+/* FUNCTION: CONFIG_LOAD
+this function parses the configuration file into the config struct (the defaults are set first)
+the file contains "key = value" lines, "#" starts a comment; the keys are:
+    lux = <lux> <dimming>      (one line per dimming level, if none is given lux_dimming.txt is read)
+    display = <address> sensor|sun  (one line per display, the lux lines after it are the own table of the display,
+                                     without display lines one display is driven at disp_address)
+    page = time|date|temp|text <seconds> (one line per page of the display rotation, in the order of the rotation,
+                                     without page lines the time is shown)
+    hysteresis_up, hysteresis_down [%], lux_median, lux_tau_s [s], tsl2561_package = t|cs, lux_scale, lux_offset,
+    mqtt_address, mqtt_client_id, mqtt_topic, temp_topic, encoding, telemetry_deadband [%], telemetry_heartbeat [s],
+    clock_sync_wait [s], dimming_learn = 0|1, sensor, gpio_line, location = <lat>,<lon>, ramp_ms, display_mode,
+    log_clock, log_display, log_sensor, log_mqtt, log_sched  (-1: none, 0: errors .. 3: debug)
+Input:
+    config: the result, only to be used if the file is valid
+    path: path of the configuration file (a missing file is not an error, the defaults are used)
+    lux_path: path of the legacy lux-dimming file
+Output:
+    0 if the configuration is valid, -1 otherwise (unknown key, invalid value, or not increasing lux table)
+*/
+int config_load(struct clock_config *config, const char *path, const char *lux_path);
 
-                // if currlight is not yet initialized
-                if (dontwait)//(currlight==-1)
-                {
-                    // if the current time is smaller or equal than the sun-rise time, or higher than the sun-set time, than
-                    if (((a_tm->tm_hour*100+a_tm->tm_min) <= (thissunup.rise_hour*100+ thissunup.rise_min)) ||
-                        ((a_tm->tm_hour*100+a_tm->tm_min) > (thissunup.set_hour*100+ thissunup.set_min)))
-                    {
-                        // set the display light to minimum
-                        adimming.currlight=adimming.dimming_min;
-                    }
-                    else
-                    {
-                        // else set it to the maximum
-                        adimming.currlight=adimming.dimming_max;
-                    }
-                }
-            }
-        }
-        else
+/* FUNCTION: CONFIG_APPLY_OPTIONS
+this function applies the command line options on the config (the options override the configuration file)
+Input:
+    config: the config to be changed
+    argc, argv: the arguments of the process
+Output:
+    0 if the options are valid, -1 otherwise
+*/
+int config_apply_options(struct clock_config *config, int argc, char *argv[]);
+
+/* FUNCTION: CONFIG_WATCH
+this function creates an inotify watch on the directory of the configuration file (the editors replace the file by a rename,
+so the directory is watched, not the file)
+Input:
+    dir: the directory of the configuration file
+Output:
+    the inotify file descriptor, -1 on failure (the configuration is only read at the start-up)
+*/
+int config_watch(const char *dir);
+
+/* FUNCTION: CONFIG_CHANGED
+this function reads the pending inotify events, and checks if the configuration file or the lux-dimming file was written
+Input:
+    fd: the inotify file descriptor
+Output:
+    1 if one of the files was changed, 0 otherwise
+*/
+int config_changed(int fd);
+
+/* FUNCTION: CONFIG_PRINT
+this function writes the settings to the standard output
+Input:
+    config: the settings
+    path: path of the configuration file
+*/
+void config_print(const struct clock_config *config, const char *path);
+
+/* FUNCTION: GET_DISPL_VALUES
+sub-function create the hex values for the display settings
+ inputs:
+    struct tm *a_tm                 : including the current time
+    currlight                       : the required dimming value
+    mode                            : display mode (HH:MM or MM:SS, steady or blinking colon)
+ output: struct
+    displ_h1 - memory content of the first character of the hour (of the minute in MM:SS mode)
+    displ_h2 - memory content of the second character of the hour (of the minute in MM:SS mode)
+    disp_min1 - memory content of the first character of the minute (of the second in MM:SS mode)
+    disp_min2 - memory content of the second character of the minute (of the second in MM:SS mode)
+    disp_dim : dimming
+    disp_colon: colon, in blinking colon mode it is on in the even seconds
+*/
+struct disp_refresh_values get_displ_values(struct tm *a_tm,unsigned char currlight, enum display_mode mode);
+
+/* FUNCTION: DISPLAY_FRAME_COMPOSE
+this function writes the display refresh values into the display framebuffer (no I2C communication)
+ inputs:
+    fb                      :   the framebuffer to be filled
+    adisp_refresh_values    :   contains the register values of the display segments
+*/
+void display_frame_compose(struct display_framebuffer *fb, struct disp_refresh_values adisp_refresh_values);
+
+/* FUNCTION: DISPLAY_FLUSH
+this function sends the changed bytes of the framebuffers to the display devices (adjacent changes are merged into one block write)
+the writes of all displays are sent as one I2C_RDWR transfer, an offline display (see struct clock_display) in its own transfer
+ inputs:
+    displays                :   the displays to be sent
+    count                   :   number of the displays
+    file                    :   bus handler
+*/
+int display_flush(struct clock_display *displays, int count, int file);
+
+/* FUNCTION: DISPLAY_UPDATE
+this function send the defined values to the display devices via the I2C bus
+ inputs:
+    adisp_refresh_values    :   contains the register values of the display segments (the same on all displays)
+    displays                :   the displays
+    ramp                    :   the dimming ramp (the brightness of each display)
+    file                    :   bus handler
+*/
+int display_update(struct disp_refresh_values adisp_refresh_values, struct clock_display *displays, const struct dimming_ramp *ramp, int file);
+
+/* FUNCTION: DISPLAY_SET_BLINK
+this function sets the blinking of the whole display by the HT16K33 (the display stays turned on)
+ inputs:
+    blink                   :   blink frequency setting (Display_blink_off, Display_blink_1Hz)
+    file                    :   bus handler
+*/
+int display_set_blink(unsigned char blink, int file);
+
+/* FUNCTION: DISPLAY_CLOCK_EFFECTS
+this function starts or stops the per-second refresh, and in the hwblink mode the blinking of the displays,
+they are only needed while the visible page shows the time
+ inputs:
+    clock_shown             :   1 if the visible page shows the time
+    mode                    :   the display mode
+    refresher               :   the per-second refresh
+    displays                :   the displays
+    count                   :   number of the displays
+    bus                     :   the I2C bus
+*/
+void display_clock_effects(int clock_shown, enum display_mode mode, struct refresh_scheduler *refresher, const struct clock_display *displays,
+                           int count, struct i2c_bus *bus);
+
+/* FUNCTION: PARSE_DISPLAY_MODE
+this function converts the name of the display mode (hhmm, blink, mmss, hwblink, lux) to enum display_mode
+Input:
+    name: name of the display mode
+    mode: the result
+Output:
+    0 if the name is known, -1 otherwise
+*/
+int parse_display_mode(const char *name, enum display_mode *mode);
+
+/* FUNCTION: DIMMING_RAMP_START
+this function starts (or retargets) the dimming ramp from the current brightness levels to the targets
+the first step is done at once, the following ones are spread over the ramp duration (but at least RampMinStepMs apart),
+so a transition needs at most MaxDimming brightness commands
+if the brightness on a display is not yet known, its target is set without ramp
+Input:
+    ramp: the dimming ramp
+    displays: the displays, the targets are their current dimming
+*/
+void dimming_ramp_start(struct dimming_ramp *ramp, const struct clock_display *displays);
+
+/* FUNCTION: DIMMING_RAMP_STEP
+this function is called when the ramp timer expires: the brightness is stepped towards the targets,
+and only the brightness commands are sent (the display RAM is unchanged, see display_flush)
+Input:
+    ramp: the dimming ramp
+    displays: the displays
+    file: bus handler
+Output:
+    the result of the display flush
+*/
+int dimming_ramp_step(struct dimming_ramp *ramp, struct clock_display *displays, int file);
+
+/* FUNCTION: UPDATE_DIMMING
+this function is responsible to modify the current dimming settings in function of the current time
+at sun-set the dimming is set to the minimum, at sun-rise to the maximum (the transition is smoothed by the dimming ramp)
+in the polar night the dimming is kept at the minimum, in the polar day at the maximum
+inputs:
+ struct tm *a_tm                    : including the current time
+ struct display_dimming adimming    : including the previous dimming settings
+ struct sunup thissunup             : including the sun-set sun-rise times to know when the dimming needs to change
+output                              : including the current dimming settings (with memory)
+*/
+struct display_dimming update_dimming(struct tm *a_tm,struct display_dimming adimming,struct sunup thissunup);
+
+/* FUNCTION: UPDATE_DIMMING_BY_LUX
+this function is responsible to modify the current dimming settings in function of the measured lux
+the level is looked up in the log-lux bucket table of the compiled curve, and changed only if the lux is out of
+the hysteresis band of the current level
+inputs:
+ float lux                          : measured lux value
+ const struct dimming_curve *curve  : compiled look-up table for dimming vs lux
+ struct display_dimming adimming    : including the previous dimming settings
+output                              : including the current dimming settings (with memory)
+*/
+struct display_dimming update_dimming_by_lux(float lux, const struct dimming_curve *curve, struct display_dimming adimming);
+
+/* FUNCTION: LUX_TABLE_VALID
+this function checks that the minimum lux of the defined dimming levels is increasing (the dimming bands shall not overlap)
+Input:
+    lux_values: the lux-dimming table
+Output:
+    -1 if a dimming level is not increasing, 0 if the table is valid
+*/
+int lux_table_valid(const int *lux_values);
+
+/* FUNCTION: DIMMING_CURVE_BUILD
+this function compiles the lux-dimming table into the dimming curve (dense levels, hysteresis bands, log-lux buckets)
+inputs:
+ curve                              : the curve to be built
+ lux_array                          : lux-dimming table, the minimum lux of each dimming level (0: not defined)
+ hysteresis_up, hysteresis_down     : hysteresis [%] above / below the lux threshold of the levels
+*/
+void dimming_curve_build(struct dimming_curve *curve, const int *lux_array, int hysteresis_up, int hysteresis_down);
+
+/* FUNCTION: DIMMING_CURVE_INDEX
+this function returns the index of the curve level of the lux without hysteresis (O(1) bucket lookup)
+inputs:
+ curve                              : the compiled curve
+ lux                                : lux value
+output                              : index in the levels of the curve
+*/
+int dimming_curve_index(const struct dimming_curve *curve, float lux);
+
+/* FUNCTION: LUX_FILTER_CONFIGURE
+this function sets the median size and the time constant of the lux filter, and clears its history
+inputs:
+ filter                             : the lux filter
+ median_size                        : number of samples of the median (1..LUX_MEDIAN_MAX)
+ tau_s                              : time constant of the smoother [s]
+*/
+void lux_filter_configure(struct lux_filter *filter, int median_size, float tau_s);
+
+/* FUNCTION: LUX_FILTER_UPDATE
+this function puts a valid lux sample into the filter, and returns the filtered lux
+if the previous sample is older than LuxFilterResetTaus time constants, the history is cleared (the old samples
+are not relevant any more), so the sample is taken at once; without smoothing (tau_s = 0, or smooth = 0) the history is kept
+inputs:
+ filter                             : the lux filter
+ lux                                : the measured lux
+ now                                : monotonic time of the sample [s]
+ smooth                             : 1 to use both stages, 0 to use only the median (the sample rate is irregular)
+output                              : the filtered lux
+*/
+float lux_filter_update(struct lux_filter *filter, float lux, double now, int smooth);
+
+
+/* FUNCTION: CALCULATE_SUN_UP
+To calculate the sun-set and sun-rise times for a given location, on a given Julian date this function should be called
+Necessary inputs:
+Ln_deg: north longitudial coordinate, as double (for locations south to the equador it is a negative value)
+Lw_deg: west latituial coordinate, as double (for location east to Greenwich it is a negative value)
+Jdate: the Julian date of the day
+Output will be provided as struct sun_table_entry (minutes after UTC midnight, SunPolarNight or SunPolarDay in the polar days)
+*/
+struct sun_table_entry calculate_sun_up(double Ln_deg, double Lw_deg, int Jdate);
+
+/* FUNCTION: SUN_TABLE_OPEN
+this function opens (or creates) and maps the sun-rise / sun-set table file
+if the file is not a valid table for the location (magic, version or coordinates mismatch), the table is generated
+by calculate_sun_up for each day of the year
+Input:
+    table: the table to be initialized
+    path: path of the table file
+    Ln_deg: north coordinate of the location
+    Lw_deg: west coordinate of the location
+Output:
+    0 if the table is usable (mapped file, or generated in memory if the file can not be used), negative on error
+*/
+int sun_table_open(struct sun_table *table, const char *path, double Ln_deg, double Lw_deg);
+
+/* FUNCTION: SUN_TABLE_LOOKUP
+this function returns the sun-set and sun-rise times of the day in local time (the UTC offset of the day is used)
+the entry of the day is selected by the month and the day (the table is calculated for a leap year)
+Input:
+    table: the sun table
+    a_tm: the current local time
+Output:
+    struct sunup: sun-set and sun-rise in local HH:MM, or the polar day / polar night
+*/
+struct sunup sun_table_lookup(const struct sun_table *table, const struct tm *a_tm);
+
+/* FUNCTION: SUN_TABLE_CLOSE
+this function writes back and unmaps the sun table
+Input:
+    table: the sun table
+*/
+void sun_table_close(struct sun_table *table);
+
+/* FUNCTION: PROGRAM_SLEEP
+this subfunction calles the nanosleep() function for the defined seconds
+Input:
+    sec: the seconds till the program needs to sleep
+*/
+void program_sleep(float sec);
+
+/* FUNCTION: CLOCK_SYNC_START
+this function starts the tracking of the synchronization state of the system clock, if the clock is not yet
+synchronized the state is checked in every ClockSyncCheckSec (CLOCK_EVENT_SYNC)
+Input:
+    sync: the clock synchronization state
+    wait_s: the longest wait for the NTP synchronization [s], 0: the synchronization is not waited for
+*/
+void clock_sync_start(struct clock_sync *sync, int wait_s);
+
+/* FUNCTION: CLOCK_SYNC_CHECK
+this function checks the synchronization state of the system clock (adjtimex), the check timer is stopped
+when the clock is synchronized
+Input:
+    sync: the clock synchronization state
+Output:
+    1 if the clock became synchronized now (the display and the sun-set table shall be updated), otherwise 0
+*/
+int clock_sync_check(struct clock_sync *sync);
+
+/* FUNCTION: WAIT_FOR_CLOCK_EVENT
+this function arms the timer for the next event (lux sample slot or minute boundary) and blocks until it expires,
+or until the light sensor interrupt is raised
+Input:
+    timer_fd: timerfd created on CLOCK_REALTIME
+    sample_lux: if 1 the lux sample slot before the minute boundary is scheduled as well
+    interrupt_fd: GPIO line event file descriptor of the sensor interrupt, -1 if not used
+    measure_fd: the timerfd of the light measurement (CLOCK_EVENT_SENSOR_READY), -1 if not used
+    ramp_fd: the timerfd of the dimming ramp (CLOCK_EVENT_RAMP), -1 if not used
+    tick_fd: the timerfd of the per-second display refresh (CLOCK_EVENT_TICK), -1 if not used
+    config_fd: the inotify file descriptor of the configuration file (CLOCK_EVENT_CONFIG), -1 if not used
+    page_fd: the timerfd of the page rotation (CLOCK_EVENT_PAGE), -1 if not used
+    page_data_fd: the eventfd of the received page data (CLOCK_EVENT_PAGE_DATA), -1 if not used
+    command_fd: the eventfd of the received MQTT commands (CLOCK_EVENT_COMMAND), -1 if not used
+    sync_fd: the timerfd of the clock synchronization check (CLOCK_EVENT_SYNC), -1 if not used
+Output:
+    enum clock_event: the event which woke up the process
+*/
+enum clock_event wait_for_clock_event(int timer_fd, int sample_lux, int interrupt_fd, int measure_fd, int ramp_fd, int tick_fd, int config_fd,
+                                      int page_fd, int page_data_fd, int command_fd, int sync_fd);
+
+/* FUNCTION: REFRESH_SCHEDULER_START
+this function (re)aligns the per-second ticks to the second boundary of the system clock, the ticks are
+absolute CLOCK_MONOTONIC deadlines, so the refresh does not drift by the time spent in the main loop
+Input:
+    sched: the refresh scheduler (nothing is done if it has no timer)
+Output:
+    0 on success, -1 if the timer could not be armed
+*/
+int refresh_scheduler_start(struct refresh_scheduler *sched);
+
+/* FUNCTION: REFRESH_SCHEDULER_TICK
+this function is called when the refresh timer expires: the wake-up delay after the deadline (jitter) is measured,
+and the deadline is moved to the next tick
+Input:
+    sched: the refresh scheduler
+Output:
+    the number of the expired deadlines (more than 1 if ticks were missed), negative on failure
+*/
+int refresh_scheduler_tick(struct refresh_scheduler *sched);
+
+/* FUNCTION: REFRESH_SCHEDULER_REPORT
+this function writes the jitter statistics of the refresh ticks to the standard output, and resets them
+Input:
+    sched: the refresh scheduler
+*/
+void refresh_scheduler_report(struct refresh_scheduler *sched);
+
+/* FUNCTION: REFRESH_SCHEDULER_STOP
+this function disarms the per-second ticks (e.g. while a page is shown which does not change with the time)
+Input:
+    sched: the refresh scheduler (nothing is done if it has no timer)
+*/
+void refresh_scheduler_stop(struct refresh_scheduler *sched);
+
+/* FUNCTION I2C_BUS_OPEN
+This function opens the I2C bus (a failure is not fatal, the bus is reopened by i2c_bus_check)
+Inputs:
+    bus: the I2C bus, adapter_nr is to be set
+Output:
+    0 on success, -1 if the bus could not be opened
+*/
+int i2c_bus_open(struct i2c_bus *bus);
+
+/* FUNCTION I2C_BUS_CLOSE
+This function closes the I2C bus handle opened by i2c_bus_open
+Inputs:
+    bus: the I2C bus
+*/
+void i2c_bus_close(struct i2c_bus *bus);
+
+/* FUNCTION I2C_BUS_USE
+This function binds the bus handle to the slave address of the device, the ioctl is skipped if the handle
+is already bound to the address
+Inputs:
+    bus: the I2C bus
+    address: address of the device
+Output:
+    the bus handle to be used for the transactions with the device, -1 if the handle cannot be bound to the address
+*/
+int i2c_bus_use(struct i2c_bus *bus, unsigned char address);
+
+/* FUNCTION I2C_BUS_CHECK
+This function counts the consecutive bus faults (EREMOTEIO, ETIMEDOUT, EIO), and after I2CErrorBurst of them
+the bus handle is reopened (the process is not restarted)
+Inputs:
+    bus: the I2C bus
+    res: result of the last transaction(s), negative on failure
+    error: errno captured at the failed transaction (only used if res is negative)
+Output:
+    1 if the bus was reopened (the devices shall be initialized again), 0 otherwise
+*/
+int i2c_bus_check(struct i2c_bus *bus, int res, int error);
+
+/* FUNCTION: MEASURE_LUX_START
+this function starts a light measurement via the bound sensor driver, and arms the measurement timer
+for the time the data is expected to be valid (the function does not wait for the integration)
+Input:
+    measurement: state of the measurement
+    sensor: the sensor driver
+    int file: file descriptor of the light sensor
+Output:
+    0 if the measurement is started, 1 if a measurement is already running, negative on failure
+*/
+int measure_lux_start(struct light_measurement *measurement, const struct sensor_driver *sensor, int file);
+
+/* FUNCTION: MEASURE_LUX_POLL
+this function is called when the measurement timer expires: if the sensor reports valid data, it is read,
+else the timer is re-armed for the next check (till the number of checks reaches LightMeasurementMaxPolls)
+after the read the range of the next measurement is selected (auto-ranging)
+Input:
+    measurement: state of the measurement
+    sensor: the sensor driver
+    int file: file descriptor of the light sensor
+    data: filled with the measured data and calculated lux (negative channels on failure, with the errno of the failed transaction)
+Output:
+    1 if the measurement is finished (data is filled), 0 if the data is not yet valid
+*/
+int measure_lux_poll(struct light_measurement *measurement, const struct sensor_driver *sensor, int file, struct light_sensor_data *data);
+
+/* FUNCTION: CALCULATE_LUX
+this function calculates the lux value from the measured light sensor data
+Input:
+    float broadband: bradband sensor measured value
+    float ir: infrared sensor measured value
+    package: the lux coefficients of the TSL2561 package
+Output:
+    float lux   : the calculated lux value
+*/
+float calculate_lux(float broadband, float ir, const struct tsl2561_package *package);
+
+/* FUNCTION: FIND_TSL2561_PACKAGE
+this function finds the lux coefficients of a TSL2561 package by name
+Input:
+    name: name of the package (t: T, FN and CL packages, cs: CS package)
+Output:
+    the package, NULL if not found
+*/
+const struct tsl2561_package *find_tsl2561_package(const char *name);
+
+/* FUNCTION: LUX_CALIBRATE
+this function applies the per-board calibration to the lux of the sensor
+Input:
+    lux: the lux of the sensor driver
+    scale, offset: the calibration
+Output:
+    the calibrated lux (not negative)
+*/
+float lux_calibrate(float lux, float scale, float offset);
+
+/* FUNCTION: LUX_UNCALIBRATE
+this function converts a calibrated lux back to the lux of the sensor driver (the inverse of lux_calibrate)
+Input:
+    lux: the calibrated lux
+    scale, offset: the calibration
+Output:
+    the lux of the sensor driver (not negative)
+*/
+float lux_uncalibrate(float lux, float scale, float offset);
+
+/* FUNCTION: LUX_CALIBRATION_FIT
+this function adds a reference point to the lux calibration, and fits the calibration to the points
+Input:
+    fit: the points of the calibration
+    sensor_lux: the (not calibrated) lux of the sensor
+    reference: the reference lux
+    scale, offset: the calibration, changed only if the fit is valid
+Output:
+    0 if the calibration is changed, -1 if the point is rejected (dark, or the fit is out of the limits)
+*/
+int lux_calibration_fit(struct lux_calibration *fit, float sensor_lux, float reference, float *scale, float *offset);
+
+/* FUNCTION: TELEMETRY_POLICY_CHECK
+this function decides if a telemetry record is published (see struct telemetry_policy), the published record is the new state
+Input:
+    policy: the publish-on-change state
+    record: the telemetry of the minute
+Output:
+    1 if the record shall be published, 0 if nothing changed out of the deadband
+*/
+int telemetry_policy_check(struct telemetry_policy *policy, const struct telemetry_record *record);
+
+/* FUNCTION: TELEMETRY_QUEUE_PUSH
+this function puts a record into the telemetry queue without blocking (producer side)
+Input:
+    queue: the telemetry queue
+    record: the record to be queued
+Output:
+    0 if the record is queued, -1 if the queue is full (the record is dropped and counted)
+*/
+int telemetry_queue_push(struct telemetry_queue *queue, const struct telemetry_record *record);
+
+/* FUNCTION: TELEMETRY_QUEUE_POP
+this function takes the oldest record from the telemetry queue without blocking (consumer side)
+Input:
+    queue: the telemetry queue
+    record: the record to be filled
+Output:
+    1 if a record is returned, 0 if the queue is empty
+*/
+int telemetry_queue_pop(struct telemetry_queue *queue, struct telemetry_record *record);
+
+/* FUNCTION: TELEMETRY_RING_OPEN
+this function opens (or creates) and maps the offline telemetry ring file
+Input:
+    ring: the ring to be initialized
+    path: path of the ring file
+Output:
+    0 if the ring is mapped, negative on error (the ring is not usable)
+*/
+int telemetry_ring_open(struct telemetry_ring *ring, const char *path);
+
+/* FUNCTION: TELEMETRY_RING_APPEND
+this function stores a sample in the ring (if the ring is full the oldest sample is overwritten)
+Input:
+    ring: the telemetry ring
+    record: the telemetry to be stored
+*/
+void telemetry_ring_append(struct telemetry_ring *ring, const struct telemetry_record *record);
+
+/* FUNCTION: TELEMETRY_RING_PEEK
+this function copies the oldest not yet replayed samples from the ring (the samples stay in the ring)
+Input:
+    ring: the telemetry ring
+    samples: array to be filled
+    max_samples: size of the array
+Output:
+    number of samples copied
+*/
+int telemetry_ring_peek(struct telemetry_ring *ring, struct telemetry_sample *samples, int max_samples);
+
+/* FUNCTION: TELEMETRY_RING_CONSUME
+this function removes the oldest samples from the ring (after they are published)
+Input:
+    ring: the telemetry ring
+    count: number of samples to remove
+*/
+void telemetry_ring_consume(struct telemetry_ring *ring, int count);
+
+/* FUNCTION: TELEMETRY_RING_CLOSE
+this function writes back and unmaps the ring file
+Input:
+    ring: the telemetry ring
+*/
+void telemetry_ring_close(struct telemetry_ring *ring);
+
+/* FUNCTION: LUX_HISTORY_OPEN
+this function opens (or creates) and maps the lux history file, the tiers are placed on their own pages after the header page
+the write position of each tier is found by its newest record, and the current periods of the downsampled tiers are
+rebuilt from the raw tier (a restart does not lose the readings of the period)
+if the file is not a valid history file (magic, version or capacity mismatch) it is reinitialized as an empty history
+Input:
+    history: the history to be initialized
+    path: path of the history file
+Output:
+    0 if the history is mapped, negative on error (the history is not usable)
+*/
+int lux_history_open(struct lux_history *history, const char *path);
+
+/* FUNCTION: LUX_HISTORY_APPEND
+this function appends the reading of the minute to the raw tier, and to the current periods of the downsampled tiers
+(the record of a period is appended when the first reading of the next period arrives); the oldest records are overwritten
+the tiers are ordered by time: a reading not newer than the newest record (e.g. the minute already stored) is dropped
+Input:
+    history: the lux history
+    timestamp: time of the reading
+    data: the reading (calibrated lux, raw channels)
+*/
+void lux_history_append(struct lux_history *history, time_t timestamp, struct light_sensor_data data);
+
+/* FUNCTION: LUX_HISTORY_READ
+this function copies the newest records of a tier into the query result, the oldest first
+Input:
+    history: the lux history
+    tier: the tier to be read
+    count: number of records (at most LUX_HISTORY_QUERY_MAX)
+    skip: number of the newest records left out (for the paging of the older records)
+    query: the result to be filled
+Output:
+    number of records copied
+*/
+int lux_history_read(const struct lux_history *history, enum lux_history_tier tier, int count, int skip, struct lux_history_query *query);
+
+/* FUNCTION: LUX_HISTORY_CLOSE
+this function writes back and unmaps the history file
+Input:
+    history: the lux history
+*/
+void lux_history_close(struct lux_history *history);
+
+/* FUNCTION: LUX_HISTORY_OVERRIDE
+this function appends a brightness command with the lux of the moment to the override tier (a point of the dimming learning)
+a command within DimmingLearnSettleSec of the previous one replaces it (the brightness is stepped till it fits the room),
+a command older than the newest record is dropped
+Input:
+    history: the lux history
+    timestamp: time of the command
+    lux: the filtered lux at the command
+    level: the brightness of the command (0..15)
+*/
+void lux_history_override(struct lux_history *history, time_t timestamp, float lux, int level);
+
+/* FUNCTION: DIMMING_LEARN_TABLE
+this function fits the lux-dimming table to the brightness overrides of the history: an isotonic (monotone increasing)
+regression of the level over the lux by pool adjacent violators, the points of the configured table are weak points of the fit
+(DimmingLearnPriorWeight), so the table is kept where the user has not overridden the dimming; the weight of an override is
+halved in every DimmingLearnHalfLifeSec, so an old choice fades out; the level threshold between two fitted levels is at
+the geometric mean of their lux (the table is in whole lux as the configured one: below 1 lux the dimming stays 0, even if
+the overrides choose a brighter level in the dark)
+Input:
+    history: the lux history
+    lux_values: the configured lux-dimming table
+    now: the current time
+    learned: the fitted lux-dimming table
+Output:
+    number of the overrides used, 0: the fitted table is the configured one
+*/
+int dimming_learn_table(const struct lux_history *history, const int *lux_values, time_t now, int *learned);
+
+/* FUNCTION: DIMMING_LEARN_APPLY
+this function fits the lux-dimming table of each display following the light sensor, compiles it, and swaps it in for the
+curve of the display at once (the main loop is the only user of the curves, so a compiled curve replaces the old one
+between two events); the displays without overrides keep the curve of the configured table
+the dimming of a refitted display is looked up again on the new curve (the change is sent by the caller)
+Input:
+    displays: the displays
+    count: number of the displays
+    config: the configured lux tables and hysteresis
+    history: the lux history with the overrides
+    now: the current time
+    lux: the current lux, negative if there is no valid reading (the dimming follows the next reading)
+Output:
+    number of the refitted displays (the sensor thresholds of the old bands shall be set again)
+*/
+int dimming_learn_apply(struct clock_display *displays, int count, const struct clock_config *config, const struct lux_history *history, time_t now, float lux);
+
+/* FUNCTION: PARSE_PAYLOAD_ENCODING
+this function converts the name of the payload encoding (json, bin, cbor) to enum payload_encoding
+Input:
+    name: name of the encoding
+    encoding: the result
+Output:
+    0 if the name is known, -1 otherwise
+*/
+int parse_payload_encoding(const char *name, enum payload_encoding *encoding);
+
+/* FUNCTION: ENCODE_TELEMETRY
+this function encodes one live telemetry record in the selected encoding
+Input:
+    w: output buffer
+    encoding: payload encoding
+    record: the telemetry record
+    mqtt_status: value of the "mqtt" field
+    dropped: number of records dropped from the telemetry queue
+*/
+void encode_telemetry(struct payload_writer *w, enum payload_encoding encoding, const struct telemetry_record *record, int mqtt_status, unsigned int dropped);
+
+/* FUNCTION: ENCODE_REPLAY
+this function encodes a batch of replayed telemetry samples in the selected encoding
+Input:
+    w: output buffer
+    encoding: payload encoding
+    samples: the samples
+    count: number of samples
+*/
+void encode_replay(struct payload_writer *w, enum payload_encoding encoding, const struct telemetry_sample *samples, int count);
+
+/* FUNCTION: ENCODE_STATS
+this function encodes the instrumentation statistics as JSON (low rate, always JSON), and resets them
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+    period_s: seconds since the last statistics
+*/
+void encode_stats(struct payload_writer *w, const char *client_id, long period_s);
+
+/* FUNCTION: ENCODE_STARTUP
+this function encodes the start-up timing as JSON (once per start, always JSON)
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+*/
+void encode_startup(struct payload_writer *w, const char *client_id);
+
+/* FUNCTION: ENCODE_HISTORY
+this function encodes the result of a history command as JSON (always JSON), the records are arrays, the oldest first:
+[timestamp, lux, ir, broadband] of the raw tier, [start of the period, min, max, avg] of the downsampled tiers,
+[timestamp, lux, level] of the overrides
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+    query: the result of the history command
+*/
+void encode_history(struct payload_writer *w, const char *client_id, const struct lux_history_query *query);
+
+/* FUNCTION: STARTUP_MARK
+this function records the time of a start-up stage, only the first time the stage is reached
+Input:
+    stage: the stage in startup_timing
+Output:
+    1 if the stage is reached now, 0 if it was already reached
+*/
+int startup_mark(atomic_long *stage);
+
+/* FUNCTION: STARTUP_COMPLETE
+this function marks the end of the start-up, the publisher thread publishes the start-up timing at once (or after the connection)
+Input:
+    publisher: the MQTT publisher (started)
+*/
+void startup_complete(struct mqtt_publisher *publisher);
+
+/* FUNCTION: MQTT_PUBLISH_REPLAY
+this function publishes the samples of the offline telemetry ring in batches (one message carries REPLAY_BATCH_SIZE samples)
+Input:
+    publisher: the publisher state (shall be connected)
+Output:
+    0 if the ring is empty, negative if a publish failed (the remaining samples stay in the ring)
+*/
+int mqtt_publish_replay(struct mqtt_publisher *publisher);
+
+/* FUNCTION: MQTT_PUBLISHER_START
+this function creates the MQTT client and starts the publisher thread
+Input:
+    publisher: the publisher state to be initialized
+    ring_path: path of the offline telemetry ring file
+    config: the MQTT settings (broker, client id, topic, temperature topic) and the payload encoding
+    feed: the received data of the display pages
+Output:
+    0 if the thread is started, negative on error
+*/
+int mqtt_publisher_start(struct mqtt_publisher *publisher, const char *ring_path, const struct clock_config *config, struct page_feed *feed);
+
+/* FUNCTION: MQTT_MESSAGE_ARRIVED
+MQTT client callback (called on the thread of the MQTT client): the outdoor temperature is stored in the page feed,
+and the main loop is woken up if the temperature page is visible; the commands are parsed and queued for the main loop
+the temperature payload is a number in [C], or a JSON object, the first number of it is used
+Input:
+    context: pointer to struct mqtt_publisher
+    topic_name, topic_len: topic of the message
+    message: the received message
+Output:
+    1: the message is processed (freed)
+*/
+int mqtt_message_arrived(void *context, char *topic_name, int topic_len, MQTTClient_message *message);
+
+/* FUNCTION: COMMAND_PARSE
+this function parses the payload of a command message (see enum command_kind)
+Input:
+    payload: the payload, zero terminated
+    command: the result
+Output:
+    0 if the command is valid, -1 otherwise
+*/
+int command_parse(const char *payload, struct clock_command *command);
+
+/* FUNCTION: COMMAND_QUEUE_PUSH
+this function puts a command into the command queue without blocking (producer side), and wakes up the main loop
+Input:
+    queue: the command queue
+    command: the command to be queued
+Output:
+    0 if the command is queued, -1 if the queue is full (the command is dropped)
+*/
+int command_queue_push(struct command_queue *queue, const struct clock_command *command);
+
+/* FUNCTION: COMMAND_QUEUE_POP
+this function takes the oldest command from the command queue (consumer side)
+Input:
+    queue: the command queue
+    command: the result
+Output:
+    1 if a command is returned, 0 if the queue is empty
+*/
+int command_queue_pop(struct command_queue *queue, struct clock_command *command);
+
+/* FUNCTION: MQTT_PUBLISHER_STOP
+this function stops the publisher thread, disconnects and destroys the MQTT client
+(nothing is done if the publisher was not started)
+Input:
+    publisher: the publisher state
+*/
+void mqtt_publisher_stop(struct mqtt_publisher *publisher);
+
+/* FUNCTION: MQTT_PUBLISHER_THREAD
+thread function: (re)connects to the broker with exponential backoff, and publishes the queued telemetry records
+Input:
+    arg: pointer to struct mqtt_publisher
+*/
+void *mqtt_publisher_thread(void *arg);
+
+/* FUNCTION: STATS_RECORD
+this function puts a value into the latency histogram of a stage (lock-free, callable from any thread)
+Input:
+    stage: the measured stage
+    us: the value [us]
+*/
+void stats_record(enum stats_stage stage, long us);
+
+/* FUNCTION: STATS_SINCE
+this function puts the CLOCK_MONOTONIC time elapsed since start into the latency histogram of a stage
+Input:
+    stage: the measured stage
+    start: CLOCK_MONOTONIC time of the start of the stage
+*/
+void stats_since(enum stats_stage stage, const struct timespec *start);
+
+/* FUNCTION: LOG_MSG
+this function puts a log record into the in-memory ring without formatting it (the arguments are copied)
+the record is written to the standard output by the writer thread if its level is enabled for the subsystem,
+otherwise it is only kept for the SIGUSR1 dump
+the errno is not changed (the failed call can be logged before its errno is checked)
+Input:
+    subsystem: the part of the clock which logs
+    level: level of the record
+    format: printf format (string literal), the arguments follow
+*/
+void log_msg(enum log_subsystem subsystem, enum log_level level, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
+
+/* FUNCTION: LOG_SET_LEVEL
+this function sets the level of the records of a subsystem which are written to the standard output (-1: none, 0: errors only)
+Input:
+    subsystem: the subsystem
+    level: the highest level to be written
+*/
+void log_set_level(enum log_subsystem subsystem, int level);
+
+/* FUNCTION: LOG_START
+this function initializes the log ring, and starts the writer thread (SIGUSR1 dumps the whole ring)
+Input:
+    level: the level of all subsystems (the verbose input)
+Output:
+    0 if the thread is started, negative on error (the records are kept in the ring only)
+*/
+int log_start(int level);
+
+/* FUNCTION: LOG_STOP
+this function writes the pending records, and stops the writer thread
+*/
+void log_stop(void);
+
+/* FUNCTION: LOG_FORMAT
+this function expands a log record into text (lazy formatting, done by the writer thread)
+Input:
+    record: the log record
+    out: the output buffer
+    size: size of the output buffer
+*/
+void log_format(const struct log_record *record, char *out, size_t size);
+
+/* FUNCTION: LOG_WRITER_THREAD
+the thread writes the enabled log records to the standard output, and the whole ring on the dump request
+Input:
+    arg: not used
+*/
+void *log_writer_thread(void *arg);
+
+// stuff to properly shutdown the process
+void term(int signo);
+
+// SIGUSR1: dump of the log ring
+void log_dump_request(int signo);
+
+//------------------END OF FUNCTION DECLARATIONS------------------------
+
+//-------------------------CONSTANTS------------------------------------
+// define adapter number of I2C bus
+const unsigned char adapter_nr = 1;
+// number of consecutive bus faults which triggers the reopen of the I2C bus
+const int I2CErrorBurst = 3;
+// Define display I2C address
+const unsigned char disp_address = 0x70;
+// display internal address of first character
+const unsigned char Hour1_address = 0x00;
+// display internal address of second character
+const unsigned char Hour2_address = 0x02;
+// display internal address of third character
+const unsigned char Min1_address = 0x06;
+// display internal address of fourth character
+const unsigned char Min2_address = 0x08;
+// display internal address of colon character
+const unsigned char Colon_address = 0x04;
+// display memory value to turn on the colon
+const unsigned char Colon_on = 0x02;
+// display memory bit of the decimal point of a digit
+const unsigned char Segment_dot = 0x80;
+// the display shows the time from this year, before it the system clock is not yet set (no RTC, NTP not yet synchronized)
+const int ClockValidYear = 2024;
+// period of the synchronization check of the system clock while it is not synchronized [sec]
+const int ClockSyncCheckSec = 1;
+// default of the longest wait for the NTP synchronization before the time is shown anyway [sec]
+const int ClockSyncWaitSec = 600;
+/* ASCII to 7 segment glyph table (the bits of the segments are listed at get_hex_code), 0x00 for the characters without glyph
+the letters which cannot be shown in one case use the glyph of the other case */
+const unsigned char SegmentFont[128] =
+{
+    [' '] = 0x00, ['!'] = 0x86, ['"'] = 0x22, ['\''] = 0x20, ['('] = 0x39, [')'] = 0x0F, ['*'] = 0x63, ['-'] = 0x40,
+    ['/'] = 0x52, ['='] = 0x48, ['?'] = 0x53, ['['] = 0x39, ['\\'] = 0x64, [']'] = 0x0F, ['^'] = 0x23, ['_'] = 0x08,
+    ['0'] = 0x3F, ['1'] = 0x06, ['2'] = 0x5B, ['3'] = 0x4F, ['4'] = 0x66, ['5'] = 0x6D, ['6'] = 0x7D, ['7'] = 0x07,
+    ['8'] = 0x7F, ['9'] = 0x6F,
+    ['A'] = 0x77, ['B'] = 0x7C, ['C'] = 0x39, ['D'] = 0x5E, ['E'] = 0x79, ['F'] = 0x71, ['G'] = 0x3D, ['H'] = 0x76,
+    ['I'] = 0x30, ['J'] = 0x1E, ['K'] = 0x75, ['L'] = 0x38, ['M'] = 0x37, ['N'] = 0x54, ['O'] = 0x3F, ['P'] = 0x73,
+    ['Q'] = 0x67, ['R'] = 0x50, ['S'] = 0x6D, ['T'] = 0x78, ['U'] = 0x3E, ['V'] = 0x3E, ['W'] = 0x2A, ['X'] = 0x76,
+    ['Y'] = 0x6E, ['Z'] = 0x5B,
+    ['a'] = 0x5F, ['b'] = 0x7C, ['c'] = 0x58, ['d'] = 0x5E, ['e'] = 0x7B, ['f'] = 0x71, ['g'] = 0x6F, ['h'] = 0x74,
+    ['i'] = 0x10, ['j'] = 0x0E, ['k'] = 0x75, ['l'] = 0x30, ['m'] = 0x37, ['n'] = 0x54, ['o'] = 0x5C, ['p'] = 0x73,
+    ['q'] = 0x67, ['r'] = 0x50, ['s'] = 0x6D, ['t'] = 0x78, ['u'] = 0x1C, ['v'] = 0x1C, ['w'] = 0x2A, ['x'] = 0x76,
+    ['y'] = 0x6E, ['z'] = 0x5B
+};
+// display setup command values to blink the whole display (HT16K33 blink register)
+const unsigned char Display_blink_off = 0x00;
+const unsigned char Display_blink_1Hz = 0x04;
+// period of the per-second display refresh [ms]
+const int RefreshPeriodMs = 1000;
+// display RAM size (HT16K33 display data address 0x00..0x0F)
+#define DISPLAY_RAM_SIZE 16
+// unchanged bytes between two changed ones are re-sent if the gap is not larger than this (cheaper than a new transaction)
+const int DisplayMergeGap = 2;
+// define constant for maximum dimming value
+const unsigned char MaxDimming = 15;
+// dimming without a light sensor reading (the first frame, or a failed measurement)
+const unsigned char SubstituteDimming = 3;
+// default duration of a dimming transition [ms], and the minimum time between two brightness steps [ms]
+const int RampDurationMs = 2000;
+const int RampMinStepMs = 20;
+// lux sample slot before the minute change (the measurement shall be finished before the display update) [sec]
+const int SampleBeforeMinuteSec = 2;
+// interval of the light sensor ready checks after the expected ready time [ms], and the maximum number of checks
+const int LightMeasurementPollMs = 10;
+const int LightMeasurementMaxPolls = 20;
+// a continuously integrating sensor (TSL2561, VEML7700) is read after the power on or a range change only when the first
+// integration of the range is finished: its integration time with this margin (oscillator tolerance) plus the ADC start-up [ms]
+const float SensorSettleMargin = 1.2;
+const int SensorSettleMs = 3;
+// the range is selected so the expected counts stay below this part of the saturation (headroom for brightening)
+const float RangeTargetFill = 0.5;
+// the range is kept while its counts are inside this band of the saturation (hysteresis of the range changes)
+const float RangeKeepFillLow = 0.25;
+const float RangeKeepFillHigh = 0.75;
+// log-lux buckets of the dimming curve: resolution, and the lux of the lowest bucket (below it is the first bucket)
+const int LuxBucketsPerOctave = 16;
+const float LuxBucketMin = 0.0078125f;
+// default lux filter: median of 3 samples, and ~3.5 min time constant (the former y += (x - y) / 4 per minute)
+const int LuxMedianSize = 3;
+const int LuxTauSec = 210;
+// the filter history is cleared if there was no sample for this many time constants
+const float LuxFilterResetTaus = 4.0f;
+
+// TSL2561 light sensor
+  // Sensor I2C address: 0x39 (see sensor_drivers)
+  // Base Command value
+  const unsigned char Sensor_command = 0x80;
+  // Command extension to read word
+  const unsigned char Sensor_Read_Word = 0x20;
+  // integration time at power on (TIMING register 02h) [ms]
+  const int TSL2561_Integration_ms = 402;
+  // Command value to change power on/off
+  const unsigned char Sensor_Power = 0x0;
+  // The TIMING register defaults to 02h at power on. - which should be good, anyway to change it the command value extension
+  const unsigned char Sensor_Timing = 0x1;
+  // Command value to change interrupt settings
+  const unsigned char Sensor_interrupt = 0x6;
+  // interrupt control value: level interrupt (INTR = 01), raised after 2 integration periods out of the thresholds
+  const unsigned char Sensor_interrupt_level = 0x12;
+  // Command extension to clear the pending interrupt
+  const unsigned char Sensor_Clear = 0x40;
+  // Threshold registers (compared with the broadband channel)
+  const unsigned char TSL2561_Threshold_Low = 0x2;
+  const unsigned char TSL2561_Threshold_High = 0x4;
+  // ID register (part number and revision)
+  const unsigned char TSL2561_ID_register = 0xA;
+  // ADC Channel Data Registers (Ch - Fh)
+  const unsigned char TSL2561_Broadband_Low = 0xC;
+  const unsigned char TSL2561_Broadband_High = 0xD;
+  const unsigned char TSL2561_IR_Low = 0xE;
+  const unsigned char TSL2561_IR_High = 0xF;
+  // gain / integration time ranges, config: TIMING register (GAIN 0x10, INTEG 13.7 ms: 0x0, 101 ms: 0x1, 402 ms: 0x2)
+  const struct sensor_range tsl2561_ranges[] =
+  {
+      {1.0,  13.7,  5047, 0x00},
+      {1.0,  101.0, 37177, 0x01},
+      {1.0,  402.0, 65535, 0x02},
+      {16.0, 101.0, 37177, 0x11},
+      {16.0, 402.0, 65535, 0x12}
+  };
+  // lux coefficients of the packages (datasheet): T, FN and CL packages, and CS package
+  const struct tsl2561_package tsl2561_packages[] =
+  {
+      {"t",  {0.50, 0.61, 0.80, 1.30}, {0.0304, 0.0224, 0.0128, 0.00146}, {0.062,  0.031,  0.0153, 0.00112}},
+      {"cs", {0.52, 0.65, 0.80, 1.30}, {0.0315, 0.0229, 0.0157, 0.00338}, {0.0593, 0.0291, 0.0180, 0.00260}}
+  };
+  #define TSL2561_PACKAGE_COUNT (sizeof(tsl2561_packages) / sizeof(tsl2561_packages[0]))
+  // the CH1/CH0 ^ 1.4 table covers the first segment of all packages
+  const float RatioPowMax = 0.52;
+  // the limits of a calibration fit, and the smallest sensor lux of a calibration point
+  const float LuxScaleMin = 0.05;
+  const float LuxScaleMax = 20.0;
+  const float LuxCalibrationMinLux = 0.5;
+
+// TSL2591 light sensor
+  // Sensor I2C address: 0x29 (see sensor_drivers)
+  const unsigned char command_bit    = 0xA0;
+  //Register (0x00)
+  const unsigned char enable_register = 0x00;
+  const unsigned char enable_poweron  = 0x01;
+  const unsigned char enable_poweroff = 0x00;
+  const unsigned char enable_aen      = 0x02;
+  const unsigned char enable_aien     = 0x10;
+
+  const unsigned char control_register = 0x01;
+  const unsigned char sreset           = 0x80;
+  //AGAIN
+  const unsigned char low_gain         = 0X00; //Low gain (1x)
+  const unsigned char medium_gain      = 0X10; //Medium gain (25x)
+  const unsigned char high_gain        = 0X20; //High gain (428x)
+  const unsigned char max_gain         = 0x30; //Max gain (9876x)
+  //ATIME
+  const unsigned char atime_100ms      = 0x00; //100 millis    MAX COUNT 36863 
+  const unsigned char atime_200ms      = 0x01; //200 millis    MAX COUNT 65535 
+  const unsigned char atime_300ms      = 0x02; //300 millis
+  const unsigned char atime_400ms      = 0x03; //400 millis
+  const unsigned char atime_500ms      = 0x04; //500 millis
+  const unsigned char atime_600ms      = 0x05; //600 millis
+  // ALS interrupt thresholds (compared with the broadband channel)
+  const unsigned char threshold_low_register  = 0x04;
+  const unsigned char threshold_high_register = 0x06;
+  // interrupt persistence: raised after 2 consecutive values out of the thresholds
+  const unsigned char persist_register = 0x0C;
+  const unsigned char persist_2        = 0x02;
+  // special function: clear the ALS and no persist ALS interrupt
+  const unsigned char clear_interrupt_command = 0xE7;
+  // Status register, AVALID: the ALS integration cycle is completed since AEN was asserted
+  const unsigned char status_register = 0x13;
+  const unsigned char status_avalid   = 0x01;
+  // Chip ID
+  const unsigned char id_register      = 0x12;
+  const unsigned char TSL2591_ID       = 0x50;
+  // ADC Channel Data Registers
+  const unsigned char TSL2591_Broadband_Low = 0x14;
+  const unsigned char TSL2591_Broadband_High = 0x15;
+  const unsigned char TSL2591_IR_Low = 0x16;
+  const unsigned char TSL2591_IR_High = 0x17;
+  
+  //lux calculation constant
+  const float lux_df = 762.0;
+  // gain / integration time ranges, config: CONTROL register (AGAIN | ATIME)
+  const struct sensor_range tsl2591_ranges[] =
+  {
+      {1.0,    100.0, 36863, 0x00},
+      {1.0,    400.0, 65535, 0x03},
+      {25.0,   200.0, 65535, 0x11},
+      {25.0,   600.0, 65535, 0x15},
+      {428.0,  200.0, 65535, 0x21},
+      {428.0,  600.0, 65535, 0x25},
+      {9876.0, 600.0, 65535, 0x35}
+  };
+
+// VEML7700 light sensor
+  // Sensor I2C address: 0x10 (see sensor_drivers)
+  
+  // config
+  const unsigned char configuration_register    = 0x00;
+  const unsigned short als_poweroff             = 0x1;
+  const unsigned short als_poweron              = 0x0;
+  const unsigned short interrupt_disable        = 0x0;
+  const unsigned short als_pers_1               = 0x0;
+  const unsigned short als_pers_2               = 0x10;
+  const unsigned short als_pers_4               = 0x20;
+  const unsigned short als_pers_8               = 0x30;
+  const unsigned short als_integration_time_25  = 0x300;
+  const unsigned short als_integration_time_50  = 0x200;
+  const unsigned short als_integration_time_100 = 0x00;
+  const unsigned short als_integration_time_200 = 0x40;
+  const unsigned short als_integration_time_400 = 0x80;
+  const unsigned short als_integration_time_800 = 0xC0;
+  const unsigned short als_gain_1p4             = 0x1800;
+  const unsigned short als_gain_1p8             = 0x1000;
+  const unsigned short als_gain_2               = 0x800;
+  const unsigned short als_gain_1               = 0x0;
+  
+  //power save
+  const unsigned char power_saving_register = 0x03;
+  const unsigned char psm_1                 = 0x0;
+  const unsigned char psm_2                 = 0x02;
+  const unsigned char psm_3                 = 0x04;
+  const unsigned char psm_4                 = 0x06;
+  const unsigned char psm_en               = 0x01;
+  const unsigned char psm_dis              = 0x0;
+  
+  // measurements
+  const unsigned char als_register          = 0x04;
+  const unsigned char white_register        = 0x05;
+
+  // device ID (low byte of the ID register)
+  const unsigned char id_register_veml      = 0x07;
+  const unsigned char VEML7700_ID           = 0x81;
+  // gain / integration time ranges, config: ALS_GAIN | ALS_IT bits of the configuration register
+  const struct sensor_range veml7700_ranges[] =
+  {
+      {0.125, 25.0,  65535, 0x1300},
+      {0.125, 100.0, 65535, 0x1000},
+      {1.0,   100.0, 65535, 0x0000},
+      {2.0,   100.0, 65535, 0x0800},
+      {2.0,   400.0, 65535, 0x0880},
+      {2.0,   800.0, 65535, 0x08C0}
+  };
+  // resolution at gain 1 and 100 ms integration time [lx/count]
+  const float veml7700_resolution = 0.0576;
+
+// first and maximum wait between two MQTT connection attempts [sec]
+const int MqttBackoffMinSec = 1;
+const int MqttBackoffMaxSec = 300;
+// timeout of a single MQTT connection attempt [sec]
+const int MqttConnectTimeoutSec = 5;
+// the lux deadband of the telemetry is relative to at least this lux (the sensor noise in the dark is not published)
+const float LuxDeadbandFloor = 1.0;
+
+// the known light sensor drivers, in probe order
+const struct sensor_driver sensor_drivers[] =
+{
+    {"tsl2561",  0x39, SENSOR_CAP_IR_CHANNEL | SENSOR_CAP_GAIN | SENSOR_CAP_THRESHOLD_INT, tsl2561_probe, tsl2561_init, tsl2561_start, tsl2561_ready, tsl2561_read, tsl2561_shutdown,
+                 tsl2561_ranges, sizeof(tsl2561_ranges) / sizeof(tsl2561_ranges[0]), 2, tsl2561_set_range,
+                 tsl2561_set_thresholds, tsl2561_clear_interrupt},
+    {"tsl2591",  0x29, SENSOR_CAP_IR_CHANNEL | SENSOR_CAP_GAIN | SENSOR_CAP_THRESHOLD_INT, tsl2591_probe, tsl2591_init, tsl2591_start, tsl2591_ready, tsl2591_read, tsl2591_shutdown,
+                 tsl2591_ranges, sizeof(tsl2591_ranges) / sizeof(tsl2591_ranges[0]), 2, tsl2591_set_range,
+                 tsl2591_set_thresholds, tsl2591_clear_interrupt},
+    // the VEML7700 has no INT pin, the threshold crossing is only flagged in a register
+    {"veml7700", 0x10, SENSOR_CAP_GAIN, veml7700_probe, veml7700_init, veml7700_start, veml7700_ready, veml7700_read, veml7700_shutdown,
+                 veml7700_ranges, sizeof(veml7700_ranges) / sizeof(veml7700_ranges[0]), 3, veml7700_set_range,
+                 NULL, NULL}
+};
+#define SENSOR_DRIVER_COUNT ((int)(sizeof(sensor_drivers) / sizeof(sensor_drivers[0])))
+
+// the kinds of the display pages (see the page lines of the configuration file)
+const struct page_driver page_drivers[] =
+{
+    {"time", PAGE_UPDATE_CLOCK,  time_page_stamp, time_page_render},
+    {"date", PAGE_UPDATE_MINUTE, date_page_stamp, date_page_render},
+    {"temp", PAGE_UPDATE_DATA,   temp_page_stamp, temp_page_render},
+    {"text", PAGE_UPDATE_DATA,   text_page_stamp, text_page_render}
+};
+#define PAGE_DRIVER_COUNT ((int)(sizeof(page_drivers) / sizeof(page_drivers[0])))
+
+// filename which conatains lux values for dimming (used if the configuration file has no lux table)
+const char lux_file[] = "lux_dimming.txt";
+// filename of the configuration file
+const char config_file[] = "clock.conf";
+// gpiochip device of the light sensor INT line (Raspberry Pi header GPIOs)
+const char gpio_chip_path[] = "/dev/gpiochip0";
+// in interrupt mode the sensor is still measured in every SensorCheckMinutes, to detect a dead sensor
+const int SensorCheckMinutes = 15;
+// filename of the light sensor probe cache
+const char sensor_probe_file[] = "sensor_probe.txt";
+// filename of the offline telemetry ring
+const char telemetry_ring_file[] = "telemetry_ring.bin";
+// filename of the lux history archive
+const char lux_history_file[] = "lux_history.bin";
+// identification and layout version of the lux history file
+const uint32_t LuxHistoryMagic = 0x484B4C43; // "CLKH"
+const uint32_t LuxHistoryVersion = 2;
+// the header and the tiers start on page boundaries, a record never crosses a page
+const size_t LuxHistoryPageSize = 4096;
+// period of the records of the tiers [s], and the records of the tiers: 24 hours of minutes, 30 days of 5 minutes
+// and 365 days of hours, rounded up to whole pages (256 records per page), the overrides are not periodic
+const uint32_t LuxHistoryPeriodSec[LUX_HISTORY_TIERS] = {60, 300, 3600, 0};
+const uint32_t LuxHistoryCapacity[LUX_HISTORY_TIERS] = {1536, 8704, 8960, LUX_HISTORY_OVERRIDES};
+// names of the tiers in the history command and in its result
+const char *const LuxHistoryTierNames[LUX_HISTORY_TIERS] = {"raw", "5min", "hour", "override"};
+// size of the payload of a history command result
+#define HISTORY_PAYLOAD_SIZE (LUX_HISTORY_QUERY_MAX * 56 + 160)
+// the dimming learning: an override within DimmingLearnSettleSec of the previous one replaces it, the weight of an override
+// is halved in every DimmingLearnHalfLifeSec, a level of the configured table weighs as an override of DimmingLearnPriorWeight
+// (the table decides only where there is no override, an override is outweighed by the table after about half a year)
+const int DimmingLearnSettleSec = 60;
+const double DimmingLearnHalfLifeSec = 30 * 86400.0;
+const double DimmingLearnPriorWeight = 0.01;
+// the points of the fit: the overrides and the levels of the configured table
+#define DIMMING_LEARN_POINTS (LUX_HISTORY_OVERRIDES + 16)
+// sun-rise / sun-set table of the configured location (generated at start-up if missing)
+const char sun_table_file[] = "sun_table.bin";
+const uint32_t SunTableMagic = 0x4E555343; // "CSUN"
+const uint32_t SunTableVersion = 2;
+// days in the table (the days of a leap year)
+#define SUN_TABLE_DAYS 366
+// the table is calculated for a leap year, so every day of the year has an entry (the yearly drift is ~1 minute)
+const int SunTableYear = 2024;
+// the first day of each month in the table (the days of the leap year)
+const int SunTableMonthStart[12] = {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335};
+// the entry of a day without sun-rise (polar night) or without sun-set (polar day)
+const int16_t SunPolarNight = -1;
+const int16_t SunPolarDay = -2;
+// identification and layout version of the offline telemetry ring file
+const uint32_t TelemetryRingMagic = 0x524B4C43; // "CLKR"
+const uint32_t TelemetryRingVersion = 1;
+// number of samples in the offline telemetry ring (2 days of minutes)
+const uint32_t TelemetryRingCapacity = 2880;
+// number of samples in one replay message
+#define REPLAY_BATCH_SIZE 30
+// schema version of the binary and CBOR payloads (part of the topic suffix)
+const unsigned char PayloadSchemaVersion = 2;
+// size of a live telemetry payload buffer, and of a replay payload buffer
+#define TELEMETRY_PAYLOAD_SIZE 192
+#define REPLAY_PAYLOAD_SIZE (REPLAY_BATCH_SIZE * 64 + 32)
+// the instrumentation statistics are published in every StatsPeriodSec, the payload size of the statistics
+const int StatsPeriodSec = 300;
+#define STATS_PAYLOAD_SIZE (STATS_STAGES * (STATS_BUCKETS * 11 + 80) + 320)
+const char *const StatsStageNames[STATS_STAGES] = {"loop", "display", "measure", "mqtt", "minute_late"};
+// names of the log subsystems and levels in the log output
+const char *const LogSubsystemNames[LOG_SUBSYSTEMS] = {"clock", "display", "sensor", "mqtt", "sched"};
+const char *const LogLevelNames[4] = {"error", "notice", "info", "debug"};
+// the writer thread writes the enabled records at least in every LogFlushMs
+const int LogFlushMs = 1000;
+// the level of the subsystem is not set in clock.conf, the verbose input is used
+const int LogLevelDefault = -2;
+
+
+//--------------------END OF CONSTANTS----------------------------------
+
+//-------------------------GLOBAL VARIABLES-----------------------------
+// variable created to handle external KILL signal
+volatile sig_atomic_t done = 0;
+// the in-memory log ring
+struct log_ring log_ring;
+// the hot path instrumentation
+struct clock_stats clock_stats;
+// the timing of the start-up
+struct startup_timing startup_timing;
+// the lux coefficients of the TSL2561 (set from the configuration, read by the sensor driver)
+const struct tsl2561_package *tsl2561_package = &tsl2561_packages[0];
+// 1 if the continuously integrating sensor is powered on or re-ranged, and its ADC registers do not yet hold an integration
+// of the current range (set by the init and set_range of the TSL2561 and VEML7700 drivers, cleared by their start)
+int sensor_settling = 1;
+
+//---------------------END OF GLOBAL VARIABLES--------------------------
+
+
+int main (int argc, char *argv[])
+{
+    // the start-up timing is measured from here (the first frame, the sensor warm-up, the MQTT connection)
+    clock_gettime(CLOCK_MONOTONIC, &startup_timing.start);
+    atomic_init(&startup_timing.first_frame_us, -1);
+    atomic_init(&startup_timing.boot_ms, -1);
+    atomic_init(&startup_timing.first_lux_us, -1);
+    atomic_init(&startup_timing.mqtt_connect_us, -1);
+    atomic_init(&startup_timing.complete, 0);
+
+    // prepare function to be killed properly
+    struct sigaction action;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = term;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTRAP, &action, NULL);
+
+    //allocate lux_path to calling command
+    char lux_path[50];
+    char filepath[50];
+    snprintf(lux_path,50, "%s",argv[0]);
+    //Get executable location from argv[0] (see main function), and append with lux_file
+    char *s = strrchr(lux_path, '/');
+    if (s) {
+        *s = '\0';
+    }
+    strcpy(filepath, lux_path);
+    strcat(filepath, "/");
+    strcat(filepath, lux_file);
+    // the offline telemetry ring is stored next to the executable as well
+    char ring_path[100];
+    snprintf(ring_path, 100, "%s/%s", lux_path, telemetry_ring_file);
+    char probe_path[100];
+    snprintf(probe_path, 100, "%s/%s", lux_path, sensor_probe_file);
+    char sun_path[100];
+    snprintf(sun_path, 100, "%s/%s", lux_path, sun_table_file);
+    char history_path[100];
+    snprintf(history_path, 100, "%s/%s", lux_path, lux_history_file);
+    //snprintf(filepath,50,"%s/%s", lux_path, lux_file);
+
+    char config_path[100];
+    snprintf(config_path, 100, "%s/%s", lux_path, config_file);
+
+    // the level of the terminal messages (of all subsystems, unless clock.conf sets it per subsystem)
+    int verbose = 0;
+    // the settings: defaults, than the configuration file, than the command line options
+    struct clock_config config;
+    memset(&config, 0, sizeof(config));
+    if (config_apply_options(&config, argc, argv) < 0)
+    {
+        printf("usage: %s [-e json|bin|cbor] [-s auto|none|tsl2561|tsl2591|veml7700] [-g gpio_line] [-l lat,lon] [-r ramp_ms] [-d hhmm|blink|mmss|hwblink|lux] [verbose]\n", argv[0]);
+        return 1;
+    }
+    // if the program is started with a number argument above or equal to 1, than turn on terminal messages
+    if (optind < argc)
+    {
+        verbose = atol(argv[optind]);
+    }
+    // the log records are formatted and written by the log writer thread, SIGUSR1 writes the last records of all levels
+    log_start(verbose);
+    if (config_load(&config, config_path, filepath) < 0)
+    {
+        // ERROR HANDLING: the clock shall run with an invalid configuration file as well
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "CONFIGURATION INVALID, the defaults are used");
+        config_load(&config, "", filepath);
+    }
+    config_apply_options(&config, argc, argv);
+    for (int i = 0; i < LOG_SUBSYSTEMS; i++)
+    {
+        log_set_level(i, (config.log_levels[i] == LogLevelDefault) ? verbose : config.log_levels[i]);
+    }
+    config_print(&config, config_path);
+    tsl2561_package = config.tsl2561_package;
+    // the configuration file is parsed again if it is changed
+    int config_fd = config_watch(lux_path);
+    // open th I2C bus for the communication with the display and the sensor (but no actual communication yet)
+    // the same handle is used for both devices, if the bus fails it is reopened without restarting the process
+    struct i2c_bus bus;
+    memset(&bus, 0, sizeof(bus));
+    bus.adapter_nr = adapter_nr;
+    i2c_bus_open(&bus);
+    // set if the bus was reopened: the display and the sensor shall be initialized again
+    int bus_recovered = 0;
+
+    // find the light sensor, and open th I2C bus for the communication with it
+    const struct sensor_driver *sensor = NULL;
+    int light_sensor_available = 0;
+    int light_sensor_dead = 0;
+    int light_sensor_dead_lim = 5;
+    if (strcmp(config.sensor, "auto") == 0)
+    {
+        sensor = sensor_probe(&bus, probe_path);
+    }
+    else if (strcmp(config.sensor, "none") != 0)
+    {
+        // the sensor is defined by the user, no probing
+        sensor = find_sensor_driver(config.sensor);
+    }
+    if (sensor != NULL)
+    {
+        light_sensor_available = 1;
+    }
+    // open the sensor interrupt line, if requested and supported by the sensor
+    int interrupt_fd = -1;
+    // are the sensor thresholds set for the current dimming band?
+    int thresholds_armed = 0;
+    if ((config.gpio_line >= 0) && (sensor != NULL))
+    {
+        if (sensor->caps & SENSOR_CAP_THRESHOLD_INT)
+        {
+            interrupt_fd = gpio_open_event(gpio_chip_path, config.gpio_line);
+        }
+        if (interrupt_fd < 0)
+        {
+            log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor interrupt is not available, the sensor is polled");
+        }
+    }
+
+    // the pages of the display rotation, only the visible page is drawn (the temperature page is fed by the MQTT thread)
+    struct page_scheduler pages;
+    page_scheduler_init(&pages);
+    page_scheduler_configure(&pages, &config);
+    struct page_context page_ctx;
+    memset(&page_ctx, 0, sizeof(page_ctx));
+    page_ctx.feed = &pages.feed;
+
+    // the time is shown when the system clock is synchronized (a clock step wakes up the loop, see wait_for_clock_event)
+    struct clock_sync clock_sync;
+    clock_sync_start(&clock_sync, config.clock_sync_wait);
+    page_ctx.clock_synced = clock_sync.synced;
+
+    //set up MQTT, the connection and the publishing is done on the publisher thread
+    struct mqtt_publisher publisher;
+    struct telemetry_record telemetry;
+    // the telemetry is published on change (or at the heartbeat), not at every minute
+    struct telemetry_policy telemetry_policy;
+    memset(&telemetry_policy, 0, sizeof(telemetry_policy));
+    telemetry_policy.lux_deadband_pct = config.telemetry_deadband;
+    telemetry_policy.heartbeat_s = config.telemetry_heartbeat;
+
+    // the sun-rise / sun-set table of the location, the daily calculation is a lookup in this table
+    // (the sun-rise calculation uses north and west positive coordinates)
+    struct sun_table sun_table;
+    if (sun_table_open(&sun_table, sun_path, config.latitude, -config.longitude) < 0)
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "SUN TABLE OPEN FAILED");
+    }
+
+    // create a sunup type struct, with invalid (not HH:MM) values, {-1,-1,-1,-1}
+    struct sunup thissunup={-1,-1,-1,-1,0};
+
+    // create the displays: the shadow of the display RAM (all segments off), the lux-dimming table compiled for the lookup,
+    // and the dimming status structure, filled with initial values
+    //      dimming.lightchange=0;
+    //      dimming.currlight=0;
+    //      dimming.dimming_max=15;
+    //      dimming.dimming_min=0;
+    // currlight is set to -1 to ensure that the starting value is really set
+    // the displays following the sensor are dimmed by the sun if there is no sensor
+    struct clock_display displays[DISPLAY_MAX];
+    memset(displays, 0, sizeof(displays));
+    int display_count = config.display_count;
+    // number of the displays dimmed by the sun-set and sun-rise
+    int sun_displays = 0;
+    for (int i = 0; i < display_count; i++)
+    {
+        struct display_dimming initial_dimming = {0, -1, MaxDimming, 0};
+        displays[i].address = config.displays[i].address;
+        displays[i].use_sensor = config.displays[i].use_sensor && light_sensor_available;
+        displays[i].dimming = initial_dimming;
+        dimming_curve_build(&displays[i].curve, config.displays[i].lux_values, config.hysteresis_up, config.hysteresis_down);
+        sun_displays += !displays[i].use_sensor;
+    }
+
+    // create structure variable for display refresh values (the frame of the visible page)
+    struct disp_refresh_values adisp_refresh_values;
+    memset(&adisp_refresh_values, 0, sizeof(adisp_refresh_values));
+
+    // create time management structure to get the current time and the used timezone, summer time information
+    struct tm *a_tm;
+
+    // create a variable to show if this is the first minute update (the dimming start value shall be set)
+    int first_minute = 1;
+
+    // create the timer which wakes up the process at the lux sample slot and at the minute change
+    // the timer is set to absolute CLOCK_REALTIME deadlines, and cancelled if the system clock is set
+    int timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    if (timer_fd < 0)
+    {
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "TIMER CREATE FAILED");
+    }
+    // the first display update is done without waiting for the minute change
+    enum clock_event event = CLOCK_EVENT_MINUTE;
+    // wake-up time of the loop iteration, and whether the minute timer woke it up (for the instrumentation)
+    struct timespec loop_start;
+    clock_gettime(CLOCK_MONOTONIC, &loop_start);
+    int minute_flip = 0;
+
+    // create the dimming ramp, its timer wakes up the process at the brightness steps
+    struct dimming_ramp ramp;
+    ramp.count = display_count;
+    for (int i = 0; i < DISPLAY_MAX; i++)
+    {
+        ramp.level[i] = -1;
+        ramp.target[i] = -1;
+    }
+    ramp.duration_ms = config.ramp_ms;
+    // no brightness command yet: the dimming of the displays is used
+    ramp.override = -1;
+    ramp.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (ramp.timer_fd < 0)
+    {
+        log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "RAMP TIMER CREATE FAILED");
+    }
+
+    // create the per-second display refresh, it is only needed if the display changes at every second
+    struct refresh_scheduler refresher;
+    memset(&refresher, 0, sizeof(refresher));
+    refresher.period_ms = RefreshPeriodMs;
+    refresher.timer_fd = -1;
+    if ((config.display_mode == DISPLAY_MODE_BLINK) || (config.display_mode == DISPLAY_MODE_MMSS))
+    {
+        refresher.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (refresher.timer_fd < 0)
+        {
+            log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "REFRESH TIMER CREATE FAILED");
+        }
+    }
+
+    // create the state of the light measurement, its timer wakes up the process when the sensor data is ready
+    struct light_measurement measurement;
+    memset(&measurement, 0, sizeof(measurement));
+    measurement.range = -1;
+    measurement.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (measurement.timer_fd < 0)
+    {
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "MEASUREMENT TIMER CREATE FAILED");
+    }
+
+    // define variable for I2C bus read/wrtie event results
+    int res=0;
+    int disp_status;
+
+    // define variable to store lux value, and its filter
+    float lux = 0.0;
+    struct lux_filter lux_filter;
+    lux_filter_configure(&lux_filter, config.lux_median, config.lux_tau_s);
+    // the points of the lux calibration, and the reference lux of the calibrate command till the sensor is read (-1: none)
+    struct lux_calibration lux_calibration;
+    memset(&lux_calibration, 0, sizeof(lux_calibration));
+    float calibration_reference = -1.0;
+    struct light_sensor_data ls_data;
+    // no reading till the warm-up measurement is ready (the substitute dimming is used)
+    ls_data.lux = 0.0;
+    ls_data.raw_lux = 0.0;
+    ls_data.s_ir = -1;
+    ls_data.s_broadband = -1;
+    ls_data.range = -1;
+    ls_data.error = 0;
+
+    // Turn on the displays
+    for (int i = 0; i < display_count; i++)
+    {
+        disp_status=display_init(1, i2c_bus_use(&bus, displays[i].address));
+        if (disp_status < 0)
+        {
+            // the missing display does not stop the frames of the others, it is initialized again at the minute changes
+            displays[i].offline = 1;
+            log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY %#.2x INIT FAILED", displays[i].address);
+        }
+        // the whole display blinking is offloaded to the display driver (only while the time is shown)
+        if ((config.display_mode == DISPLAY_MODE_HWBLINK) && page_shows_clock(&pages))
+        {
+            res = display_set_blink(Display_blink_1Hz, i2c_bus_use(&bus, displays[i].address));
+            if (res < 0)
+            {
+                log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY %#.2x BLINK FAILED", displays[i].address);
+            }
+        }
+    }
+
+    // the first frame is written at once, the sensor and the MQTT are brought up after it
+    // (the brightness is the substitute till the dimming of the first minute update is ramped in)
+    time_t start_time = time(NULL);
+    page_ctx.a_tm = localtime(&start_time);
+    page_ctx.mode = config.display_mode;
+    page_draw(&pages, &page_ctx, &adisp_refresh_values);
+    for (int i = 0; i < display_count; i++)
+    {
+        ramp.level[i] = SubstituteDimming;
+    }
+    disp_status = display_update(adisp_refresh_values, displays, &ramp, bus.fd);
+    if (disp_status < 0)
+    {
+        log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY FIRST FRAME FAILED");
+    }
+    startup_mark(&startup_timing.first_frame_us);
+    struct timespec boot_time;
+    clock_gettime(CLOCK_BOOTTIME, &boot_time);
+    atomic_store(&startup_timing.boot_ms, boot_time.tv_sec * 1000L + boot_time.tv_nsec / 1000000);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "First frame in %ld us after the start, %ld ms after the boot",
+            atomic_load(&startup_timing.first_frame_us), atomic_load(&startup_timing.boot_ms));
+
+    // set up MQTT, the connection is done on the publisher thread (in parallel with the sensor warm-up)
+    if (mqtt_publisher_start(&publisher, ring_path, &config, &pages.feed) < 0)
+    {
+        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT PUBLISHER START FAILED");
+    }
+
+    // Turn on sensor, and start the first measurement at once: the dimming follows the first reading,
+    // without waiting for the lux sample slot of the minute
+    int warm_up = 0;
+    if (light_sensor_available)
+    {
+      res=sensor_init(sensor, 1, i2c_bus_use(&bus, sensor->address));
+      if (res < 0)
+      {
+          // light_sensor_available = 0;
+          log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "LIGHT SENSOR INIT FAILED");
+      }
+      else
+      {
+          warm_up = (measure_lux_start(&measurement, sensor, i2c_bus_use(&bus, sensor->address)) >= 0);
+      }
+    }
+    if (!warm_up)
+    {
+        startup_complete(&publisher);
+    }
+    // the archive of the readings (mapped while the warm-up measurement runs), without a sensor there is nothing to keep
+    struct lux_history lux_history;
+    memset(&lux_history, 0, sizeof(lux_history));
+    if (light_sensor_available && (lux_history_open(&lux_history, history_path) < 0))
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "LUX HISTORY OPEN FAILED, the readings are not archived");
+    }
+    // the lux tables learned from the overrides of the earlier runs
+    if (config.dimming_learn)
+    {
+        dimming_learn_apply(displays, display_count, &config, &lux_history, start_time, -1.0f);
+    }
+
+    // continous operation (while(1))
+    // done parameter can be changed by application kill signal for proper shutdown
+    // the process sleeps in wait_for_clock_event() till the next lux sample slot, minute change, sensor interrupt, finished measurement,
+    // dimming step or per-second refresh
+    while(!done)
+    {
+        // create variable where the time information will be stored [type: time_t]
+        time_t now=time(NULL);
+        // get the current time from the system
+        a_tm = localtime(&now);
+
+        // if the system clock was set, the sun-set and sun-rise times shall be recalculated for the new date
+        if (event == CLOCK_EVENT_JUMP)
+        {
+            thissunup.set_hour = -1;
+            log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "System clock change detected");
+        }
+        // the synchronization state is checked in every ClockSyncCheckSec and at every clock step till it is synchronized,
+        // then the time and the sun-set and sun-rise times of the real date are shown at once
+        if (((event == CLOCK_EVENT_SYNC) || (event == CLOCK_EVENT_JUMP) || (event == CLOCK_EVENT_MINUTE)) && clock_sync_check(&clock_sync))
+        {
+            page_ctx.clock_synced = 1;
+            thissunup.set_hour = -1;
+            event = CLOCK_EVENT_JUMP;
+        }
+
+        // the MQTT commands: the brightness, the page and the text are changed at once, the display mode and the reload
+        // are done as a change of the configuration
+        int config_reload = (event == CLOCK_EVENT_CONFIG) && config_changed(config_fd);
+        int mode_command = -1;
+        // the changed settings update the dimming and the display at once, without the other tasks of the minute change
+        int display_refresh = 0;
+        if (event == CLOCK_EVENT_COMMAND)
+        {
+            struct clock_command command;
+            int page_changed = 0;
+            int redraw = 0;
+            while (command_queue_pop(&publisher.commands, &command))
+            {
+                log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "MQTT command %d (%d %s) received", command.kind, command.value, command.text);
+                if (command.kind == COMMAND_BRIGHTNESS)
+                {
+                    // the first ramp step is done at once
+                    ramp.override = command.value;
+                    dimming_ramp_start(&ramp, displays);
+                    // the chosen brightness at the light of the moment is a point of the dimming learning, the tables are
+                    // fitted again only when a point arrives (the override is shown, the new dimming is used after "auto")
+                    if ((command.value >= 0) && light_sensor_available && page_ctx.clock_synced &&
+                        (ls_data.s_broadband >= 0) && (ls_data.s_ir >= 0))
+                    {
+                        lux_history_override(&lux_history, now, lux, command.value);
+                        if (config.dimming_learn && (dimming_learn_apply(displays, display_count, &config, &lux_history, now, lux) > 0))
+                        {
+                            thresholds_armed = 0;
+                        }
+                    }
+                }
+                else if (command.kind == COMMAND_MODE)
+                {
+                    mode_command = command.value;
+                }
+                else if (command.kind == COMMAND_RELOAD)
+                {
+                    config_reload = 1;
+                }
+                else if ((command.kind == COMMAND_CALIBRATE) && (command.lux < 0.0f))
+                {
+                    // the calibration of the configuration file is dropped as well, the samples are not filtered together
+                    memset(&lux_calibration, 0, sizeof(lux_calibration));
+                    config.lux_scale = 1.0;
+                    config.lux_offset = 0.0;
+                    lux_filter_configure(&lux_filter, config.lux_median, config.lux_tau_s);
+                    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Lux calibration is reset");
+                }
+                else if (command.kind == COMMAND_CALIBRATE)
+                {
+                    // the point is fitted when the started measurement is ready (a running one is used as well)
+                    calibration_reference = command.lux;
+                    if (!light_sensor_available ||
+                        (measure_lux_start(&measurement, sensor, i2c_bus_use(&bus, sensor->address)) < 0))
+                    {
+                        calibration_reference = -1.0;
+                        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Lux calibration failed, no light measurement");
+                    }
+                }
+                else if (command.kind == COMMAND_HISTORY)
+                {
+                    // one result is handed over at a time, the publisher thread is woken up for it
+                    if (atomic_load_explicit(&publisher.history.pending, memory_order_acquire))
+                    {
+                        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "History command dropped, the previous result is not yet published");
+                    }
+                    else
+                    {
+                        lux_history_read(&lux_history, (enum lux_history_tier)command.value, command.count, command.skip, &publisher.history);
+                        atomic_store_explicit(&publisher.history.pending, 1, memory_order_release);
+                        sem_post(&publisher.queue.ready);
+                    }
+                }
+                else
+                {
+                    if (command.kind == COMMAND_TEXT)
+                    {
+                        memcpy(pages.feed.text, command.text, sizeof(pages.feed.text));
+                        pages.feed.text_seq++;
+                        command.page = find_page_driver("text");
+                    }
+                    // the page is shown at once (if it is in the rotation), the frame is sent only if it changed
+                    page_changed |= (page_scheduler_show(&pages, command.page) > 0);
+                    redraw = 1;
+                }
+            }
+            if (page_changed)
+            {
+                display_clock_effects(page_shows_clock(&pages), config.display_mode, &refresher, displays, display_count, &bus);
+            }
+            page_ctx.a_tm = a_tm;
+            if (redraw && page_draw(&pages, &page_ctx, &adisp_refresh_values))
+            {
+                disp_status = display_update(adisp_refresh_values, displays, &ramp, bus.fd);
+                int error = errno;
+                if (disp_status < 0)
+                {
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY UPDATE FIALED");
+                }
+                bus_recovered |= i2c_bus_check(&bus, disp_status, error);
+            }
+        }
+
+        // the configuration file was changed (or the reload / mode command is received): the new settings are validated,
+        // than swapped at once
+        if (config_reload || (mode_command >= 0))
+        {
+            struct clock_config fresh = config;
+            int load_res = 0;
+            if (config_reload)
+            {
+                load_res = ((config_load(&fresh, config_path, filepath) < 0) || (config_apply_options(&fresh, argc, argv) < 0)) ? -1 : 0;
+            }
+            // the mode command is kept till the next change of the configuration file
+            if (mode_command >= 0)
+            {
+                fresh.display_mode = (enum display_mode)mode_command;
+            }
+            if (load_res < 0)
+            {
+                log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Configuration change is rejected, the settings are unchanged");
+            }
+            else
+            {
+                // the MQTT, sensor and interrupt settings are only used at the start-up
+                if ((strcmp(fresh.mqtt_address, config.mqtt_address) != 0) || (strcmp(fresh.mqtt_client_id, config.mqtt_client_id) != 0) ||
+                    (strcmp(fresh.mqtt_topic, config.mqtt_topic) != 0) || (fresh.encoding != config.encoding) ||
+                    (strcmp(fresh.temp_topic, config.temp_topic) != 0) || (fresh.clock_sync_wait != config.clock_sync_wait) ||
+                    (strcmp(fresh.sensor, config.sensor) != 0) || (fresh.gpio_line != config.gpio_line))
+                {
+                    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "MQTT, sensor and interrupt settings take effect at the next start");
+                    memcpy(fresh.mqtt_address, config.mqtt_address, sizeof(fresh.mqtt_address));
+                    memcpy(fresh.mqtt_client_id, config.mqtt_client_id, sizeof(fresh.mqtt_client_id));
+                    memcpy(fresh.mqtt_topic, config.mqtt_topic, sizeof(fresh.mqtt_topic));
+                    memcpy(fresh.temp_topic, config.temp_topic, sizeof(fresh.temp_topic));
+                    memcpy(fresh.sensor, config.sensor, sizeof(fresh.sensor));
+                    fresh.encoding = config.encoding;
+                    fresh.gpio_line = config.gpio_line;
+                    fresh.clock_sync_wait = config.clock_sync_wait;
+                }
+                // the displays are only added or removed at the start-up, their lux tables and dimming sources are changed at once
+                int displays_changed = (fresh.display_count != config.display_count);
+                for (int i = 0; (i < fresh.display_count) && !displays_changed; i++)
+                {
+                    displays_changed = (fresh.displays[i].address != config.displays[i].address);
+                }
+                if (displays_changed)
+                {
+                    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Display addresses take effect at the next start");
+                    fresh.display_count = config.display_count;
+                    memcpy(fresh.displays, config.displays, sizeof(fresh.displays));
+                }
+                // new location: the sun table is generated again, and the sun-set is looked up at the display update
+                if ((fresh.latitude != config.latitude) || (fresh.longitude != config.longitude))
+                {
+                    sun_table_close(&sun_table);
+                    if (sun_table_open(&sun_table, sun_path, fresh.latitude, -fresh.longitude) < 0)
+                    {
+                        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "SUN TABLE OPEN FAILED");
+                    }
+                    thissunup.set_hour = -1;
+                }
+                // new pages: the rotation is restarted with the first page
+                int pages_changed = (fresh.page_count != config.page_count);
+                for (int i = 0; (i < fresh.page_count) && !pages_changed; i++)
+                {
+                    pages_changed = (fresh.pages[i].driver != config.pages[i].driver) || (fresh.pages[i].duration_s != config.pages[i].duration_s);
+                }
+                if (pages_changed)
+                {
+                    page_scheduler_configure(&pages, &fresh);
+                }
+                // new display mode: the per-second refresh and the display blinking is switched
+                if (fresh.display_mode != config.display_mode)
+                {
+                    int per_second = (fresh.display_mode == DISPLAY_MODE_BLINK) || (fresh.display_mode == DISPLAY_MODE_MMSS);
+                    if (per_second && (refresher.timer_fd < 0))
+                    {
+                        refresher.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+                    }
+                    else if (!per_second && (refresher.timer_fd >= 0))
+                    {
+                        close(refresher.timer_fd);
+                        refresher.timer_fd = -1;
+                    }
+                    for (int i = 0; i < display_count; i++)
+                    {
+                        display_set_blink(((fresh.display_mode == DISPLAY_MODE_HWBLINK) && page_shows_clock(&pages)) ? Display_blink_1Hz : Display_blink_off,
+                                          i2c_bus_use(&bus, displays[i].address));
+                    }
+                }
+                if (pages_changed || (fresh.display_mode != config.display_mode))
+                {
+                    display_clock_effects(page_shows_clock(&pages), fresh.display_mode, &refresher, displays, display_count, &bus);
+                }
+                ramp.duration_ms = fresh.ramp_ms;
+                // the samples of another calibration are not filtered together with the new ones
+                int calibration_changed = (fresh.tsl2561_package != config.tsl2561_package) || (fresh.lux_scale != config.lux_scale) ||
+                                          (fresh.lux_offset != config.lux_offset);
+                tsl2561_package = fresh.tsl2561_package;
+                telemetry_policy.lux_deadband_pct = fresh.telemetry_deadband;
+                telemetry_policy.heartbeat_s = fresh.telemetry_heartbeat;
+                config = fresh;
+                for (int i = 0; i < LOG_SUBSYSTEMS; i++)
+                {
+                    log_set_level(i, (config.log_levels[i] == LogLevelDefault) ? verbose : config.log_levels[i]);
+                }
+                sun_displays = 0;
+                for (int i = 0; i < display_count; i++)
+                {
+                    displays[i].use_sensor = config.displays[i].use_sensor && light_sensor_available;
+                    dimming_curve_build(&displays[i].curve, config.displays[i].lux_values, config.hysteresis_up, config.hysteresis_down);
+                    sun_displays += !displays[i].use_sensor;
+                }
+                // the learning fits the new tables to the same overrides
+                if (config.dimming_learn &&
+                    (dimming_learn_apply(displays, display_count, &config, &lux_history, now,
+                                         ((ls_data.s_broadband >= 0) && (ls_data.s_ir >= 0)) ? lux : -1.0f) > 0))
+                {
+                    thresholds_armed = 0;
+                }
+                // a display switched to the sun needs the sun-set and sun-rise of the day
+                thissunup.set_hour = -1;
+                if ((lux_filter.median_size != config.lux_median) || (lux_filter.tau_s != config.lux_tau_s) || calibration_changed)
+                {
+                    lux_filter_configure(&lux_filter, config.lux_median, config.lux_tau_s);
+                }
+                config_print(&config, config_path);
+                // the dimming bands may have changed
+                thresholds_armed = 0;
+                // the dimming and the display is updated with the new settings at once
+                display_refresh = 1;
+            }
+        }
+
+        // lux sample slot or sensor interrupt: start the measurement, the result is processed when the data is ready
+        if (((event == CLOCK_EVENT_SAMPLE) || (event == CLOCK_EVENT_LIGHT)) && (light_sensor_available == 1))
+        {
+            res = measure_lux_start(&measurement, sensor, i2c_bus_use(&bus, sensor->address));
+            int error = errno;
+            if (res < 0)
+            {
+                log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "LIGHT MEASUREMENT START FAILED");
+            }
+            bus_recovered |= i2c_bus_check(&bus, res, error);
+        }
+
+        // the light measurement is finished: filter the lux value
+        if ((event == CLOCK_EVENT_SENSOR_READY) && (light_sensor_available == 1) &&
+            measure_lux_poll(&measurement, sensor, i2c_bus_use(&bus, sensor->address), &ls_data))
+        {
+            bus_recovered |= i2c_bus_check(&bus, ((ls_data.s_ir < 0) || (ls_data.s_broadband < 0)) ? -1 : 0, ls_data.error);
+            // a failed measurement is not put into the filter, the filtered lux is kept
+            if ((ls_data.s_ir >= 0) && (ls_data.s_broadband >= 0))
+            {
+                // the reference point of the calibrate command is fitted to the lux of the driver
+                if (calibration_reference >= 0.0f)
+                {
+                    if (lux_calibration_fit(&lux_calibration, ls_data.lux, calibration_reference, &config.lux_scale, &config.lux_offset) < 0)
+                    {
+                        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Lux calibration point rejected: sensor %.3f lux, reference %.3f lux",
+                                ls_data.lux, calibration_reference);
+                    }
+                    else
+                    {
+                        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Lux calibration of %d points: lux_scale = %.4f, lux_offset = %.3f (kept in clock.conf only if written there)",
+                                lux_calibration.points, config.lux_scale, config.lux_offset);
+                        lux_filter_configure(&lux_filter, config.lux_median, config.lux_tau_s);
+                    }
+                    calibration_reference = -1.0;
+                }
+                // the dimming, the sensor thresholds and the telemetry use the calibrated lux
+                ls_data.lux = lux_calibrate(ls_data.lux, config.lux_scale, config.lux_offset);
+                // interrupt mode: the sample is taken only when the light left the band of the filtered lux, so only the
+                // median rejects the spikes (e.g. a car head light), the smoother is not used: it would keep the filtered
+                // lux in the old band, and the thresholds armed around it would raise the interrupt at each integration
+                // (the median follows a real change after a few samples, and the history is kept between the interrupts)
+                struct timespec sample_time;
+                clock_gettime(CLOCK_MONOTONIC, &sample_time);
+                lux = lux_filter_update(&lux_filter, ls_data.lux, sample_time.tv_sec + sample_time.tv_nsec / 1e9, interrupt_fd < 0);
+            }
+            // no light (0 counts, the lux of the driver may be clamped above 0) is a valid reading only in the most sensitive
+            // range (the auto-ranging selects it at once)
+            int valid_reading = (ls_data.s_ir >= 0) && (ls_data.s_broadband >= 0) &&
+                                ((ls_data.s_broadband > 0) || (ls_data.range == sensor->range_count - 1));
+            if (!valid_reading)
+            {
+                light_sensor_dead = light_sensor_dead + 1;
+                if (light_sensor_dead > light_sensor_dead_lim +1)
+                {
+                    light_sensor_dead = light_sensor_dead_lim +1;
+                }
+            }
+            else
+            {
+                light_sensor_dead = 0;
+            }
+            log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "The measured lux is: %.4f", lux);
+
+            // the warm-up measurement of the start-up: its first valid reading is applied at once, a dark reading of a less
+            // sensitive range is measured again at once in the range selected by the auto-ranging
+            int first_reading = valid_reading && startup_mark(&startup_timing.first_lux_us);
+            if (warm_up)
+            {
+                int retry = !valid_reading && (ls_data.s_ir >= 0) && (ls_data.s_broadband >= 0) && (measurement.range != ls_data.range);
+                if (!retry || (measure_lux_start(&measurement, sensor, i2c_bus_use(&bus, sensor->address)) < 0))
+                {
+                    warm_up = 0;
+                    startup_complete(&publisher);
+                }
+            }
+            // interrupt mode: the dimming follows the measurement without waiting for the minute change,
+            // and the thresholds are set around the new dimming band
+            if (interrupt_fd >= 0)
+            {
+                res = sensor->clear_interrupt(i2c_bus_use(&bus, sensor->address));
+            }
+            if ((interrupt_fd >= 0) || first_reading)
+            {
+                if ((ls_data.s_broadband >= 0) && (ls_data.s_ir >= 0))
+                {
+                    int lightchange = 0;
+                    for (int i = 0; i < display_count; i++)
+                    {
+                        if (displays[i].use_sensor)
+                        {
+                            displays[i].dimming = update_dimming_by_lux(lux, &displays[i].curve, displays[i].dimming);
+                        }
+                        if (displays[i].use_sensor && (displays[i].dimming.lightchange != 0))
+                        {
+                            lightchange = 1;
+                            log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "Display %#.2x dimming is set to %d by the light sensor", displays[i].address,
+                                    displays[i].dimming.currlight);
+                        }
+                    }
+                    if (lightchange)
+                    {
+                        // the ramp sends only the dimming commands, the digits are unchanged
+                        dimming_ramp_start(&ramp, displays);
+                    }
+                }
+            }
+            if (interrupt_fd >= 0)
+            {
+                thresholds_armed = (sensor_arm_thresholds(sensor, i2c_bus_use(&bus, sensor->address), ls_data, displays, display_count, measurement.range,
+                                                          config.lux_scale, config.lux_offset) >= 0);
+            }
+        }
+
+        // minute change (or system clock change): update the display
+        int minute_event = (event == CLOCK_EVENT_MINUTE) || (event == CLOCK_EVENT_JUMP);
+        if (minute_event)
+        {
+            // an offline display is initialized again (e.g. it is plugged in again), and it is sent in the common transfer
+            // if it responds; the failures count as bus faults only if no display responds
+            int offline_count = 0;
+            int online_failed = 1;
+            int online_error = 0;
+            for (int i = 0; i < display_count; i++)
+            {
+                if (!displays[i].offline)
+                {
+                    continue;
+                }
+                offline_count++;
+                res = display_init(1, i2c_bus_use(&bus, displays[i].address));
+                if ((res >= 0) && (config.display_mode == DISPLAY_MODE_HWBLINK) && page_shows_clock(&pages))
+                {
+                    res = display_set_blink(Display_blink_1Hz, i2c_bus_use(&bus, displays[i].address));
+                }
+                if (res < 0)
+                {
+                    online_error = errno;
+                }
+                else
+                {
+                    displays[i].offline = 0;
+                    displays[i].fb.sent_valid = 0;
+                    online_failed = 0;
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "Display %#.2x is initialized again", displays[i].address);
+                }
+            }
+            if ((offline_count == display_count) && (display_count > 0))
+            {
+                bus_recovered |= i2c_bus_check(&bus, online_failed ? -1 : 0, online_error);
+            }
+        }
+
+        // the dimming and the display content: at the minute change, and at once with the changed settings
+        if (minute_event || display_refresh)
+        {
+            // if it is 4 o'clock in the morning, or the sunset is not yet calculated, than let's calculate it
+            // (only if a display is dimmed by the sun)
+            if (sun_displays > 0)
+            {
+                if (((a_tm->tm_hour == 4) && (a_tm->tm_min == 0))||(thissunup.set_hour == -1))
+                {
+                    // look up sun-set and sun-rise times
+                    thissunup=sun_table_lookup(&sun_table, a_tm);
+                    // output at every loglevel
+                    if (thissunup.polar != 0)
+                    {
+                        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "%s: the sun does not %s today", (thissunup.polar > 0) ? "polar day" : "polar night",
+                                (thissunup.polar > 0) ? "set" : "rise");
+                    }
+                    else
+                    {
+                        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "sun set is expected at %02d:%02d", thissunup.set_hour, thissunup.set_min);
+                        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "sun rise is expected at %02d:%02d", thissunup.rise_hour, thissunup.rise_min);
+                    }
+
+                    // if currlight is not yet initialized
+                    for (int i = 0; (i < display_count) && first_minute; i++)//(currlight==-1)
+                    {
+                        struct display_dimming *adimming = &displays[i].dimming;
+                        if (displays[i].use_sensor)
+                        {
+                            continue;
+                        }
+                        // in the polar days update_dimming sets the light, else
+                        // if the current time is smaller or equal than the sun-rise time, or higher than the sun-set time, than
+                        if (thissunup.polar != 0)
+                        {
+                            continue;
+                        }
+                        if (((a_tm->tm_hour*100+a_tm->tm_min) <= (thissunup.rise_hour*100+ thissunup.rise_min)) ||
+                            ((a_tm->tm_hour*100+a_tm->tm_min) > (thissunup.set_hour*100+ thissunup.set_min)))
+                        {
+                            // set the display light to minimum
+                            adimming->currlight=adimming->dimming_min;
+                        }
+                        else
+                        {
+                            // else set it to the maximum
+                            adimming->currlight=adimming->dimming_max;
+                        }
+                    }
+                }
+            }
+
+            // define current dimming settings of each display
+            for (int i = 0; i < display_count; i++)
+            {
+                struct display_dimming *adimming = &displays[i].dimming;
+                if (displays[i].use_sensor == 0)
+                {
+                    // if light sensor is not availbale or not to be used, based on sunup/sunrise
+                    *adimming=update_dimming(a_tm,*adimming,thissunup);
+                }
+                else
+                {
+                    // else based on the sensor reading
+                    // if sensor reading OK
+                    if ((ls_data.s_broadband >=0 ) && (ls_data.s_ir >= 0))
+                    {
+                        *adimming=update_dimming_by_lux(lux, &displays[i].curve, *adimming);
+                    }
+                    // else use substitute value
+                    else
+                    {
+                        adimming->currlight= SubstituteDimming;
+                    }
+                }
+            }
+
+            // the dimming change is done by the ramp, the display update shows the current level of the ramp
+            dimming_ramp_start(&ramp, displays);
+            // define memory values for the displays: the visible page is drawn once for all of them (if its content changed)
+            page_ctx.a_tm = a_tm;
+            page_ctx.mode = config.display_mode;
+            page_ctx.lux = lux;
+            page_ctx.lux_valid = light_sensor_available && (ls_data.s_broadband >= 0) && (ls_data.s_ir >= 0);
+            page_draw(&pages, &page_ctx, &adisp_refresh_values);
+
+            // Set display content and dimming (one transfer for all displays)
+            disp_status= display_update(adisp_refresh_values, displays, &ramp, bus.fd);
+            int disp_error = errno;
+            if (disp_status < 0)
+            {
+                log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY UPDATE FIALED");
+            }
+            // the minute timer woke up the loop: how late is the new minute on the display
+            if (minute_flip)
+            {
+                struct timespec flip_time;
+                clock_gettime(CLOCK_REALTIME, &flip_time);
+                if ((flip_time.tv_sec % 60) < 30)
+                {
+                    stats_record(STATS_MINUTE_LATE, (flip_time.tv_sec % 60) * 1000000L + flip_time.tv_nsec / 1000);
+                }
+            }
+            bus_recovered |= i2c_bus_check(&bus, disp_status, disp_error);
+            // only display minutely information at more detailed loglevels
+            log_msg(LOG_DISPLAY, LOG_LEVEL_INFO, "The hour is: %02d, display code is %#.2x;%#.2x, result: %d",a_tm->tm_hour,adisp_refresh_values.disp_h1,adisp_refresh_values.disp_h2,res);
+            log_msg(LOG_DISPLAY, LOG_LEVEL_INFO, "The minute is: %02d, display code is %#.2x;%#.2x, result: %d",a_tm->tm_min,adisp_refresh_values.disp_min1,adisp_refresh_values.disp_min2,res);
+            for (int i = 0; i < display_count; i++)
+            {
+                if (displays[i].dimming.lightchange == 0)
+                {
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_INFO, "Display %#.2x dimming is unchanged, %d, display memory is %#.2x", displays[i].address,
+                            displays[i].dimming.currlight, displays[i].fb.dim);
+                }
+                // display dimming change at every loglevel
+                if (displays[i].dimming.lightchange != 0)
+                {
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "Display %#.2x dimming is set to %d, display memory to set: %#.2x, result: %d", displays[i].address,
+                            displays[i].dimming.currlight, displays[i].fb.dim, disp_status);
+                }
+            }
+        }
+
+        // the other tasks of the minute change: sensor restart, history, telemetry
+        if (minute_event)
+        {
+            // if light sensor failure occured, than try restart the light sensor
+            if (light_sensor_dead == light_sensor_dead_lim)
+            {
+                atomic_fetch_add_explicit(&clock_stats.sensor_restarts, 1, memory_order_relaxed);
+                res = sensor_init(sensor, 0, i2c_bus_use(&bus, sensor->address));
+                if (res >= 0)
+                {
+                    program_sleep(0.5);
+                    res=sensor_init(sensor, 1, i2c_bus_use(&bus, sensor->address));
+                }
+                if (res >= 0)
+                {
+                    // the samples before the restart are not trusted
+                    lux_filter_configure(&lux_filter, config.lux_median, config.lux_tau_s);
+                    // the init turned off the sensor interrupt, and set the default range
+                    thresholds_armed = 0;
+                    measurement.range = -1;
+                }
+                else
+                {
+                    light_sensor_dead = 0;
+                }
+            }
+
+            // the reading of the minute is archived (only with the real time, the records are ordered by time)
+            if (light_sensor_available && page_ctx.clock_synced && (ls_data.s_broadband >= 0) && (ls_data.s_ir >= 0))
+            {
+                lux_history_append(&lux_history, now, ls_data);
+            }
+
+            // hand over the telemetry to the MQTT publisher thread (never blocks the display update)
+            telemetry.timestamp = now;
+            telemetry.lux = lux;
+            // the telemetry carries the dimming of the first display
+            telemetry.dimming = displays[0].dimming.currlight;
+            telemetry.ir = ls_data.s_ir;
+            telemetry.broadband = ls_data.s_broadband;
+            telemetry.range = light_sensor_available ? ls_data.range : -1;
+            telemetry.disp_err = disp_status;
+            telemetry.sensor_restart = (light_sensor_dead == light_sensor_dead_lim);
+            if (!telemetry_policy_check(&telemetry_policy, &telemetry))
+            {
+                // nothing changed out of the deadband: the publisher thread is not woken up
+                atomic_fetch_add_explicit(&clock_stats.telemetry_suppressed, 1, memory_order_relaxed);
+            }
+            else if (telemetry_queue_push(&publisher.queue, &telemetry) < 0)
+            {
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT queue is full, telemetry dropped");
+            }
+
+            // the per-second refresh is re-aligned to the second boundary of the system clock (if the time is shown)
+            if ((refresher.timer_fd >= 0) && page_shows_clock(&pages))
+            {
+                refresh_scheduler_report(&refresher);
+                refresh_scheduler_start(&refresher);
+            }
+
+            first_minute = 0;
+        }
+
+        // interrupt mode: set the thresholds around the current dimming band if they are not yet set
+        if ((minute_event || display_refresh) && (interrupt_fd >= 0) && (thresholds_armed == 0))
+        {
+            thresholds_armed = (sensor_arm_thresholds(sensor, i2c_bus_use(&bus, sensor->address), ls_data, displays, display_count, measurement.range,
+                                                      config.lux_scale, config.lux_offset) >= 0);
+        }
+
+        // per-second display refresh: only the changed digits / the colon are sent (see display_flush)
+        if ((event == CLOCK_EVENT_TICK) && (refresh_scheduler_tick(&refresher) > 0))
+        {
+            // the tick is aligned to the second boundary, the time is rounded to be safe from a slightly early wake-up
+            struct timespec tick_time;
+            clock_gettime(CLOCK_REALTIME, &tick_time);
+            time_t tick_sec = tick_time.tv_sec + (tick_time.tv_nsec >= 500000000L);
+            a_tm = localtime(&tick_sec);
+            page_ctx.a_tm = a_tm;
+            if (page_draw(&pages, &page_ctx, &adisp_refresh_values))
+            {
+                disp_status = display_update(adisp_refresh_values, displays, &ramp, bus.fd);
+                int error = errno;
+                if (disp_status < 0)
+                {
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY UPDATE FIALED");
+                }
+                bus_recovered |= i2c_bus_check(&bus, disp_status, error);
+            }
+        }
+
+        // the display time of the page is over (the next page is drawn), or new data of the visible page is received
+        // (the frame is only sent if the page changed)
+        if (((event == CLOCK_EVENT_PAGE) && (page_scheduler_rotate(&pages) > 0)) ||
+            ((event == CLOCK_EVENT_PAGE_DATA) && (page_data_read(&pages) > 0)))
+        {
+            if (event == CLOCK_EVENT_PAGE)
+            {
+                display_clock_effects(page_shows_clock(&pages), config.display_mode, &refresher, displays, display_count, &bus);
+            }
+            page_ctx.a_tm = a_tm;
+            if (page_draw(&pages, &page_ctx, &adisp_refresh_values))
+            {
+                disp_status = display_update(adisp_refresh_values, displays, &ramp, bus.fd);
+                int error = errno;
+                if (disp_status < 0)
+                {
+                    log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY UPDATE FIALED");
+                }
+                bus_recovered |= i2c_bus_check(&bus, disp_status, error);
+            }
+        }
+
+        // the next brightness step of the dimming ramp
+        if (event == CLOCK_EVENT_RAMP)
+        {
+            res = dimming_ramp_step(&ramp, displays, bus.fd);
+            int error = errno;
+            if (res < 0)
+            {
+                log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY DIMMING FAILED");
+            }
+            bus_recovered |= i2c_bus_check(&bus, res, error);
+        }
+
+        // the I2C bus was reopened: the devices may have lost their state, initialize them again
+        if (bus_recovered)
+        {
+            for (int i = 0; i < display_count; i++)
+            {
+                displays[i].offline = (display_init(1, i2c_bus_use(&bus, displays[i].address)) < 0);
+                if ((config.display_mode == DISPLAY_MODE_HWBLINK) && page_shows_clock(&pages))
+                {
+                    display_set_blink(Display_blink_1Hz, i2c_bus_use(&bus, displays[i].address));
+                }
+                // the whole display RAM and the dimming is re-sent
+                displays[i].fb.sent_valid = 0;
+            }
+            disp_status = display_flush(displays, display_count, bus.fd);
+            res = 0;
+            if (light_sensor_available)
+            {
+                res = sensor_init(sensor, 1, i2c_bus_use(&bus, sensor->address));
+                // the init turned off the sensor interrupt, and set the default range
+                thresholds_armed = 0;
+                measurement.range = -1;
+            }
+            log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "I2C bus recovered (%d), display: %d, sensor: %d", bus.recoveries, disp_status, res);
+            bus_recovered = 0;
+        }
+
+        // sleep till the next lux sample slot, minute change or sensor interrupt
+        // in interrupt mode the sensor is sampled only in every SensorCheckMinutes
+        int sample_lux = light_sensor_available &&
+                         ((interrupt_fd < 0) || ((a_tm->tm_min % SensorCheckMinutes) == (SensorCheckMinutes - 1)));
+        stats_since(STATS_LOOP, &loop_start);
+        event = wait_for_clock_event(timer_fd, sample_lux, interrupt_fd, measurement.timer_fd, ramp.timer_fd, refresher.timer_fd, config_fd,
+                                     pages.timer_fd, pages.feed.event_fd, publisher.commands.event_fd, clock_sync.timer_fd);
+        clock_gettime(CLOCK_MONOTONIC, &loop_start);
+        minute_flip = (event == CLOCK_EVENT_MINUTE);
+    }
+    close(timer_fd);
+    close(measurement.timer_fd);
+    close(ramp.timer_fd);
+    if (refresher.timer_fd >= 0)
+    {
+        close(refresher.timer_fd);
+    }
+    if (clock_sync.timer_fd >= 0)
+    {
+        close(clock_sync.timer_fd);
+    }
+    if (config_fd >= 0)
+    {
+        close(config_fd);
+    }
+    if (interrupt_fd >= 0)
+    {
+        close(interrupt_fd);
+    }
+    // Turn off the displays
+    for (int i = 0; i < display_count; i++)
+    {
+        res = display_init(0, i2c_bus_use(&bus, displays[i].address));
+        if (res < 0)
+        {
+            log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY %#.2x SHUTDOWN FAILED", displays[i].address);
+        }
+    }
+    // Turn off sensor
+    if (light_sensor_available)
+    {
+      res = sensor_init(sensor, 0, i2c_bus_use(&bus, sensor->address));
+      if (res < 0)
+      {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "SENSOR SHUTDOWN FAILED");
+      }
+    }
+    lux_history_close(&lux_history);
+    //Stop the publisher thread, disconnect and destroy MQTT
+    mqtt_publisher_stop(&publisher);
+    // after the MQTT thread: the callback writes the page eventfd
+    page_scheduler_close(&pages);
+    sun_table_close(&sun_table);
+    i2c_bus_close(&bus);
+    // write the pending log records
+    log_stop();
+    return 0;
+}
+
+/* FUNCTION I2C_BUS_OPEN
+This function opens the I2C bus (a failure is not fatal, the bus is reopened by i2c_bus_check)
+Inputs:
+    bus: the I2C bus, adapter_nr is to be set
+Output:
+    0 on success, -1 if the bus could not be opened
+*/
+int i2c_bus_open(struct i2c_bus *bus)
+{
+    char filename[20];
+
+    snprintf(filename, 19, "/dev/i2c-%d", bus->adapter_nr);
+    bus->fd = open(filename, O_RDWR | O_CLOEXEC);
+    // the handle is not yet bound to any device
+    bus->address = -1;
+    // if fake I2C header is used, than file opening will fail
+    #ifdef I2C_INC_FAKE
+        if (bus->fd < 0)
+        {
+            bus->fd = -bus->fd;
+        }
+    #endif
+    if (bus->fd < 0)
+    {
+        // ERROR HANDLING; you can check errno to see what went wrong
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "FAILED OPENING I2C BUS");
+        return -1;
+    }
+    return 0;
+}
+
+/* FUNCTION I2C_BUS_CLOSE
+This function closes the I2C bus handle opened by i2c_bus_open
+Inputs:
+    bus: the I2C bus
+*/
+void i2c_bus_close(struct i2c_bus *bus)
+{
+    // if fake I2C header is used, than the handle is not a real file
+    #ifndef I2C_INC_FAKE
+        if (bus->fd >= 0)
+        {
+            close(bus->fd);
+        }
+    #endif
+    bus->fd = -1;
+    bus->address = -1;
+}
+
+/* FUNCTION I2C_BUS_USE
+This function binds the bus handle to the slave address of the device, the ioctl is skipped if the handle
+is already bound to the address
+Inputs:
+    bus: the I2C bus
+    address: address of the device
+Output:
+    the bus handle to be used for the transactions with the device, -1 if the handle cannot be bound to the address
+*/
+int i2c_bus_use(struct i2c_bus *bus, unsigned char address)
+{
+    if ((bus->fd >= 0) && (bus->address != address))
+    {
+        // actually this linkes the address to the file
+        if (ioctl(bus->fd, I2C_SLAVE, address) < 0)
+        {
+            // ERROR HANDLING: the transactions would go to the previous device, they shall fail instead
+            bus->address = -1;
+            log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "OPENING CHANNEL FOR %#02x IS FAILED", address);
+            return -1;
+        }
+        bus->address = address;
+    }
+    return bus->fd;
+}
+
+/* FUNCTION I2C_BUS_CHECK
+This function counts the consecutive bus faults (EREMOTEIO, ETIMEDOUT, EIO), and after I2CErrorBurst of them
+the bus handle is reopened (the process is not restarted)
+if the bus is not open (e.g. it failed at the start-up), the reopen is tried at once
+Inputs:
+    bus: the I2C bus
+    res: result of the last transaction(s), negative on failure
+    error: errno captured at the failed transaction (only used if res is negative)
+Output:
+    1 if the bus was reopened (the devices shall be initialized again), 0 otherwise
+*/
+int i2c_bus_check(struct i2c_bus *bus, int res, int error)
+{
+    if (bus->fd >= 0)
+    {
+        atomic_fetch_add_explicit(&clock_stats.i2c_ops, 1, memory_order_relaxed);
+        if (res >= 0)
+        {
+            bus->errors = 0;
+            return 0;
+        }
+        // NACK (EREMOTEIO), stuck bus (ETIMEDOUT) or controller error (EIO): the other errors are not bus faults
+        if ((error != EREMOTEIO) && (error != ETIMEDOUT) && (error != EIO))
+        {
+            return 0;
+        }
+        atomic_fetch_add_explicit(&clock_stats.i2c_errors, 1, memory_order_relaxed);
+        bus->errors++;
+        if (bus->errors < I2CErrorBurst)
+        {
+            return 0;
+        }
+    }
+    // reopen the bus, the controller driver resets its state at the open
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "I2C bus faults: %d, the bus is reopened (errno: %d)", bus->errors, error);
+    i2c_bus_close(bus);
+    bus->errors = 0;
+    if (i2c_bus_open(bus) < 0)
+    {
+        return 0;
+    }
+    bus->recoveries++;
+    atomic_fetch_add_explicit(&clock_stats.i2c_reopens, 1, memory_order_relaxed);
+    return 1;
+}
+
+/* FUNCTION: SENSOR_INIT
+ sub-function is created to turn on and turn off the light sensor, via the bound sensor driver
+ inputs
+        sensor: the sensor driver
+        onoff: 1 to turn the sensor on, 0 to turn the sensor off
+        file: bus handler
+*/
+int sensor_init(const struct sensor_driver *sensor, unsigned char onoff, int file)
+{
+    if (onoff)
+    {
+        return sensor->init(1, file);
+    }
+    return sensor->shutdown(file);
+}
+
+/* FUNCTION: DISPLAY_INIT
+sub-function is created to turn on and turn off the display
+ inputs
+        onoff: 1 to turn the display and the oscillator on; 0 to turn it off
+*/
+int display_init(unsigned char onoff, int file)
+{
+    unsigned char display_switch = 0x80 | onoff;
+    unsigned char display_osc    = 0x20 | onoff;
+    int res = 0;
+    int ares = 0;
+
+    // Using SMBus commands
+    res = i2c_smbus_read_byte_data(file, display_osc);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares = res;
+    }
+    log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Display message set to %#.2x, with result %d",display_osc,res);
+
+    // Using SMBus commands
+    res = i2c_smbus_read_byte_data(file, display_switch);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares = res;
+    }
+
+    log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Display message set to %#.2x, with result %d",display_switch,res);
+
+    // the colon is part of the display framebuffer (see display_frame_compose)
+
+    return ares;
+}
+
+/* FUNCTION: DISP_REFRESH_VALUES
+sub-function to update the display content
+ inputs:
+    displ_h1 - memory content of the first character of the hour
+    displ_h2 - memory content of the second character of the hour
+    disp_min1 - memory content of the first character of the minute
+    disp_min2 - memory content of the second character of the minute
+ output: ---
+*/
+struct disp_refresh_values get_displ_values(struct tm *a_tm, unsigned char currlight, enum display_mode mode)
+{
+    struct disp_refresh_values adisp_refresh_values;
+    if (mode == DISPLAY_MODE_MMSS)
+    {
+        // define display hex codes for MM:SS
+        adisp_refresh_values.disp_h1 = get_hex_code(a_tm->tm_min/10);
+        adisp_refresh_values.disp_h2 = get_hex_code(a_tm->tm_min%10);
+        adisp_refresh_values.disp_min1 = get_hex_code(a_tm->tm_sec/10);
+        adisp_refresh_values.disp_min2 = get_hex_code(a_tm->tm_sec%10);
+    }
+    else
+    {
+        // define display hex codes for HH:MM
+        adisp_refresh_values.disp_h1 = get_hex_code(a_tm->tm_hour/10);
+        adisp_refresh_values.disp_h2 = get_hex_code(a_tm->tm_hour%10);
+        adisp_refresh_values.disp_min1 = get_hex_code(a_tm->tm_min/10);
+        adisp_refresh_values.disp_min2 = get_hex_code(a_tm->tm_min%10);
+    }
+    // the blinking colon is on in the even seconds (so it is turned on at the minute change)
+    if ((mode == DISPLAY_MODE_BLINK) && (a_tm->tm_sec % 2))
+    {
+        adisp_refresh_values.disp_colon = 0;
+    }
+    else
+    {
+        adisp_refresh_values.disp_colon = Colon_on;
+    }
+    // get display hex code for dimming
+    adisp_refresh_values.disp_dim = 0xE0+ currlight;
+
+    return adisp_refresh_values;
+}
+
+/* FUNCTION: DISPLAY_UPDATE
+this function send the defined values to the display devices via the I2C bus
+the digits are the same on all displays, the dimming of each display is the current level of its ramp
+ inputs:
+    adisp_refresh_values    :   contains the register values of the display segments
+    displays                :   the displays (ramp->count of them)
+    ramp                    :   the dimming ramp
+    file                    :   bus handler
+*/
+int display_update(struct disp_refresh_values adisp_refresh_values, struct clock_display *displays, const struct dimming_ramp *ramp, int file)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // fill the framebuffers, than send the changes of all displays together
+    for (int i = 0; i < ramp->count; i++)
+    {
+        adisp_refresh_values.disp_dim = 0xE0 + ramp->level[i];
+        display_frame_compose(&displays[i].fb, adisp_refresh_values);
+    }
+    int res = display_flush(displays, ramp->count, file);
+    stats_since(STATS_DISPLAY, &start);
+    return res;
+}
+
+/* FUNCTION: DISPLAY_FRAME_COMPOSE
+this function writes the display refresh values into the display framebuffer (no I2C communication)
+ inputs:
+    fb                      :   the framebuffer to be filled
+    adisp_refresh_values    :   contains the register values of the display segments
+*/
+void display_frame_compose(struct display_framebuffer *fb, struct disp_refresh_values adisp_refresh_values)
+{
+    fb->ram[Hour1_address] = adisp_refresh_values.disp_h1;
+    fb->ram[Hour2_address] = adisp_refresh_values.disp_h2;
+    fb->ram[Colon_address] = adisp_refresh_values.disp_colon;
+    fb->ram[Min1_address]  = adisp_refresh_values.disp_min1;
+    fb->ram[Min2_address]  = adisp_refresh_values.disp_min2;
+    fb->dim = adisp_refresh_values.disp_dim;
+}
+
+/* display_batch_send: sends the collected display messages as one I2C_RDWR transfer (repeated start between the messages) */
+static int display_batch_send(int file, struct i2c_msg *msgs, int nmsgs)
+{
+    struct i2c_rdwr_ioctl_data batch;
+    if (nmsgs == 0)
+    {
+        return 0;
+    }
+    batch.msgs = msgs;
+    batch.nmsgs = nmsgs;
+    int res = ioctl(file, I2C_RDWR, &batch);
+    log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Display batch of %d messages is written, with result %d", nmsgs, res);
+    return (res < 0) ? -1 : 0;
+}
+
+/* FUNCTION: DISPLAY_FLUSH
+this function sends the changed bytes of the framebuffers to the display devices
+the display address pointer is incremented automatically after each byte, so a run of changed bytes is sent
+as one block write (changed bytes separated by at most DisplayMergeGap unchanged bytes are merged into the same run)
+the dimming command is only sent if it differs from the last one sent
+if the display content is not known (start-up, I2C failure) the whole display RAM is sent
+the block writes and dimming commands of all displays are collected into one I2C_RDWR transfer (split only if it
+would exceed DISPLAY_BATCH_MSGS messages), so the frame of a tick is one system call for all displays
+the transfer stops at the first NACK: after a failed transfer each of its displays is sent again in its own transfer,
+a display failing that is set offline, and sent in its own transfer till it is initialized again (only the going offline
+is reported as an error, so a missing display does not cause a fault burst at every frame)
+ inputs:
+    displays                :   the displays to be sent
+    count                   :   number of the displays
+    file                    :   bus handler
+*/
+int display_flush(struct clock_display *displays, int count, int file)
+{
+    // per display at most one message for each run (the runs are separated by unchanged bytes), and the dimming command
+    struct i2c_msg msgs[DISPLAY_MAX * (DISPLAY_RAM_SIZE / 2 + 2)];
+    unsigned char bytes[DISPLAY_MAX * (DISPLAY_RAM_SIZE / 2 + 2)][DISPLAY_RAM_SIZE + 1];
+    int owner[DISPLAY_MAX * (DISPLAY_RAM_SIZE / 2 + 2)];
+    int result[DISPLAY_MAX];
+    int first_msg[DISPLAY_MAX];
+    int nmsgs = 0;
+    int batched = 0;
+    int ares = 0;
+
+    // the messages of the online displays first (the common transfer), than the messages of the offline displays
+    for (int n = 0; n < 2 * count; n++)
+    {
+        int d = n % count;
+        if (n == count)
+        {
+            batched = nmsgs;
+        }
+        if ((displays[d].offline != 0) != (n >= count))
+        {
+            continue;
+        }
+        struct display_framebuffer *fb = &displays[d].fb;
+        int i = 0;
+        result[d] = 0;
+        first_msg[d] = nmsgs;
+        while (i < DISPLAY_RAM_SIZE)
+        {
+            // find the first changed byte
+            if (fb->sent_valid && (fb->ram[i] == fb->sent[i]))
+            {
+                i++;
+                continue;
+            }
+            // extend the run till the last changed byte, bridging small gaps of unchanged bytes
+            int first = i;
+            int last = i;
+            for (int j = i + 1; j < DISPLAY_RAM_SIZE; j++)
+            {
+                if (!fb->sent_valid || (fb->ram[j] != fb->sent[j]))
+                {
+                    if (j - last - 1 > DisplayMergeGap)
+                    {
+                        break;
+                    }
+                    last = j;
+                }
+            }
+            // the display RAM address, than the data of the run
+            bytes[nmsgs][0] = first;
+            memcpy(&bytes[nmsgs][1], &fb->ram[first], last - first + 1);
+            msgs[nmsgs].addr = displays[d].address;
+            msgs[nmsgs].flags = 0;
+            msgs[nmsgs].len = last - first + 2;
+            msgs[nmsgs].buf = bytes[nmsgs];
+            owner[nmsgs++] = d;
+            log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Display %#.2x RAM %#.2x..%#.2x is queued", displays[d].address, first, last);
+            i = last + 1;
+        }
+
+        //dimming
+        // only perform if dimming needs to be changed, the command is a one byte write
+        if (!fb->sent_valid || (fb->dim != fb->sent_dim))
+        {
+            bytes[nmsgs][0] = fb->dim;
+            msgs[nmsgs].addr = displays[d].address;
+            msgs[nmsgs].flags = 0;
+            msgs[nmsgs].len = 1;
+            msgs[nmsgs].buf = bytes[nmsgs];
+            owner[nmsgs++] = d;
+        }
+    }
+
+    // one transfer for all online displays (more only if it would exceed DISPLAY_BATCH_MSGS messages)
+    for (int first = 0; first < batched; first += DISPLAY_BATCH_MSGS)
+    {
+        int n = (batched - first < DISPLAY_BATCH_MSGS) ? batched - first : DISPLAY_BATCH_MSGS;
+        int res = display_batch_send(file, &msgs[first], n);
+        for (int k = first; (k < first + n) && (res < 0); k++)
+        {
+            // ERROR HANDLING: i2c transaction failed, the displays of the failed transfer are sent one by one
+            result[owner[k]] = res;
+        }
+    }
+    // an own transfer for each display of a failed transfer, and for each offline display
+    for (int d = 0; d < count; d++)
+    {
+        if ((result[d] < 0) || displays[d].offline)
+        {
+            int last_msg = first_msg[d];
+            while ((last_msg < nmsgs) && (owner[last_msg] == d))
+            {
+                last_msg++;
+            }
+            result[d] = display_batch_send(file, &msgs[first_msg[d]], last_msg - first_msg[d]);
+        }
+    }
+
+    for (int d = 0; d < count; d++)
+    {
+        struct display_framebuffer *fb = &displays[d].fb;
+        if ((result[d] < 0) && !displays[d].offline)
+        {
+            // ERROR HANDLING: the display is kept out of the common transfer till it is initialized again
+            ares = result[d];
+            displays[d].offline = 1;
+            log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "Display %#.2x is not responding, it is sent in an own transfer", displays[d].address);
+        }
+        // remember what is on the display; after a failure the content is unknown, so it will be fully re-sent
+        memcpy(fb->sent, fb->ram, DISPLAY_RAM_SIZE);
+        fb->sent_dim = fb->dim;
+        fb->sent_valid = (result[d] >= 0);
+    }
+    return ares;
+}
+
+
+/* FUNCTION: DISPLAY_SET_BLINK
+this function sets the blinking of the whole display by the HT16K33 (the display stays turned on)
+the blinking is done by the display driver, the CPU does not need to wake up for it
+ inputs:
+    blink                   :   blink frequency setting (Display_blink_off, Display_blink_1Hz)
+    file                    :   bus handler
+*/
+int display_set_blink(unsigned char blink, int file)
+{
+    // display setup: display on, and the blink frequency
+    unsigned char display_setup = 0x80 | 0x01 | blink;
+    int res = 0;
+
+    // Using SMBus commands
+    res = i2c_smbus_read_byte_data(file, display_setup);
+    log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Display message set to %#.2x, with result %d", display_setup, res);
+    return (res < 0) ? res : 0;
+}
+
+/* FUNCTION: DISPLAY_CLOCK_EFFECTS
+this function starts or stops the per-second refresh, and in the hwblink mode the blinking of the displays,
+they are only needed while the visible page shows the time
+ inputs:
+    clock_shown             :   1 if the visible page shows the time
+    mode                    :   the display mode
+    refresher               :   the per-second refresh
+    displays                :   the displays
+    count                   :   number of the displays
+    bus                     :   the I2C bus
+*/
+void display_clock_effects(int clock_shown, enum display_mode mode, struct refresh_scheduler *refresher, const struct clock_display *displays,
+                           int count, struct i2c_bus *bus)
+{
+    if (clock_shown)
+    {
+        refresh_scheduler_start(refresher);
+    }
+    else
+    {
+        refresh_scheduler_stop(refresher);
+    }
+    for (int i = 0; (i < count) && (mode == DISPLAY_MODE_HWBLINK); i++)
+    {
+        if (display_set_blink(clock_shown ? Display_blink_1Hz : Display_blink_off, i2c_bus_use(bus, displays[i].address)) < 0)
+        {
+            log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "DISPLAY %#.2x BLINK FAILED", displays[i].address);
+        }
+    }
+}
+
+/* FUNCTION: PARSE_DISPLAY_MODE
+this function converts the name of the display mode (hhmm, blink, mmss, hwblink, lux) to enum display_mode
+Input:
+    name: name of the display mode
+    mode: the result
+Output:
+    0 if the name is known, -1 otherwise
+*/
+int parse_display_mode(const char *name, enum display_mode *mode)
+{
+    if (strcmp(name, "hhmm") == 0)
+    {
+        *mode = DISPLAY_MODE_HHMM;
+    }
+    else if (strcmp(name, "blink") == 0)
+    {
+        *mode = DISPLAY_MODE_BLINK;
+    }
+    else if (strcmp(name, "mmss") == 0)
+    {
+        *mode = DISPLAY_MODE_MMSS;
+    }
+    else if (strcmp(name, "hwblink") == 0)
+    {
+        *mode = DISPLAY_MODE_HWBLINK;
+    }
+    else if (strcmp(name, "lux") == 0)
+    {
+        *mode = DISPLAY_MODE_LUX;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* FUNCTION: DIMMING_RAMP_START
+this function starts (or retargets) the dimming ramp from the current brightness levels to the targets
+the first step is done at once, the following ones are spread over the ramp duration (but at least RampMinStepMs apart),
+so a transition needs at most MaxDimming brightness commands
+the step period is set by the display with the longest transition, the shorter ones reach their target earlier
+if the brightness on a display is not yet known, its target is set without ramp
+Input:
+    ramp: the dimming ramp
+    displays: the displays (ramp->count of them), the targets are their current dimming
+*/
+void dimming_ramp_start(struct dimming_ramp *ramp, const struct clock_display *displays)
+{
+    struct itimerspec steps;
+    memset(&steps, 0, sizeof(steps));
+    int levels = 0;
+    for (int i = 0; i < ramp->count; i++)
+    {
+        ramp->target[i] = (ramp->override >= 0) ? ramp->override : displays[i].dimming.currlight;
+        if (ramp->level[i] < 0)
+        {
+            // nothing to ramp: the level is shown by the next display update
+            ramp->level[i] = ramp->target[i];
+        }
+        if (abs(ramp->target[i] - ramp->level[i]) > levels)
+        {
+            levels = abs(ramp->target[i] - ramp->level[i]);
+        }
+    }
+    if (levels == 0)
+    {
+        // all targets are reached, the running ramp is stopped
+        timerfd_settime(ramp->timer_fd, 0, &steps, NULL);
+        return;
+    }
+    int step_ms = ramp->duration_ms / levels;
+    if (step_ms < RampMinStepMs)
+    {
+        step_ms = RampMinStepMs;
+    }
+    // the first step at once (1 ns, a zero value would disarm the timer), than periodically
+    steps.it_value.tv_nsec = 1;
+    steps.it_interval.tv_sec = step_ms / 1000;
+    steps.it_interval.tv_nsec = (step_ms % 1000) * 1000000L;
+    if (timerfd_settime(ramp->timer_fd, 0, &steps, NULL) < 0)
+    {
+        // ERROR HANDLING: no timer, the targets are shown by the next display update
+        memcpy(ramp->level, ramp->target, sizeof(ramp->level));
+        return;
+    }
+    for (int i = 0; i < ramp->count; i++)
+    {
+        if (ramp->level[i] != ramp->target[i])
+        {
+            log_msg(LOG_DISPLAY, LOG_LEVEL_INFO, "Display %#.2x dimming ramp from %d to %d, step in every %d ms", displays[i].address,
+                    ramp->level[i], ramp->target[i], step_ms);
+        }
+    }
+}
+
+/* FUNCTION: DIMMING_RAMP_STEP
+this function is called when the ramp timer expires: the brightness of each display is stepped towards its target,
+and only the brightness commands are sent, in one transfer (the display RAM is unchanged, see display_flush)
+if the process was late and more steps are expired, the level is stepped by all of them with one command
+Input:
+    ramp: the dimming ramp
+    displays: the displays (ramp->count of them)
+    file: bus handler
+Output:
+    the result of the display flush
+*/
+int dimming_ramp_step(struct dimming_ramp *ramp, struct clock_display *displays, int file)
+{
+    uint64_t expirations = 0;
+    if (read(ramp->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        return 0;
+    }
+    int reached = 1;
+    for (int i = 0; i < ramp->count; i++)
+    {
+        int levels = abs(ramp->target[i] - ramp->level[i]);
+        if ((ramp->duration_ms == 0) || (expirations >= (uint64_t)levels))
+        {
+            ramp->level[i] = ramp->target[i];
+        }
+        else
+        {
+            ramp->level[i] += (ramp->target[i] > ramp->level[i]) ? (int)expirations : -(int)expirations;
+            reached = 0;
+        }
+        displays[i].fb.dim = 0xE0 + ramp->level[i];
+    }
+    if (reached)
+    {
+        // all targets are reached, stop the timer
+        struct itimerspec stop;
+        memset(&stop, 0, sizeof(stop));
+        timerfd_settime(ramp->timer_fd, 0, &stop, NULL);
+    }
+    int res = display_flush(displays, ramp->count, file);
+    log_msg(LOG_DISPLAY, LOG_LEVEL_DEBUG, "Dimming ramp step: %d (target %d) on the first display, result: %d", ramp->level[0], ramp->target[0], res);
+    return res;
+}
+
+/* FUNCTION: UPDATE_DIMMING
+this function is responsible to modify the current dimming settings in function of the current time
+at sun-set the dimming is set to the minimum, at sun-rise to the maximum (the transition is smoothed by the dimming ramp)
+in the polar night the dimming is kept at the minimum, in the polar day at the maximum
+inputs:
+ struct tm *a_tm                    : including the current time
+ struct display_dimming adimming    : including the previous dimming settings
+ struct sunup thissunup             : including the sun-set sun-rise times to know when the dimming needs to change
+output                              : including the current dimming settings (with memory)
+*/
+struct display_dimming update_dimming(struct tm *a_tm,struct display_dimming adimming,struct sunup thissunup)
+{
+    struct display_dimming bdimming=adimming;
+    bdimming.lightchange = 0;
+    // polar day and polar night: the light is kept at the maximum / minimum all day
+    if (thissunup.polar != 0)
+    {
+        unsigned char polar_light = (thissunup.polar > 0) ? bdimming.dimming_max : bdimming.dimming_min;
+        if (bdimming.currlight != polar_light)
+        {
+            bdimming.lightchange = (polar_light > bdimming.currlight) ? 1 : -1;
+            bdimming.currlight = polar_light;
+        }
+    }
+    // If the sunset is now
+    else if ((thissunup.set_hour == a_tm->tm_hour) && (thissunup.set_min == a_tm->tm_min))
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_DEBUG, "decrease dimming");
+
+        // If not yet on min light
+        // Minimum dimming setting is 0
+        if (bdimming.currlight > bdimming.dimming_min)
+        {
+            // decrease light
+            bdimming.currlight = bdimming.dimming_min;
+            bdimming.lightchange = -1;
+        }
+    }
+    // If the sunrise is now
+    else if ((thissunup.rise_hour == a_tm->tm_hour) && (thissunup.rise_min == a_tm->tm_min))
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_DEBUG, "increase dimming");
+
+        // If not yet on max light
+        // Maximum dimming setting is 15
+        if (bdimming.currlight < bdimming.dimming_max)
+        {
+            // increase light
+            bdimming.currlight = bdimming.dimming_max;
+            bdimming.lightchange = 1;
+        }
+    }
+
+    return bdimming;
+}
+
+/* FUNCTION: UPDATE_DIMMING_BY_LUX
+this function is responsible to modify the current dimming settings in function of the measured lux
+the level is looked up in the log-lux bucket table of the compiled curve, and changed only if the lux is out of
+the hysteresis band of the current level (if the current dimming is not a level of the curve, e.g. at start-up,
+the looked up level is set)
+inputs:
+ float lux                          : measured lux value
+ const struct dimming_curve *curve  : compiled look-up table for dimming vs lux
+ struct display_dimming adimming    : including the previous dimming settings
+output                              : including the current dimming settings (with memory)
+*/
+struct display_dimming update_dimming_by_lux(float lux, const struct dimming_curve *curve, struct display_dimming adimming)
+{
+    int lightchange = 0; //positive increasing, negative decreasing
+    int target = dimming_curve_index(curve, lux);
+    int index = -1;
+    for (int i = 0; i < curve->count; i++)
+    {
+        if (curve->level[i] == adimming.currlight)
+        {
+            index = i;
+        }
+    }
+    if (index < 0)
+    {
+        index = target;
+    }
+    // step up only while the lux is above the up hysteresis of the next level
+    while ((index < target) && (lux > curve->up[index + 1]))
+    {
+        index++;
+    }
+    // step down only while the lux is below the down hysteresis of the current level
+    while ((index > target) && (lux < curve->down[index]))
+    {
+        index--;
+    }
+    int dimming = curve->level[index];
+    if (dimming > adimming.currlight)
+    {
+        lightchange = 1;
+    }
+    else if (dimming < adimming.currlight)
+    {
+        lightchange = -1;
+    }
+    log_msg(LOG_DISPLAY, LOG_LEVEL_INFO, "Look-up table dimming: %d, for lux %.2f", dimming, lux);
+
+    // Create dimming status structure, and fill it with initial val
+    //      bdimming.lightchange=0;
+    //      bdimming.currlight=0;
+    //      bdimming.dimming_max=15;
+    //      bdimming.dimming_min=0; */
+    struct display_dimming bdimming={0, 0, MaxDimming, 0};
+    // set the dimming value as found above
+    bdimming.currlight = dimming;
+    bdimming.lightchange = lightchange;
+    return bdimming;
+}
+
+/* FUNCTION: LUX_TABLE_VALID
+this function checks that the minimum lux of the defined dimming levels is increasing (the dimming bands shall not overlap)
+Input:
+    lux_values: the lux-dimming table
+Output:
+    -1 if a dimming level is not increasing, 0 if the table is valid
+*/
+int lux_table_valid(const int *lux_values)
+{
+    int last_lux = -1;
+    int ares = 0;
+    for (int i = 0; i <= MaxDimming; i++)
+    {
+        if (lux_values[i] == 0)
+        {
+            continue;
+        }
+        if (lux_values[i] <= last_lux)
+        {
+            ares = -1;
+            log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Configuration lux table is not increasing at dimming %d", i);
+        }
+        last_lux = lux_values[i];
+    }
+    return ares;
+}
+
+/* FUNCTION: DIMMING_CURVE_BUILD
+this function compiles the lux-dimming table into the dimming curve (dense levels, hysteresis bands, log-lux buckets)
+inputs:
+ curve                              : the curve to be built
+ lux_array                          : lux-dimming table, the minimum lux of each dimming level (0: not defined)
+ hysteresis_up, hysteresis_down     : hysteresis [%] above / below the lux threshold of the levels
+*/
+void dimming_curve_build(struct dimming_curve *curve, const int *lux_array, int hysteresis_up, int hysteresis_down)
+{
+    // dimming 0 is set below the lowest defined lux (the table is validated to be increasing, see config_load)
+    curve->count = 1;
+    curve->level[0] = 0;
+    curve->lux[0] = 0.0f;
+    curve->up[0] = 0.0f;
+    curve->down[0] = 0.0f;
+    for (int i = 1; i <= MaxDimming; i++)
+    {
+        if (lux_array[i] > 0)
+        {
+            int n = curve->count++;
+            curve->level[n] = i;
+            curve->lux[n] = lux_array[i];
+            curve->up[n] = lux_array[i] * (100 + hysteresis_up) / 100.0f;
+            curve->down[n] = lux_array[i] * (100 - hysteresis_down) / 100.0f;
+        }
+    }
+    // each bucket starts at LuxBucketMin * 2^(b / LuxBucketsPerOctave)
+    int index = 0;
+    for (int b = 0; b < LUX_BUCKETS; b++)
+    {
+        float edge = LuxBucketMin * exp2f((float)b / LuxBucketsPerOctave);
+        while ((index + 1 < curve->count) && (curve->lux[index + 1] < edge))
+        {
+            index++;
+        }
+        curve->bucket[b] = index;
+    }
+}
+
+/* FUNCTION: DIMMING_CURVE_INDEX
+this function returns the index of the curve level of the lux without hysteresis (O(1) bucket lookup)
+the bucket gives the highest level below the bucket, only the thresholds inside the bucket are compared
+inputs:
+ curve                              : the compiled curve
+ lux                                : lux value
+output                              : index in the levels of the curve
+*/
+int dimming_curve_index(const struct dimming_curve *curve, float lux)
+{
+    int b = 0;
+    if (lux > LuxBucketMin)
+    {
+        b = (int)(log2f(lux / LuxBucketMin) * LuxBucketsPerOctave);
+        if (b >= LUX_BUCKETS)
+        {
+            b = LUX_BUCKETS - 1;
+        }
+    }
+    int index = curve->bucket[b];
+    while ((index + 1 < curve->count) && (lux > curve->lux[index + 1]))
+    {
+        index++;
+    }
+    return index;
+}
+
+/* FUNCTION: LUX_FILTER_CONFIGURE
+this function sets the median size and the time constant of the lux filter, and clears its history
+inputs:
+ filter                             : the lux filter
+ median_size                        : number of samples of the median (1..LUX_MEDIAN_MAX)
+ tau_s                              : time constant of the smoother [s]
+*/
+void lux_filter_configure(struct lux_filter *filter, int median_size, float tau_s)
+{
+    memset(filter, 0, sizeof(struct lux_filter));
+    filter->median_size = median_size;
+    filter->tau_s = tau_s;
+}
+
+/* FUNCTION: LUX_FILTER_UPDATE
+this function puts a valid lux sample into the filter, and returns the filtered lux
+if the previous sample is older than LuxFilterResetTaus time constants, the history is cleared (the old samples
+are not relevant any more), so the sample is taken at once; without smoothing (tau_s = 0, or smooth = 0) the history is kept
+inputs:
+ filter                             : the lux filter
+ lux                                : the measured lux
+ now                                : monotonic time of the sample [s]
+ smooth                             : 1 to use both stages, 0 to use only the median (the sample rate is irregular)
+output                              : the filtered lux
+*/
+float lux_filter_update(struct lux_filter *filter, float lux, double now, int smooth)
+{
+    double dt = now - filter->last_time;
+    smooth = smooth && (filter->tau_s > 0.0f);
+    if ((filter->count > 0) && smooth && (dt > LuxFilterResetTaus * filter->tau_s))
+    {
+        filter->count = 0;
+        filter->next = 0;
+    }
+    filter->last_time = now;
+
+    // median stage: the sample is put into the ring buffer, the median of the window is sorted out of a copy
+    filter->window[filter->next] = lux;
+    filter->next = (filter->next + 1) % filter->median_size;
+    if (filter->count < filter->median_size)
+    {
+        filter->count++;
+    }
+    float sorted[LUX_MEDIAN_MAX] = {0};
+    for (int i = 0; i < filter->count; i++)
+    {
+        // insertion sort (at most LUX_MEDIAN_MAX samples)
+        int k = i;
+        while ((k > 0) && (sorted[k - 1] > filter->window[i]))
+        {
+            sorted[k] = sorted[k - 1];
+            k--;
+        }
+        sorted[k] = filter->window[i];
+    }
+    float median = sorted[filter->count / 2];
+    if ((filter->count % 2) == 0)
+    {
+        median = (median + sorted[filter->count / 2 - 1]) / 2.0f;
+    }
+
+    // smoother stage: alpha = 1 - e^(-dt/tau), the first sample is taken as it is
+    if ((filter->count == 1) || !smooth)
+    {
+        filter->value = median;
+    }
+    else
+    {
+        float alpha = 1.0f - expf(-(float)dt / filter->tau_s);
+        filter->value = filter->value + alpha * (median - filter->value);
+    }
+    return filter->value;
+}
+
+/* FUNTION: GET_HEX_CODE
+sub-function is created to get hex code for a single digit =meaning this shall be called four times for HH:MM format
+ input
+    anum: a number value between 0-900000000
+ output:
+    integer with the value representing the digit anum on the display memory
+
+Decimal value of each segment:
+    ------  1
+    I    I
+32  I    I  2
+    I    I
+    ------  64
+    I    I
+16  I    I  4
+    I    I
+    ------  8
+    Value of decimal dot: 128=0x80
+*/
+unsigned char get_hex_code(int anum)
+{
+    // nothin' = 0x00 out of the digits
+    return ((anum >= 0) && (anum <= 9)) ? SegmentFont['0' + anum] : 0x00;
+}
+
+/* FUNCTION: RENDER_TEXT
+this function renders a text into the four digits and the colon of the display refresh values (the dimming is unchanged)
+the characters are looked up in SegmentFont, a '.' lights the decimal point of the previous digit (or is a digit of its
+own at the start of the text, or after an other '.'), a ':' the colon
+a text longer than the four digits is shown as "----"
+ inputs:
+    values          : the display refresh values to be filled
+    text            : the text to be shown
+    justify_right   : 1 to justify the text to the right, 0 to the left
+*/
+void render_text(struct disp_refresh_values *values, const char *text, int justify_right)
+{
+    // the glyphs are placed after 4 blank digits, so the right justification is only an offset of the read-out
+    unsigned char glyphs[4 + 5] = {0};
+    int count = 0;
+    int dot_allowed = 0;
+    unsigned char colon = 0;
+    for (const unsigned char *p = (const unsigned char *)text; (*p != '\0') && (count <= 4); p++)
+    {
+        if (*p == ':')
+        {
+            colon = Colon_on;
+        }
+        else if ((*p == '.') && dot_allowed)
+        {
+            glyphs[4 + count - 1] |= Segment_dot;
+            dot_allowed = 0;
+        }
+        else
+        {
+            glyphs[4 + count++] = (*p == '.') ? Segment_dot : SegmentFont[*p & 0x7F];
+            dot_allowed = (*p != '.');
+        }
+    }
+    if (count > 4)
+    {
+        // ERROR HANDLING: the text does not fit
+        memset(&glyphs[4], SegmentFont['-'], 4);
+        count = 4;
+    }
+    const unsigned char *digits = justify_right ? &glyphs[count] : &glyphs[4];
+    values->disp_h1 = digits[0];
+    values->disp_h2 = digits[1];
+    values->disp_min1 = digits[2];
+    values->disp_min2 = digits[3];
+    values->disp_colon = colon;
+}
+
+/* FUNCTION: RENDER_NUMBER
+this function renders a number right justified into the four digits of the display refresh values
+the number is shown with as many of the decimals as fit, a larger number in thousands with a "k" suffix, "----" if it does not fit
+ inputs:
+    values          : the display refresh values to be filled
+    value           : the number to be shown
+    decimals        : the most decimals to be shown
+*/
+void render_number(struct disp_refresh_values *values, float value, int decimals)
+{
+    char text[48];
+    for (int thousands = 0; thousands <= 1; thousands++)
+    {
+        for (int d = decimals; d >= 0; d--)
+        {
+            // the decimal point is on the previous digit, it does not take a digit
+            int len = snprintf(text, sizeof(text), "%.*f%s", d, thousands ? value / 1000.0f : value, thousands ? "k" : "");
+            if (len - (d > 0) <= 4)
+            {
+                render_text(values, text, 1);
+                return;
+            }
+        }
+    }
+    render_text(values, "----", 1);
+}
+
+/* FUNCTIONS: TIME_PAGE_..., DATE_PAGE_..., TEMP_PAGE_...
+the page drivers: stamp (changes with the content of the page), render (draws the page)
+    time: the time in the display mode (or the lux in the lux mode), ---- till the system clock is synchronized
+    date: DD.MM, ---- till the system clock is synchronized
+    temp: the outdoor temperature received on MQTT, e.g. 21.5* (* is the degree sign), --* before the first message
+*/
+long time_page_stamp(const struct page_context *ctx)
+{
+    // not synchronized: ---- (the lux mode does not show the time)
+    if (!ctx->clock_synced && (ctx->mode != DISPLAY_MODE_LUX))
+    {
+        return -1;
+    }
+    long minutes = ((long)ctx->a_tm->tm_year * 366 + ctx->a_tm->tm_yday) * 1440 + ctx->a_tm->tm_hour * 60 + ctx->a_tm->tm_min;
+    // the display mode is part of the stamp: a mode change is drawn at once
+    if ((ctx->mode == DISPLAY_MODE_BLINK) || (ctx->mode == DISPLAY_MODE_MMSS))
+    {
+        return (minutes * 60 + ctx->a_tm->tm_sec) * 8 + ctx->mode;
+    }
+    return minutes * 8 + ctx->mode;
+}
+
+void time_page_render(const struct page_context *ctx, struct disp_refresh_values *values)
+{
+    // the brightness is set by display_update from the dimming ramp
+    *values = get_displ_values(ctx->a_tm, 0, ctx->mode);
+    // lux mode: the filtered lux is shown instead of the time
+    if ((ctx->mode == DISPLAY_MODE_LUX) && ctx->lux_valid)
+    {
+        render_number(values, ctx->lux, 2);
+    }
+    else if (ctx->mode == DISPLAY_MODE_LUX)
+    {
+        render_text(values, "Err", 1);
+    }
+    else if (!ctx->clock_synced)
+    {
+        render_text(values, "----", 1);
+    }
+}
+
+long date_page_stamp(const struct page_context *ctx)
+{
+    return ctx->clock_synced ? (long)ctx->a_tm->tm_year * 366 + ctx->a_tm->tm_yday : -1;
+}
+
+void date_page_render(const struct page_context *ctx, struct disp_refresh_values *values)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%02d.%02d", ctx->a_tm->tm_mday, ctx->a_tm->tm_mon + 1);
+    render_text(values, ctx->clock_synced ? text : "----", 1);
+}
+
+long temp_page_stamp(const struct page_context *ctx)
+{
+    return (long)atomic_load_explicit(&ctx->feed->temperature_seq, memory_order_acquire);
+}
+
+void temp_page_render(const struct page_context *ctx, struct disp_refresh_values *values)
+{
+    char text[16];
+    if (atomic_load_explicit(&ctx->feed->temperature_seq, memory_order_acquire) == 0)
+    {
+        render_text(values, "--*", 1);
+        return;
+    }
+    float temperature = atomic_load_explicit(&ctx->feed->temperature, memory_order_relaxed) / 10.0f;
+    // with one decimal if it fits (the decimal point does not take a digit), e.g. -12.5 is shown as -13*
+    int len = snprintf(text, sizeof(text), "%.1f*", temperature);
+    if (len - 1 > 4)
+    {
+        snprintf(text, sizeof(text), "%.0f*", temperature);
+    }
+    render_text(values, text, 1);
+}
+
+long text_page_stamp(const struct page_context *ctx)
+{
+    return (long)ctx->feed->text_seq;
+}
+
+void text_page_render(const struct page_context *ctx, struct disp_refresh_values *values)
+{
+    render_text(values, ctx->feed->text, 0);
+}
+
+/* FUNCTION: FIND_PAGE_DRIVER
+this function looks up a page driver by its name
+Input:
+    name: name of the page (time, date, temp, text)
+Output:
+    the page driver, or NULL if the name is unknown
+*/
+const struct page_driver *find_page_driver(const char *name)
+{
+    for (int i = 0; i < PAGE_DRIVER_COUNT; i++)
+    {
+        if (strcmp(page_drivers[i].name, name) == 0)
+        {
+            return &page_drivers[i];
+        }
+    }
+    return NULL;
+}
+
+/* FUNCTION: PAGE_SCHEDULER_INIT
+this function creates the rotation timer and the data eventfd of the page scheduler (a failure is not fatal:
+without the timer the first page is shown, without the eventfd the received data is shown at the next minute change)
+Input:
+    pages: the page scheduler
+*/
+void page_scheduler_init(struct page_scheduler *pages)
+{
+    memset(pages, 0, sizeof(struct page_scheduler));
+    atomic_init(&pages->feed.listening, 0);
+    atomic_init(&pages->feed.temperature, 0);
+    atomic_init(&pages->feed.temperature_seq, 0);
+    pages->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (pages->timer_fd < 0)
+    {
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "PAGE TIMER CREATE FAILED");
+    }
+    pages->feed.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pages->feed.event_fd < 0)
+    {
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "PAGE EVENT CREATE FAILED");
+    }
+}
+
+/* page_scheduler_arm: the rotation timer expires at the end of the display time of the visible page (not armed for one page),
+the MQTT thread wakes up the main loop only if a data page is visible */
+static void page_scheduler_arm(struct page_scheduler *pages)
+{
+    struct itimerspec deadline;
+    memset(&deadline, 0, sizeof(deadline));
+    if (pages->count > 1)
+    {
+        deadline.it_value.tv_sec = pages->pages[pages->visible].duration_s;
+    }
+    if ((pages->timer_fd >= 0) && (timerfd_settime(pages->timer_fd, 0, &deadline, NULL) < 0))
+    {
+        // ERROR HANDLING: the visible page is kept
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "PAGE TIMER SET FAILED");
+    }
+    atomic_store(&pages->feed.listening, (pages->pages[pages->visible].driver->update == PAGE_UPDATE_DATA));
+    pages->drawn_valid = 0;
+}
+
+/* FUNCTION: PAGE_SCHEDULER_CONFIGURE
+this function sets the pages of the rotation, the first page is shown, and the rotation timer is armed if there are more pages
+Input:
+    pages: the page scheduler
+    config: the pages of the configuration
+*/
+void page_scheduler_configure(struct page_scheduler *pages, const struct clock_config *config)
+{
+    pages->count = config->page_count;
+    memcpy(pages->pages, config->pages, sizeof(pages->pages));
+    pages->visible = 0;
+    page_scheduler_arm(pages);
+}
+
+/* FUNCTION: PAGE_SCHEDULER_ROTATE
+this function is called when the rotation timer expires: the next page is made visible (it is drawn at the next page_draw),
+and the timer is armed for its display time
+Input:
+    pages: the page scheduler
+Output:
+    1 if the visible page is changed, 0 if not, negative on failure
+*/
+int page_scheduler_rotate(struct page_scheduler *pages)
+{
+    uint64_t expirations = 0;
+    if (read(pages->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        return -1;
+    }
+    if (pages->count <= 1)
+    {
+        return 0;
+    }
+    pages->visible = (pages->visible + 1) % pages->count;
+    page_scheduler_arm(pages);
+    log_msg(LOG_SCHED, LOG_LEVEL_DEBUG, "page %d (%s) is shown for %d sec", pages->visible, pages->pages[pages->visible].driver->name,
+            pages->pages[pages->visible].duration_s);
+    return 1;
+}
+
+/* FUNCTION: PAGE_SCHEDULER_SHOW
+this function makes the first page of a kind visible at once (it is drawn at the next page_draw), the rotation goes on from it
+Input:
+    pages: the page scheduler
+    driver: the kind of the page
+Output:
+    1 if the visible page is changed, 0 if it is already visible, -1 if the rotation has no such page
+*/
+int page_scheduler_show(struct page_scheduler *pages, const struct page_driver *driver)
+{
+    for (int i = 0; i < pages->count; i++)
+    {
+        if (pages->pages[i].driver != driver)
+        {
+            continue;
+        }
+        if (i == pages->visible)
+        {
+            return 0;
+        }
+        // the display time of the page starts again
+        pages->visible = i;
+        page_scheduler_arm(pages);
+        return 1;
+    }
+    return -1;
+}
+
+/* FUNCTION: PAGE_SHOWS_CLOCK
+Input:
+    pages: the page scheduler
+Output:
+    1 if the visible page changes with the time (the per-second refresh and the blinking are only needed then), 0 if not
+*/
+int page_shows_clock(const struct page_scheduler *pages)
+{
+    return (pages->pages[pages->visible].driver->update == PAGE_UPDATE_CLOCK);
+}
+
+/* FUNCTION: PAGE_DATA_READ
+this function reads the pending wake-ups of the data eventfd (CLOCK_EVENT_PAGE_DATA)
+Input:
+    pages: the page scheduler
+Output:
+    the number of the wake-ups, negative on failure
+*/
+int page_data_read(struct page_scheduler *pages)
+{
+    uint64_t wakeups = 0;
+    if (read(pages->feed.event_fd, &wakeups, sizeof(wakeups)) < 0)
+    {
+        return -1;
+    }
+    return (int)wakeups;
+}
+
+/* FUNCTION: PAGE_DRAW
+this function draws the visible page if it is not yet drawn or its content changed (the page stamp changed),
+the pages which are not visible are not drawn
+Input:
+    pages: the page scheduler
+    ctx: the data of the pages
+    values: the display refresh values, unchanged if the page is not drawn
+Output:
+    1 if the page is drawn (the display shall be updated), 0 if the frame is unchanged
+*/
+int page_draw(struct page_scheduler *pages, const struct page_context *ctx, struct disp_refresh_values *values)
+{
+    const struct page_driver *driver = pages->pages[pages->visible].driver;
+    long stamp = driver->stamp(ctx);
+    if (pages->drawn_valid && (stamp == pages->drawn_stamp))
+    {
+        return 0;
+    }
+    driver->render(ctx, values);
+    pages->drawn_stamp = stamp;
+    pages->drawn_valid = 1;
+    return 1;
+}
+
+/* FUNCTION: PAGE_SCHEDULER_CLOSE
+this function closes the timer and the eventfd of the page scheduler
+Input:
+    pages: the page scheduler
+*/
+void page_scheduler_close(struct page_scheduler *pages)
+{
+    atomic_store(&pages->feed.listening, 0);
+    if (pages->timer_fd >= 0)
+    {
+        close(pages->timer_fd);
+    }
+    if (pages->feed.event_fd >= 0)
+    {
+        close(pages->feed.event_fd);
+    }
+}
+
+/* FUNTION: CALCULATE_SUN_UP
+Calculates the sun-set and sun-rise times for a given location, on a given Julian date
+Necessary inputs:
+Ln_deg: north longitudial coordinate, as double (for locations south to the equador it is a negative value)
+Lw_deg: west latituial coordinate, as double (for location east to Greenwich it is a negative value)
+Jdate: the Julian date of the day
+Output will be provided as struct sun_table_entry (minutes after UTC midnight, SunPolarNight or SunPolarDay in the polar days)
+The accuracy of this function is appx +-15minutes. If you would consider a more accurate value, than please consider using different code.
+(An option for accuracy improvement could be to repeat the calculation of M_deg, C, lambda_deg and J_transit (noon_prev) recursively several times)
+Due to the large number of Julian date, and the required precisity the used type is double during the calculation
+The function is called only to generate the sun table (see sun_table_open)
+*/
+struct sun_table_entry calculate_sun_up(double Ln_deg, double Lw_deg, int Jdate)
+{
+    // outptt variable to store the reurn values
+    struct sun_table_entry asunup;
+    // calculate PI (3.14...) as double
+    double aPI = acos(-1.0);
+
+    // Start of sunset sun-rise calculation, based on: http://users.electromagnetic.net/bu/astro/sunrise-set.php
+    double Ln_rad    = Ln_deg*2*aPI/360;
+    double n_        = (Jdate - 2451545 - 0.0009) - (Lw_deg/360);
+    int    n         = round(n_);
+    double noon_prev = 2451545 + 0.0009 + (Lw_deg/360) + n ;
+    double M_deg     = fmod(357.5291 + 0.98560028 * (noon_prev - 2451545), 360.0);
+    double M_rad     = M_deg *2* aPI/360;
+    double C_x   = (1.9148 * sin(M_rad)) + (0.0200 * sin(2 * M_rad)) + (0.0003 * sin(3 * M_rad)) ;
+    double lambda_deg= fmod(M_deg + 102.9372 + C_x + 180, 360.0) ;
+    double lambda_rad= lambda_deg *2* aPI/360;
+    double J_transit = noon_prev + (0.0053 * sin(M_rad)) - (0.0069 * sin(2 * lambda_rad));
+    double theta     = asin( sin(lambda_rad) * sin(23.45*2*aPI/360) );
+    double cos_H     = (sin(-0.83*2*aPI/360) - sin(Ln_rad) * sin(theta)) / (cos(Ln_rad) * cos(theta));
+    // polar night (the sun does not rise) and polar day (the sun does not set): there is no sun-rise or sun-set time
+    if ((cos_H > 1.0) || (cos_H < -1.0))
+    {
+        asunup.rise_utc_min = (cos_H > 1.0) ? SunPolarNight : SunPolarDay;
+        asunup.set_utc_min = asunup.rise_utc_min;
+        return asunup;
+    }
+    double H_rad     = acos(cos_H);
+    double H_deg     = H_rad*360/2/aPI;
+    double noon      = 2451545 + 0.0009 + ((H_deg + Lw_deg)/360) + n;
+    double sunset    = noon + (0.0053 * sin(M_rad)) - (0.0069 * sin(2 * lambda_rad)) ;
+    double sunrise   = J_transit - (sunset - J_transit) ;
+    // End of sunset sun-rise calculation, based on: http://users.electromagnetic.net/bu/astro/sunrise-set.php
+
+
+    // Calculate it to minutes after UTC midnight
+    // Julian calendar contains the date as the integer number, the number after the decimal point refers to the time within the day
+    // Julian calendar changes day at noon, so xx.0=12:00h UTC, so 12 hours (720 minutes) shall be added
+    asunup.set_utc_min  = (int)((sunset - floor(sunset)) * 1440 + 720) % 1440;
+    asunup.rise_utc_min = (int)((sunrise - floor(sunrise)) * 1440 + 720) % 1440;
+    return asunup;
+}
+
+/* FUNCTION: SUN_TABLE_OPEN
+this function opens (or creates) and maps the sun-rise / sun-set table file
+if the file is not a valid table for the location (magic, version or coordinates mismatch), the table is generated
+by calculate_sun_up for each day of the year
+Input:
+    table: the table to be initialized
+    path: path of the table file
+    Ln_deg: north coordinate of the location
+    Lw_deg: west coordinate of the location
+Output:
+    0 if the table is usable (mapped file, or generated in memory if the file can not be used), negative on error
+*/
+int sun_table_open(struct sun_table *table, const char *path, double Ln_deg, double Lw_deg)
+{
+    void *map = MAP_FAILED;
+    table->header = NULL;
+    table->days = NULL;
+    table->size = sizeof(struct sun_table_header) + SUN_TABLE_DAYS * sizeof(struct sun_table_entry);
+
+    int file = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    // a new file is extended with zeros, which is an invalid header
+    if ((file >= 0) && (ftruncate(file, table->size) >= 0))
+    {
+        map = mmap(NULL, table->size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    if (file >= 0)
+    {
+        // the mapping stays valid after the file is closed
+        close(file);
+    }
+    if (map == MAP_FAILED)
+    {
+        // the table is generated in memory at every start-up (e.g. read-only file system)
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "SUN TABLE MAP FAILED: %s, the table is kept in memory", path);
+        map = mmap(NULL, table->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+        {
+            return -1;
+        }
+    }
+    table->header = (struct sun_table_header *)map;
+    table->days = (struct sun_table_entry *)((char *)map + sizeof(struct sun_table_header));
+
+    if ((table->header->magic != SunTableMagic) || (table->header->version != SunTableVersion) ||
+        (table->header->latitude != Ln_deg) || (table->header->longitude != Lw_deg))
+    {
+        // the header is invalidated first, and written after the entries (an interrupted generation is repeated)
+        table->header->magic = 0;
+        // Julian date of the 1st of January (12:00 UTC), with the leap days of the previous years since 2000
+        int Jdate = (SunTableYear - 2000) * 365 + (int)((SunTableYear - 2000 + 3) / 4) + 2451545;
+        for (int day = 0; day < SUN_TABLE_DAYS; day++)
+        {
+            table->days[day] = calculate_sun_up(Ln_deg, Lw_deg, Jdate + day);
+        }
+        log_msg(LOG_CLOCK, LOG_LEVEL_DEBUG, "Sun table, Jdate %d: sun-rise %d min, sun-set %d min (UTC)", Jdate,
+                table->days[0].rise_utc_min, table->days[0].set_utc_min);
+        table->header->version = SunTableVersion;
+        table->header->latitude = Ln_deg;
+        table->header->longitude = Lw_deg;
+        table->header->magic = SunTableMagic;
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Sun table is generated for %.4f N, %.4f W: %s", Ln_deg, Lw_deg, path);
+    }
+    return 0;
+}
+
+/* FUNCTION: SUN_TABLE_LOOKUP
+this function returns the sun-set and sun-rise times of the day in local time (the UTC offset of the day is used)
+the entry of the day is selected by the month and the day (the table is calculated for a leap year)
+Input:
+    table: the sun table
+    a_tm: the current local time
+Output:
+    struct sunup: sun-set and sun-rise in local HH:MM, or the polar day / polar night
+*/
+struct sunup sun_table_lookup(const struct sun_table *table, const struct tm *a_tm)
+{
+    // invalid (not HH:MM) values if the table is not usable
+    struct sunup asunup = {-1, -1, -1, -1, 0};
+    if (table->header == NULL)
+    {
+        return asunup;
+    }
+    struct sun_table_entry day = table->days[SunTableMonthStart[a_tm->tm_mon] + a_tm->tm_mday - 1];
+    if ((day.rise_utc_min == SunPolarNight) || (day.rise_utc_min == SunPolarDay))
+    {
+        // the times are valid, so the day is not looked up again before the next 4 o'clock
+        asunup.set_hour = asunup.set_min = asunup.rise_hour = asunup.rise_min = 0;
+        asunup.polar = (day.rise_utc_min == SunPolarDay) ? 1 : -1;
+        return asunup;
+    }
+    // the UTC offset of the local time (time zone and summer time) [min]
+    int offset = (int)(a_tm->tm_gmtoff / 60);
+    int set_min  = ((day.set_utc_min + offset) % 1440 + 1440) % 1440;
+    int rise_min = ((day.rise_utc_min + offset) % 1440 + 1440) % 1440;
+    asunup.set_hour  = set_min / 60;
+    asunup.set_min   = set_min % 60;
+    asunup.rise_hour = rise_min / 60;
+    asunup.rise_min  = rise_min % 60;
+    return asunup;
+}
+
+/* FUNCTION: SUN_TABLE_CLOSE
+this function writes back and unmaps the sun table
+Input:
+    table: the sun table
+*/
+void sun_table_close(struct sun_table *table)
+{
+    if (table->header == NULL)
+    {
+        return;
+    }
+    msync(table->header, table->size, MS_SYNC);
+    munmap(table->header, table->size);
+    table->header = NULL;
+    table->days = NULL;
+}
+
+/* FUNCTION: PROGRAM_SLEEP
+this subfunction calles the nanosleep() function for the defined seconds
+Input:
+    sec: the seconds till the program needs to sleep
+*/
+void program_sleep(float sec)
+{
+    // create nanosleep structure
+    struct timespec ts;
+    // convert input to nanosleep structure
+    ts.tv_sec = (int)sec;
+    ts.tv_nsec = (sec-(int)sec)*1000000000;
+    // perform the sleep
+    nanosleep(&ts, NULL);
+    log_msg(LOG_SCHED, LOG_LEVEL_DEBUG, "slept for %g sec",sec);
+}
+
+/* FUNCTION: CLOCK_SYNC_START
+this function starts the tracking of the synchronization state of the system clock, if the clock is not yet
+synchronized the state is checked in every ClockSyncCheckSec (CLOCK_EVENT_SYNC)
+the check timer is on CLOCK_MONOTONIC, so it is not moved by the step of the system clock
+Input:
+    sync: the clock synchronization state
+    wait_s: the longest wait for the NTP synchronization [s], 0: the synchronization is not waited for
+*/
+void clock_sync_start(struct clock_sync *sync, int wait_s)
+{
+    sync->timer_fd = -1;
+    sync->synced = 0;
+    sync->wait_s = wait_s;
+    clock_gettime(CLOCK_MONOTONIC, &sync->start);
+    // a synchronized clock is shown at once, without a timer
+    if (clock_sync_check(sync))
+    {
+        return;
+    }
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "System clock is not synchronized, the time is shown after the NTP synchronization");
+    sync->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    struct itimerspec period;
+    memset(&period, 0, sizeof(period));
+    period.it_value.tv_sec = ClockSyncCheckSec;
+    period.it_interval.tv_sec = ClockSyncCheckSec;
+    if ((sync->timer_fd < 0) || (timerfd_settime(sync->timer_fd, 0, &period, NULL) < 0))
+    {
+        // ERROR HANDLING: no periodic check, the state is checked at the minute changes and clock steps
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "CLOCK SYNC TIMER FAILED");
+    }
+}
+
+/* FUNCTION: CLOCK_SYNC_CHECK
+this function checks the synchronization state of the system clock (adjtimex), the check timer is stopped
+when the clock is synchronized
+the clock is synchronized if the kernel clock is not STA_UNSYNC (set by the NTP daemon), or the wait is over;
+the year shall be valid in both cases. Once synchronized the state is kept (a later NTP outage does not blank the clock)
+Input:
+    sync: the clock synchronization state
+Output:
+    1 if the clock became synchronized now (the display and the sun-set table shall be updated), otherwise 0
+*/
+int clock_sync_check(struct clock_sync *sync)
+{
+    uint64_t expirations = 0;
+    if (sync->synced)
+    {
+        return 0;
+    }
+    if (sync->timer_fd >= 0)
+    {
+        // non-blocking: the check is also done at the minute changes and clock steps
+        if (read(sync->timer_fd, &expirations, sizeof(expirations)) < 0)
+        {
+            expirations = 0;
+        }
+    }
+    struct timex tx;
+    memset(&tx, 0, sizeof(tx));
+    int state = adjtimex(&tx);
+    // ERROR HANDLING: without the kernel state (e.g. not supported) only the year is checked
+    int kernel_synced = (state < 0) || ((state != TIME_ERROR) && !(tx.status & STA_UNSYNC));
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int waited = (now.tv_sec - sync->start.tv_sec >= sync->wait_s);
+    time_t wall = time(NULL);
+    struct tm wall_tm;
+    localtime_r(&wall, &wall_tm);
+    if ((wall_tm.tm_year + 1900 < ClockValidYear) || (!kernel_synced && !waited))
+    {
+        return 0;
+    }
+    sync->synced = 1;
+    if (sync->timer_fd >= 0)
+    {
+        close(sync->timer_fd);
+        sync->timer_fd = -1;
+    }
+    if (kernel_synced)
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "System clock is synchronized (estimated error %ld us) after %ld s", (long)tx.esterror,
+                (long)(now.tv_sec - sync->start.tv_sec));
+    }
+    else
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "System clock is not synchronized by NTP in %d s, the time is shown", sync->wait_s);
+    }
+    return 1;
+}
+
+/* FUNCTION: WAIT_FOR_CLOCK_EVENT
+this function arms the timer for the next event (lux sample slot or minute boundary) and blocks until it expires,
+or until the light sensor interrupt is raised
+the timer deadline is an absolute CLOCK_REALTIME value, so the wake-up is aligned to the minute boundary,
+and the timer is cancelled (ECANCELED) if the system clock is set in the meantime
+Input:
+    timer_fd: timerfd created on CLOCK_REALTIME
+    sample_lux: if 1 the lux sample slot before the minute boundary is scheduled as well
+    interrupt_fd: GPIO line event file descriptor of the sensor interrupt, -1 if not used
+    measure_fd: the timerfd of the light measurement (CLOCK_EVENT_SENSOR_READY), -1 if not used
+    ramp_fd: the timerfd of the dimming ramp (CLOCK_EVENT_RAMP), -1 if not used
+    tick_fd: the timerfd of the per-second display refresh (CLOCK_EVENT_TICK), -1 if not used
+    config_fd: the inotify file descriptor of the configuration file (CLOCK_EVENT_CONFIG), -1 if not used
+    page_fd: the timerfd of the page rotation (CLOCK_EVENT_PAGE), -1 if not used
+    page_data_fd: the eventfd of the received page data (CLOCK_EVENT_PAGE_DATA), -1 if not used
+    command_fd: the eventfd of the received MQTT commands (CLOCK_EVENT_COMMAND), -1 if not used
+    sync_fd: the timerfd of the clock synchronization check (CLOCK_EVENT_SYNC), -1 if not used
+Output:
+    enum clock_event: the event which woke up the process
+*/
+enum clock_event wait_for_clock_event(int timer_fd, int sample_lux, int interrupt_fd, int measure_fd, int ramp_fd, int tick_fd, int config_fd,
+                                      int page_fd, int page_data_fd, int command_fd, int sync_fd)
+{
+    struct timespec now;
+    struct itimerspec deadline;
+    enum clock_event event = CLOCK_EVENT_MINUTE;
+    uint64_t expirations = 0;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    // next minute boundary
+    time_t next_minute = (now.tv_sec / 60 + 1) * 60;
+    // if the lux sample slot of this minute is still ahead, than wake up for the sample first
+    if (sample_lux && ((next_minute - SampleBeforeMinuteSec) > now.tv_sec))
+    {
+        next_minute = next_minute - SampleBeforeMinuteSec;
+        event = CLOCK_EVENT_SAMPLE;
+    }
+
+    memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value.tv_sec = next_minute;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &deadline, NULL) < 0)
+    {
+        // ERROR HANDLING: the timer could not be armed, fall back to sleep till the deadline
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "TIMER SET FAILED");
+        program_sleep((float)(next_minute - now.tv_sec) - now.tv_nsec / 1000000000.0f);
+        return event;
+    }
+    log_msg(LOG_SCHED, LOG_LEVEL_DEBUG, "next event %d is scheduled in %ld sec", event, (long)(next_minute - now.tv_sec));
+
+    // wait for the timer, the sensor interrupt line, the measurement, the ramp, the refresh timer, the configuration change,
+    // the page rotation, the page data, the commands and the clock synchronization check (a negative fd is ignored by poll)
+    struct pollfd fds[10];
+    fds[0].fd = timer_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = interrupt_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = measure_fd;
+    fds[2].events = POLLIN;
+    fds[3].fd = ramp_fd;
+    fds[3].events = POLLIN;
+    fds[4].fd = tick_fd;
+    fds[4].events = POLLIN;
+    fds[5].fd = config_fd;
+    fds[5].events = POLLIN;
+    fds[6].fd = page_fd;
+    fds[6].events = POLLIN;
+    fds[7].fd = page_data_fd;
+    fds[7].events = POLLIN;
+    fds[8].fd = command_fd;
+    fds[8].events = POLLIN;
+    fds[9].fd = sync_fd;
+    fds[9].events = POLLIN;
+    if (poll(fds, 10, -1) < 0)
+    {
+        // interrupted (e.g. by the KILL signal)
+        return CLOCK_EVENT_NONE;
+    }
+    // the timer has priority: the display update shall not be delayed
+    if (fds[0].revents)
+    {
+        if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+        {
+            if (errno == ECANCELED)
+            {
+                // the system clock was set (discontinuous change) before the deadline
+                return CLOCK_EVENT_JUMP;
+            }
+            return CLOCK_EVENT_NONE;
+        }
+        return event;
+    }
+    // the per-second refresh is the next: the seconds and the colon shall be shown on time
+    if (fds[4].revents)
+    {
+        // the timer expiration is read by refresh_scheduler_tick
+        return CLOCK_EVENT_TICK;
+    }
+    // the commands are the next: the command shall be shown at once
+    if (fds[8].revents)
+    {
+        uint64_t commands = 0;
+        if (read(command_fd, &commands, sizeof(commands)) < 0)
+        {
+            return CLOCK_EVENT_NONE;
+        }
+        return CLOCK_EVENT_COMMAND;
+    }
+    // the synchronization of the clock is the next: the time shall be shown at once
+    if (fds[9].revents)
+    {
+        // the timer expiration is read by clock_sync_check
+        return CLOCK_EVENT_SYNC;
+    }
+    if (fds[6].revents)
+    {
+        // the timer expiration is read by page_scheduler_rotate
+        return CLOCK_EVENT_PAGE;
+    }
+    if (fds[1].revents)
+    {
+#ifndef noI2C
+        struct gpioevent_data edge;
+        if (read(interrupt_fd, &edge, sizeof(edge)) < 0)
+        {
+            return CLOCK_EVENT_NONE;
+        }
+#endif
+        log_msg(LOG_SCHED, LOG_LEVEL_INFO, "Light sensor interrupt received");
+        return CLOCK_EVENT_LIGHT;
+    }
+    if (fds[2].revents)
+    {
+        // the timer expiration is read by measure_lux_poll
+        return CLOCK_EVENT_SENSOR_READY;
+    }
+    if (fds[3].revents)
+    {
+        // the timer expiration is read by dimming_ramp_step
+        return CLOCK_EVENT_RAMP;
+    }
+    if (fds[5].revents)
+    {
+        // the inotify events are read by config_changed
+        return CLOCK_EVENT_CONFIG;
+    }
+    if (fds[7].revents)
+    {
+        // the wake-ups are read by page_data_read
+        return CLOCK_EVENT_PAGE_DATA;
+    }
+    return CLOCK_EVENT_NONE;
+}
+
+/* FUNCTION: REFRESH_SCHEDULER_START
+this function (re)aligns the per-second ticks to the second boundary of the system clock, the ticks are
+absolute CLOCK_MONOTONIC deadlines, so the refresh does not drift by the time spent in the main loop
+Input:
+    sched: the refresh scheduler (nothing is done if it has no timer)
+Output:
+    0 on success, -1 if the timer could not be armed
+*/
+int refresh_scheduler_start(struct refresh_scheduler *sched)
+{
+    struct timespec realtime;
+    struct itimerspec ticks;
+    if (sched->timer_fd < 0)
+    {
+        return 0;
+    }
+    // the monotonic clock does not follow the steps of the system clock: the time till the next second boundary
+    // of the system clock is added to the monotonic time
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &sched->deadline);
+    long long deadline_ns = (long long)sched->deadline.tv_sec * 1000000000LL + sched->deadline.tv_nsec
+                          + (1000000000LL - realtime.tv_nsec);
+    sched->deadline.tv_sec = deadline_ns / 1000000000LL;
+    sched->deadline.tv_nsec = deadline_ns % 1000000000LL;
+
+    memset(&ticks, 0, sizeof(ticks));
+    ticks.it_value = sched->deadline;
+    ticks.it_interval.tv_sec = sched->period_ms / 1000;
+    ticks.it_interval.tv_nsec = (sched->period_ms % 1000) * 1000000L;
+    if (timerfd_settime(sched->timer_fd, TFD_TIMER_ABSTIME, &ticks, NULL) < 0)
+    {
+        // ERROR HANDLING: the timer could not be armed, the display is refreshed only at the minute change
+        log_msg(LOG_SCHED, LOG_LEVEL_NOTICE, "REFRESH TIMER SET FAILED");
+        return -1;
+    }
+    log_msg(LOG_SCHED, LOG_LEVEL_DEBUG, "refresh ticks are aligned, the first one is in %ld us", (1000000000L - realtime.tv_nsec) / 1000);
+    return 0;
+}
+
+/* FUNCTION: REFRESH_SCHEDULER_TICK
+this function is called when the refresh timer expires: the wake-up delay after the deadline (jitter) is measured,
+and the deadline is moved to the next tick
+Input:
+    sched: the refresh scheduler
+Output:
+    the number of the expired deadlines (more than 1 if ticks were missed), negative on failure
+*/
+int refresh_scheduler_tick(struct refresh_scheduler *sched)
+{
+    uint64_t expirations = 0;
+    struct timespec now;
+    if (read(sched->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long period_ns = (long long)sched->period_ms * 1000000LL;
+    long long deadline_ns = (long long)sched->deadline.tv_sec * 1000000000LL + sched->deadline.tv_nsec;
+    // the jitter is measured to the last expired deadline, the former ones are counted as missed
+    deadline_ns += (long long)(expirations - 1) * period_ns;
+    long jitter_us = (long)(((long long)now.tv_sec * 1000000000LL + now.tv_nsec - deadline_ns) / 1000);
+    sched->ticks++;
+    sched->missed += (long)(expirations - 1);
+    sched->jitter_sum_us += jitter_us;
+    if (jitter_us > sched->jitter_max_us)
+    {
+        sched->jitter_max_us = jitter_us;
+    }
+    deadline_ns += period_ns;
+    sched->deadline.tv_sec = deadline_ns / 1000000000LL;
+    sched->deadline.tv_nsec = deadline_ns % 1000000000LL;
+    log_msg(LOG_SCHED, LOG_LEVEL_DEBUG, "refresh tick, jitter: %ld us, expirations: %d", jitter_us, (int)expirations);
+    return (int)expirations;
+}
+
+/* FUNCTION: REFRESH_SCHEDULER_REPORT
+this function writes the jitter statistics of the refresh ticks to the standard output, and resets them
+Input:
+    sched: the refresh scheduler
+*/
+void refresh_scheduler_report(struct refresh_scheduler *sched)
+{
+    if (sched->ticks > 0)
+    {
+        log_msg(LOG_SCHED, LOG_LEVEL_INFO, "Refresh ticks: %ld, missed: %ld, jitter avg: %.0f us, max: %ld us",
+                sched->ticks, sched->missed, sched->jitter_sum_us / sched->ticks, sched->jitter_max_us);
+    }
+    sched->ticks = 0;
+    sched->missed = 0;
+    sched->jitter_sum_us = 0.0;
+    sched->jitter_max_us = 0;
+}
+
+/* FUNCTION: REFRESH_SCHEDULER_STOP
+this function disarms the per-second ticks (e.g. while a page is shown which does not change with the time)
+Input:
+    sched: the refresh scheduler (nothing is done if it has no timer)
+*/
+void refresh_scheduler_stop(struct refresh_scheduler *sched)
+{
+    struct itimerspec off;
+    if (sched->timer_fd < 0)
+    {
+        return;
+    }
+    memset(&off, 0, sizeof(off));
+    timerfd_settime(sched->timer_fd, 0, &off, NULL);
+}
+
+/* FUNCTION: MEASURE_LUX_START
+this function starts a light measurement via the bound sensor driver, and arms the measurement timer
+for the time the data is expected to be valid (the function does not wait for the integration)
+Input:
+    measurement: state of the measurement
+    sensor: the sensor driver
+    int file: file descriptor of the light sensor
+Output:
+    0 if the measurement is started, 1 if a measurement is already running, negative on failure
+*/
+int measure_lux_start(struct light_measurement *measurement, const struct sensor_driver *sensor, int file)
+{
+    struct itimerspec deadline;
+    struct timespec start;
+    if (measurement->active)
+    {
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // after the sensor init the range is set to the default of the driver
+    if (measurement->range < 0)
+    {
+        if (sensor->set_range(file, &sensor->ranges[sensor->default_range]) >= 0)
+        {
+            measurement->range = sensor->default_range;
+        }
+    }
+    int ready_ms = -1;
+    if (measurement->range >= 0)
+    {
+        ready_ms = sensor->start(file, &sensor->ranges[measurement->range]);
+    }
+    stats_since(STATS_MEASURE, &start);
+    measurement->active = 1;
+    measurement->polls = 0;
+    // the failure is reported by measure_lux_poll at the first timer expiration
+    measurement->failed = (ready_ms < 0);
+    if (ready_ms < 1)
+    {
+        // a zero timer value would disarm the timer
+        ready_ms = 1;
+    }
+    memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value.tv_sec = ready_ms / 1000;
+    deadline.it_value.tv_nsec = (ready_ms % 1000) * 1000000L;
+    if (timerfd_settime(measurement->timer_fd, 0, &deadline, NULL) < 0)
+    {
+        // ERROR HANDLING: the timer could not be armed, nothing would wake up the measurement
+        measurement->active = 0;
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "MEASUREMENT TIMER SET FAILED");
+        return -1;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_DEBUG, "Light measurement is started, data is expected in %d ms", ready_ms);
+    return measurement->failed ? -1 : 0;
+}
+
+/* FUNCTION: MEASURE_LUX_POLL
+this function is called when the measurement timer expires: if the sensor reports valid data, it is read,
+else the timer is re-armed for the next check (till the number of checks reaches LightMeasurementMaxPolls)
+after the read the range of the next measurement is selected (auto-ranging)
+Input:
+    measurement: state of the measurement
+    sensor: the sensor driver
+    int file: file descriptor of the light sensor
+    data: filled with the measured data and calculated lux (negative channels on failure, with the errno of the failed transaction)
+Output:
+    1 if the measurement is finished (data is filled), 0 if the data is not yet valid
+*/
+int measure_lux_poll(struct light_measurement *measurement, const struct sensor_driver *sensor, int file, struct light_sensor_data *data)
+{
+    struct itimerspec deadline;
+    struct timespec start;
+    uint64_t expirations = 0;
+    int res = -1;
+
+    // acknowledge the timer expiration
+    if (read(measurement->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        return 0;
+    }
+    if (measurement->active == 0)
+    {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int error = 0;
+    if (measurement->failed == 0)
+    {
+        res = sensor->ready(file);
+        error = (res < 0) ? errno : 0;
+    }
+    measurement->polls = measurement->polls + 1;
+    if ((res == 0) && (measurement->polls < LightMeasurementMaxPolls))
+    {
+        // not yet valid, check again a bit later
+        memset(&deadline, 0, sizeof(deadline));
+        deadline.it_value.tv_nsec = LightMeasurementPollMs * 1000000L;
+        if (timerfd_settime(measurement->timer_fd, 0, &deadline, NULL) >= 0)
+        {
+            stats_since(STATS_MEASURE, &start);
+            return 0;
+        }
+    }
+    measurement->active = 0;
+    if (res > 0)
+    {
+        *data = sensor->read(file, &sensor->ranges[measurement->range]);
+        data->raw_lux = data->lux;
+        data->error = ((data->s_ir < 0) || (data->s_broadband < 0)) ? errno : 0;
+    }
+    else
+    {
+        // ERROR HANDLING: the sensor failed, or the data is not valid in time
+        data->s_ir = -1;
+        data->s_broadband = -1;
+        data->lux = 0.0;
+        data->raw_lux = 0.0;
+        data->error = error;
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light measurement failed after %d checks", measurement->polls);
+    }
+    data->range = measurement->range;
+
+    // select the gain / integration time for the next measurement
+    int next = sensor_select_range(sensor, *data);
+    if ((next != measurement->range) && (sensor->set_range(file, &sensor->ranges[next]) >= 0))
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor range is changed from %d to %d", measurement->range, next);
+        measurement->range = next;
+    }
+    stats_since(STATS_MEASURE, &start);
+    return 1;
+}
+
+/* FUNCTION: FIND_SENSOR_DRIVER
+this function looks up a sensor driver by name
+Input:
+    name: name of the driver (e.g. tsl2561)
+Output:
+    the driver, or NULL if the name is unknown
+*/
+const struct sensor_driver *find_sensor_driver(const char *name)
+{
+    for (int i = 0; i < SENSOR_DRIVER_COUNT; i++)
+    {
+        if (strcmp(sensor_drivers[i].name, name) == 0)
+        {
+            return &sensor_drivers[i];
+        }
+    }
+    return NULL;
+}
+
+/* FUNCTION: SENSOR_PROBE
+this function finds the light sensor on the bus: the driver in the probe cache file is checked first,
+than all known drivers on their I2C address; the found driver is stored in the cache file for the next start
+Input:
+    bus: the I2C bus to be probed
+    cache_path: path of the probe cache file
+Output:
+    the bound driver, or NULL if no sensor is found
+*/
+const struct sensor_driver *sensor_probe(struct i2c_bus *bus, const char *cache_path)
+{
+    const struct sensor_driver *cached = NULL;
+    char name[16] = "";
+
+    // read the driver found at the previous start
+    FILE *f = fopen(cache_path, "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "%15s", name) == 1)
+        {
+            cached = find_sensor_driver(name);
+        }
+        fclose(f);
+    }
+    if (cached != NULL)
+    {
+        if (cached->probe(i2c_bus_use(bus, cached->address)))
+        {
+            log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor %s found at %#.2x (cached)", cached->name, cached->address);
+            return cached;
+        }
+    }
+
+    // probe all known drivers
+    for (int i = 0; i < SENSOR_DRIVER_COUNT; i++)
+    {
+        const struct sensor_driver *sensor = &sensor_drivers[i];
+        if (sensor == cached)
+        {
+            continue;
+        }
+        if (sensor->probe(i2c_bus_use(bus, sensor->address)))
+        {
+            log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor %s found at %#.2x", sensor->name, sensor->address);
+            f = fopen(cache_path, "w");
+            if (f != NULL)
+            {
+                fprintf(f, "%s\n", sensor->name);
+                fclose(f);
+            }
+            return sensor;
+        }
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "No light sensor found");
+    return NULL;
+}
+
+/* FUNCTION: TSL2561_INIT
+ sub-function is created to turn on and turn off the TSL2561 light sensor, the function also turn off interrupts
+ inputs
+        onoff: 1 to turn the sensor on, 0 to turn the sensor off
+        file: bus handler
+*/
+int tsl2561_init(unsigned char onoff, int file)
+{
+    int ares=0;
+    int res=0;
+    unsigned char command = Sensor_command;
+    // Power off value
+    unsigned char power_command = 0x00; 
+    if (onoff)
+    {
+    // Power on value
+    power_command = 0x03; 
+    }
+    // Turn on/off light sensor power
+    // Using SMBus commands
+    command = Sensor_command + Sensor_Power;
+    res = i2c_smbus_write_byte_data(file, command, power_command);
+    // the ADC registers are 0 till the first integration after the power on is finished
+    sensor_settling = 1;
+    if (res < 0)
+    {
+    // ERROR HANDLING: i2c transaction failed
+    ares=res;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor control register is set to %d, with result %d", power_command, res);
+    if (onoff)
+      {
+      // Turn off interrupts
+      // Using SMBus commands
+      command = Sensor_command + Sensor_interrupt;
+      res = i2c_smbus_write_byte_data(file, command, 0x0);
+      if (res < 0)
+      {
+          // ERROR HANDLING: i2c transaction failed
+          ares=res;
+      }
+      log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor interrupts are turned off, with result %d", res);
+    }
+
+    return ares;
+}
+
+/* FUNCTION: TSL2561_SHUTDOWN
+ sub-function is created to turn off the light sensor
+ inputs
+        file: bus handler
+*/
+int tsl2561_shutdown(int file)
+{
+    return tsl2561_init(0, file);
+}
+
+/* FUNCTION: TSL2561_SET_RANGE
+ sub-function is created to set the gain and integration time of the TSL2561 (TIMING register)
+ inputs
+        file: bus handler
+        range: the gain / integration time range to be set
+*/
+int tsl2561_set_range(int file, const struct sensor_range *range)
+{
+    int res = i2c_smbus_write_byte_data(file, Sensor_command + Sensor_Timing, range->config);
+    // the ADC registers hold the count of the old range till the first integration of the new one is finished
+    sensor_settling = 1;
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor timing register is set to %#.2x (gain %gx, %g ms), with result %d", range->config, range->gain, range->atime_ms, res);
+    return res;
+}
+
+/* FUNCTION: TSL2561_SET_THRESHOLDS
+ sub-function is created to program the interrupt thresholds of the TSL2561, and turn on the level interrupt
+ inputs
+        file: bus handler
+        low, high: thresholds in broadband channel counts, the interrupt is raised below low or above high
+*/
+int tsl2561_set_thresholds(int file, int low, int high)
+{
+    int ares=0;
+    int res=0;
+    res = i2c_smbus_write_word_data(file, Sensor_command + Sensor_Read_Word + TSL2561_Threshold_Low, low);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    res = i2c_smbus_write_word_data(file, Sensor_command + Sensor_Read_Word + TSL2561_Threshold_High, high);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    res = i2c_smbus_write_byte_data(file, Sensor_command + Sensor_interrupt, Sensor_interrupt_level);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor thresholds are set to %d - %d, with result %d", low, high, ares);
+    return ares;
+}
+
+/* FUNCTION: TSL2561_CLEAR_INTERRUPT
+ sub-function is created to clear the pending interrupt of the TSL2561
+ inputs
+        file: bus handler
+*/
+int tsl2561_clear_interrupt(int file)
+{
+    int res = i2c_smbus_write_byte(file, Sensor_command + Sensor_Clear);
+    if (res < 0)
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor interrupt clear failed");
+    }
+    return res;
+}
+
+/* FUNCTION: TSL2561_START
+this function starts the TSL2561 measurement: the powered sensor integrates continuously, the ADC registers hold the
+last finished integration, so the data is valid at once, except after the power on (the registers are 0) or a range
+change (the count of the old range): than the first integration of the range is waited for
+Input:
+    int file: file descriptor of the light sensor
+    range: the current gain / integration time range
+Output:
+    time till the data is expected to be valid [ms]
+*/
+int tsl2561_start(int file, const struct sensor_range *range)
+{
+    if (sensor_settling)
+    {
+        sensor_settling = 0;
+        return (int)(range->atime_ms * SensorSettleMargin) + SensorSettleMs;
+    }
+    return 0;
+}
+
+/* FUNCTION: TSL2561_READY
+this function checks if the TSL2561 data is valid (no status register, the sensor integrates continuously,
+the first integration after the power on or a range change is waited for by the start)
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1: the data is valid
+*/
+int tsl2561_ready(int file)
+{
+    return 1;
+}
+
+/* FUNCTION: TSL2561_READ
+this functional reads the TSL2561 measured data (one word read per channel), and calculates the lux
+(the BLOCK bit of the command selects the SMBus block protocol, the chip sends a byte count first, so a plain
+I2C block read of both channels would be shifted by one byte)
+Input:
+    int file: file descriptor of the light sensor
+    range: the gain / integration time range of the measurement
+Output:
+    struct light_sensor_data: measured data and calculated lux
+*/
+struct light_sensor_data tsl2561_read(int file, const struct sensor_range *range)
+{
+    struct light_sensor_data measurement;
+    float lux = 0.0;
+    int broadband = -1;
+    int ir = -1;
+
+    float f_broadband = 0.0;
+    float f_ir = 0.0;
+
+    // Read Broadband sensor value
+    // Using SMBus commands
+    broadband = i2c_smbus_read_word_data(file, Sensor_command + Sensor_Read_Word + TSL2561_Broadband_Low);
+    // Read infrared sensor value
+    // Using SMBus commands
+    if (broadband >= 0)
+    {
+        ir = i2c_smbus_read_word_data(file, Sensor_command + Sensor_Read_Word + TSL2561_IR_Low);
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor ADC values are read: boradband: %d, ir: %d", broadband, ir);
+    // if ir or broadband is negative than something failed during the measurement
+    if ((ir >= 0) && (broadband >= 0))
+    {
+        // make conversion based on datasheet (the proposed calculation is for gain=16 and 402 ms integration time)
+        float scale = (16.0 / range->gain) * (402.0 / range->atime_ms);
+        f_broadband= (float)broadband * scale;
+        f_ir = (float)ir * scale;
+        // calculate lux from measured values
+        lux = calculate_lux(f_broadband, f_ir, tsl2561_package);
+    }
+
+    measurement.s_ir = ir;
+    measurement.s_broadband = broadband;
+    measurement.lux = lux;
+    return measurement;
+}
+
+/* FUNCTION: TSL2591_INIT
+ sub-function is created to turn on and turn off the TSL2591 light sensor
+ inputs
+        onoff: 1 to turn the sensor on, 0 to turn the sensor off
+        file: bus handler
+*/
+int tsl2591_init(unsigned char onoff, int file)
+{
+    int ares=0;
+    int res=0;
+    unsigned char addr;
+    //get chip id
+    addr = id_register | command_bit;
+    res = i2c_smbus_read_byte_data(file, addr);
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares=res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor Chip ID = 0x%X",res);
+
+    // TSL2591_Write_Byte(ENABLE_REGISTER, ENABLE_POWERON | ENABLE_AEN );
+    addr = enable_register | command_bit;
+    res = i2c_smbus_write_byte_data(file, addr, enable_poweron | enable_aen);
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares=res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor enable register is set to %d, with result %d",  enable_poweron | enable_aen, res);
+    
+    // set gain and integral time
+    // TSL2591_Write_Byte(CONTROL_REGISTER, control);
+    addr = control_register | command_bit;
+    res = i2c_smbus_write_byte_data(file, addr, medium_gain | atime_200ms);
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares=res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor config register is set to %d, with result %d",  medium_gain | atime_200ms, res);
+
+    // interrupt is not used, persistent register is not set 
+    // TSL2591_Write_Byte(PERSIST_REGISTER, 0x01);//filter
+    
+    // Disable ALS
+    addr = enable_register | command_bit;
+    res = i2c_smbus_write_byte_data(file, addr, enable_poweron);
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares=res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor ALS disable: enable register is set to %d, with result %d", enable_poweron, res);
+
+    return ares;
+}
+
+/* FUNCTION: TSL2591_SHUTDOWN
+ sub-function is created to turn off the light sensor
+ inputs
+        file: bus handler
+*/
+int tsl2591_shutdown(int file)
+{
+    // TSL2591_Write_Byte(ENABLE_REGISTER, ENABLE_POWEROFF);
+    int res = i2c_smbus_write_byte_data(file, enable_register | command_bit, enable_poweroff);
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor enable register is set to %d, with result %d", enable_poweroff, res);
+    return res;
+}
+
+/* FUNCTION: TSL2591_SET_RANGE
+ sub-function is created to set the gain and integration time of the TSL2591 (CONTROL register)
+ inputs
+        file: bus handler
+        range: the gain / integration time range to be set
+*/
+int tsl2591_set_range(int file, const struct sensor_range *range)
+{
+    // TSL2591_Write_Byte(CONTROL_REGISTER, control);
+    int res = i2c_smbus_write_byte_data(file, control_register | command_bit, range->config);
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor config register is set to %#.2x (gain %gx, %g ms), with result %d", range->config, range->gain, range->atime_ms, res);
+    return res;
+}
+
+/* FUNCTION: TSL2591_SET_THRESHOLDS
+ sub-function is created to program the ALS interrupt thresholds of the TSL2591, and turn on the continuous
+ measurement with the ALS interrupt (the read function turns off the ALS, so it shall be called after each measurement)
+ inputs
+        file: bus handler
+        low, high: thresholds in broadband channel counts, the interrupt is raised below low or above high
+*/
+int tsl2591_set_thresholds(int file, int low, int high)
+{
+    int ares=0;
+    int res=0;
+    res = i2c_smbus_write_word_data(file, threshold_low_register | command_bit, low);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    res = i2c_smbus_write_word_data(file, threshold_high_register | command_bit, high);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    res = i2c_smbus_write_byte_data(file, persist_register | command_bit, persist_2);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    res = i2c_smbus_write_byte_data(file, enable_register | command_bit, enable_poweron | enable_aen | enable_aien);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        ares=res;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor thresholds are set to %d - %d, with result %d", low, high, ares);
+    return ares;
+}
+
+/* FUNCTION: TSL2591_CLEAR_INTERRUPT
+ sub-function is created to clear the pending ALS interrupt of the TSL2591
+ inputs
+        file: bus handler
+*/
+int tsl2591_clear_interrupt(int file)
+{
+    int res = i2c_smbus_write_byte(file, clear_interrupt_command);
+    if (res < 0)
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor interrupt clear failed");
+    }
+    return res;
+}
+
+/* FUNCTION: TSL2591_START
+this function starts the TSL2591 measurement by enabling the ALS (the ALS is disabled after each read)
+Input:
+    int file: file descriptor of the light sensor
+    range: the current gain / integration time range
+Output:
+    time till the data is expected to be valid (the integration time) [ms], negative on failure
+*/
+int tsl2591_start(int file, const struct sensor_range *range)
+{
+    int res = 0;
+    unsigned char addr;
+
+    // Enable ALS
+    addr = enable_register | command_bit;
+    res = i2c_smbus_write_byte_data(file, addr, enable_poweron | enable_aen);
+    log_msg(LOG_SENSOR, LOG_LEVEL_DEBUG, "Light sensor enable register is set to %d, with result %d",  enable_poweron | enable_aen, res);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        return res;
+    }
+    return (int)range->atime_ms;
+}
+
+/* FUNCTION: TSL2591_READY
+this function checks the AVALID bit of the TSL2591 status register
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1 if the integration is finished, 0 if not yet, negative on failure
+*/
+int tsl2591_ready(int file)
+{
+    int res = i2c_smbus_read_byte_data(file, status_register | command_bit);
+    if (res < 0)
+    {
+        // ERROR HANDLING: i2c transaction failed
+        return res;
+    }
+    return (res & status_avalid) ? 1 : 0;
+}
+
+/* FUNCTION: TSL2591_READ
+this functional reads the TSL2591 measured data (both channels by one block read), and calculates the lux
+Input:
+    int file: file descriptor of the light sensor
+    range: the gain / integration time range of the measurement
+Output:
+    struct light_sensor_data: measured data and calculated lux
+*/
+struct light_sensor_data tsl2591_read(int file, const struct sensor_range *range)
+{
+    struct light_sensor_data measurement;
+    float lux = 0.0;
+    int broadband = -1;
+    int ir = -1;
+
+    int res = 0;
+    unsigned char addr;
+    unsigned char adc[4];
+
+    // channel_0 and channel_1 (C0DATAL, C0DATAH, C1DATAL, C1DATAH) with auto-increment
+    addr = TSL2591_Broadband_Low | command_bit;
+    res = i2c_smbus_read_i2c_block_data(file, addr, 4, adc);
+    if (res == 4)
+    {
+        broadband = adc[0] | (adc[1] << 8);
+        ir = adc[2] | (adc[3] << 8);
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor ADC values are read: boradband: %d, ir: %d", broadband, ir);
+  
+    // Disable ALS
+    addr = enable_register | command_bit;
+    res = i2c_smbus_write_byte_data(file, addr, enable_poweron);
+    log_msg(LOG_SENSOR, LOG_LEVEL_DEBUG, "Light sensor ALS disable: enable register is set to %d, with result %d", enable_poweron, res);
+  
+    //calculate lux
+    if ((broadband >= 0) && (ir >= 0))
+    {
+        float cpl;
+        cpl = (range->atime_ms * range->gain) / lux_df;
+        lux = (broadband - (2 * ir)) / cpl;
+    }
+
+    //_TSL2591_LUX_DF = 408.0
+    //_TSL2591_LUX_COEFB = 1.64
+    //_TSL2591_LUX_COEFC = 0.59
+    //_TSL2591_LUX_COEFD = 0.86
+    //float lux2
+    //lux2 = ((_TSL2591_LUX_COEFC * channel_0) - (_TSL2591_LUX_COEFD * channel_1) ) / cpl
+    
+    if (lux < 0)
+    {
+      lux = 0;
+    }
+    
+
+    measurement.s_ir = ir;
+    measurement.s_broadband = broadband;
+    measurement.lux = lux;
+    return measurement;
+}
+
+/* FUNCTION: VEML7700_INIT
+ sub-function is created to turn on and turn off the VEML7700 light sensor
+ inputs
+        onoff: 1 to turn the sensor on, 0 to turn the sensor off
+        file: bus handler
+*/
+int veml7700_init(unsigned char onoff, int file)
+{
+    int ares=0;
+    int res=0;
+    // minimum current cunsumption is defined by the datasheet when: ALS_Gain: 01, PSM: 11, ALS_IT: 0000
+    // in thisa case the refresh time is 4.1s, resolution is 0.0288lx/bit
+    unsigned short power = als_poweroff;
+    unsigned short psm = psm_dis;
+    if (onoff)
+    {
+      power = als_poweron;
+      psm   = psm_en;
+    }
+    res = i2c_smbus_write_word_data(file, configuration_register, power | als_integration_time_100 | als_gain_2 );
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares = res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor ALS enable register is set to %d, with result %d", power | als_integration_time_100 | als_gain_2, res);
+    // the ALS and WHITE registers are 0 till the first measurement after the power on is finished
+    sensor_settling = 1;
+    
+    res = i2c_smbus_write_word_data(file, power_saving_register, psm_4 | psm );
+        if (res < 0)
+        {
+            // ERROR HANDLING: i2c transaction failed
+            ares = res;
+        }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor power saving register is set to %d, with result %d", psm_4 | psm, res);
+
+    return ares;
+}
+
+/* FUNCTION: VEML7700_SHUTDOWN
+ sub-function is created to turn off the light sensor
+ inputs
+        file: bus handler
+*/
+int veml7700_shutdown(int file)
+{
+    return veml7700_init(0, file);
+}
+
+/* FUNCTION: VEML7700_SET_RANGE
+ sub-function is created to set the gain and integration time of the VEML7700 (configuration register)
+ inputs
+        file: bus handler
+        range: the gain / integration time range to be set
+*/
+int veml7700_set_range(int file, const struct sensor_range *range)
+{
+    int res = i2c_smbus_write_word_data(file, configuration_register, als_poweron | interrupt_disable | range->config);
+    // the ALS and WHITE registers hold the count of the old range till the first measurement of the new one is finished
+    sensor_settling = 1;
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor ALS configuration register is set to %#.4x (gain %gx, %g ms), with result %d", range->config, range->gain, range->atime_ms, res);
+    return res;
+}
+
+/* FUNCTION: VEML7700_START
+this function starts the VEML7700 measurement: the sensor measures continuously in power saving mode, the ALS and
+WHITE registers hold the last finished measurement, so the data is valid at once, except after the power on (the
+registers are 0) or a range change (the count of the old range): than the first measurement of the range is waited for
+Input:
+    int file: file descriptor of the light sensor
+    range: the current gain / integration time range
+Output:
+    time till the data is expected to be valid [ms]
+*/
+int veml7700_start(int file, const struct sensor_range *range)
+{
+    if (sensor_settling)
+    {
+        sensor_settling = 0;
+        return (int)(range->atime_ms * SensorSettleMargin) + SensorSettleMs;
+    }
+    return 0;
+}
+
+/* FUNCTION: VEML7700_READY
+this function checks if the VEML7700 data is valid (no status bit, the sensor measures continuously,
+the first measurement after the power on or a range change is waited for by the start)
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1: the data is valid
+*/
+int veml7700_ready(int file)
+{
+    return 1;
+}
+
+/* FUNCTION: VEML7700_READ
+this functional reads the VEML7700 measured data, and calculates the lux
+(the ALS and WHITE channels are separate 16 bit command codes, they can not be read by one block read)
+Input:
+    int file: file descriptor of the light sensor
+    range: the gain / integration time range of the measurement
+Output:
+    struct light_sensor_data: measured data and calculated lux
+*/
+struct light_sensor_data veml7700_read(int file, const struct sensor_range *range)
+{
+    struct light_sensor_data measurement;
+    float lux = 0.0;
+    int broadband = 0;
+    int ir = 0;
+
+    // the resolution is inversely proportional to the gain and the integration time (0.0288lx/bit at gain 2, 100 ms)
+    broadband = i2c_smbus_read_word_data(file, als_register);
+    ir = i2c_smbus_read_word_data(file, white_register);
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Light sensor ADC values are read: ALS: %d, White: %d", broadband, ir);
+    
+    lux = broadband * veml7700_resolution / (range->gain * range->atime_ms / 100.0);
+
+
+    measurement.s_ir = ir;
+    measurement.s_broadband = broadband;
+    measurement.lux = lux;
+    return measurement;
+}
+
+/* FUNCTION: TSL2561_PROBE
+this function checks if a TSL2561 answers on the bus, based on the part number of the ID register
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1 if the sensor is a TSL2561, 0 otherwise
+*/
+int tsl2561_probe(int file)
+{
+    int res = i2c_smbus_read_byte_data(file, Sensor_command + TSL2561_ID_register);
+    // PARTNO: 0001 TSL2561CS, 0101 TSL2561T/FN/CL
+    return (res >= 0) && (((res & 0xF0) == 0x10) || ((res & 0xF0) == 0x50));
+}
+
+/* FUNCTION: TSL2591_PROBE
+this function checks if a TSL2591 answers on the bus, based on the ID register
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1 if the sensor is a TSL2591, 0 otherwise
+*/
+int tsl2591_probe(int file)
+{
+    int res = i2c_smbus_read_byte_data(file, id_register | command_bit);
+    return (res == TSL2591_ID);
+}
+
+/* FUNCTION: VEML7700_PROBE
+this function checks if a VEML7700 answers on the bus, based on the device ID in the ID register
+Input:
+    int file: file descriptor of the light sensor
+Output:
+    1 if the sensor is a VEML7700, 0 otherwise
+*/
+int veml7700_probe(int file)
+{
+    int res = i2c_smbus_read_word_data(file, id_register_veml);
+    return (res >= 0) && ((res & 0xFF) == VEML7700_ID);
+}
+
+/* FUNCTION: SENSOR_SELECT_RANGE
+this function selects the gain / integration time range for the next measurement from the counts of the last one:
+the range is kept while the counts stay between RangeKeepFillLow and RangeKeepFillHigh of its saturation, else
+the counts are scaled to each range, and the most sensitive range is selected where the expected counts
+stay below RangeTargetFill of the saturation (a saturated measurement selects the least sensitive range)
+a dark scene selects the most sensitive range at once, a bright one converges in one or two measurements
+Input:
+    sensor: the sensor driver
+    ls_data: the last measurement
+Output:
+    index of the selected range
+*/
+int sensor_select_range(const struct sensor_driver *sensor, struct light_sensor_data ls_data)
+{
+    // the failed measurement does not change the range
+    if ((ls_data.range < 0) || (ls_data.s_broadband < 0) || (ls_data.s_ir < 0))
+    {
+        return (ls_data.range >= 0) ? ls_data.range : sensor->default_range;
+    }
+    const struct sensor_range *measured = &sensor->ranges[ls_data.range];
+    // the higher channel limits the range (the white channel of the VEML7700 may be above the ALS channel)
+    int counts = (ls_data.s_broadband > ls_data.s_ir) ? ls_data.s_broadband : ls_data.s_ir;
+    if (counts >= measured->max_count)
+    {
+        // saturated: the real light level is unknown, start from the least sensitive range
+        return 0;
+    }
+    // inside the band the range is kept, so the range does not change back and forth at the limit of two ranges
+    if ((counts >= RangeKeepFillLow * measured->max_count) && (counts <= RangeKeepFillHigh * measured->max_count))
+    {
+        return ls_data.range;
+    }
+    // counts per unit of gain * integration time
+    float rate = counts / (measured->gain * measured->atime_ms);
+    for (int i = sensor->range_count - 1; i > 0; i--)
+    {
+        const struct sensor_range *candidate = &sensor->ranges[i];
+        if (rate * candidate->gain * candidate->atime_ms <= RangeTargetFill * candidate->max_count)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* FUNCTION: SENSOR_ARM_THRESHOLDS
+this function programs the interrupt thresholds of the sensor around the lux band of the current dimming,
+so the sensor interrupt is raised only if the light crosses into another dimming band
+the band follows update_dimming_by_lux: the dimming decreases below its own lux value minus the down hysteresis,
+and increases above the lux value of the next defined dimming plus the up hysteresis
+with more displays following the sensor, the intersection of their bands is used (any band change raises the interrupt)
+Input:
+    sensor: the sensor driver (with SENSOR_CAP_THRESHOLD_INT)
+    file: file descriptor of the light sensor
+    ls_data: the last measurement (the lux band is converted to raw counts with the counts/lux ratio of its driver lux)
+    displays: the displays (the ones with use_sensor are considered)
+    count: number of the displays
+    range: the current gain / integration time range of the sensor (the counts are compared in this range)
+    scale, offset: the lux calibration (the bands are in calibrated lux, the offset makes the counts/lux ratio of the
+                   calibrated lux depend on the light, so the bands are converted back to the lux of the driver first)
+Output:
+    negative value if an I2C transaction failed
+*/
+int sensor_arm_thresholds(const struct sensor_driver *sensor, int file, struct light_sensor_data ls_data, const struct clock_display *displays, int count, int range,
+                          float scale, float offset)
+{
+    float low_lux = 0.0;
+    float high_lux = -1.0; // no brighter dimming band
+    const struct sensor_range *current = &sensor->ranges[(range >= 0) ? range : sensor->default_range];
+    int low = 0;
+    int high = current->max_count;
+
+    for (int d = 0; d < count; d++)
+    {
+        const struct dimming_curve *curve = &displays[d].curve;
+        if (!displays[d].use_sensor)
+        {
+            continue;
+        }
+        // the band of the current level (the highest level not above the current dimming)
+        int index = 0;
+        for (int i = 1; i < curve->count; i++)
         {
-            if (((a_tm->tm_hour == 4) && (a_tm->tm_min == 0)) || (lux_read == 0))
+            if (curve->level[i] <= displays[d].dimming.currlight)
             {
-                read_lux_values(lux_values, filepath);
-                // output at every loglevel
-                if (verbose)
-                {
-                    printf("Lux file read: %s\n", filepath);
-                    printf("The lux values are: ");
-                    for(int i = 0; i <= MaxDimming; i++) {
-                        printf("%d ", lux_values[i]);
-                    }
-                    printf("\n");
-                }
-                lux_read = 1;
+                index = i;
             }
         }
+        if (curve->down[index] > low_lux)
+        {
+            low_lux = curve->down[index];
+        }
+        if ((index + 1 < curve->count) && ((high_lux < 0.0) || (curve->up[index + 1] < high_lux)))
+        {
+            high_lux = curve->up[index + 1];
+        }
+    }
+
+    if ((ls_data.raw_lux > 0.0) && (ls_data.s_broadband > 0) && (ls_data.range >= 0))
+    {
+        // convert the driver lux of the band with the counts/lux ratio of the last measurement (includes gain,
+        // integration time and IR share) scaled to the current range, if the range is changed after the measurement
+        const struct sensor_range *measured = &sensor->ranges[ls_data.range];
+        float counts_per_lux = (ls_data.s_broadband / ls_data.raw_lux) *
+                               (current->gain * current->atime_ms) / (measured->gain * measured->atime_ms);
+        low = (int)(lux_uncalibrate(low_lux, scale, offset) * counts_per_lux);
+        if (high_lux >= 0.0)
+        {
+            high = (int)(lux_uncalibrate(high_lux, scale, offset) * counts_per_lux) + 1;
+        }
+    }
+    else
+    {
+        // no valid ratio (dark, or no measurement yet): the interrupt is raised at the first count above the last value
+        high = (ls_data.s_broadband > 0) ? ls_data.s_broadband : 0;
+    }
+    if (high > current->max_count)
+    {
+        high = current->max_count;
+    }
+    if (low > high)
+    {
+        low = high;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_INFO, "Dimming band: %.1f - %.1f lux, thresholds: %d - %d counts", low_lux, high_lux, low, high);
+    return sensor->set_thresholds(file, low, high);
+}
+
+/* FUNCTION: GPIO_OPEN_EVENT
+this function requests the falling edge events of a GPIO line via the gpiochip character device
+(the INT output of the light sensors is active low, open drain: a pull-up is needed on the line)
+Input:
+    chip_path: path of the gpiochip device
+    line: line offset on the gpiochip
+Output:
+    file descriptor of the line events (readable if an edge is detected), or -1 on failure
+*/
+int gpio_open_event(const char *chip_path, int line)
+{
+#ifndef noI2C
+    struct gpioevent_request request;
+    int chip_fd = open(chip_path, O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0)
+    {
+        // ERROR HANDLING; you can check errno to see what went wrong
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Failed to open the gpiochip %s", chip_path);
+        return -1;
+    }
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = line;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+    snprintf(request.consumer_label, sizeof(request.consumer_label), "clock light sensor");
+    int res = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    // the line event fd is kept open, the chip fd is not needed anymore
+    close(chip_fd);
+    if (res < 0)
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Failed to request the events of GPIO line %d", line);
+        return -1;
+    }
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Light sensor interrupt is read from GPIO line %d", line);
+    return request.fd;
+#else
+    // no GPIO without the target hardware
+    return -1;
+#endif
+}
+
+/* ratio_pow14: CH1/CH0 ^ 1.4 by linear interpolation in a table built at the first call (the error is below 0.1 % of the lux) */
+static float ratio_pow14(float ratio)
+{
+    static float table[RATIO_POW_STEPS + 1];
+    static int built = 0;
+    if (!built)
+    {
+        for (int i = 0; i <= RATIO_POW_STEPS; i++)
+        {
+            table[i] = powf(RatioPowMax * i / RATIO_POW_STEPS, 1.4f);
+        }
+        built = 1;
+    }
+    if ((ratio < 0.0f) || (ratio >= RatioPowMax))
+    {
+        return powf(ratio, 1.4f);
+    }
+    float position = ratio * RATIO_POW_STEPS / RatioPowMax;
+    int index = (int)position;
+    return table[index] + (table[index + 1] - table[index]) * (position - index);
+}
+
+/* FUNCTION: CALCULATE_LUX
+this function calculates the lux value from the measured light sensor data
+the segments and the coefficients are the datasheet values of the package (see struct tsl2561_package)
+Input:
+    float broadband: bradband sensor measured value
+    float ir: infrared sensor measured value
+    package: the lux coefficients of the TSL2561 package
+Output:
+    float lux   : the calculated lux value
+*/
+float calculate_lux(float broadband, float ir, const struct tsl2561_package *package)
+{
+    float lux = 0.0;
+    float ratio = 0.0;
+    // calculate ration with division of zero protection
+    if (broadband > 0.0) ratio = ir / broadband;
+    // make the necessary calculations based on the segment of the ratio
+    // first segment: Lux = ch0 * CH0 - ch1 * CH0 * ((CH1/CH0)^1.4)
+    if ((ratio <= package->ratio[0]) && (broadband > 0.0))
+    {
+        lux = package->ch0[0] * broadband - package->ch1[0] * broadband * ratio_pow14(ratio);
+    }
+    // the other segments: Lux = ch0 * CH0 - ch1 * CH1
+    else if ((ratio <= package->ratio[3]) && (broadband > 0.0))
+    {
+        int segment = (ratio <= package->ratio[1]) ? 1 : ((ratio <= package->ratio[2]) ? 2 : 3);
+        lux = package->ch0[segment] * broadband - package->ch1[segment] * ir;
+    }
+    // above the last ratio Lux = 0
+    else
+    {
+        lux = 0.02;
+    }
+    // if a calculation went out of limits, than set the lux value to 0
+    if (isnan(lux))
+    {
+        lux = 0.02;
+    }
+    else if (lux < 0.02)
+    {
+        lux = 0.02;
+    }
+    return lux;
+}
+
+/* FUNCTION: FIND_TSL2561_PACKAGE
+this function finds the lux coefficients of a TSL2561 package by name
+Input:
+    name: name of the package (t: T, FN and CL packages, cs: CS package)
+Output:
+    the package, NULL if not found
+*/
+const struct tsl2561_package *find_tsl2561_package(const char *name)
+{
+    for (unsigned int i = 0; i < TSL2561_PACKAGE_COUNT; i++)
+    {
+        if (strcmp(tsl2561_packages[i].name, name) == 0)
+        {
+            return &tsl2561_packages[i];
+        }
+    }
+    return NULL;
+}
+
+/* FUNCTION: LUX_CALIBRATE
+this function applies the per-board calibration to the lux of the sensor
+Input:
+    lux: the lux of the sensor driver
+    scale, offset: the calibration
+Output:
+    the calibrated lux (not negative)
+*/
+float lux_calibrate(float lux, float scale, float offset)
+{
+    float calibrated = lux * scale + offset;
+    return (calibrated > 0.0f) ? calibrated : 0.0f;
+}
 
-        // if current minute is not equal to the previous
-        if (amin != a_tm->tm_min)
+/* FUNCTION: LUX_UNCALIBRATE
+this function converts a calibrated lux back to the lux of the sensor driver (the inverse of lux_calibrate)
+(the scale is checked in the configuration, it is never 0)
+Input:
+    lux: the calibrated lux
+    scale, offset: the calibration
+Output:
+    the lux of the sensor driver (not negative)
+*/
+float lux_uncalibrate(float lux, float scale, float offset)
+{
+    float sensor_lux = (lux - offset) / scale;
+    return (sensor_lux > 0.0f) ? sensor_lux : 0.0f;
+}
+
+/* FUNCTION: LUX_CALIBRATION_FIT
+this function adds a reference point to the lux calibration, and fits the calibration to the points
+one point (or points at the same light) gives a scale without offset, more points at different light give
+the least squares line
+Input:
+    fit: the points of the calibration
+    sensor_lux: the (not calibrated) lux of the sensor
+    reference: the reference lux
+    scale, offset: the calibration, changed only if the fit is valid
+Output:
+    0 if the calibration is changed, -1 if the point is rejected (dark, or the fit is out of the limits)
+*/
+int lux_calibration_fit(struct lux_calibration *fit, float sensor_lux, float reference, float *scale, float *offset)
+{
+    // ERROR HANDLING: in the dark the ratio is dominated by the sensor noise
+    if (sensor_lux < LuxCalibrationMinLux)
+    {
+        return -1;
+    }
+    struct lux_calibration next = *fit;
+    next.points++;
+    next.sum_x += sensor_lux;
+    next.sum_y += reference;
+    next.sum_xx += (double)sensor_lux * sensor_lux;
+    next.sum_xy += (double)sensor_lux * reference;
+    double fit_scale = next.sum_xy / next.sum_xx;
+    double fit_offset = 0.0;
+    double det = next.points * next.sum_xx - next.sum_x * next.sum_x;
+    // the line is only fitted if the points span at least a factor of 2 of light (det is n^2 times the variance)
+    if ((next.points >= 2) && (det > 0.05 * next.points * next.sum_xx))
+    {
+        fit_scale = (next.points * next.sum_xy - next.sum_x * next.sum_y) / det;
+        fit_offset = (next.sum_y - fit_scale * next.sum_x) / next.points;
+    }
+    if ((fit_scale < LuxScaleMin) || (fit_scale > LuxScaleMax))
+    {
+        return -1;
+    }
+    *fit = next;
+    *scale = (float)fit_scale;
+    *offset = (float)fit_offset;
+    return 0;
+}
+
+/* FUNCTION: READ_LUX_VALUES
+sub-function is created to read lux values for dimming from file
+    file name is stored in lux_file variable
+        the file shall contain lux dimming pairs in each row, both as integer values
+    input: pointer to the array to be filled
+the result will contain as many elements as MaxDimming, and 
+- for each defined dimming point the minimum lux level will be the contant
+- will contain 0 if the input file do not specify lux value for the dimming
+*/
+void read_lux_values(int * lux_array, char * filepath)
+{
+    // reset all values to 0
+    for (int i = 0; i <= MaxDimming; i++)
+    {
+        lux_array[i] = 0;
+    }
+
+    // open file to append ("a")
+    FILE *f = fopen(filepath, "r");
+    if (f == NULL)
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_ERROR, "Lux-dimming file open failed");
+    }
+    else
+    {
+        // or other suitable maximum line size
+        char line [ 128 ]; 
+        // read a line
+        while ( fgets ( line, sizeof line, f ) != NULL ) 
         {
-            // store previous minute value
-            amin=a_tm->tm_min;
+            char *token;
+            // Token will point to the part before the " ".
+            token = strtok(line, " ");
+            int alux = atoi(token);
+            // Token will point to the part after the " ".
+            token = strtok(NULL, " ");
+            // convert token to number
+            int adimming = atoi(token);
+            lux_array[adimming] = alux;
+        }
+        // close file
+        fclose(f);
+    }
+}
+
+
+/* FUNCTION: CONFIG_LOAD
+this function parses the configuration file into the config struct (the defaults are set first)
+the file contains "key = value" lines, "#" starts a comment; the keys are:
+    lux = <lux> <dimming>      (one line per dimming level, if none is given lux_dimming.txt is read)
+    display = <address> sensor|sun  (one line per display, the lux lines after it are the own table of the display,
+                                     without display lines one display is driven at disp_address)
+    page = time|date|temp|text <seconds> (one line per page of the display rotation, in the order of the rotation,
+                                     without page lines the time is shown)
+    hysteresis_up, hysteresis_down [%], lux_median, lux_tau_s [s], tsl2561_package = t|cs, lux_scale, lux_offset,
+    mqtt_address, mqtt_client_id, mqtt_topic, temp_topic, encoding, telemetry_deadband [%], telemetry_heartbeat [s],
+    clock_sync_wait [s], dimming_learn = 0|1, sensor, gpio_line, location = <lat>,<lon>, ramp_ms, display_mode,
+    log_clock, log_display, log_sensor, log_mqtt, log_sched  (-1: none, 0: errors .. 3: debug)
+Input:
+    config: the result, only to be used if the file is valid
+    path: path of the configuration file (a missing file is not an error, the defaults are used)
+    lux_path: path of the legacy lux-dimming file
+Output:
+    0 if the configuration is valid, -1 otherwise (unknown key, invalid value, or not increasing lux table)
+*/
+int config_load(struct clock_config *config, const char *path, const char *lux_path)
+{
+    int lux_defined = 0;
+    // the display the lux lines belong to (-1: the common table), and whether it has an own table
+    int display = -1;
+    int display_lux_defined[DISPLAY_MAX] = {0};
+    int line_nr = 0;
+    int ares = 0;
 
-            // define current dimming settings
-            if (!((light_sensor_available == 1) && (use_light_sensor == 1)))
+    // defaults (the original compile-time settings)
+    memset(config, 0, sizeof(struct clock_config));
+    snprintf(config->mqtt_address, sizeof(config->mqtt_address), "%s", ADDRESS);
+    snprintf(config->mqtt_client_id, sizeof(config->mqtt_client_id), "%s", CLIENTID);
+    snprintf(config->mqtt_topic, sizeof(config->mqtt_topic), "%s", TOPIC);
+    config->encoding = PAYLOAD_JSON;
+    snprintf(config->sensor, sizeof(config->sensor), "auto");
+    config->gpio_line = -1;
+    config->latitude = 47.5;
+    config->longitude = 19.0;
+    config->ramp_ms = RampDurationMs;
+    config->display_mode = DISPLAY_MODE_HHMM;
+    config->hysteresis_up = 5;
+    config->hysteresis_down = 5;
+    config->lux_median = LuxMedianSize;
+    config->lux_tau_s = LuxTauSec;
+    config->telemetry_deadband = 10;
+    config->telemetry_heartbeat = 900;
+    config->clock_sync_wait = ClockSyncWaitSec;
+    config->tsl2561_package = &tsl2561_packages[0];
+    config->lux_scale = 1.0;
+    config->lux_offset = 0.0;
+    for (int i = 0; i < LOG_SUBSYSTEMS; i++)
+    {
+        config->log_levels[i] = LogLevelDefault;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f != NULL)
+    {
+        char line[160];
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            line_nr++;
+            // cut the comment and the line end
+            line[strcspn(line, "#\r\n")] = '\0';
+            char key[32];
+            char value[128];
+            int n = sscanf(line, " %31[a-z_] = %127[^\n]", key, value);
+            if (n <= 0)
             {
-                // if light sensor is not availbale or not to be used, based on sunup/sunrise
-                adimming=update_dimming(a_tm,adimming,thissunup, verbose);
+                // empty line
+                continue;
             }
-            else
+            // remove the trailing spaces of the value
+            int len = (n == 2) ? (int)strlen(value) : 0;
+            while ((len > 0) && (value[len - 1] == ' ' || value[len - 1] == '\t'))
+            {
+                value[--len] = '\0';
+            }
+            int lux = 0;
+            int dimming = 0;
+            int res = 0;
+            if (n != 2)
             {
-                // else based on the sensor reading
-                // if sensor reading OK
-                if ((ls_data.s_broadband >=0 ) && (ls_data.s_ir >= 0))
+                res = -1;
+            }
+            else if (strcmp(key, "lux") == 0)
+            {
+                res = ((sscanf(value, "%d %d", &lux, &dimming) == 2) && (lux >= 0) && (dimming >= 0) && (dimming <= MaxDimming)) ? 0 : -1;
+                if ((res == 0) && (display >= 0))
                 {
-                    adimming=update_dimming_by_lux(lux, lux_values, adimming, verbose);
+                    config->displays[display].lux_values[dimming] = lux;
+                    display_lux_defined[display] = 1;
                 }
-                // else use substitute value
-                else
+                else if (res == 0)
+                {
+                    config->lux_values[dimming] = lux;
+                    lux_defined = 1;
+                }
+            }
+            else if (strcmp(key, "display") == 0)
+            {
+                // display = <address> sensor|sun
+                char *end = NULL;
+                long address = strtol(value, &end, 0);
+                while ((*end == ' ') || (*end == '\t'))
+                {
+                    end++;
+                }
+                res = ((config->display_count < DISPLAY_MAX) && (address >= 0x70) && (address <= 0x77) &&
+                       ((strcmp(end, "sensor") == 0) || (strcmp(end, "sun") == 0))) ? 0 : -1;
+                for (int i = 0; i < config->display_count; i++)
+                {
+                    if (config->displays[i].address == address)
+                    {
+                        res = -1;
+                    }
+                }
+                if (res == 0)
+                {
+                    display = config->display_count++;
+                    config->displays[display].address = (unsigned char)address;
+                    config->displays[display].use_sensor = (strcmp(end, "sensor") == 0);
+                }
+            }
+            else if (strcmp(key, "hysteresis_up") == 0)
+            {
+                config->hysteresis_up = atoi(value);
+                res = ((config->hysteresis_up >= 0) && (config->hysteresis_up <= 50)) ? 0 : -1;
+            }
+            else if (strcmp(key, "hysteresis_down") == 0)
+            {
+                config->hysteresis_down = atoi(value);
+                res = ((config->hysteresis_down >= 0) && (config->hysteresis_down <= 50)) ? 0 : -1;
+            }
+            else if (strcmp(key, "lux_median") == 0)
+            {
+                config->lux_median = atoi(value);
+                res = ((config->lux_median >= 1) && (config->lux_median <= LUX_MEDIAN_MAX)) ? 0 : -1;
+            }
+            else if (strcmp(key, "lux_tau_s") == 0)
+            {
+                config->lux_tau_s = atoi(value);
+                res = ((config->lux_tau_s >= 0) && (config->lux_tau_s <= 3600)) ? 0 : -1;
+            }
+            else if (strcmp(key, "tsl2561_package") == 0)
+            {
+                config->tsl2561_package = find_tsl2561_package(value);
+                res = (config->tsl2561_package != NULL) ? 0 : -1;
+            }
+            else if (strcmp(key, "lux_scale") == 0)
+            {
+                config->lux_scale = strtof(value, NULL);
+                res = ((config->lux_scale >= LuxScaleMin) && (config->lux_scale <= LuxScaleMax)) ? 0 : -1;
+            }
+            else if (strcmp(key, "lux_offset") == 0)
+            {
+                config->lux_offset = strtof(value, NULL);
+                res = ((config->lux_offset >= -1000.0f) && (config->lux_offset <= 1000.0f)) ? 0 : -1;
+            }
+            else if ((strcmp(key, "mqtt_address") == 0) && (len < (int)sizeof(config->mqtt_address)))
+            {
+                strcpy(config->mqtt_address, value);
+            }
+            else if ((strcmp(key, "mqtt_client_id") == 0) && (len < (int)sizeof(config->mqtt_client_id)))
+            {
+                strcpy(config->mqtt_client_id, value);
+            }
+            else if ((strcmp(key, "mqtt_topic") == 0) && (len < (int)sizeof(config->mqtt_topic)))
+            {
+                strcpy(config->mqtt_topic, value);
+            }
+            else if ((strcmp(key, "temp_topic") == 0) && (len < (int)sizeof(config->temp_topic)))
+            {
+                strcpy(config->temp_topic, value);
+            }
+            else if (strcmp(key, "page") == 0)
+            {
+                // page = <name> <seconds>
+                char name[16];
+                int duration_s = 0;
+                const struct page_driver *driver = NULL;
+                if (sscanf(value, "%15s %d", name, &duration_s) == 2)
+                {
+                    driver = find_page_driver(name);
+                }
+                res = ((driver != NULL) && (config->page_count < PAGE_MAX) && (duration_s >= 1) && (duration_s <= 3600)) ? 0 : -1;
+                if (res == 0)
+                {
+                    config->pages[config->page_count].driver = driver;
+                    config->pages[config->page_count].duration_s = duration_s;
+                    config->page_count++;
+                }
+            }
+            else if (strcmp(key, "encoding") == 0)
+            {
+                res = parse_payload_encoding(value, &config->encoding);
+            }
+            else if (strcmp(key, "sensor") == 0)
+            {
+                res = ((strcmp(value, "auto") == 0) || (strcmp(value, "none") == 0) || (find_sensor_driver(value) != NULL)) ? 0 : -1;
+                if (res == 0)
                 {
-                    adimming.currlight= 3;
+                    strcpy(config->sensor, value);
                 }
             }
-
-            // define memory values for the display
-            adisp_refresh_values=get_displ_values(a_tm, adimming.currlight,verbose);
-
-            // Set display content and dimming
-            disp_status= display_update(adisp_refresh_values, display_file_descriptor, adimming.lightchange, verbose);
-            if ((disp_status < 0) && verbose)
+            else if (strcmp(key, "gpio_line") == 0)
+            {
+                config->gpio_line = atoi(value);
+                res = (config->gpio_line >= -1) ? 0 : -1;
+            }
+            else if (strcmp(key, "location") == 0)
+            {
+                res = ((sscanf(value, "%lf,%lf", &config->latitude, &config->longitude) == 2) &&
+                       (fabs(config->latitude) <= 90.0) && (fabs(config->longitude) <= 180.0)) ? 0 : -1;
+            }
+            else if (strcmp(key, "telemetry_deadband") == 0)
+            {
+                config->telemetry_deadband = atoi(value);
+                res = ((config->telemetry_deadband >= 0) && (config->telemetry_deadband <= 100)) ? 0 : -1;
+            }
+            else if (strcmp(key, "telemetry_heartbeat") == 0)
             {
-                printf("DISPLAY UPDATE FIALED\n");
+                config->telemetry_heartbeat = atoi(value);
+                res = ((config->telemetry_heartbeat >= 60) && (config->telemetry_heartbeat <= 86400)) ? 0 : -1;
             }
-            // only display minutely information at more detailed loglevels
-            if (verbose > 1)
+            else if (strcmp(key, "dimming_learn") == 0)
             {
-                printf("The hour is: %02d, display code is %#.2x;%#.2x, result: %d \n",a_tm->tm_hour,adisp_refresh_values.disp_h1,adisp_refresh_values.disp_h2,res);
-                printf("The minute is: %02d, display code is %#.2x;%#.2x, result: %d \n",a_tm->tm_min,adisp_refresh_values.disp_min1,adisp_refresh_values.disp_min2,res);
-                if (adimming.lightchange == 0)
-                {
-                    printf("Display dimming is unchanged, %d, display memory is %#.2x  \n", adimming.currlight, adisp_refresh_values.disp_dim);
-                }
+                config->dimming_learn = atoi(value);
+                res = ((strcmp(value, "0") == 0) || (strcmp(value, "1") == 0)) ? 0 : -1;
             }
-            // display dimming change at every loglevel
-            if ((adimming.lightchange != 0) && verbose)
+            else if (strcmp(key, "clock_sync_wait") == 0)
             {
-                printf("Display dimming is set to %d, display memory to set: %#.2x, result: %d \n", adimming.currlight, adisp_refresh_values.disp_dim,res);
+                config->clock_sync_wait = atoi(value);
+                res = ((config->clock_sync_wait >= 0) && (config->clock_sync_wait <= 86400)) ? 0 : -1;
             }
-
-            // if light sensor failure occured, than try restart the light sensor
-            if (light_sensor_dead == light_sensor_dead_lim)
+            else if (strcmp(key, "ramp_ms") == 0)
             {
-                res = sensor_init(0, sensor_file_descriptor, verbose);
-                if (res >= 0)
-                {
-                    program_sleep(0.5,verbose);
-                    res=sensor_init(1, sensor_file_descriptor, verbose);
-                }
-                if (res >= 0)
-                {
-                    lux = 0.0;
-                }
-                else
-                {
-                    light_sensor_dead = 0;
-                }
+                config->ramp_ms = atoi(value);
+                res = (config->ramp_ms >= 0) ? 0 : -1;
             }
-
-            //Do MQTT connect, publish and disconnect
-            //first check if the client is connected, if not then connect
-            if (1 == 1)
+            else if (strcmp(key, "display_mode") == 0)
             {
-                if (MQTTClient_isConnected(client) == 1)
+                res = parse_display_mode(value, &config->display_mode);
+            }
+            else if (strncmp(key, "log_", 4) == 0)
+            {
+                // log_<subsystem> = level
+                res = -1;
+                for (int i = 0; i < LOG_SUBSYSTEMS; i++)
                 {
-                    MQTT_Connected = 1;
-                    if (light_sensor_dead == light_sensor_dead_lim)
-                    {
-                        MQTT_Connected = 3; // tried to restart sensor
-                    }
-                    if (verbose > 1)
+                    if ((strcmp(&key[4], LogSubsystemNames[i]) == 0) && (sscanf(value, "%d", &config->log_levels[i]) == 1) &&
+                        (config->log_levels[i] >= -1) && (config->log_levels[i] <= LOG_LEVEL_DEBUG))
                     {
-                        printf("MQTT connection is alive\n");
+                        res = 0;
                     }
                 }
-                else
-                {
-                    MQTT_Connected = 0;
-                     if (MQTTClient_connect(client, &conn_opts) == MQTTCLIENT_SUCCESS)
-                     {
-                         MQTT_Connected = 2;
-                         if (verbose)
-                         {
-                           printf("MQTT connection was not alive, connected\n");
-                         }
-                     }
-                     else
-                     {
-                         if (verbose)
-                         {
-                           printf("MQTT connection is not alive\n");
-                         }
-                     }
-                }
-                if (MQTT_Connected >= 1)
-                {
-                    snprintf(mqtt_payload,100,"{\"lux\": %.5f, \"dimming\": %i, \"mqtt\": %i, \"ir\": %i, \"broadband\": %i, \"disp_err\": %i}",
-                        lux, adimming.currlight, MQTT_Connected, ls_data.s_ir, ls_data.s_broadband, disp_status);
-                    pubmsg.payload = mqtt_payload;
-                    pubmsg.payloadlen = strlen(mqtt_payload);
-                    pubmsg.qos = QOS;
-                    pubmsg.retained = 1;
-                    MQTTClient_publishMessage(client, TOPIC, &pubmsg, &token);
-                    MQTTClient_waitForCompletion(client, token, 5000);
-                }
             }
-
-            // get sleep time
-            a_tm = localtime(&now);
-            // define max sleep (some delay will be caused by the light sensor measurement, but below 1 sec)
-            int StopSleepBeforeSec = 58;
-            if (a_tm->tm_sec < StopSleepBeforeSec)
+            else
             {
-                sleep_sec= StopSleepBeforeSec - a_tm->tm_sec;
+                res = -1;
             }
-            else
+            if (res < 0)
             {
-                sleep_sec= 1;
+                // ERROR HANDLING: the whole file is rejected, a half applied configuration is worse than the old one
+                ares = -1;
+                log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Configuration %s line %d is invalid: %s", path, line_nr, line);
             }
+        }
+        fclose(f);
+    }
+
+    // the lux table of the earlier versions
+    if (!lux_defined)
+    {
+        read_lux_values(config->lux_values, (char *)lux_path);
+    }
+    if (lux_table_valid(config->lux_values) < 0)
+    {
+        ares = -1;
+    }
+    // without display lines the display of the earlier versions, following the sensor
+    if (config->display_count == 0)
+    {
+        config->display_count = 1;
+        config->displays[0].address = disp_address;
+        config->displays[0].use_sensor = 1;
+    }
+    // without page lines only the time is shown (no rotation)
+    if (config->page_count == 0)
+    {
+        config->page_count = 1;
+        config->pages[0].driver = find_page_driver("time");
+        config->pages[0].duration_s = 60;
+    }
+    // the displays without own lux lines use the common table
+    for (int i = 0; i < config->display_count; i++)
+    {
+        if (!display_lux_defined[i])
+        {
+            memcpy(config->displays[i].lux_values, config->lux_values, sizeof(config->lux_values));
+        }
+        else if (lux_table_valid(config->displays[i].lux_values) < 0)
+        {
+            ares = -1;
+        }
+    }
+    return ares;
+}
+
+/* FUNCTION: CONFIG_APPLY_OPTIONS
+this function applies the command line options on the config (the options override the configuration file)
+Input:
+    config: the config to be changed
+    argc, argv: the arguments of the process
+Output:
+    0 if the options are valid, -1 otherwise
+*/
+int config_apply_options(struct clock_config *config, int argc, char *argv[])
+{
+    int opt;
+    // the options are parsed again at every reload of the configuration file
+    optind = 1;
+    while ((opt = getopt(argc, argv, "e:s:g:l:r:d:")) != -1)
+    {
+        if ((opt == 'e') && (parse_payload_encoding(optarg, &config->encoding) == 0))
+        {
+            continue;
+        }
+        if ((opt == 's') && ((strcmp(optarg, "auto") == 0) || (strcmp(optarg, "none") == 0) || (find_sensor_driver(optarg) != NULL)))
+        {
+            snprintf(config->sensor, sizeof(config->sensor), "%s", optarg);
+            continue;
+        }
+        if ((opt == 'g') && (atoi(optarg) >= 0))
+        {
+            config->gpio_line = atoi(optarg);
+            continue;
+        }
+        if ((opt == 'l') && (sscanf(optarg, "%lf,%lf", &config->latitude, &config->longitude) == 2) &&
+            (fabs(config->latitude) <= 90.0) && (fabs(config->longitude) <= 180.0))
+        {
+            continue;
+        }
+        if ((opt == 'r') && (atoi(optarg) >= 0))
+        {
+            config->ramp_ms = atoi(optarg);
+            continue;
+        }
+        if ((opt == 'd') && (parse_display_mode(optarg, &config->display_mode) == 0))
+        {
+            continue;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* FUNCTION: CONFIG_WATCH
+this function creates an inotify watch on the directory of the configuration file (the editors replace the file by a rename,
+so the directory is watched, not the file)
+Input:
+    dir: the directory of the configuration file
+Output:
+    the inotify file descriptor, -1 on failure (the configuration is only read at the start-up)
+*/
+int config_watch(const char *dir)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ((fd >= 0) && (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0))
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+    {
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "CONFIGURATION WATCH FAILED, the configuration is only read at the start-up");
+    }
+    return fd;
+}
 
-            //at the first minute do not wait, as we are out of synch
-            if (dontwait == 0)
+/* FUNCTION: CONFIG_CHANGED
+this function reads the pending inotify events, and checks if the configuration file or the lux-dimming file was written
+Input:
+    fd: the inotify file descriptor
+Output:
+    1 if one of the files was changed, 0 otherwise
+*/
+int config_changed(int fd)
+{
+    // aligned for the struct inotify_event
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            if ((event->len > 0) && ((strcmp(event->name, config_file) == 0) || (strcmp(event->name, lux_file) == 0)))
             {
-                program_sleep(sleep_sec,verbose);
-                // measure lux value after the long wait if communication with the sensor is OK
-                if (light_sensor_available == 1)
-                {
-                    //some low-pass filtering on lux value ~4min (y += alpha * ( x - y ) )
-                    ls_data = measure_lux(sensor_file_descriptor, verbose);
-                    if (ls_data.lux > 0.0)
-                    {
-                        lux = lux + ((ls_data.lux - lux) / 4.0f);
-                    }
-                    else
-                    {
-                        lux = 0.0;
-                    }
-                    if ((lux < 0.01) || (ls_data.s_ir < 0) || (ls_data.s_broadband < 0))
-                    {
-                        light_sensor_dead = light_sensor_dead + 1;
-                        if (light_sensor_dead > light_sensor_dead_lim +1)
-                        {
-                            light_sensor_dead = light_sensor_dead_lim +1;
-                        }
-                    }
-                    else
-                    {
-                        light_sensor_dead = 0;
-                    }
-                }
-                if (verbose > 1)
-                {
-                    printf("The measured lux is: %.4f\n", lux);
-                }
+                changed = 1;
             }
-            else
+        }
+    }
+    return changed;
+}
+
+
+/* FUNCTION: CONFIG_PRINT
+this function writes the settings to the standard output
+Input:
+    config: the settings
+    path: path of the configuration file
+*/
+void config_print(const struct clock_config *config, const char *path)
+{
+    char lux_list[16 * 8] = "";
+    size_t len = 0;
+    for (int i = 0; i <= MaxDimming; i++)
+    {
+        len += snprintf(&lux_list[len], sizeof(lux_list) - len, "%d ", config->lux_values[i]);
+    }
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Configuration: %s", path);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "MQTT: %s, client: %s, topic: %s, encoding: %d", config->mqtt_address, config->mqtt_client_id, config->mqtt_topic, config->encoding);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Sensor: %s, interrupt line: %d, location: %.4f,%.4f, ramp: %d ms, display mode: %d",
+            config->sensor, config->gpio_line, config->latitude, config->longitude, config->ramp_ms, config->display_mode);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "The lux values are: %s", lux_list);
+    for (int d = 0; d < config->display_count; d++)
+    {
+        len = 0;
+        for (int i = 0; i <= MaxDimming; i++)
+        {
+            len += snprintf(&lux_list[len], sizeof(lux_list) - len, "%d ", config->displays[d].lux_values[i]);
+        }
+        log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Display %#.2x dimming by the %s, lux values: %s", config->displays[d].address,
+                config->displays[d].use_sensor ? "sensor" : "sun", lux_list);
+    }
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Lux calibration: TSL2561 package %s, lux = %.4f * sensor lux + %.3f", config->tsl2561_package->name,
+            config->lux_scale, config->lux_offset);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Hysteresis: +%d%% / -%d%%, lux filter: median of %d, tau %d s", config->hysteresis_up, config->hysteresis_down,
+            config->lux_median, config->lux_tau_s);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Dimming learning: %s", config->dimming_learn ? "the lux tables are fitted to the brightness commands" : "off");
+    char page_list[PAGE_MAX * 16] = "";
+    len = 0;
+    for (int i = 0; i < config->page_count; i++)
+    {
+        len += snprintf(&page_list[len], sizeof(page_list) - len, "%s%s %d s", (i > 0) ? ", " : "", config->pages[i].driver->name,
+                        config->pages[i].duration_s);
+    }
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Pages: %s; temperature topic: %s", page_list, (config->temp_topic[0] != '\0') ? config->temp_topic : "none");
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Telemetry: published on change (lux deadband %d%%), heartbeat %d s", config->telemetry_deadband,
+            config->telemetry_heartbeat);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Clock synchronization: the time is shown after the NTP synchronization, at most after %d s",
+            config->clock_sync_wait);
+}
+
+/* FUNCTION: TELEMETRY_POLICY_CHECK
+this function decides if a telemetry record is published (see struct telemetry_policy), the published record is the new state
+the lux deadband is relative, so the dark hours with a few lux do not publish the noise of the sensor at every minute
+Input:
+    policy: the publish-on-change state
+    record: the telemetry of the minute
+Output:
+    1 if the record shall be published, 0 if nothing changed out of the deadband
+*/
+int telemetry_policy_check(struct telemetry_policy *policy, const struct telemetry_record *record)
+{
+    const struct telemetry_record *last = &policy->last;
+    float deadband = fmaxf(fabsf(last->lux), LuxDeadbandFloor) * policy->lux_deadband_pct / 100.0f;
+    int publish = !policy->valid ||
+                  (record->timestamp - last->timestamp >= policy->heartbeat_s) ||
+                  (record->timestamp < last->timestamp) ||
+                  (fabsf(record->lux - last->lux) > deadband) ||
+                  (record->dimming != last->dimming) ||
+                  (record->disp_err != last->disp_err) ||
+                  (record->range != last->range) ||
+                  record->sensor_restart;
+    if (publish)
+    {
+        policy->last = *record;
+        policy->valid = 1;
+    }
+    return publish;
+}
+
+/* FUNCTION: TELEMETRY_QUEUE_PUSH
+this function puts a record into the telemetry queue without blocking (producer side)
+the record is written first, than the head index is released, so the consumer only sees complete records
+Input:
+    queue: the telemetry queue
+    record: the record to be queued
+Output:
+    0 if the record is queued, -1 if the queue is full (the record is dropped and counted)
+*/
+int telemetry_queue_push(struct telemetry_queue *queue, const struct telemetry_record *record)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= TELEMETRY_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    queue->records[head % TELEMETRY_QUEUE_SIZE] = *record;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    sem_post(&queue->ready);
+    return 0;
+}
+
+/* FUNCTION: TELEMETRY_QUEUE_POP
+this function takes the oldest record from the telemetry queue without blocking (consumer side)
+Input:
+    queue: the telemetry queue
+    record: the record to be filled
+Output:
+    1 if a record is returned, 0 if the queue is empty
+*/
+int telemetry_queue_pop(struct telemetry_queue *queue, struct telemetry_record *record)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail)
+    {
+        return 0;
+    }
+    *record = queue->records[tail % TELEMETRY_QUEUE_SIZE];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/* FUNCTION: COMMAND_PARSE
+this function parses the payload of a command message (see enum command_kind)
+Input:
+    payload: the payload, zero terminated
+    command: the result
+Output:
+    0 if the command is valid, -1 otherwise
+*/
+int command_parse(const char *payload, struct clock_command *command)
+{
+    char name[16] = "";
+    char argument[32] = "";
+    int n = sscanf(payload, " %15s %31[^\r\n]", name, argument);
+    memset(command, 0, sizeof(struct clock_command));
+    if ((n >= 1) && (strcmp(name, "brightness") == 0))
+    {
+        char *end = NULL;
+        command->kind = COMMAND_BRIGHTNESS;
+        command->value = (int)strtol(argument, &end, 10);
+        if (strcmp(argument, "auto") == 0)
+        {
+            command->value = -1;
+            return 0;
+        }
+        return ((end != argument) && (*end == '\0') && (command->value >= 0) && (command->value <= MaxDimming)) ? 0 : -1;
+    }
+    if ((n >= 1) && (strcmp(name, "mode") == 0))
+    {
+        enum display_mode mode;
+        command->kind = COMMAND_MODE;
+        if (parse_display_mode(argument, &mode) < 0)
+        {
+            return -1;
+        }
+        command->value = mode;
+        return 0;
+    }
+    if ((n >= 1) && (strcmp(name, "page") == 0))
+    {
+        command->kind = COMMAND_PAGE;
+        command->page = find_page_driver(argument);
+        return (command->page != NULL) ? 0 : -1;
+    }
+    if ((n >= 1) && (strcmp(name, "text") == 0))
+    {
+        // the text page shows the first 4 characters (and their decimal points)
+        command->kind = COMMAND_TEXT;
+        snprintf(command->text, sizeof(command->text), "%s", argument);
+        return 0;
+    }
+    if ((n == 1) && (strcmp(name, "reload") == 0))
+    {
+        command->kind = COMMAND_RELOAD;
+        return 0;
+    }
+    if ((n == 2) && (strcmp(name, "calibrate") == 0))
+    {
+        char *end = NULL;
+        command->kind = COMMAND_CALIBRATE;
+        if (strcmp(argument, "reset") == 0)
+        {
+            command->lux = -1.0f;
+            return 0;
+        }
+        command->lux = strtof(argument, &end);
+        return ((end != argument) && (*end == '\0') && (command->lux >= 0.0f)) ? 0 : -1;
+    }
+    if ((n == 2) && (strcmp(name, "history") == 0))
+    {
+        char tier[12] = "";
+        char count[12] = "";
+        char skip[12] = "";
+        char extra[2] = "";
+        char *end = NULL;
+        command->kind = COMMAND_HISTORY;
+        command->value = -1;
+        command->count = LUX_HISTORY_QUERY_MAX;
+        command->skip = 0;
+        int words = sscanf(argument, "%11s %11s %11s %1s", tier, count, skip, extra);
+        if (words > 3)
+        {
+            return -1;
+        }
+        if (words >= 2)
+        {
+            command->count = (int)strtol(count, &end, 10);
+            if ((end == count) || (*end != '\0'))
             {
-                // dontwait is only needed at startup
-                dontwait = 0;
+                return -1;
             }
         }
+        if (words == 3)
+        {
+            command->skip = (int)strtol(skip, &end, 10);
+            if ((end == skip) || (*end != '\0'))
+            {
+                return -1;
+            }
+        }
+        for (int i = 0; i < LUX_HISTORY_TIERS; i++)
+        {
+            if (strcmp(tier, LuxHistoryTierNames[i]) == 0)
+            {
+                command->value = i;
+            }
+        }
+        return ((command->value >= 0) && (command->count > 0) && (command->skip >= 0)) ? 0 : -1;
+    }
+    return -1;
+}
+
+/* FUNCTION: COMMAND_QUEUE_PUSH
+this function puts a command into the command queue without blocking (producer side), and wakes up the main loop
+the command is written first, than the head index is released, so the consumer only sees complete commands
+Input:
+    queue: the command queue
+    command: the command to be queued
+Output:
+    0 if the command is queued, -1 if the queue is full (the command is dropped)
+*/
+int command_queue_push(struct command_queue *queue, const struct clock_command *command)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= COMMAND_QUEUE_SIZE)
+    {
+        return -1;
+    }
+    queue->commands[head % COMMAND_QUEUE_SIZE] = *command;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    uint64_t wakeup = 1;
+    if ((queue->event_fd >= 0) && (write(queue->event_fd, &wakeup, sizeof(wakeup)) < 0))
+    {
+        // ERROR HANDLING: the command is done at the next wake-up of the main loop
+        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "COMMAND EVENT WRITE FAILED");
+    }
+    return 0;
+}
+
+/* FUNCTION: COMMAND_QUEUE_POP
+this function takes the oldest command from the command queue (consumer side)
+Input:
+    queue: the command queue
+    command: the result
+Output:
+    1 if a command is returned, 0 if the queue is empty
+*/
+int command_queue_pop(struct command_queue *queue, struct clock_command *command)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (head == tail)
+    {
+        return 0;
+    }
+    *command = queue->commands[tail % COMMAND_QUEUE_SIZE];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/* FUNCTION: TELEMETRY_RING_OPEN
+this function opens (or creates) and maps the offline telemetry ring file
+if the file is not a valid ring file (magic, version or capacity mismatch) it is reinitialized as an empty ring
+Input:
+    ring: the ring to be initialized
+    path: path of the ring file
+Output:
+    0 if the ring is mapped, negative on error (the ring is not usable)
+*/
+int telemetry_ring_open(struct telemetry_ring *ring, const char *path)
+{
+    ring->header = NULL;
+    ring->samples = NULL;
+    ring->size = sizeof(struct telemetry_ring_header) + TelemetryRingCapacity * sizeof(struct telemetry_sample);
+
+    int file = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (file < 0)
+    {
+        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "TELEMETRY RING OPEN FAILED: %s", path);
+        return -1;
+    }
+    // a new file is extended with zeros, which is an invalid header
+    if (ftruncate(file, ring->size) < 0)
+    {
+        close(file);
+        return -1;
+    }
+    void *map = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    // the mapping stays valid after the file is closed
+    close(file);
+    if (map == MAP_FAILED)
+    {
+        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "TELEMETRY RING MAP FAILED: %s", path);
+        return -1;
+    }
+    ring->header = (struct telemetry_ring_header *)map;
+    ring->samples = (struct telemetry_sample *)((char *)map + sizeof(struct telemetry_ring_header));
+
+    if ((ring->header->magic != TelemetryRingMagic) || (ring->header->version != TelemetryRingVersion) ||
+        (ring->header->capacity != TelemetryRingCapacity) || (ring->header->head - ring->header->tail > TelemetryRingCapacity))
+    {
+        ring->header->magic = TelemetryRingMagic;
+        ring->header->version = TelemetryRingVersion;
+        ring->header->capacity = TelemetryRingCapacity;
+        ring->header->head = 0;
+        ring->header->tail = 0;
+    }
+    log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "Telemetry ring %s holds %u samples to be replayed", path, ring->header->head - ring->header->tail);
+    return 0;
+}
+
+/* FUNCTION: TELEMETRY_RING_APPEND
+this function stores a sample in the ring (if the ring is full the oldest sample is overwritten)
+Input:
+    ring: the telemetry ring
+    record: the telemetry to be stored
+*/
+void telemetry_ring_append(struct telemetry_ring *ring, const struct telemetry_record *record)
+{
+    if (ring->header == NULL)
+    {
+        return;
+    }
+    struct telemetry_sample *sample = &ring->samples[ring->header->head % ring->header->capacity];
+    sample->timestamp = (uint32_t)record->timestamp;
+    sample->lux = record->lux;
+    sample->ir = record->ir;
+    sample->broadband = record->broadband;
+    sample->dimming = (uint8_t)record->dimming;
+    sample->disp_err = (record->disp_err < 0) ? -1 : 0;
+    sample->range = (uint8_t)record->range;
+    sample->reserved = 0;
+    // sample first, than the index (a crash in between loses only this sample)
+    ring->header->head++;
+    if (ring->header->head - ring->header->tail > ring->header->capacity)
+    {
+        ring->header->tail = ring->header->head - ring->header->capacity;
+    }
+}
+
+/* FUNCTION: TELEMETRY_RING_PEEK
+this function copies the oldest not yet replayed samples from the ring (the samples stay in the ring)
+Input:
+    ring: the telemetry ring
+    samples: array to be filled
+    max_samples: size of the array
+Output:
+    number of samples copied
+*/
+int telemetry_ring_peek(struct telemetry_ring *ring, struct telemetry_sample *samples, int max_samples)
+{
+    if (ring->header == NULL)
+    {
+        return 0;
+    }
+    int count = 0;
+    uint32_t index = ring->header->tail;
+    while ((index != ring->header->head) && (count < max_samples))
+    {
+        samples[count] = ring->samples[index % ring->header->capacity];
+        index++;
+        count++;
+    }
+    return count;
+}
+
+/* FUNCTION: TELEMETRY_RING_CONSUME
+this function removes the oldest samples from the ring (after they are published)
+Input:
+    ring: the telemetry ring
+    count: number of samples to remove
+*/
+void telemetry_ring_consume(struct telemetry_ring *ring, int count)
+{
+    if (ring->header == NULL)
+    {
+        return;
+    }
+    ring->header->tail = ring->header->tail + count;
+}
+
+/* FUNCTION: TELEMETRY_RING_CLOSE
+this function writes back and unmaps the ring file
+Input:
+    ring: the telemetry ring
+*/
+void telemetry_ring_close(struct telemetry_ring *ring)
+{
+    if (ring->header == NULL)
+    {
+        return;
+    }
+    msync(ring->header, ring->size, MS_SYNC);
+    munmap(ring->header, ring->size);
+    ring->header = NULL;
+    ring->samples = NULL;
+}
 
-        // sleep for a fracture of a second using nanosleep (to ensure that the next minute change will be detected at appx in this time-frame)
-        program_sleep(0.2,verbose);
+/* lux_history_stamp: timestamp of a record of a tier (all record types start with it) */
+static uint32_t lux_history_stamp(const struct lux_history *history, int tier, uint32_t index)
+{
+    if (tier == LUX_HISTORY_RAW)
+    {
+        return ((const struct lux_history_sample *)history->records[tier])[index].timestamp;
     }
-    // Turn off display
-    res = display_init(0, display_file_descriptor, verbose);
-    if ((res < 0) && verbose)
+    if (tier == LUX_HISTORY_OVERRIDE)
     {
-        printf("DISPLAY SHUTDOWN FAILED\n");
+        return ((const struct lux_history_override *)history->records[tier])[index].timestamp;
     }
-    // Turn off sensor
-    if (light_sensor_available)
+    return ((const struct lux_history_aggregate *)history->records[tier])[index].timestamp;
+}
+
+/* lux_history_advance: the record of the slot at head is written, the next record goes to the next slot */
+static void lux_history_advance(struct lux_history *history, int tier, uint32_t timestamp)
+{
+    history->head[tier] = (history->head[tier] + 1) % history->header->capacity[tier];
+    if (history->filled[tier] < history->header->capacity[tier])
     {
-      res = sensor_init(0, sensor_file_descriptor, verbose);
-      if ((res < 0) && verbose)
-      {
-        printf("SENSOR SHUTDOWN FAILED\n");
-      }
+        history->filled[tier]++;
     }
-    //Disconnect and Destroy MQTT
-    MQTTClient_disconnect(client, 10000);
-    MQTTClient_destroy(&client);
-    return 0;
+    history->newest[tier] = timestamp;
 }
 
-/* FUNCTION OPENI2C_BUS
-This function opens the I2C bus
-Inputs:
-    adapter_nr: integer, describes which I2C bus to be opened
-    verbose: puts success information to the standard output
+/* lux_history_accumulate: a reading is added to the current period of a downsampled tier, the record of the previous
+   period is appended first if the reading starts a new period (the periods already stored are skipped) */
+static void lux_history_accumulate(struct lux_history *history, int tier, uint32_t timestamp, float lux)
+{
+    struct lux_history_bucket *bucket = &history->buckets[tier - 1];
+    uint32_t start = timestamp - timestamp % LuxHistoryPeriodSec[tier];
+    if ((history->filled[tier] > 0) && (start <= history->newest[tier]))
+    {
+        return;
+    }
+    if ((bucket->start != 0) && (bucket->start != start))
+    {
+        struct lux_history_aggregate *record = &((struct lux_history_aggregate *)history->records[tier])[history->head[tier]];
+        record->min = bucket->min;
+        record->max = bucket->max;
+        record->avg = (float)(bucket->sum / bucket->count);
+        // the timestamp last: a slot with the new timestamp is complete
+        record->timestamp = bucket->start;
+        lux_history_advance(history, tier, bucket->start);
+        bucket->start = 0;
+    }
+    if (bucket->start == 0)
+    {
+        bucket->start = start;
+        bucket->min = lux;
+        bucket->max = lux;
+        bucket->sum = 0.0;
+        bucket->count = 0;
+    }
+    bucket->min = (lux < bucket->min) ? lux : bucket->min;
+    bucket->max = (lux > bucket->max) ? lux : bucket->max;
+    bucket->sum = bucket->sum + lux;
+    bucket->count++;
+}
+
+/* FUNCTION: LUX_HISTORY_OPEN
+this function opens (or creates) and maps the lux history file, the tiers are placed on their own pages after the header page
+the write position of each tier is found by its newest record, and the current periods of the downsampled tiers are
+rebuilt from the raw tier (a restart does not lose the readings of the period)
+if the file is not a valid history file (magic, version or capacity mismatch) it is reinitialized as an empty history
+Input:
+    history: the history to be initialized
+    path: path of the history file
 Output:
-    file: variable to store I2C bus handle
+    0 if the history is mapped, negative on error (the history is not usable)
 */
-int openI2C_bus(int adapter_nr,unsigned char address, int verbose)
+int lux_history_open(struct lux_history *history, const char *path)
 {
-    int file=0;
-    // if I2C bus option is on (compile time switch to support debugging)
-    int res=0;
-    char filename[20];
+    size_t offsets[LUX_HISTORY_TIERS];
+    memset(history, 0, sizeof(struct lux_history));
+    history->size = LuxHistoryPageSize;
+    for (int tier = 0; tier < LUX_HISTORY_TIERS; tier++)
+    {
+        // all record types are 16 bytes, the tier is rounded up to whole pages
+        size_t tier_size = LuxHistoryCapacity[tier] * sizeof(struct lux_history_sample);
+        offsets[tier] = history->size;
+        history->size = history->size + (tier_size + LuxHistoryPageSize - 1) / LuxHistoryPageSize * LuxHistoryPageSize;
+    }
 
-    snprintf(filename, 19, "/dev/i2c-%d", adapter_nr);
-    file = open(filename, O_RDWR);
-    // if fake I2C header is used, than file opening will fail
-    #ifdef I2C_INC_FAKE
-        if (file < 0)
-        {
-            file = -file;
-        }
-    #endif
+    int file = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
     if (file < 0)
     {
-        // ERROR HANDLING; you can check errno to see what went wrong
-        if (verbose)
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "LUX HISTORY OPEN FAILED: %s", path);
+        return -1;
+    }
+    // a new file is extended with zeros, which is an invalid header and empty tiers
+    if (ftruncate(file, history->size) < 0)
+    {
+        close(file);
+        return -1;
+    }
+    void *map = mmap(NULL, history->size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    // the mapping stays valid after the file is closed
+    close(file);
+    if (map == MAP_FAILED)
+    {
+        log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "LUX HISTORY MAP FAILED: %s", path);
+        return -1;
+    }
+    history->header = (struct lux_history_header *)map;
+    int valid = (history->header->magic == LuxHistoryMagic) && (history->header->version == LuxHistoryVersion);
+    for (int tier = 0; tier < LUX_HISTORY_TIERS; tier++)
+    {
+        valid = valid && (history->header->capacity[tier] == LuxHistoryCapacity[tier]);
+        history->records[tier] = (char *)map + offsets[tier];
+    }
+    if (!valid)
+    {
+        // the only write of the header page and of the whole file
+        memset(map, 0, history->size);
+        history->header->magic = LuxHistoryMagic;
+        history->header->version = LuxHistoryVersion;
+        memcpy(history->header->capacity, LuxHistoryCapacity, sizeof(history->header->capacity));
+    }
+
+    // the next record of a tier goes after its newest record
+    for (int tier = 0; tier < LUX_HISTORY_TIERS; tier++)
+    {
+        for (uint32_t i = 0; i < LuxHistoryCapacity[tier]; i++)
         {
-            printf("FAILED OPENING I2C BUS\n");
+            uint32_t timestamp = lux_history_stamp(history, tier, i);
+            if (timestamp == 0)
+            {
+                continue;
+            }
+            history->filled[tier]++;
+            if (timestamp > history->newest[tier])
+            {
+                history->newest[tier] = timestamp;
+                history->head[tier] = (i + 1) % LuxHistoryCapacity[tier];
+            }
         }
-        exit(1);
     }
-    else
+    // the readings of the raw tier after the newest period of a downsampled tier are added again, the oldest first
+    const struct lux_history_sample *samples = (const struct lux_history_sample *)history->records[LUX_HISTORY_RAW];
+    for (uint32_t k = history->filled[LUX_HISTORY_RAW]; k > 0; k--)
     {
-        // actually this linkes the address to the file
-        res=ioctl(file, I2C_SLAVE, address);
-        if ((res < 0) && verbose)
+        uint32_t index = (history->head[LUX_HISTORY_RAW] + LuxHistoryCapacity[LUX_HISTORY_RAW] - k) % LuxHistoryCapacity[LUX_HISTORY_RAW];
+        for (int tier = LUX_HISTORY_5MIN; tier <= LUX_HISTORY_HOUR; tier++)
         {
-            printf("OPENING CHANNEL FOR %#02x IS FAILED\n",address);
+            lux_history_accumulate(history, tier, samples[index].timestamp, samples[index].lux);
         }
     }
-    return file;
+    log_msg(LOG_SENSOR, LOG_LEVEL_NOTICE, "Lux history %s holds %u raw, %u 5 minute, %u hour and %u override records", path,
+            history->filled[LUX_HISTORY_RAW], history->filled[LUX_HISTORY_5MIN], history->filled[LUX_HISTORY_HOUR],
+            history->filled[LUX_HISTORY_OVERRIDE]);
+    return 0;
 }
 
-/* FUNCTION: SENSOR_INIT
- sub-function is created to turn on and turn off the light sensor, the function also turn off interrupts
- inputs
-        onoff: 1 to turn the sensor on, 0 to turn the sensor off
-        verbose: 1, or greater integer if you want to have messages on the standard output
+/* FUNCTION: LUX_HISTORY_APPEND
+this function appends the reading of the minute to the raw tier, and to the current periods of the downsampled tiers
+(the record of a period is appended when the first reading of the next period arrives); the oldest records are overwritten
+the tiers are ordered by time: a reading not newer than the newest record (e.g. the minute already stored) is dropped
+Input:
+    history: the lux history
+    timestamp: time of the reading
+    data: the reading (calibrated lux, raw channels)
 */
-int sensor_init(unsigned char onoff, int file, int verbose)
+void lux_history_append(struct lux_history *history, time_t timestamp, struct light_sensor_data data)
 {
-
-  int ares=0;
-  #ifdef TSL2561
-    int res=0;
-    unsigned char command = Sensor_command;
-    // Power off value
-    unsigned char power_command = 0x00; 
-    if (onoff)
+    if (history->header == NULL)
     {
-    // Power on value
-    power_command = 0x03; 
+        return;
     }
-    // Turn on/off light sensor power
-    // Using SMBus commands
-    command = Sensor_command + Sensor_Power;
-    res = i2c_smbus_write_byte_data(file, command, power_command);
-    if (res < 0)
+    uint32_t minute = (uint32_t)(timestamp - timestamp % LuxHistoryPeriodSec[LUX_HISTORY_RAW]);
+    if ((history->filled[LUX_HISTORY_RAW] > 0) && (minute <= history->newest[LUX_HISTORY_RAW]))
     {
-    // ERROR HANDLING: i2c transaction failed
-    ares=res;
+        return;
     }
-    if (verbose)
+    struct lux_history_sample *sample = &((struct lux_history_sample *)history->records[LUX_HISTORY_RAW])[history->head[LUX_HISTORY_RAW]];
+    sample->lux = data.lux;
+    sample->ir = data.s_ir;
+    sample->broadband = data.s_broadband;
+    // the timestamp last: a slot with the new timestamp is complete
+    sample->timestamp = minute;
+    lux_history_advance(history, LUX_HISTORY_RAW, minute);
+    for (int tier = LUX_HISTORY_5MIN; tier <= LUX_HISTORY_HOUR; tier++)
     {
-       printf("Light sensor control register is set to %d, with result %d \n", power_command, res);
-    }
-    if (onoff)
-      {
-      // Turn off interrupts
-      // Using SMBus commands
-      command = Sensor_command + Sensor_interrupt;
-      res = i2c_smbus_write_byte_data(file, command, 0x0);
-      if (res < 0)
-      {
-          // ERROR HANDLING: i2c transaction failed
-          ares=res;
-      }
-      if (verbose)
-      {
-          printf("Light sensor interrupts are turned off, with result %d \n", res);
-      }
+        lux_history_accumulate(history, tier, minute, data.lux);
     }
-  #endif
+}
 
-  #ifdef TSL2591
-    int res=0;
-    unsigned char addr;
-    //get chip id
-    addr = id_register | command_bit;
-    res = i2c_smbus_read_byte_data(file, addr);
-        if (res < 0)
+/* FUNCTION: LUX_HISTORY_READ
+this function copies the newest records of a tier into the query result, the oldest first
+Input:
+    history: the lux history
+    tier: the tier to be read
+    count: number of records (at most LUX_HISTORY_QUERY_MAX)
+    skip: number of the newest records left out (for the paging of the older records)
+    query: the result to be filled
+Output:
+    number of records copied
+*/
+int lux_history_read(const struct lux_history *history, enum lux_history_tier tier, int count, int skip, struct lux_history_query *query)
+{
+    query->tier = tier;
+    query->count = 0;
+    if ((history->header == NULL) || (skip < 0) || ((uint32_t)skip >= history->filled[tier]))
+    {
+        return 0;
+    }
+    if (count > LUX_HISTORY_QUERY_MAX)
+    {
+        count = LUX_HISTORY_QUERY_MAX;
+    }
+    if ((uint32_t)count > history->filled[tier] - skip)
+    {
+        count = history->filled[tier] - skip;
+    }
+    uint32_t capacity = history->header->capacity[tier];
+    uint32_t first = (history->head[tier] + capacity - skip - count) % capacity;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t index = (first + i) % capacity;
+        if (tier == LUX_HISTORY_RAW)
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares=res;
+            query->records.samples[i] = ((const struct lux_history_sample *)history->records[tier])[index];
         }
-        if (verbose)
+        else if (tier == LUX_HISTORY_OVERRIDE)
         {
-      printf("Light sensor Chip ID = 0x%X \r\n",res);
+            query->records.overrides[i] = ((const struct lux_history_override *)history->records[tier])[index];
         }
-
-    // TSL2591_Write_Byte(ENABLE_REGISTER, ENABLE_POWERON | ENABLE_AEN );
-    addr = enable_register | command_bit;
-    res = i2c_smbus_write_byte_data(file, addr, enable_poweron | enable_aen);
-        if (res < 0)
+        else
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares=res;
+            query->records.aggregates[i] = ((const struct lux_history_aggregate *)history->records[tier])[index];
         }
-    if (verbose)
+    }
+    query->count = count;
+    return count;
+}
+
+/* FUNCTION: LUX_HISTORY_CLOSE
+this function writes back and unmaps the history file
+Input:
+    history: the lux history
+*/
+void lux_history_close(struct lux_history *history)
+{
+    if (history->header == NULL)
     {
-        printf("Light sensor enable register is set to %d, with result %d \n",  enable_poweron | enable_aen, res);
+        return;
     }
-    
-    // set gain and integral time
-    // TSL2591_Write_Byte(CONTROL_REGISTER, control);
-    addr = control_register | command_bit;
-    res = i2c_smbus_write_byte_data(file, addr, medium_gain | atime_200ms);
-        if (res < 0)
+    msync(history->header, history->size, MS_SYNC);
+    munmap(history->header, history->size);
+    history->header = NULL;
+}
+
+/* FUNCTION: LUX_HISTORY_OVERRIDE
+this function appends a brightness command with the lux of the moment to the override tier (a point of the dimming learning)
+a command within DimmingLearnSettleSec of the previous one replaces it (the brightness is stepped till it fits the room),
+a command older than the newest record is dropped
+Input:
+    history: the lux history
+    timestamp: time of the command
+    lux: the filtered lux at the command
+    level: the brightness of the command (0..15)
+*/
+void lux_history_override(struct lux_history *history, time_t timestamp, float lux, int level)
+{
+    if (history->header == NULL)
+    {
+        return;
+    }
+    int tier = LUX_HISTORY_OVERRIDE;
+    uint32_t capacity = history->header->capacity[tier];
+    int replace = 0;
+    if (history->filled[tier] > 0)
+    {
+        if ((uint32_t)timestamp < history->newest[tier])
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares=res;
+            return;
         }
-    if (verbose)
+        replace = ((uint32_t)timestamp < history->newest[tier] + DimmingLearnSettleSec);
+    }
+    // the replaced record is the newest one, the slot before the head
+    uint32_t index = replace ? (history->head[tier] + capacity - 1) % capacity : history->head[tier];
+    struct lux_history_override *override = &((struct lux_history_override *)history->records[tier])[index];
+    override->lux = lux;
+    override->level = level;
+    override->reserved = 0;
+    // the timestamp last: a slot with the new timestamp is complete
+    override->timestamp = (uint32_t)timestamp;
+    if (replace)
+    {
+        history->newest[tier] = (uint32_t)timestamp;
+    }
+    else
     {
-        printf("Light sensor config register is set to %d, with result %d \n",  medium_gain | atime_200ms, res);
+        lux_history_advance(history, tier, (uint32_t)timestamp);
     }
+}
 
-    // interrupt is not used, persistent register is not set 
-    // TSL2591_Write_Byte(PERSIST_REGISTER, 0x01);//filter
-    
-    // Disable ALS
-    addr = enable_register | command_bit;
-    res = i2c_smbus_write_byte_data(file, addr, enable_poweron);
-        if (res < 0)
+/* dimming_learn_compare: qsort order of the points of the dimming learning, increasing lux */
+static int dimming_learn_compare(const void *a, const void *b)
+{
+    float lux_a = ((const struct dimming_learn_block *)a)->lux_low;
+    float lux_b = ((const struct dimming_learn_block *)b)->lux_low;
+    return (lux_a > lux_b) - (lux_a < lux_b);
+}
+
+/* FUNCTION: DIMMING_LEARN_TABLE
+this function fits the lux-dimming table to the brightness overrides of the history: an isotonic (monotone increasing)
+regression of the level over the lux by pool adjacent violators, the points of the configured table are weak points of the fit
+(DimmingLearnPriorWeight), so the table is kept where the user has not overridden the dimming; the weight of an override is
+halved in every DimmingLearnHalfLifeSec, so an old choice fades out; the level threshold between two fitted levels is at
+the geometric mean of their lux (the table is in whole lux as the configured one: below 1 lux the dimming stays 0, even if
+the overrides choose a brighter level in the dark)
+Input:
+    history: the lux history
+    lux_values: the configured lux-dimming table
+    now: the current time
+    learned: the fitted lux-dimming table
+Output:
+    number of the overrides used, 0: the fitted table is the configured one
+*/
+int dimming_learn_table(const struct lux_history *history, const int *lux_values, time_t now, int *learned)
+{
+    struct dimming_learn_block points[DIMMING_LEARN_POINTS];
+    int count = 0;
+    int overrides = 0;
+    memcpy(learned, lux_values, (MaxDimming + 1) * sizeof(int));
+    if (history->header == NULL)
+    {
+        return 0;
+    }
+    const struct lux_history_override *records = (const struct lux_history_override *)history->records[LUX_HISTORY_OVERRIDE];
+    for (uint32_t i = 0; i < history->header->capacity[LUX_HISTORY_OVERRIDE]; i++)
+    {
+        if (records[i].timestamp == 0)
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares=res;
+            continue;
         }
-    if (verbose)
+        double age = difftime(now, (time_t)records[i].timestamp);
+        points[count].lux_low = records[i].lux;
+        points[count].lux_high = records[i].lux;
+        points[count].weight = exp2(-((age > 0.0) ? age : 0.0) / DimmingLearnHalfLifeSec);
+        points[count].sum = points[count].weight * records[i].level;
+        count++;
+    }
+    overrides = count;
+    if (overrides == 0)
     {
-        printf("Light sensor ALS disable: enable register is set to %d, with result %d \n", enable_poweron, res);
+        return 0;
     }
-  #endif
-  
-  #ifdef VEML7700
-    int res=0;
-    // minimum current cunsumption is defined by the datasheet when: ALS_Gain: 01, PSM: 11, ALS_IT: 0000
-    // in thisa case the refresh time is 4.1s, resolution is 0.0288lx/bit
-    unsigned short power = als_poweroff;
-    unsigned short psm = psm_dis;
-    if (onoff)
+    // a point of the configured table in the middle (log-lux) of each dimming band, dimming 0 below the lowest lux
+    int band_lux = 0;
+    int band_level = 0;
+    for (int i = 1; i <= MaxDimming + 1; i++)
     {
-      power = als_poweron;
-      psm   = psm_en;
+        if ((i <= MaxDimming) && (lux_values[i] == 0))
+        {
+            continue;
+        }
+        // the highest band is taken up to the double of its lux
+        int next_lux = (i <= MaxDimming) ? lux_values[i] : 2 * band_lux;
+        if (next_lux > 0)
+        {
+            points[count].lux_low = (band_lux > 0) ? sqrtf((float)band_lux * next_lux) : next_lux / 2.0f;
+            points[count].lux_high = points[count].lux_low;
+            points[count].weight = DimmingLearnPriorWeight;
+            points[count].sum = DimmingLearnPriorWeight * band_level;
+            count++;
+        }
+        band_lux = next_lux;
+        band_level = i;
     }
-    res = i2c_smbus_write_word_data(file, configuration_register, power | als_integration_time_100 | als_gain_2 );
-        if (res < 0)
+    qsort(points, count, sizeof(struct dimming_learn_block), dimming_learn_compare);
+
+    // pool adjacent violators: a point below the level of the block before it is pooled with it (in place, the blocks
+    // are the first ones of the array)
+    int blocks = 0;
+    for (int i = 0; i < count; i++)
+    {
+        points[blocks++] = points[i];
+        while ((blocks > 1) && (points[blocks - 2].sum * points[blocks - 1].weight > points[blocks - 1].sum * points[blocks - 2].weight))
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares = res;
+            points[blocks - 2].lux_high = points[blocks - 1].lux_high;
+            points[blocks - 2].weight = points[blocks - 2].weight + points[blocks - 1].weight;
+            points[blocks - 2].sum = points[blocks - 2].sum + points[blocks - 1].sum;
+            blocks--;
         }
-    if (verbose)
+    }
+
+    // the table of the fitted levels: the lowest block is selected below the first threshold as well
+    memset(learned, 0, (MaxDimming + 1) * sizeof(int));
+    int last_level = (int)lround(points[0].sum / points[0].weight);
+    int last_lux = 0;
+    float last_high = points[0].lux_high;
+    if (last_level > 0)
     {
-        printf("Light sensor ALS enable register is set to %d, with result %d \n", power | als_integration_time_100 | als_gain_2, res);
+        learned[last_level] = 1;
+        last_lux = 1;
     }
-    
-    res = i2c_smbus_write_word_data(file, power_saving_register, psm_4 | psm );
-        if (res < 0)
+    for (int b = 1; b < blocks; b++)
+    {
+        int level = (int)lround(points[b].sum / points[b].weight);
+        if (level > last_level)
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares = res;
+            // the table is in whole lux, and shall be increasing
+            int threshold = (int)lroundf(sqrtf(fmaxf(last_high, 0.0f) * points[b].lux_low));
+            threshold = (threshold > last_lux) ? threshold : last_lux + 1;
+            learned[level] = threshold;
+            last_level = level;
+            last_lux = threshold;
         }
-    if (verbose)
-    {
-        printf("Light sensor power saving register is set to %d, with result %d \n", psm_4 | psm, res);
+        last_high = points[b].lux_high;
     }
-  #endif
-  
-    return ares;
+    return overrides;
 }
 
-
-/* FUNCTION: DISPLAY_INIT
-sub-function is created to turn on and turn off the display
- inputs
-        onoff: 1 to turn the display and the oscillator on; 0 to turn it off
-        verbose: 1, or greater integer if you want to have messages on the standard output
+/* FUNCTION: DIMMING_LEARN_APPLY
+this function fits the lux-dimming table of each display following the light sensor, compiles it, and swaps it in for the
+curve of the display at once (the main loop is the only user of the curves, so a compiled curve replaces the old one
+between two events); the displays without overrides keep the curve of the configured table
+the dimming of a refitted display is looked up again on the new curve (the change is sent by the caller)
+Input:
+    displays: the displays
+    count: number of the displays
+    config: the configured lux tables and hysteresis
+    history: the lux history with the overrides
+    now: the current time
+    lux: the current lux, negative if there is no valid reading (the dimming follows the next reading)
+Output:
+    number of the refitted displays (the sensor thresholds of the old bands shall be set again)
 */
-int display_init(unsigned char onoff, int file, int verbose)
+int dimming_learn_apply(struct clock_display *displays, int count, const struct clock_config *config, const struct lux_history *history, time_t now, float lux)
 {
-    unsigned char display_switch = 0x80 | onoff;
-    unsigned char display_osc    = 0x20 | onoff;
-    int res = 0;
-    int ares = 0;
+    int refitted = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int learned[16];
+        if (!displays[i].use_sensor || (dimming_learn_table(history, config->displays[i].lux_values, now, learned) == 0))
+        {
+            continue;
+        }
+        struct dimming_curve curve;
+        dimming_curve_build(&curve, learned, config->hysteresis_up, config->hysteresis_down);
+        displays[i].curve = curve;
+        refitted++;
+        if (lux >= 0.0f)
+        {
+            displays[i].dimming = update_dimming_by_lux(lux, &displays[i].curve, displays[i].dimming);
+        }
+        char lux_list[16 * 12] = "";
+        int len = 0;
+        for (int level = 1; level <= MaxDimming; level++)
+        {
+            if (learned[level] > 0)
+            {
+                len += snprintf(&lux_list[len], sizeof(lux_list) - len, "%s%d %d", (len > 0) ? ", " : "", learned[level], level);
+            }
+        }
+        log_msg(LOG_DISPLAY, LOG_LEVEL_NOTICE, "Display %#.2x learned lux table (lux dimming): %s", displays[i].address, lux_list);
+    }
+    return refitted;
+}
 
-    // Using SMBus commands
-    res = i2c_smbus_read_byte_data(file, display_osc);
-    if (res < 0)
+/* FUNCTION: PARSE_PAYLOAD_ENCODING
+this function converts the name of the payload encoding (json, bin, cbor) to enum payload_encoding
+Input:
+    name: name of the encoding
+    encoding: the result
+Output:
+    0 if the name is known, -1 otherwise
+*/
+int parse_payload_encoding(const char *name, enum payload_encoding *encoding)
+{
+    if (strcmp(name, "json") == 0)
     {
-        // ERROR HANDLING: i2c transaction failed
-        ares = res;
+        *encoding = PAYLOAD_JSON;
     }
-    if (verbose > 2)
+    else if (strcmp(name, "bin") == 0)
     {
-        printf("Display message set to %#.2x, with result %d \n",display_osc,res);
+        *encoding = PAYLOAD_BINARY;
     }
-
-    // Using SMBus commands
-    res = i2c_smbus_read_byte_data(file, display_switch);
-    if (res < 0)
+    else if (strcmp(name, "cbor") == 0)
     {
-        // ERROR HANDLING: i2c transaction failed
-        ares = res;
+        *encoding = PAYLOAD_CBOR;
     }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
 
-    if (verbose > 2)
+/* payload writer helpers: the bytes beyond the buffer size are counted, but not written */
+static void put_byte(struct payload_writer *w, unsigned char value)
+{
+    if (w->len < w->size)
     {
-        printf("Display message set to %#.2x, with result %d \n",display_switch,res);
+        w->buf[w->len] = value;
     }
+    w->len++;
+}
 
-    if (onoff)
+static void put_u16le(struct payload_writer *w, uint16_t value)
+{
+    put_byte(w, value & 0xFF);
+    put_byte(w, value >> 8);
+}
+
+static void put_u32le(struct payload_writer *w, uint32_t value)
+{
+    put_u16le(w, value & 0xFFFF);
+    put_u16le(w, value >> 16);
+}
+
+static void put_f32le(struct payload_writer *w, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32le(w, bits);
+}
+
+static void put_text(struct payload_writer *w, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void put_text(struct payload_writer *w, const char *format, ...)
+{
+    va_list args;
+    int space = (w->len < w->size) ? (w->size - w->len) : 0;
+    va_start(args, format);
+    int len = vsnprintf((space > 0) ? (char *)w->buf + w->len : NULL, space, format, args);
+    va_end(args);
+    // vsnprintf writes a terminating zero, that is not part of the payload
+    w->len += (len < 0) ? 0 : len;
+}
+
+/* CBOR helpers (RFC 8949): data item head with the major type, and the typed items used by the payload */
+static void cbor_put_head(struct payload_writer *w, unsigned char major, uint32_t value)
+{
+    if (value < 24)
     {
-        // Turn on the colon
-        // Using SMBus commands
-        res = i2c_smbus_write_byte_data(file, Colon_address, 0x02);
-        if (res < 0)
-        {
-            // ERROR HANDLING: i2c transaction failed
-            ares = res;
-        }
-        if (verbose >2)
-        {
-            printf("Colon is turned on, with result %d \n",res);
-        }
+        put_byte(w, (major << 5) | value);
+    }
+    else if (value <= 0xFF)
+    {
+        put_byte(w, (major << 5) | 24);
+        put_byte(w, value);
+    }
+    else if (value <= 0xFFFF)
+    {
+        put_byte(w, (major << 5) | 25);
+        put_byte(w, value >> 8);
+        put_byte(w, value & 0xFF);
     }
+    else
+    {
+        put_byte(w, (major << 5) | 26);
+        put_byte(w, value >> 24);
+        put_byte(w, (value >> 16) & 0xFF);
+        put_byte(w, (value >> 8) & 0xFF);
+        put_byte(w, value & 0xFF);
+    }
+}
 
-    return ares;
+static void cbor_put_int(struct payload_writer *w, int64_t value)
+{
+    if (value >= 0)
+    {
+        cbor_put_head(w, 0, (uint32_t)value);
+    }
+    else
+    {
+        cbor_put_head(w, 1, (uint32_t)(-1 - value));
+    }
 }
 
-/* FUNCTION: DISP_REFRESH_VALUES
-sub-function to update the display content
- inputs:
-    displ_h1 - memory content of the first character of the hour
-    displ_h2 - memory content of the second character of the hour
-    disp_min1 - memory content of the first character of the minute
-    disp_min2 - memory content of the second character of the minute
- output: ---
-*/
-struct disp_refresh_values get_displ_values(struct tm *a_tm, unsigned char currlight, int verbose)
+static void cbor_put_float(struct payload_writer *w, float value)
 {
-    struct disp_refresh_values adisp_refresh_values;
-    // define display hex codes for HH:MM
-    adisp_refresh_values.disp_h1 = get_hex_code(a_tm->tm_hour/10);
-    adisp_refresh_values.disp_h2 = get_hex_code(a_tm->tm_hour%10);
-    adisp_refresh_values.disp_min1 = get_hex_code(a_tm->tm_min/10);
-    adisp_refresh_values.disp_min2 = get_hex_code(a_tm->tm_min%10);
-    // get display hex code for dimming
-    adisp_refresh_values.disp_dim = 0xE0+ currlight;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_byte(w, 0xFA);
+    put_byte(w, bits >> 24);
+    put_byte(w, (bits >> 16) & 0xFF);
+    put_byte(w, (bits >> 8) & 0xFF);
+    put_byte(w, bits & 0xFF);
+}
 
-    return adisp_refresh_values;
+static void cbor_put_key(struct payload_writer *w, const char *key)
+{
+    int len = strlen(key);
+    cbor_put_head(w, 3, len);
+    for (int i = 0; i < len; i++)
+    {
+        put_byte(w, key[i]);
+    }
 }
 
-/* FUNCTION: DISPLAY_UPDATE
-this function send the defined values to the display device via the I2C bus
- inputs:
-    adisp_refresh_values    :   contains the register values of the display segments
-    file                    :   bus handler
-    lightchange             :   if light settings needs to be updated (positive increase, negative decrease)
-    verbose                 :   if 1 some information will be sent to the standard output
+/* FUNCTION: ENCODE_TELEMETRY
+this function encodes one live telemetry record in the selected encoding
+binary layout (28 bytes, little-endian):
+    u8 schema version, u8 mqtt, u8 dimming, i8 disp_err, u32 timestamp, f32 lux, i32 ir, i32 broadband, u32 dropped,
+    u8 range (0xFF: no sensor), u8 reserved, u16 reserved
+CBOR: map with the keys of the JSON payload, and the timestamp
+Input:
+    w: output buffer
+    encoding: payload encoding
+    record: the telemetry record
+    mqtt_status: value of the "mqtt" field
+    dropped: number of records dropped from the telemetry queue
 */
-int display_update(struct disp_refresh_values adisp_refresh_values, int file, int lightchange, int verbose)
+void encode_telemetry(struct payload_writer *w, enum payload_encoding encoding, const struct telemetry_record *record, int mqtt_status, unsigned int dropped)
 {
-    int res = 0;
-    int ares = 0;
-
-    // displ_h1,displ_h1
-
-    // Using SMBus commands
-    res = i2c_smbus_write_byte_data(file, Hour1_address, adisp_refresh_values.disp_h1);
-    if (res < 0)
+    if (encoding == PAYLOAD_BINARY)
     {
-        // ERROR HANDLING: i2c transaction failed
-        ares = res;
+        put_byte(w, PayloadSchemaVersion);
+        put_byte(w, mqtt_status);
+        put_byte(w, record->dimming);
+        put_byte(w, (record->disp_err < 0) ? 0xFF : 0);
+        put_u32le(w, (uint32_t)record->timestamp);
+        put_f32le(w, record->lux);
+        put_u32le(w, (uint32_t)record->ir);
+        put_u32le(w, (uint32_t)record->broadband);
+        put_u32le(w, dropped);
+        put_byte(w, (uint8_t)record->range);
+        put_byte(w, 0);
+        put_u16le(w, 0);
     }
-    // Using SMBus commands
-    res = i2c_smbus_write_byte_data(file, Hour2_address, adisp_refresh_values.disp_h2);
-    if (res < 0)
+    else if (encoding == PAYLOAD_CBOR)
     {
-        // ERROR HANDLING: i2c transaction failed
-        ares = res;
+        cbor_put_head(w, 5, 9);
+        cbor_put_key(w, "ts");
+        cbor_put_int(w, record->timestamp);
+        cbor_put_key(w, "lux");
+        cbor_put_float(w, record->lux);
+        cbor_put_key(w, "dimming");
+        cbor_put_int(w, record->dimming);
+        cbor_put_key(w, "mqtt");
+        cbor_put_int(w, mqtt_status);
+        cbor_put_key(w, "ir");
+        cbor_put_int(w, record->ir);
+        cbor_put_key(w, "broadband");
+        cbor_put_int(w, record->broadband);
+        cbor_put_key(w, "range");
+        cbor_put_int(w, record->range);
+        cbor_put_key(w, "disp_err");
+        cbor_put_int(w, record->disp_err);
+        cbor_put_key(w, "dropped");
+        cbor_put_int(w, dropped);
+    }
+    else
+    {
+        put_text(w, "{\"lux\": %.5f, \"dimming\": %i, \"mqtt\": %i, \"ir\": %i, \"broadband\": %i, \"range\": %i, \"disp_err\": %i, \"dropped\": %u}",
+            record->lux, record->dimming, mqtt_status, record->ir, record->broadband, record->range, record->disp_err, dropped);
     }
+}
 
-    // displ_h1,displ_h1
-    // Using SMBus commands
-    res = i2c_smbus_write_byte_data(file, Min1_address, adisp_refresh_values.disp_min1);
-    if (res < 0)
+/* FUNCTION: ENCODE_REPLAY
+this function encodes a batch of replayed telemetry samples in the selected encoding
+each sample is [timestamp, lux, dimming, ir, broadband, disp_err, range]
+binary layout (little-endian): u8 schema version, u8 reserved, u16 count, than count times 20 bytes:
+    u32 timestamp, f32 lux, i32 ir, i32 broadband, u8 dimming, i8 disp_err, u8 range, u8 reserved
+JSON and CBOR: {"samples": [[...], ...]}
+Input:
+    w: output buffer
+    encoding: payload encoding
+    samples: the samples
+    count: number of samples
+*/
+void encode_replay(struct payload_writer *w, enum payload_encoding encoding, const struct telemetry_sample *samples, int count)
+{
+    if (encoding == PAYLOAD_BINARY)
     {
-        //ERROR HANDLING: i2c transaction failed
-        ares = res;
+        put_byte(w, PayloadSchemaVersion);
+        put_byte(w, 0);
+        put_u16le(w, count);
+        for (int i = 0; i < count; i++)
+        {
+            put_u32le(w, samples[i].timestamp);
+            put_f32le(w, samples[i].lux);
+            put_u32le(w, (uint32_t)samples[i].ir);
+            put_u32le(w, (uint32_t)samples[i].broadband);
+            put_byte(w, samples[i].dimming);
+            put_byte(w, (uint8_t)samples[i].disp_err);
+            put_byte(w, samples[i].range);
+            put_byte(w, 0);
+        }
     }
-    // Using SMBus commands
-    res = i2c_smbus_write_byte_data(file, Min2_address, adisp_refresh_values.disp_min2);
-    if (res < 0)
+    else if (encoding == PAYLOAD_CBOR)
     {
-        // ERROR HANDLING: i2c transaction failed
-        ares=res;
+        cbor_put_head(w, 5, 1);
+        cbor_put_key(w, "samples");
+        cbor_put_head(w, 4, count);
+        for (int i = 0; i < count; i++)
+        {
+            cbor_put_head(w, 4, 7);
+            cbor_put_int(w, samples[i].timestamp);
+            cbor_put_float(w, samples[i].lux);
+            cbor_put_int(w, samples[i].dimming);
+            cbor_put_int(w, samples[i].ir);
+            cbor_put_int(w, samples[i].broadband);
+            cbor_put_int(w, samples[i].disp_err);
+            cbor_put_int(w, (samples[i].range == 0xFF) ? -1 : samples[i].range);
+        }
+    }
+    else
+    {
+        put_text(w, "{\"samples\": [");
+        for (int i = 0; i < count; i++)
+        {
+            put_text(w, "%s[%u, %.5f, %u, %d, %d, %d, %d]", (i == 0) ? "" : ", ",
+                samples[i].timestamp, samples[i].lux, samples[i].dimming, samples[i].ir, samples[i].broadband, samples[i].disp_err,
+                (samples[i].range == 0xFF) ? -1 : samples[i].range);
+        }
+        put_text(w, "]}");
     }
+}
 
-    //dimming
-    // only perform if dimming needs to be changed
-    if (lightchange != 0)
+/* FUNCTION: ENCODE_STATS
+this function encodes the instrumentation statistics as JSON (low rate, always JSON), and resets them
+the counters are exchanged with 0 one by one, so a value recorded during the encoding goes into the next period
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+    period_s: seconds since the last statistics
+*/
+void encode_stats(struct payload_writer *w, const char *client_id, long period_s)
+{
+    put_text(w, "{\"client\": \"%s\", \"period\": %ld", client_id, period_s);
+    put_text(w, ", \"i2c\": {\"ops\": %u, \"errors\": %u, \"reopens\": %u, \"sensor_restarts\": %u}",
+        atomic_exchange(&clock_stats.i2c_ops, 0), atomic_exchange(&clock_stats.i2c_errors, 0),
+        atomic_exchange(&clock_stats.i2c_reopens, 0), atomic_exchange(&clock_stats.sensor_restarts, 0));
+    put_text(w, ", \"mqtt\": {\"connects\": %u, \"connect_failures\": %u, \"publish_failures\": %u, \"telemetry_suppressed\": %u}",
+        atomic_exchange(&clock_stats.mqtt_connects, 0), atomic_exchange(&clock_stats.mqtt_connect_failures, 0),
+        atomic_exchange(&clock_stats.mqtt_publish_failures, 0), atomic_exchange(&clock_stats.telemetry_suppressed, 0));
+    // the buckets are the counts of [2^(k-1), 2^k) us, the last one is open
+    put_text(w, ", \"latency_us\": {");
+    for (int stage = 0; stage < STATS_STAGES; stage++)
     {
-        // Using SMBus commands
-        res = i2c_smbus_read_byte_data(file, adisp_refresh_values.disp_dim);
-        if (res < 0)
+        struct latency_histogram *h = &clock_stats.stages[stage];
+        unsigned int count = atomic_exchange(&h->count, 0);
+        unsigned long sum = atomic_exchange(&h->sum_us, 0);
+        put_text(w, "%s\"%s\": {\"count\": %u, \"avg\": %lu, \"max\": %lu, \"buckets\": [", (stage == 0) ? "" : ", ",
+            StatsStageNames[stage], count, (count > 0) ? sum / count : 0, atomic_exchange(&h->max_us, 0));
+        for (int k = 0; k < STATS_BUCKETS; k++)
         {
-            // ERROR HANDLING: i2c transaction failed
-            ares=res;
+            put_text(w, "%s%u", (k == 0) ? "" : ", ", atomic_exchange(&h->buckets[k], 0));
         }
+        put_text(w, "]}");
     }
-    return ares;
+    put_text(w, "}}");
 }
 
+/* FUNCTION: ENCODE_STARTUP
+this function encodes the start-up timing as JSON (once per start, always JSON)
+the stages not reached are -1 (e.g. the lux without a sensor)
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+*/
+void encode_startup(struct payload_writer *w, const char *client_id)
+{
+    put_text(w, "{\"client\": \"%s\", \"boot_ms\": %ld, \"first_frame_us\": %ld, \"first_lux_us\": %ld, \"mqtt_connect_us\": %ld}",
+        client_id, atomic_load(&startup_timing.boot_ms), atomic_load(&startup_timing.first_frame_us),
+        atomic_load(&startup_timing.first_lux_us), atomic_load(&startup_timing.mqtt_connect_us));
+}
 
-/* FUNCTION: UPDATE_DIMMING
-this function is responsible to modify the current dimming settings in function of the current time
-inputs:
- struct tm *a_tm                    : including the current time
- struct display_dimming adimming    : including the previous dimming settings
- struct sunup thissunup             : including the sun-set sun-rise times to know when the dimming needs to change
- verbose                            : gives some text to the standard output
-output                              : including the current dimming settings (with memory)
+/* FUNCTION: ENCODE_HISTORY
+this function encodes the result of a history command as JSON (always JSON), the records are arrays, the oldest first:
+[timestamp, lux, ir, broadband] of the raw tier, [start of the period, min, max, avg] of the downsampled tiers,
+[timestamp, lux, level] of the overrides
+Input:
+    w: output buffer
+    client_id: MQTT client identifier of the board
+    query: the result of the history command
 */
-struct display_dimming update_dimming(struct tm *a_tm,struct display_dimming adimming,struct sunup thissunup, int verbose)
+void encode_history(struct payload_writer *w, const char *client_id, const struct lux_history_query *query)
 {
-    struct display_dimming bdimming=adimming;
-    // If the sunset is now, or dimming decrease ongoing
-    if (((thissunup.set_hour == a_tm->tm_hour) && (thissunup.set_min == a_tm->tm_min)) || (bdimming.lightchange == -1))
+    put_text(w, "{\"client\": \"%s\", \"tier\": \"%s\", \"period_s\": %u, \"records\": [", client_id,
+        LuxHistoryTierNames[query->tier], LuxHistoryPeriodSec[query->tier]);
+    for (int i = 0; i < query->count; i++)
     {
-        if (verbose > 2)
+        if (query->tier == LUX_HISTORY_RAW)
         {
-            printf("decrease dimming\n");
+            const struct lux_history_sample *sample = &query->records.samples[i];
+            put_text(w, "%s[%u, %.2f, %d, %d]", (i > 0) ? ", " : "", sample->timestamp, sample->lux, sample->ir, sample->broadband);
         }
-
-        // If not yet on min light
-        // Minimum dimming setting is 0
-        if (bdimming.currlight > bdimming.dimming_min)
+        else if (query->tier == LUX_HISTORY_OVERRIDE)
         {
-            // decrease light
-            if (verbose > 2)
-            {
-                printf("dimming-1\n");
-            }
-            bdimming.currlight--;
-            // Set slightly passed
-            bdimming.lightchange=-1;
+            const struct lux_history_override *override = &query->records.overrides[i];
+            put_text(w, "%s[%u, %.2f, %d]", (i > 0) ? ", " : "", override->timestamp, override->lux, override->level);
         }
-        else // If min light
+        else
         {
-            // So further light change is required (dimming ongoing to be stopped)
-            if (verbose > 2)
-            {
-                printf("stop dimming change\n");
-            }
-            bdimming.lightchange=0;
+            const struct lux_history_aggregate *aggregate = &query->records.aggregates[i];
+            put_text(w, "%s[%u, %.2f, %.2f, %.2f]", (i > 0) ? ", " : "", aggregate->timestamp, aggregate->min, aggregate->max,
+                aggregate->avg);
         }
     }
-    // If the sunrise is now, or slightly passed
-    else if (((thissunup.rise_hour == a_tm->tm_hour) && (thissunup.rise_min == a_tm->tm_min)) || (bdimming.lightchange == 1))
+    put_text(w, "]}");
+}
+
+/* FUNCTION: STARTUP_MARK
+this function records the time of a start-up stage, only the first time the stage is reached
+(called by the main loop and the publisher thread, the stage is set by compare and exchange)
+Input:
+    stage: the stage in startup_timing
+Output:
+    1 if the stage is reached now, 0 if it was already reached
+*/
+int startup_mark(atomic_long *stage)
+{
+    struct timespec now;
+    long not_reached = -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_us = (now.tv_sec - startup_timing.start.tv_sec) * 1000000L + (now.tv_nsec - startup_timing.start.tv_nsec) / 1000;
+    return atomic_compare_exchange_strong(stage, &not_reached, elapsed_us);
+}
+
+/* FUNCTION: STARTUP_COMPLETE
+this function marks the end of the start-up, the publisher thread publishes the start-up timing at once (or after the connection)
+Input:
+    publisher: the MQTT publisher (started)
+*/
+void startup_complete(struct mqtt_publisher *publisher)
+{
+    atomic_store(&startup_timing.complete, 1);
+    log_msg(LOG_CLOCK, LOG_LEVEL_NOTICE, "Start-up finished, first lux in %ld us", atomic_load(&startup_timing.first_lux_us));
+    // the publisher thread is woken up as for a queued record
+    sem_post(&publisher->queue.ready);
+}
+
+/* FUNCTION: MQTT_PUBLISH_REPLAY
+this function publishes the samples of the offline telemetry ring in batches (one message carries REPLAY_BATCH_SIZE samples)
+the batch is encoded by encode_replay()
+the samples are only removed from the ring after the message is delivered
+Input:
+    publisher: the publisher state (shall be connected)
+Output:
+    0 if the ring is empty, negative if a publish failed (the remaining samples stay in the ring)
+*/
+int mqtt_publish_replay(struct mqtt_publisher *publisher)
+{
+    struct telemetry_sample samples[REPLAY_BATCH_SIZE];
+    unsigned char payload[REPLAY_PAYLOAD_SIZE];
+    struct payload_writer w;
+    MQTTClient_deliveryToken token;
+    int count;
+
+    while (((count = telemetry_ring_peek(&publisher->ring, samples, REPLAY_BATCH_SIZE)) > 0) && !atomic_load(&publisher->stop))
     {
-        // If not yet on max light
-        // Maximum dimming setting is 15
-        if (bdimming.currlight < bdimming.dimming_max)
+        w.buf = payload;
+        w.size = REPLAY_PAYLOAD_SIZE;
+        w.len = 0;
+        encode_replay(&w, publisher->encoding, samples, count);
+        if (w.len > w.size)
         {
-            // increase light
-            if (verbose > 2)
-            {
-                printf("dimming+1\n");
-            }
-            bdimming.currlight++;
-            bdimming.lightchange = 1;
+            // ERROR HANDLING: cannot happen with the sizes above, but never send a truncated batch
+            return -1;
         }
-        else // If max light
+        if ((MQTTClient_publish(publisher->client, publisher->replay_topic, w.len, payload, QOS, 0, &token) != MQTTCLIENT_SUCCESS) ||
+            (MQTTClient_waitForCompletion(publisher->client, token, TIMEOUT) != MQTTCLIENT_SUCCESS))
         {
-            // So further light change is required
-            if (verbose > 2)
-            {
-                printf("stop dimming change\n");
-            }
-            bdimming.lightchange = 0;
+            return -1;
         }
+        telemetry_ring_consume(&publisher->ring, count);
+        log_msg(LOG_MQTT, LOG_LEVEL_INFO, "MQTT replay of %d samples is published", count);
     }
-
-    return bdimming;
+    return 0;
 }
 
-/* FUNCTION: UPDATE_DIMMING_BY_LUX
-this function is responsible to modify the current dimming settings in function of the measured lux
-inputs:
- int lux                            : measured lux value
- struct display_dimming adimming    : including the previous dimming settings
- int * lux_array                    : look-up table for dimming vs lux
-output                              : including the current dimming settings (with memory)
+/* FUNCTION: MQTT_PUBLISHER_START
+this function creates the MQTT client and starts the publisher thread
+Input:
+    publisher: the publisher state to be initialized
+    ring_path: path of the offline telemetry ring file
+    config: the MQTT settings (broker, client id, topic, temperature topic) and the payload encoding
+    feed: the received data of the display pages
+Output:
+    0 if the thread is started, negative on error
 */
-struct display_dimming update_dimming_by_lux(int lux, int * lux_array, struct display_dimming adimming, int verbose)
+int mqtt_publisher_start(struct mqtt_publisher *publisher, const char *ring_path, const struct clock_config *config, struct page_feed *feed)
 {
-    int dimming = 0;
-    int hysteresis = 5; // [%]
-    int lightchange = 0; //positive increasing, negative decreasing
-    // for each possible dimming value (starting from the lowest)
-    for (int i = 0; i <= MaxDimming; i++)
+    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
+
+    memset(publisher, 0, sizeof(struct mqtt_publisher));
+    atomic_init(&publisher->queue.head, 0);
+    atomic_init(&publisher->queue.tail, 0);
+    atomic_init(&publisher->queue.dropped, 0);
+    atomic_init(&publisher->stop, 0);
+    sem_init(&publisher->queue.ready, 0, 0);
+    atomic_init(&publisher->commands.head, 0);
+    atomic_init(&publisher->commands.tail, 0);
+    publisher->commands.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // the topic suffix identifies the payload encoding and schema version (JSON keeps the original topic)
+    enum payload_encoding encoding = config->encoding;
+    publisher->encoding = encoding;
+    char suffix[16] = "";
+    if (encoding == PAYLOAD_BINARY)
+    {
+        snprintf(suffix, sizeof(suffix), "/bin%u", PayloadSchemaVersion);
+    }
+    else if (encoding == PAYLOAD_CBOR)
+    {
+        snprintf(suffix, sizeof(suffix), "/cbor%u", PayloadSchemaVersion);
+    }
+    snprintf(publisher->topic, sizeof(publisher->topic), "%s%s", config->mqtt_topic, suffix);
+    snprintf(publisher->replay_topic, sizeof(publisher->replay_topic), "%s/replay%s", config->mqtt_topic, suffix);
+    // the statistics are a sibling of the telemetry topic (clock/light -> clock/stats)
+    const char *last_level = strrchr(config->mqtt_topic, '/');
+    int parent_len = (last_level != NULL) ? (int)(last_level - config->mqtt_topic) : 0;
+    snprintf(publisher->stats_topic, sizeof(publisher->stats_topic), "%.*s%sstats", parent_len, config->mqtt_topic,
+             (last_level != NULL) ? "/" : "");
+    // the start-up timing is retained, so it is per board as the commands (clock/light -> clock/<client id>/startup)
+    snprintf(publisher->startup_topic, sizeof(publisher->startup_topic), "%.*s%s%s/startup", parent_len, config->mqtt_topic,
+             (last_level != NULL) ? "/" : "", config->mqtt_client_id);
+    snprintf(publisher->client_id, sizeof(publisher->client_id), "%s", config->mqtt_client_id);
+    snprintf(publisher->temp_topic, sizeof(publisher->temp_topic), "%s", config->temp_topic);
+    // the command topic is under the parent of the telemetry topic, per board (clock/light -> clock/<client id>/cmd)
+    snprintf(publisher->cmd_topic, sizeof(publisher->cmd_topic), "%.*s%s%s/cmd", parent_len, config->mqtt_topic,
+             (last_level != NULL) ? "/" : "", config->mqtt_client_id);
+    snprintf(publisher->history_topic, sizeof(publisher->history_topic), "%.*s%s%s/history", parent_len, config->mqtt_topic,
+             (last_level != NULL) ? "/" : "", config->mqtt_client_id);
+    atomic_init(&publisher->history.pending, 0);
+    publisher->feed = feed;
+    // without the ring file the telemetry of the offline minutes is lost, but the publishing still works
+    telemetry_ring_open(&publisher->ring, ring_path);
+
+    if (MQTTClient_create(&publisher->client, config->mqtt_address, config->mqtt_client_id, MQTTCLIENT_PERSISTENCE_NONE, NULL) != MQTTCLIENT_SUCCESS)
     {
-        // if the current element of the lux_array is greater than the current lux
-        // and this value is not 0 in the vector
-        if ((lux > lux_array[i]) && (lux_array[i] > 0))
+        // ERROR HANDLING: e.g. invalid broker address, the clock works without MQTT
+        log_msg(LOG_MQTT, LOG_LEVEL_ERROR, "MQTT client for %s cannot be created", config->mqtt_address);
+        telemetry_ring_close(&publisher->ring);
+        if (publisher->commands.event_fd >= 0)
         {
-            // than this is the required dimming value
-            // at the end the highest dimming is selected which fulfills the criteria above
-            dimming = i;
+            close(publisher->commands.event_fd);
+            publisher->commands.event_fd = -1;
         }
+        return -1;
     }
-    // adding hysteresis for changing the dimming value
-    // if dimming increases
-    if (dimming > adimming.currlight)
+    conn_opts.keepAliveInterval = 70;
+    conn_opts.cleansession = 1;
+    conn_opts.connectTimeout = MqttConnectTimeoutSec;
+    publisher->conn_opts = conn_opts;
+    // the received messages are delivered on the thread of the MQTT client (the callbacks shall be set before the connection)
+    MQTTClient_setCallbacks(publisher->client, publisher, NULL, mqtt_message_arrived, NULL);
+    log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT commands are received on %s", publisher->cmd_topic);
+
+    // the KILL signals shall wake up the main loop, so they are blocked on the publisher thread
+    sigset_t signals;
+    sigset_t old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTRAP);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    int res = pthread_create(&publisher->thread, NULL, mqtt_publisher_thread, publisher);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (res != 0)
     {
-        // do not increase if the current light is below the hysteresis limit
-        if (lux < (lux_array[dimming] * (100 + hysteresis) / 100))
+        // ERROR HANDLING: without the thread the telemetry stays in the queue, the clock still works
+        MQTTClient_destroy(&publisher->client);
+        telemetry_ring_close(&publisher->ring);
+        if (publisher->commands.event_fd >= 0)
         {
-            dimming = adimming.currlight;
+            close(publisher->commands.event_fd);
+            publisher->commands.event_fd = -1;
         }
+        return -1;
     }
-    if (dimming > adimming.currlight)
+    publisher->started = 1;
+    return 0;
+}
+
+/* FUNCTION: MQTT_PUBLISHER_STOP
+this function stops the publisher thread, disconnects and destroys the MQTT client
+(nothing is done if the publisher was not started)
+Input:
+    publisher: the publisher state
+*/
+void mqtt_publisher_stop(struct mqtt_publisher *publisher)
+{
+    if (!publisher->started)
     {
-        lightchange = 1;
+        return;
     }
-    else if (dimming < adimming.currlight)
+    publisher->started = 0;
+    atomic_store(&publisher->stop, 1);
+    sem_post(&publisher->queue.ready);
+    pthread_join(publisher->thread, NULL);
+    MQTTClient_disconnect(publisher->client, 10000);
+    MQTTClient_destroy(&publisher->client);
+    // the not yet published records are kept for the next start
+    struct telemetry_record record;
+    while (telemetry_queue_pop(&publisher->queue, &record))
     {
-        lightchange = -1;
+        telemetry_ring_append(&publisher->ring, &record);
     }
-    if (verbose > 1)
+    telemetry_ring_close(&publisher->ring);
+    sem_destroy(&publisher->queue.ready);
+    if (publisher->commands.event_fd >= 0)
     {
-        printf("Look-up table dimming: %d, for lux %d\n", dimming, lux);
+        close(publisher->commands.event_fd);
     }
-
-    // Create dimming status structure, and fill it with initial val
-    //      bdimming.lightchange=0;
-    //      bdimming.currlight=0;
-    //      bdimming.dimming_max=15;
-    //      bdimming.dimming_min=0; */
-    struct display_dimming bdimming={0, 0, MaxDimming, 0};
-    // set the dimming value as found above
-    bdimming.currlight = dimming;
-    bdimming.lightchange = lightchange;
-    return bdimming;
 }
 
-/* FUNTION: GET_HEX_CODE
-sub-function is created to get hex code for a single digit =meaning this shall be called four times for HH:MM format
- input
-    anum: a number value between 0-900000000
- output:
-    integer with the value representing the digit anum on the display memory
-
-Decimal value of each segment:
-    ------  1
-    I    I
-32  I    I  2
-    I    I
-    ------  64
-    I    I
-16  I    I  4
-    I    I
-    ------  8
-    Value of decimal dot: 128=0x80
+/* FUNCTION: MQTT_PUBLISHER_THREAD
+thread function: (re)connects to the broker with exponential backoff, and publishes the queued telemetry records
+the thread sleeps on the queue semaphore, so it only wakes up if a record is queued, or a connection attempt is due
+while disconnected (or if a publish fails) the records are stored in the offline telemetry ring, which is replayed after reconnect
+the "mqtt" field of the payload is 1 if the connection was alive, 2 if it was just (re)connected, 3 if the sensor restart was tried
+Input:
+    arg: pointer to struct mqtt_publisher
 */
-unsigned char get_hex_code(int anum)
+void *mqtt_publisher_thread(void *arg)
 {
-    switch (anum)
-    {
-        case 0:
-            // 63 = 0x3F
-            return 0x3F;
-            break;
-        case 1:
-            // 6 = 0x06
-            return 0x06;
-            break;
-        case 2:
-            // 91 = 0x5B
-            return 0x5B;
-            break;
-        case 3:
-            // 79 = 0x4F
-            return 0x4F;
-            break;
-        case 4:
-            // 102 = 0x66
-            return 0x66;
-            break;
-        case 5:
-            // 109 = 0x6D
-            return 0x6D;
-            break;
-        case 6:
-            // 125 = 0x7D
-            return 0x7D;
-            break;
-        case 7:
-            // 7 = 0x07
-            return 0x07;
-            break;
-        case 8:
-            // 127 = 0x7F
-            return 0x7F;
-            break;
-        case 9:
-            // 111 = 0x6F
-            return 0x6F;
-            break;
-        default:
-            // nothin' = 0x00
-            return 0x00;
-            break;
-    }
-}
+    struct mqtt_publisher *publisher = (struct mqtt_publisher *)arg;
+    struct telemetry_record record;
+    struct timespec now;
+    struct timespec next_connect;
+    struct timespec next_stats;
+    struct timespec last_stats;
+    struct timespec publish_start;
+    unsigned char mqtt_payload[TELEMETRY_PAYLOAD_SIZE];
+    unsigned char stats_payload[STATS_PAYLOAD_SIZE];
+    unsigned char history_payload[HISTORY_PAYLOAD_SIZE];
+    struct payload_writer w;
+    MQTTClient_message pubmsg = MQTTClient_message_initializer;
+    MQTTClient_deliveryToken token;
+    int backoff = MqttBackoffMinSec;
+    int just_connected = 0;
+    int startup_published = 0;
 
-/* FUNTION: CALCULATE_SUN_UP
-Calculates the sun-set and sun-rise times for a given location, on the current day
-Necessary inputs:
-Ln_deg: north longitudial coordinate, as double (for locations south to the equador it is a negative value)
-Lw_deg: west latituial coordinate, as double (for location east to Greenwich it is a negative value)
-verbose: if it is set to 1, some intermediate information will be printed to the standard output (printf)
-The accuracy of this function is appx +-15minutes. If you would consider a more accurate value, than please consider using different code.
-(An option for accuracy improvement could be to repeat the calculation of M_deg, C, lambda_deg and J_transit (noon_prev) recursively several times)
-Due to the large number of Julian date, and the required precisity the used type is double during the calculation
-*/
-struct sunup calculate_sun_up(double Ln_deg,double Lw_deg, int verbose)
-{
-    // create time management structure to get the current time and the used timezone, summer time information
-    struct tm *a_tm;
-    // create variable where the time information will be stored
-    time_t now = time(NULL);
-    // outptt variable to store the reurn values
-    struct sunup asunup;
-    // calculate PI (3.14...) as double
-    double aPI = acos(-1.0);
-    // get the current time from the system
-    a_tm = localtime(&now);
-    // calculate current year
-    int ayear = a_tm->tm_year+1900;
-    // Calculate correction hours compared to UTC (Greenwich)
-    int UTC_corr = get_UTC_correction(a_tm);
-
-    // Calculate Julian date
-    // first calculate the Jdate
-    // number of years since 2000 multiplied by 365: (ayear-2000)*365
-    // add the number of extra days (int)((ayear-2000)/4)
-    // add the number of days in the current year: a_tm->tm_yday
-    int Jdate = (ayear - 2000) * 365 + (int)((ayear - 2000) / 4) + 2451545 + a_tm->tm_yday;
+    clock_gettime(CLOCK_MONOTONIC, &next_connect);
+    last_stats = next_connect;
+    next_stats = next_connect;
+    next_stats.tv_sec = next_stats.tv_sec + StatsPeriodSec;
 
-    // Start of sunset sun-rise calculation, based on: http://users.electromagnetic.net/bu/astro/sunrise-set.php
-    double Ln_rad    = Ln_deg*2*aPI/360;
-    double n_        = (Jdate - 2451545 - 0.0009) - (Lw_deg/360);
-    int    n         = round(n_);
-    double noon_prev = 2451545 + 0.0009 + (Lw_deg/360) + n ;
-    double M_deg     = fmodf (357.5291 + 0.98560028 * (noon_prev - 2451545),(float)360);
-    double M_rad     = M_deg *2* aPI/360;
-    double C_x   = (1.9148 * sin(M_rad)) + (0.0200 * sin(2 * M_rad)) + (0.0003 * sin(3 * M_rad)) ;
-    double lambda_deg= fmodf(M_deg + 102.9372 + C_x + 180,360) ;
-    double lambda_rad= lambda_deg *2* aPI/360;
-    double J_transit = noon_prev + (0.0053 * sin(M_rad)) - (0.0069 * sin(2 * lambda_rad));
-    double theta     = asin( sin(lambda_rad) * sin(23.45*2*aPI/360) );
-    double H_rad     = acos( (sin(-0.83*2*aPI/360) - sin(Ln_rad) * sin(theta)) / (cos(Ln_rad) * cos(theta)) );
-    double H_deg     = H_rad*360/2/aPI;
-    double noon      = 2451545 + 0.0009 + ((H_deg + Lw_deg)/360) + n;
-    double sunset    = noon + (0.0053 * sin(M_rad)) - (0.0069 * sin(2 * lambda_rad)) ;
-    double sunrise   = J_transit - (sunset - J_transit) ;
-    // End of sunset sun-rise calculation, based on: http://users.electromagnetic.net/bu/astro/sunrise-set.php
+    while (!atomic_load(&publisher->stop))
+    {
+        // (re)connect if the connection attempt is due
+        if (MQTTClient_isConnected(publisher->client) != 1)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec >= next_connect.tv_sec)
+            {
+                if (MQTTClient_connect(publisher->client, &publisher->conn_opts) == MQTTCLIENT_SUCCESS)
+                {
+                    backoff = MqttBackoffMinSec;
+                    just_connected = 1;
+                    atomic_fetch_add_explicit(&clock_stats.mqtt_connects, 1, memory_order_relaxed);
+                    startup_mark(&startup_timing.mqtt_connect_us);
+                    log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT connection was not alive, connected");
+                    // the clean session drops the subscriptions, they are renewed at every connection
+                    if (MQTTClient_subscribe(publisher->client, publisher->cmd_topic, QOS) != MQTTCLIENT_SUCCESS)
+                    {
+                        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT subscribe to %s failed", publisher->cmd_topic);
+                    }
+                    if ((publisher->temp_topic[0] != '\0') && (MQTTClient_subscribe(publisher->client, publisher->temp_topic, QOS) != MQTTCLIENT_SUCCESS))
+                    {
+                        log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT subscribe to %s failed", publisher->temp_topic);
+                    }
+                }
+                else
+                {
+                    // double the wait till the next attempt
+                    atomic_fetch_add_explicit(&clock_stats.mqtt_connect_failures, 1, memory_order_relaxed);
+                    clock_gettime(CLOCK_MONOTONIC, &next_connect);
+                    next_connect.tv_sec = next_connect.tv_sec + backoff;
+                    log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT connection is not alive, next attempt in %d sec", backoff);
+                    backoff = backoff * 2;
+                    if (backoff > MqttBackoffMaxSec)
+                    {
+                        backoff = MqttBackoffMaxSec;
+                    }
+                }
+            }
+        }
+
+        // while disconnected the records are moved to the offline telemetry ring
+        if (MQTTClient_isConnected(publisher->client) != 1)
+        {
+            while (telemetry_queue_pop(&publisher->queue, &record))
+            {
+                telemetry_ring_append(&publisher->ring, &record);
+            }
+        }
+
+        // publish the queued records
+        while ((MQTTClient_isConnected(publisher->client) == 1) && telemetry_queue_pop(&publisher->queue, &record))
+        {
+            int mqtt_status = 1;
+            if (just_connected)
+            {
+                mqtt_status = 2;
+            }
+            else if (record.sensor_restart)
+            {
+                mqtt_status = 3; // tried to restart sensor
+            }
+            just_connected = 0;
+            w.buf = mqtt_payload;
+            w.size = TELEMETRY_PAYLOAD_SIZE;
+            w.len = 0;
+            encode_telemetry(&w, publisher->encoding, &record, mqtt_status,
+                atomic_load_explicit(&publisher->queue.dropped, memory_order_relaxed));
+            if (w.len > w.size)
+            {
+                // ERROR HANDLING: cannot happen with the payload size above, but never send a truncated record
+                log_msg(LOG_MQTT, LOG_LEVEL_ERROR, "MQTT telemetry payload of %d bytes does not fit %d bytes, the record is dropped",
+                        w.len, w.size);
+                continue;
+            }
+            pubmsg.payload = mqtt_payload;
+            pubmsg.payloadlen = w.len;
+            pubmsg.qos = QOS;
+            pubmsg.retained = 1;
+            clock_gettime(CLOCK_MONOTONIC, &publish_start);
+            if ((MQTTClient_publishMessage(publisher->client, publisher->topic, &pubmsg, &token) != MQTTCLIENT_SUCCESS) ||
+                (MQTTClient_waitForCompletion(publisher->client, token, TIMEOUT) != MQTTCLIENT_SUCCESS))
+            {
+                // ERROR HANDLING: keep the record for the replay
+                atomic_fetch_add_explicit(&clock_stats.mqtt_publish_failures, 1, memory_order_relaxed);
+                telemetry_ring_append(&publisher->ring, &record);
+                continue;
+            }
+            stats_since(STATS_MQTT, &publish_start);
+            log_msg(LOG_MQTT, LOG_LEVEL_INFO, "MQTT message is published");
+        }
+
+        // after the live records, replay the records of the offline period
+        if (MQTTClient_isConnected(publisher->client) == 1)
+        {
+            if (mqtt_publish_replay(publisher) < 0)
+            {
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT replay failed");
+            }
+        }
 
+        // the statistics of the period (while disconnected they are accumulated till the connection)
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((MQTTClient_isConnected(publisher->client) == 1) && (now.tv_sec >= next_stats.tv_sec))
+        {
+            w.buf = stats_payload;
+            w.size = STATS_PAYLOAD_SIZE;
+            w.len = 0;
+            encode_stats(&w, publisher->client_id, now.tv_sec - last_stats.tv_sec);
+            if ((w.len <= w.size) &&
+                ((MQTTClient_publish(publisher->client, publisher->stats_topic, w.len, stats_payload, QOS, 0, &token) != MQTTCLIENT_SUCCESS) ||
+                 (MQTTClient_waitForCompletion(publisher->client, token, TIMEOUT) != MQTTCLIENT_SUCCESS)))
+            {
+                // ERROR HANDLING: the statistics of the period are lost, the counters are already reset
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT statistics publish failed");
+            }
+            last_stats = now;
+            next_stats = now;
+            next_stats.tv_sec = next_stats.tv_sec + StatsPeriodSec;
+        }
 
-    // Calculate it to human readeable times in HH:MM format
-    // Julian calendar contains the date as the integer number, the number after the decimal point refers to the time within the day
-    //  so if the integer is removed from the Julian date and the result is multiplied with 24, than it is the hour within the Julian day
-    // Julian calendar changes day at noon, so xx.0=12:00h, so to get a value in the afternoon, you have to add 12 to get the 24hour time format
-    // Julian calendar gives the time according to UTC timezone so the result shuld be corrigated
-    double set_hour_d = (12+(sunset-(int)sunset)*24)+UTC_corr;
-    int    set_hour   = (int)set_hour_d;
-    // similarly to the hour calculation, the value after the hour number represents the minutes within the hour, so multiplying with 60 gives the value in minutes
-    int    set_min    = (int)((set_hour_d-set_hour)*60);
-
-    // calculation of the sin-rise time in HH:MM format is similar to the calculation of the sun-set
-    // except that you should extract 12 from the value
-    double rise_hour_d = ((sunrise-(int)sunrise)*24-12)+UTC_corr;
-    int    rise_hour   = (int)rise_hour_d;
-    int    rise_min    = (int)((rise_hour_d-rise_hour)*60);
-
-    if (verbose > 2)
-    {
-        printf("timezone is: %s\n",a_tm->tm_zone);
-        printf("hour difference to UTC is %d hours.\n",UTC_corr);
-        printf("Jdate                      = %d\n", Jdate);
-        printf("rounds around the sun      = %d\n", n);
-        printf("prevision for noon (Jdate) = %f\n", noon_prev);
-        printf("M                          = %f\n", M_deg);
-        printf("C                          = %f\n", C_x);
-        printf("lambda                     = %f\n", lambda_deg);
-        printf("J_transit                  = %f\n", J_transit);
-        printf("theta                      = %f\n", theta);
-        printf("H                          = %f\n", H_deg);
-        printf("noon                       = %f\n", noon);
-        printf("sunset                     = %f\n", sunset);
-        printf("sunrise                    = %f\n", sunrise);
-    }
-    asunup.set_hour=set_hour;
-    asunup.set_min=set_min;
-    asunup.rise_hour=rise_hour;
-    asunup.rise_min=rise_min;
+        // the start-up timing, once per start (retained: the last start of the board can be read at any time)
+        if ((MQTTClient_isConnected(publisher->client) == 1) && !startup_published && atomic_load(&startup_timing.complete))
+        {
+            w.buf = stats_payload;
+            w.size = STATS_PAYLOAD_SIZE;
+            w.len = 0;
+            encode_startup(&w, publisher->client_id);
+            if ((w.len <= w.size) &&
+                ((MQTTClient_publish(publisher->client, publisher->startup_topic, w.len, stats_payload, QOS, 1, &token) != MQTTCLIENT_SUCCESS) ||
+                 (MQTTClient_waitForCompletion(publisher->client, token, TIMEOUT) != MQTTCLIENT_SUCCESS)))
+            {
+                // ERROR HANDLING: the start-up timing is published again after the next connection
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT start-up timing publish failed");
+            }
+            else
+            {
+                startup_published = 1;
+            }
+        }
 
-    return asunup;
+        // the result of a history command (not retained, it is the answer to the command)
+        if ((MQTTClient_isConnected(publisher->client) == 1) && atomic_load_explicit(&publisher->history.pending, memory_order_acquire))
+        {
+            w.buf = history_payload;
+            w.size = HISTORY_PAYLOAD_SIZE;
+            w.len = 0;
+            encode_history(&w, publisher->client_id, &publisher->history);
+            if ((w.len > w.size) ||
+                (MQTTClient_publish(publisher->client, publisher->history_topic, w.len, history_payload, QOS, 0, &token) != MQTTCLIENT_SUCCESS) ||
+                (MQTTClient_waitForCompletion(publisher->client, token, TIMEOUT) != MQTTCLIENT_SUCCESS))
+            {
+                // ERROR HANDLING: the result is dropped, the command can be sent again
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT history publish failed");
+            }
+            // the slot is free for the next history command
+            atomic_store_explicit(&publisher->history.pending, 0, memory_order_release);
+        }
+
+        // sleep till the next record, the next statistics, or till the next connection attempt
+        if (MQTTClient_isConnected(publisher->client) == 1)
+        {
+            sem_clockwait(&publisher->queue.ready, CLOCK_MONOTONIC, &next_stats);
+        }
+        else
+        {
+            sem_clockwait(&publisher->queue.ready, CLOCK_MONOTONIC, &next_connect);
+        }
+    }
+    return NULL;
 }
 
-/* FUNCTION: GET_UTC_CORRECTION
-this function converts the time-zone and summer time information to a single hour difference between UTC and the system time
+/* FUNCTION: MQTT_MESSAGE_ARRIVED
+MQTT client callback (called on the thread of the MQTT client): the outdoor temperature is stored in the page feed,
+and the main loop is woken up if the temperature page is visible; the commands are parsed and queued for the main loop
+(nothing is polled, the main loop is woken up by the eventfd of the command queue)
+the temperature payload is a number in [C], or a JSON object, the first number of it is used
 Input:
-    struct tm *a_tm: including the current time
+    context: pointer to struct mqtt_publisher
+    topic_name, topic_len: topic of the message
+    message: the received message
 Output:
-    hour difference between UTC and the system time
+    1: the message is processed (freed)
 */
-int get_UTC_correction(struct tm *a_tm)
+int mqtt_message_arrived(void *context, char *topic_name, int topic_len, MQTTClient_message *message)
 {
-    int UTC_corr = 0;
-    // if the system provided time zone is CET (Central Europian Time), or CEST (Central Europen Summer Time)
-    if ((strcmp(a_tm->tm_zone,"CET") == 0) || (strcmp(a_tm->tm_zone,"CEST") == 0))
+    struct mqtt_publisher *publisher = (struct mqtt_publisher *)context;
+    char payload[64];
+    // the payload is not zero terminated
+    int len = (message->payloadlen < (int)sizeof(payload) - 1) ? message->payloadlen : (int)sizeof(payload) - 1;
+    memcpy(payload, message->payload, len);
+    payload[len] = '\0';
+    if (strcmp(topic_name, publisher->cmd_topic) == 0)
     {
-        // CET from UTC: +1h
-        UTC_corr++;
+        struct clock_command command;
+        if (command_parse(payload, &command) < 0)
+        {
+            log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT command is invalid: %s", payload);
+        }
+        else if (command_queue_push(&publisher->commands, &command) < 0)
+        {
+            log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "MQTT command queue is full, command dropped: %s", payload);
+        }
+        MQTTClient_freeMessage(&message);
+        MQTTClient_free(topic_name);
+        return 1;
     }
-    else
+    // the first number of the payload
+    char *start = payload + strcspn(payload, "-0123456789");
+    char *end = NULL;
+    float temperature = strtof(start, &end);
+    if ((end != start) && (temperature > -100.0f) && (temperature < 100.0f))
     {
-        // place for other timezones if needed
-        ;
+        atomic_store_explicit(&publisher->feed->temperature, (int)lroundf(temperature * 10.0f), memory_order_relaxed);
+        atomic_fetch_add_explicit(&publisher->feed->temperature_seq, 1, memory_order_release);
+        // the main loop is not woken up for a page which is not visible
+        if (atomic_load(&publisher->feed->listening) && (publisher->feed->event_fd >= 0))
+        {
+            uint64_t wakeup = 1;
+            if (write(publisher->feed->event_fd, &wakeup, sizeof(wakeup)) < 0)
+            {
+                // ERROR HANDLING: the temperature is shown at the next minute change
+                log_msg(LOG_MQTT, LOG_LEVEL_NOTICE, "PAGE EVENT WRITE FAILED");
+            }
+        }
     }
-    if (a_tm->tm_isdst == 1)
+    else
     {
-        // summer time adds an other hour from the UTC timezone
-        UTC_corr++;
+        log_msg(LOG_MQTT, LOG_LEVEL_INFO, "MQTT temperature is invalid: %s", payload);
     }
-    return UTC_corr;
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topic_name);
+    return 1;
 }
 
-/* FUNCTION: PROGRAM_SLEEP
-this subfunction calles the nanosleep() function for the defined seconds
+/* stuff to handle KILL request */
+void term(int signo)
+{
+    done = 1;
+}
+
+/* SIGUSR1: the writer thread writes the whole log ring (sem_post is async-signal-safe) */
+void log_dump_request(int signo)
+{
+    log_ring.dump = 1;
+    sem_post(&log_ring.ready);
+}
+
+/* FUNCTION: STATS_RECORD
+this function puts a value into the latency histogram of a stage (lock-free, callable from any thread)
 Input:
-    sec: the seconds till the program needs to sleep
-    verbose: writes slept time to the standard output
+    stage: the measured stage
+    us: the value [us]
 */
-void program_sleep(float sec, int verbose)
+void stats_record(enum stats_stage stage, long us)
 {
-    // create nanosleep structure
-    struct timespec ts;
-    // convert input to nanosleep structure
-    ts.tv_sec = (int)sec;
-    ts.tv_nsec = (sec-(int)sec)*1000000000;
-    // perform the sleep
-    nanosleep(&ts, NULL);
-    if (verbose > 2)
+    struct latency_histogram *h = &clock_stats.stages[stage];
+    unsigned long value = (us > 0) ? (unsigned long)us : 0;
+    // bucket k: [2^(k-1), 2^k) us
+    int bucket = (value > 0) ? (int)(sizeof(unsigned long) * 8) - __builtin_clzl(value) : 0;
+    if (bucket >= STATS_BUCKETS)
+    {
+        bucket = STATS_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, value, memory_order_relaxed);
+    unsigned long max = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    while ((value > max) && !atomic_compare_exchange_weak_explicit(&h->max_us, &max, value, memory_order_relaxed, memory_order_relaxed))
     {
-        printf("slept for %g sec\n",sec);
     }
 }
 
-/* FUNCTION: MEASURE_LUX
-this functional reads the light sensor measured data, and calls the lux calculation, than returns the calculated lux
+/* FUNCTION: STATS_SINCE
+this function puts the CLOCK_MONOTONIC time elapsed since start into the latency histogram of a stage
 Input:
-    int file: file descriptor of the light sensor
-    verbose: puts information to the standard output
-Output:
-    struct light_sensor_data: measured data and calculated lux
+    stage: the measured stage
+    start: CLOCK_MONOTONIC time of the start of the stage
 */
-struct light_sensor_data measure_lux(int file, int verbose)
+void stats_since(enum stats_stage stage, const struct timespec *start)
 {
-    struct light_sensor_data measurement;
-    float lux = 0.0;
-    int broadband = 0;
-    int ir = 0;
-
-    #ifdef TSL2561
-      int res = 0;
-      float f_broadband = 0.0;
-      float f_ir = 0.0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats_record(stage, (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000);
+}
 
-    // set the gain value of the sensor if needed
-    int gain = 1;
-    // set the command values for the read
-    int command_broadband = Sensor_command + Sensor_Read_Word + Broadband_Low;
-    int command_ir = Sensor_command + Sensor_Read_Word + IR_Low;
-  
-    int command_gain = 0;
-    if (gain == 16)
+/* log_spec: parses the printf conversion at p ('%' ...), copies it to spec, and returns the type of its argument
+(0: no argument, 'i': int, 'l': long, 'L': long long, 'z': size_t, 'd': double, 's': string, 'p': pointer) */
+static const char *log_spec(const char *p, char *spec, size_t spec_size, char *type)
+{
+    size_t n = 0;
+    int length = 0;
+    spec[n++] = *p++;
+    while ((*p != '\0') && (strchr("-+ #0123456789.", *p) != NULL) && (n < spec_size - 4))
     {
-        command_gain = Sensor_command + Sensor_Timing;
-        program_sleep(0.1,verbose);
-        res = i2c_smbus_write_byte_data(file, command_gain, 0x12);
-        if (res < 0)
-        {
-            // ERROR HANDLING: i2c transaction failed
-            lux=res;
-        }
-        // wait for finish one measurement integration in the sensor (datasheet)
-        program_sleep(0.402, verbose);
+        spec[n++] = *p++;
     }
-    program_sleep(0.1,verbose);
-    // Read Broadband sensor value
-    // Using SMBus commands
-    broadband = i2c_smbus_read_word_data(file, command_broadband);
-    program_sleep(0.1,verbose);
-    // Read infrared sensor value
-    // Using SMBus commands
-    ir = i2c_smbus_read_word_data(file, command_ir);
-    // if ir or broadband is negative than something failed during the measurement
-    if ((ir >= 0) && (broadband >= 0))
+    while ((*p == 'h') || (*p == 'l') || (*p == 'z'))
     {
-        // if gain is not 16, that means gain = 1
-        if (gain != 16)
-        {
-            // make conversion based on datasheet (the proposed calculation is for gain=16)
-            f_broadband= (float)broadband * 16.0;
-            f_ir = (float)ir * 16.0;
-        }
-        else
-        {
-            f_broadband= (float)broadband;
-            f_ir = (float)ir;
-        }
-        // calculate lux from measured values
-        lux = calculate_lux(f_broadband, f_ir);
+        length = (*p == 'z') ? 'z' : ((*p == 'l') ? length + 1 : length);
+        spec[n++] = *p++;
     }
-  #endif
-    
-  #ifdef TSL2591
-    int res = 0;
-    unsigned char addr;
-    unsigned char data;
-    unsigned char TSL2591_Gain;
-    unsigned char TSL2591_Time;
-    float atime;
-    
-    // get gain and integralTime settings
-    addr = control_register | command_bit;
-    data = i2c_smbus_read_byte_data( file, addr );
-    TSL2591_Gain = data & 0x30;
-    TSL2591_Time = data & 0x07;
-    atime = 100 * TSL2591_Time + 100;
-    
-    float again;
-    again = 1.0;
-    if(TSL2591_Gain == medium_gain){
-        again = 25.0;
-    }else if(TSL2591_Gain == high_gain){
-        again = 428.0;
-    }else if(TSL2591_Gain == max_gain){
-        again = 9876.0;
+    if (*p == '\0')
+    {
+        *type = 0;
+        spec[n] = '\0';
+        return p;
     }
-
-    // Enable ALS
-    addr = enable_register | command_bit;
-    res = i2c_smbus_write_byte_data(file, addr, enable_poweron | enable_aen);
-    if (verbose > 2)
+    char conversion = *p++;
+    spec[n++] = conversion;
+    spec[n] = '\0';
+    if (strchr("diouxXc", conversion) != NULL)
     {
-    printf("Light sensor enable register is set to %d, with result %d \n",  enable_poweron | enable_aen, res);
-    }    
-    program_sleep(atime / 1000.0, verbose);
-
-    // channel_0 = TSL2591_Read_Channel0();
-    addr = Broadband_Low | command_bit;
-    broadband = i2c_smbus_read_word_data(file, addr);
-    // channel_1 = TSL2591_Read_Channel1();
-    program_sleep(0.1, verbose);
-    addr = IR_Low | command_bit;
-    ir = i2c_smbus_read_word_data(file, addr);
-    if (verbose > 1)
+        *type = (length == 'z') ? 'z' : ((length == 1) ? 'l' : ((length >= 2) ? 'L' : 'i'));
+    }
+    else if (strchr("fFeEgGaA", conversion) != NULL)
     {
-    printf("Light sensor ADC values are read: boradband: %d, ir: %d \n", broadband, ir);
+        *type = 'd';
     }
-  
-    // Disable ALS
-    addr = enable_register | command_bit;
-    res = i2c_smbus_write_byte_data(file, addr, enable_poweron);
-    if (verbose > 2)
+    else if (conversion == 's')
     {
-    printf("Light sensor ALS disable: enable register is set to %d, with result %d \n", enable_poweron, res);
+        *type = 's';
     }
-  
-    //calculate lux
-    float cpl;
-    cpl = (atime * again) / lux_df;
-    lux = (broadband - (2 * ir)) / cpl;
-
-    //_TSL2591_LUX_DF = 408.0
-    //_TSL2591_LUX_COEFB = 1.64
-    //_TSL2591_LUX_COEFC = 0.59
-    //_TSL2591_LUX_COEFD = 0.86
-    //float lux2
-    //lux2 = ((_TSL2591_LUX_COEFC * channel_0) - (_TSL2591_LUX_COEFD * channel_1) ) / cpl
-    
-    if (lux < 0)
+    else if (conversion == 'p')
     {
-      lux = 0;
+        *type = 'p';
     }
-    
-  #endif
-  
-  #ifdef VEML7700
-    // minimum current cunsumption is defined by the datasheet when: ALS_Gain: 01, PSM: 11, ALS_IT: 0000
-    // in thisa case the refresh time is 4.1s, resolution is 0.0288lx/bit
-    broadband = i2c_smbus_read_word_data(file, als_register);
-    program_sleep(0.1, verbose);
-    ir = i2c_smbus_read_word_data(file, white_register);
-    program_sleep(0.1,verbose);
-    if (verbose > 1)
+    else
     {
-      printf("Light sensor ADC values are read: ALS: %d, White: %d \n", broadband, ir);
+        *type = 0;
     }
-    
-    lux = broadband * 0.0288;
-
-  #endif
-  
-    
-    measurement.s_ir = ir;
-    measurement.s_broadband = broadband;
-    measurement.lux = lux;
-    return measurement;
+    return p;
 }
 
-/* FUNCTION: CALCULATE_LUX
-this function calculates the lux value from the measured light sensor data
+/* FUNCTION: LOG_MSG
+this function puts a log record into the in-memory ring without formatting it (the arguments are copied)
+the record is written to the standard output by the writer thread if its level is enabled for the subsystem,
+otherwise it is only kept for the SIGUSR1 dump
+the errno is not changed (the failed call can be logged before its errno is checked)
 Input:
-    float broadband: bradband sensor measured value
-    float ir: infrared sensor measured value
-Output:
-    float lux   : the calculated lux value
+    subsystem: the part of the clock which logs
+    level: level of the record
+    format: printf format (string literal), the arguments follow
 */
-float calculate_lux(float broadband, float ir)
+void log_msg(enum log_subsystem subsystem, enum log_level level, const char *format, ...)
 {
-    // T, FN, and CL Package
-    // For 0 < CH1/CH0  < 0.50 Lux = 0.0304 * CH0 - 0.062 * CH0*((CH1/CH0)^1.4)
-    // For 0.50 < CH1/CH0 < 0.61 Lux = 0.0224 * CH0 - 0.031 * CH1
-    // For 0.61 < CH1/CH0 < 0.80 Lux = 0.0128 * CH0 - 0.0153 * CH1
-    // For 0.80 < CH1/CH0 < 1.30 Lux = 0.00146 * CH0 - 0.00112 * CH1
-    // For CH1/CH0 > 1.30 Lux = 0
-    float lux = 0.0;
-    float ratio = 0.0;
-    // calculate ration with division of zero protection
-    if (broadband > 0.0) ratio = ir / broadband;
-    // make the necessary calculations based on the database
-    // For 0 < CH1/CH0  < 0.50 Lux = 0.0304 * CH0 - 0.062 * CH0*((CH1/CH0)^1.4)
-    if ((ratio <= 0.50) && (broadband > 0.0))
+    int saved_errno = errno;
+    unsigned long number = atomic_fetch_add_explicit(&log_ring.head, 1, memory_order_relaxed);
+    unsigned long slot = number % LOG_RING_SIZE;
+    struct log_record *record = &log_ring.records[slot];
+    char spec[16];
+    char type;
+    size_t strings_len = 0;
+    va_list args;
+    int enabled = ((int)level <= atomic_load_explicit(&log_ring.levels[subsystem], memory_order_relaxed));
+
+    // an enabled record of the slot which is not yet written is lost (the disabled ones are kept only for the dump)
+    if (atomic_exchange_explicit(&log_ring.pending[slot], enabled ? number + 1 : 0, memory_order_acq_rel) != 0)
     {
-        lux = 0.0304 * broadband - 0.062 * broadband * (pow(ratio,1.4));
+        atomic_fetch_add_explicit(&log_ring.lost, 1, memory_order_relaxed);
     }
-    // For 0.50 < CH1/CH0 < 0.61 Lux = 0.0224 * CH0 - 0.031 * CH1
-    else if ((ratio <= 0.61) && (broadband > 0.0))
+    // odd sequence: the record is being written
+    atomic_store_explicit(&log_ring.seq[slot], 2 * number + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->format = format;
+    record->subsystem = subsystem;
+    record->level = level;
+    record->argc = 0;
+    va_start(args, format);
+    for (const char *p = strchr(format, '%'); (p != NULL) && (record->argc < LOG_MAX_ARGS); p = strchr(p, '%'))
     {
-        lux = 0.0224 * broadband - 0.031 * ir;
+        p = log_spec(p, spec, sizeof(spec), &type);
+        int a = record->argc;
+        switch (type)
+        {
+            case 'i': record->args[a].i = va_arg(args, int); break;
+            case 'l': record->args[a].i = va_arg(args, long); break;
+            case 'L': record->args[a].i = va_arg(args, long long); break;
+            case 'z': record->args[a].i = (long long)va_arg(args, size_t); break;
+            case 'd': record->args[a].d = va_arg(args, double); break;
+            case 'p': record->args[a].p = va_arg(args, void *); break;
+            case 's':
+            {
+                // the string is copied (truncated if the string area is full)
+                const char *str = va_arg(args, const char *);
+                size_t len = strnlen(str ? str : "(null)", LOG_STRING_SIZE);
+                if (strings_len + len + 1 > LOG_STRING_SIZE)
+                {
+                    len = LOG_STRING_SIZE - strings_len - 1;
+                }
+                memcpy(&record->strings[strings_len], str ? str : "(null)", len);
+                record->strings[strings_len + len] = '\0';
+                record->args[a].i = (long long)strings_len;
+                strings_len += len + ((strings_len + len + 1 < LOG_STRING_SIZE) ? 1 : 0);
+                break;
+            }
+            default: continue;
+        }
+        record->argc++;
     }
-    // For 0.61 < CH1/CH0 < 0.80 Lux = 0.0128 * CH0 - 0.0153 * CH1
-    else if ((ratio <= 0.8) && (broadband > 0.0))
+    va_end(args);
+    // even sequence: the record is complete
+    atomic_store_explicit(&log_ring.seq[slot], 2 * number + 2, memory_order_release);
+    if (enabled)
     {
-        lux = 0.0128 * broadband - 0.0153 * ir;
+        sem_post(&log_ring.ready);
     }
-    // For 0.80 < CH1/CH0 < 1.30 Lux = 0.00146 * CH0 - 0.00112 * CH1
-    else if ((ratio <= 1.3) && (broadband > 0.0))
+    errno = saved_errno;
+}
+
+/* FUNCTION: LOG_SET_LEVEL
+this function sets the level of the records of a subsystem which are written to the standard output (-1: none, 0: errors only)
+Input:
+    subsystem: the subsystem
+    level: the highest level to be written
+*/
+void log_set_level(enum log_subsystem subsystem, int level)
+{
+    atomic_store_explicit(&log_ring.levels[subsystem], level, memory_order_relaxed);
+}
+
+/* FUNCTION: LOG_FORMAT
+this function expands a log record into text (lazy formatting, done by the writer thread)
+Input:
+    record: the log record
+    out: the output buffer
+    size: size of the output buffer
+*/
+void log_format(const struct log_record *record, char *out, size_t size)
+{
+    char spec[16];
+    char type;
+    size_t len = 0;
+    int a = 0;
+    const char *p = record->format;
+    while ((*p != '\0') && (len + 1 < size))
     {
-        lux = 0.00146 * broadband - 0.00112 * ir;
+        if (*p != '%')
+        {
+            out[len++] = *p++;
+            continue;
+        }
+        p = log_spec(p, spec, sizeof(spec), &type);
+        int res = 0;
+        if ((type == 0) || (a >= record->argc))
+        {
+            // %% (or an argument over LOG_MAX_ARGS)
+            res = snprintf(&out[len], size - len, "%s", (type == 0) ? "%" : "?");
+        }
+        else
+        {
+            switch (type)
+            {
+                case 'i': res = snprintf(&out[len], size - len, spec, (int)record->args[a].i); break;
+                case 'l': res = snprintf(&out[len], size - len, spec, (long)record->args[a].i); break;
+                case 'L': res = snprintf(&out[len], size - len, spec, record->args[a].i); break;
+                case 'z': res = snprintf(&out[len], size - len, spec, (size_t)record->args[a].i); break;
+                case 'd': res = snprintf(&out[len], size - len, spec, record->args[a].d); break;
+                case 'p': res = snprintf(&out[len], size - len, spec, record->args[a].p); break;
+                case 's': res = snprintf(&out[len], size - len, spec, &record->strings[record->args[a].i]); break;
+            }
+            a++;
+        }
+        if (res > 0)
+        {
+            len += ((size_t)res < size - len) ? (size_t)res : size - len - 1;
+        }
     }
-    // For CH1/CH0 > 1.30 Lux = 0
-    else
+    out[len] = '\0';
+}
+
+/* log_copy: copies a complete record out of the ring, returns 0 if the record is overwritten or not yet complete */
+static int log_copy(unsigned long number, struct log_record *record)
+{
+    unsigned long slot = number % LOG_RING_SIZE;
+    if (atomic_load_explicit(&log_ring.seq[slot], memory_order_acquire) != 2 * number + 2)
     {
-        lux = 0.02;
+        return 0;
     }
-    // if a calculation went out of limits, than set the lux value to 0
-    if (isnan(lux))
+    memcpy(record, &log_ring.records[slot], sizeof(struct log_record));
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&log_ring.seq[slot], memory_order_relaxed) == 2 * number + 2);
+}
+
+/* log_write: writes one record to the standard output (the dump lines have a time stamp) */
+static void log_write(const struct log_record *record, int with_time)
+{
+    char text[256];
+    log_format(record, text, sizeof(text));
+    if (with_time)
     {
-        lux = 0.02;
+        struct tm record_tm;
+        localtime_r(&record->time.tv_sec, &record_tm);
+        printf("%02d:%02d:%02d.%03ld %s %s: %s\n", record_tm.tm_hour, record_tm.tm_min, record_tm.tm_sec, record->time.tv_nsec / 1000000,
+               LogSubsystemNames[record->subsystem], LogLevelNames[record->level], text);
     }
-    else if (lux < 0.02)
+    else
     {
-        lux = 0.02;
+        printf("%s: %s\n", LogSubsystemNames[record->subsystem], text);
     }
-    return lux;
 }
 
-/* FUNCTION: READ_LUX_VALUES
-sub-function is created to read lux values for dimming from file
-    file name is stored in lux_file variable
-        the file shall contain lux dimming pairs in each row, both as integer values
-    input: pointer to the array to be filled
-the result will contain as many elements as MaxDimming, and 
-- for each defined dimming point the minimum lux level will be the contant
-- will contain 0 if the input file do not specify lux value for the dimming
+/* FUNCTION: LOG_START
+this function initializes the log ring, and starts the writer thread (SIGUSR1 dumps the whole ring)
+Input:
+    level: the level of all subsystems (the verbose input)
+Output:
+    0 if the thread is started, negative on error (the records are kept in the ring only)
 */
-void read_lux_values(int * lux_array, char * filepath)
+int log_start(int level)
 {
-    // reset all values to 0
-    for (int i = 0; i <= MaxDimming; i++)
-    {
-        lux_array[i] = 0;
-    }
-
-    // open file to append ("a")
-    FILE *f = fopen(filepath, "r");
-    if (f == NULL)
+    atomic_init(&log_ring.head, 0);
+    for (int i = 0; i < LOG_RING_SIZE; i++)
     {
-        printf("Lux-dimming file open failed\n");
+        atomic_init(&log_ring.seq[i], 0);
+        atomic_init(&log_ring.pending[i], 0);
     }
-    else
+    atomic_init(&log_ring.lost, 0);
+    for (int i = 0; i < LOG_SUBSYSTEMS; i++)
     {
-        // or other suitable maximum line size
-        char line [ 128 ]; 
-        // read a line
-        while ( fgets ( line, sizeof line, f ) != NULL ) 
-        {
-            char *token;
-            // Token will point to the part before the " ".
-            token = strtok(line, " ");
-            int alux = atoi(token);
-            // Token will point to the part after the " ".
-            token = strtok(NULL, " ");
-            // convert token to number
-            int adimming = atoi(token);
-            lux_array[adimming] = alux;
-        }
-        // close file
-        fclose(f);
+        atomic_init(&log_ring.levels[i], level);
     }
+    atomic_init(&log_ring.stop, 0);
+    log_ring.dump = 0;
+    sem_init(&log_ring.ready, 0, 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = log_dump_request;
+    sigaction(SIGUSR1, &action, NULL);
+
+    // the KILL signals and the dump request shall be handled by the main loop, so they are blocked on the writer thread
+    sigset_t signals;
+    sigset_t old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTRAP);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    int res = pthread_create(&log_ring.thread, NULL, log_writer_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    return (res == 0) ? 0 : -1;
 }
 
+/* FUNCTION: LOG_STOP
+this function writes the pending records, and stops the writer thread
+*/
+void log_stop(void)
+{
+    atomic_store(&log_ring.stop, 1);
+    sem_post(&log_ring.ready);
+    pthread_join(log_ring.thread, NULL);
+}
 
-/* stuff to handle KILL request */
-void term(int signo)
+/* FUNCTION: LOG_WRITER_THREAD
+the thread writes the enabled log records to the standard output, and the whole ring on the dump request
+the records are formatted here, so the logging threads only copy the arguments
+Input:
+    arg: not used
+*/
+void *log_writer_thread(void *arg)
 {
-    done = 1;
+    unsigned long next = 0;
+    struct log_record record;
+    struct timespec deadline;
+    int stop = 0;
+    while (!stop)
+    {
+        // wake up on the posted records, but write them together (one flush in every LogFlushMs)
+        sem_wait(&log_ring.ready);
+        stop = atomic_load(&log_ring.stop);
+        if (!stop && !log_ring.dump)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += (LogFlushMs % 1000) * 1000000L;
+            deadline.tv_sec += LogFlushMs / 1000 + deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            while (!atomic_load(&log_ring.stop) && !log_ring.dump &&
+                   (sem_clockwait(&log_ring.ready, CLOCK_MONOTONIC, &deadline) == 0))
+            {
+            }
+            // the stop request may be posted while the records are collected
+            stop = atomic_load(&log_ring.stop);
+        }
+        unsigned long head = atomic_load_explicit(&log_ring.head, memory_order_acquire);
+        // the overwritten records are skipped (the enabled ones are counted as lost by the overwriting thread)
+        if (head - next > LOG_RING_SIZE)
+        {
+            next = head - LOG_RING_SIZE;
+        }
+        int incomplete = 0;
+        for (; next != head; next++)
+        {
+            unsigned long slot = next % LOG_RING_SIZE;
+            if (!log_copy(next, &record))
+            {
+                // a reserved record which is not yet complete is retried at the next wake-up, the later ones wait for it
+                // to keep the order
+                incomplete = (atomic_load_explicit(&log_ring.seq[slot], memory_order_acquire) < 2 * next + 2);
+                if (incomplete)
+                {
+                    break;
+                }
+                continue;
+            }
+            // the enabled record is written, unless the slot is taken by a new record meanwhile
+            unsigned long pending = next + 1;
+            if (atomic_compare_exchange_strong_explicit(&log_ring.pending[slot], &pending, 0, memory_order_acq_rel, memory_order_relaxed))
+            {
+                log_write(&record, 0);
+            }
+        }
+        if (incomplete)
+        {
+            // a disabled record is not posted when it is complete, so the retry is posted here (after the next LogFlushMs)
+            sem_post(&log_ring.ready);
+        }
+        unsigned long lost = atomic_exchange_explicit(&log_ring.lost, 0, memory_order_relaxed);
+        if (lost > 0)
+        {
+            printf("log: %lu records lost\n", lost);
+        }
+        if (log_ring.dump)
+        {
+            log_ring.dump = 0;
+            printf("log: dump of the last %d records\n", LOG_RING_SIZE);
+            for (unsigned long number = (head > LOG_RING_SIZE) ? head - LOG_RING_SIZE : 0; number != head; number++)
+            {
+                if (log_copy(number, &record))
+                {
+                    log_write(&record, 1);
+                }
+            }
+        }
+        fflush(stdout);
+    }
+    return NULL;
 }
 
 /*